@@ -0,0 +1,60 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+enum SectionType {
+    UndefinedSection    = 0,
+    TextSection         = 1,
+    DataSection         = 2,
+    ExternSection       = 3, // символ определен вне программы
+    BssSection          = 4, // обнуленная память, в файле не хранится
+};
+
+enum RelocationType {
+    PcRelative32        = 2, // R_X86_64_PC32
+    PltRelative32       = 4, // R_X86_64_PLT32
+};
+
+struct TByteBuffer {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+};
+
+struct TObjectSymbol {
+    char* name;
+    SectionType section;
+    size_t offset;
+    bool isGlobal;
+    bool isReferenced;
+};
+
+// Место в .text, куда после размещения секций записывается S + A - P
+struct TRelocation {
+    size_t offset;
+    size_t symbol;
+    RelocationType type;
+    long long addend;
+};
+
+struct TObject {
+    TByteBuffer text;
+    TByteBuffer data;
+    size_t bssSize;
+    TObjectSymbol* symbols;
+    size_t symbolCount;
+    size_t symbolCapacity;
+    TRelocation* relocations;
+    size_t relocationCount;
+    size_t relocationCapacity;
+};
+
+void Assemble(const char* source, TObject* object);
+void ObjectDtor(TObject* object);
+
+void BufferAppend(TByteBuffer* buffer, const void* bytes, size_t size);
+void BufferFree(TByteBuffer* buffer);
+
+#endif // ASSEMBLER_H
@@ -0,0 +1,12 @@
+#ifndef DATA_LAYOUT_H
+#define DATA_LAYOUT_H
+
+#include "node.h"
+#include "emitter.h"
+#include "nasmGen.h"
+
+const size_t kCacheLineSize = 64;
+
+void EmitGlobalData(TEmitter* output, tNode* root, TSymbol* symbols, size_t count);
+
+#endif // DATA_LAYOUT_H
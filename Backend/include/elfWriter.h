@@ -0,0 +1,14 @@
+#ifndef ELF_WRITER_H
+#define ELF_WRITER_H
+
+#include "assembler.h"
+
+const unsigned long long kImageBase = 0x400000;
+const size_t kPageSize = 0x1000;
+
+size_t GetBssOffset(const TObject* object);
+
+void WriteObjectFile(const char* fileName, TObject* object);
+void WriteExecutable(const char* fileName, TObject* object);
+
+#endif // ELF_WRITER_H
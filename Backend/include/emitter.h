@@ -0,0 +1,25 @@
+#ifndef EMITTER_H
+#define EMITTER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+const size_t kInitialEmitterCapacity = 1 << 12; // emitter'ы заводятся и на каждую функцию, буфер растет вдвое
+
+// Текст ассемблера целиком копится в памяти и записывается в файл одним write
+struct TEmitter {
+    char* data;
+    size_t size;
+    size_t capacity;
+    bool withComments; // иначе все от ';' до конца строки формата отбрасывается
+};
+
+void EmitterCtor(TEmitter* emitter, bool withComments);
+void EmitterDtor(TEmitter* emitter);
+
+void Emit(TEmitter* emitter, const char* format, ...);
+void EmitText(TEmitter* emitter, const char* text, size_t length);
+const char* GetEmitterText(TEmitter* emitter);
+void WriteEmitter(TEmitter* emitter, const char* fileName);
+
+#endif // EMITTER_H
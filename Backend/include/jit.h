@@ -0,0 +1,11 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "assembler.h"
+
+static const char* const kJitEntryNames[] = {"rt_main", "main"};
+static const char* const kJitReleaseName = "rt_release";
+
+void RunJit(TObject* object, size_t runs);
+
+#endif // JIT_H
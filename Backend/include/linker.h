@@ -0,0 +1,8 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include "assembler.h"
+
+void LinkObjects(const TObject* objects, size_t count, TObject* result);
+
+#endif // LINKER_H
@@ -2,25 +2,54 @@
 #define NASM_GEN
 
 #include "node.h"
+#include "vector.h"
+#include "options.h"
+#include "typeInference.h"
+#include "astUtils.h"
+#include "emitter.h"
 
 #include <stdio.h>
 
+const char* const kNasmFileName = "nasm.s";
+const char* const kObjectFileName = "nasm.o";
+const char* const kExecutableFileName = "nasm";
+
 const size_t kMaxLengthOfSymbol = 32;
 const size_t kMaxLengthOfNumber = 32;
-const size_t kMaxSymbols = 128;
 const int kMaxScopes = 16;
+const size_t kMaxRegisterArguments = 6;
 
 struct TSymbol {
     char name[kMaxLengthOfSymbol];
     char initialValue[kMaxLengthOfNumber]; 
+    int offset;      // local variables: [rbp + offset]
+    const char* reg; // local variables of leaf functions live in registers
 };
 
 struct TSymbolTable {
-    TSymbol symbols[kMaxSymbols];
-    int count;
+    TSymbol* symbols; // grows in AddSymbol: pointers to symbols are valid until the next AddSymbol
+    size_t count;
+    size_t capacity;
     int currentOffset; // for local variables
+    TSymbolTable* parent; // globals for a function scope
+    TTypeInfo* types;
+    const TFunctionTable* functions; // functions of the whole program by name, built once per unit
+    tNode* function; // NULL for the global scope
+    bool preciseMath; // sin and cos are libm calls instead of inline polynomials
+    Vector staticArrays; // top-level array ( N ) nodes backed by .bss, global scope only
+    size_t labelCount; // local labels (.while0, .endif1, ...) are numbered per function
+    Vector parallelLoops; // parallel while nodes whose worker code follows the enclosing function
+    bool inParallelLoop; // worker code: a nested parallel while runs as a plain loop
+    TEmitter* slowPaths; // --overflow=bignum: big integer calls placed after the function's ret, NULL otherwise
+};
+
+// Единица компиляции: программа или модуль --separate
+struct TUnit {
+    Vector exports; // функции, которые вызывают другие модули: global fn_name
+    bool hasParallelLoops; // runtime для parallel while, с --separate - если он есть в каком-нибудь модуле
 };
 
-void RunGenerator(tNode* root);
+void RunGenerator(tNode* root, const Options* options, TTypeInfo* types);
+void GenerateUnit(tNode* root, const Options* options, TTypeInfo* types, const TUnit* unit, TEmitter* output);
 
 #endif // NASM_GEN
@@ -0,0 +1,35 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include "emitter.h"
+#include "options.h"
+
+const size_t kOutputBufferSize = 65536;
+const size_t kMaxLengthOfDecimal = 21; // 20 цифр size_t и перевод строки
+const size_t kMaxLengthOfFloat = 318; // знак, 309 цифр целой части DBL_MAX, точка, 6 знаков дробной и перевод строки
+const int kFractionDigits = 6;
+
+// Коэффициенты многочленов fdlibm для sin и cos на [-pi/4, pi/4]: rt_sin1..rt_sin6, rt_cos1..rt_cos6
+const int kTrigonometryCoefficients = 6;
+
+// Задание parallel while лежит на стеке родителя: [точка входа потока, rbp родителя, начало, конец, блокировка
+// для сумм, записи потоков, число потоков, размер порции]
+const size_t kParallelTaskSize = 64;
+const size_t kParallelFrameOffset = 8;
+const size_t kParallelBeginOffset = 16;
+const size_t kParallelEndOffset = 24;
+const size_t kParallelLockOffset = 32;
+const size_t kMaxParallelWorkers = 64;
+
+// --overflow=bignum: значения больше kMaxSmallInteger - номера длинных чисел, INT64_MAX - номер qword'а в арене.
+// cmp x, kBignumCheck переполняется ровно на номерах, поэтому проверка операнда - cmp и jo
+const long long kMaxSmallInteger = 0x7FFFFFFF7FFFFFFF; // INT64_MAX - 2^31
+const long long kBignumCheck = -2147483648LL;
+const size_t kBignumArenaSize = 1ULL << 34; // 2^31 qword'ов, числа не освобождаются
+const size_t kKaratsubaThreshold = 32; // limb'ов в меньшем множителе, ниже - умножение столбиком
+
+void EmitRuntime(TEmitter* output, const Options* options, bool hasParallelLoops);
+void EmitRuntimeSymbols(TEmitter* output, const Options* options, bool hasParallelLoops, const char* directive);
+unsigned long long GetDoubleBits(double value);
+
+#endif // RUNTIME_H
@@ -0,0 +1,12 @@
+#ifndef SEPARATE_H
+#define SEPARATE_H
+
+#include "modules.h"
+#include "options.h"
+
+const char* const kModuleAsmExtension = ".s";
+const char* const kModuleObjectExtension = ".o";
+
+void RunSeparateCompilation(TProgram* program, const Options* options);
+
+#endif // SEPARATE_H
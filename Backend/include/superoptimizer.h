@@ -0,0 +1,9 @@
+#ifndef SUPEROPTIMIZER_H
+#define SUPEROPTIMIZER_H
+
+#include "emitter.h"
+#include "options.h"
+
+void Superoptimize(TEmitter* output, size_t start, const Options* options);
+
+#endif // SUPEROPTIMIZER_H
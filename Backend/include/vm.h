@@ -0,0 +1,116 @@
+#ifndef VM_H
+#define VM_H
+
+#include "node.h"
+#include "vector.h"
+#include "options.h"
+#include "typeInference.h"
+
+#include <stdbool.h>
+
+const size_t kVmStackSize = 1 << 20; // регистры всех кадров, глобальные переменные - в начале
+const size_t kVmMaxCallDepth = 1 << 16;
+const size_t kInitialVmCodeSize = 256;
+
+// a = b op c; Imm - второй операнд в immediate; JumpIf - переход на c инструкций вперед или назад
+enum TVmOpcode {
+    VmLoad,                     // a = immediate
+    VmMove,                     // a = b
+    VmLoadGlobal,               // a = globals [ b ]
+    VmStoreGlobal,              // globals [ b ] = a
+    VmAddInt,
+    VmSubInt,
+    VmMulInt,
+    VmDivInt,
+    VmAddIntImm,                // a = b + immediate: загрузка константы и сложение
+    VmAddElementInt,            // a = b + c [ immediate ]: загрузка элемента и сложение
+    VmAddFloat,
+    VmSubFloat,
+    VmMulFloat,
+    VmDivFloat,
+    VmAddElementFloat,
+    VmIntToFloat,               // a = (double)b
+    VmSqrt,
+    VmSin,
+    VmCos,
+    VmLessInt,                  // a = b < c, результат 0 или 1
+    VmLessOrEqualInt,
+    VmIdenticalInt,
+    VmNotIdenticalInt,
+    VmLessFloat,
+    VmLessOrEqualFloat,
+    VmIdenticalFloat,
+    VmNotIdenticalFloat,
+    VmJump,
+    VmJumpIfLessInt,            // сравнение и переход одной инструкцией
+    VmJumpIfLessOrEqualInt,
+    VmJumpIfIdenticalInt,
+    VmJumpIfNotIdenticalInt,
+    VmJumpIfLessIntImm,
+    VmJumpIfLessOrEqualIntImm,
+    VmJumpIfGreaterIntImm,
+    VmJumpIfGreaterOrEqualIntImm,
+    VmJumpIfIdenticalIntImm,
+    VmJumpIfNotIdenticalIntImm,
+    VmJumpIfLessFloat,
+    VmJumpIfLessOrEqualFloat,
+    VmJumpIfIdenticalFloat,
+    VmJumpIfNotIdenticalFloat,
+    VmJumpUnlessLessFloat,      // с nan !(b < c) не равно c <= b
+    VmJumpUnlessLessOrEqualFloat,
+    VmIndex,                    // a = b [ c ]
+    VmStore,                    // b [ c ] = a
+    VmArray,                    // a = новый массив из b элементов
+    VmPrintInt,
+    VmPrintFloat,
+    VmCall,                     // a = результат, b - первый регистр нового кадра, c - смещение до функции
+    VmReturn,
+    VmCount,                    // counters [ a ]++: профиль if для --profile-generate
+    VmHalt,
+};
+
+// Регистры не типизированы: double лежит битами, как в регистрах общего назначения nasm-генератора
+union TVmValue {
+    long long integer;
+    double real;
+    TVmValue* array;
+};
+
+// handler заполняется перед выполнением адресом обработчика: интерпретатор переходит по нему
+// без switch (прямой шитый код)
+struct TVmInstruction {
+    const void* handler;
+    TVmValue immediate;
+    int a;
+    int b;
+    int c;
+    TVmOpcode opcode;
+};
+
+struct TVmFunction {
+    tNode* node;
+    size_t entry;
+    int frameSize;
+};
+
+// Код верхнего уровня начинается с нулевой инструкции и работает в кадре, первые регистры которого -
+// глобальные переменные; функции обращаются к ним через VmLoadGlobal и VmStoreGlobal
+struct TVmProgram {
+    TVmInstruction* code;
+    size_t size;
+    size_t capacity;
+    TVmValue* globals; // начальные значения
+    size_t globalCount;
+    int frameSize; // кадр верхнего уровня вместе с глобальными переменными
+    TVmFunction* functions;
+    size_t functionCount;
+    long long* counters; // NULL без --profile-generate
+    size_t ifCount; // счетчиков вдвое больше: выполнения if и входы в его тело
+};
+
+void RunVm(tNode* root, const Options* options, TTypeInfo* types);
+void CompileVmProgram(tNode* root, TTypeInfo* types, TVmProgram* program, bool isProfiling);
+void ExecuteVmProgram(TVmProgram* program, size_t runs);
+void VmProgramDtor(TVmProgram* program);
+
+#endif // VM_H
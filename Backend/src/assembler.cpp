@@ -0,0 +1,1432 @@
+#include "assembler.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdint.h>
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kMaxLengthOfLine = 256;
+const size_t kMaxLengthOfLabel = 128;
+const size_t kMaxOperands = 3;
+const size_t kInitialCapacity = 64;
+const int kNoRegister = -1;
+
+const size_t kShortBranchSize = 2;
+const size_t kJumpSize = 5;
+const size_t kConditionalJumpSize = 6;
+const size_t kCallSize = 5;
+
+enum OperandKind {
+    NoOperand           = 0,
+    RegisterOperand     = 1,
+    ImmediateOperand    = 2,
+    MemoryOperand       = 3,
+    SymbolOperand       = 4, // метка: цель перехода или адрес
+};
+
+struct TAsmOperand {
+    OperandKind kind;
+    int reg;
+    int size; // в байтах, 0 - не указан
+    long long value; // непосредственное значение или смещение адреса
+    int base;
+    int index;
+    int scale;
+    char symbol[kMaxLengthOfLabel]; // адрес в памяти относительно rip
+};
+
+enum BranchType {
+    JumpBranch          = 1,
+    ConditionalBranch   = 2,
+    CallBranch          = 3,
+};
+
+// Переход к метке: его длина (rel8 или rel32) выбирается после разбора всей программы
+struct TBranch {
+    size_t offset; // позиция в потоке байт без переходов
+    BranchType type;
+    int condition;
+    size_t symbol;
+    bool isLong;
+};
+
+struct TPendingRelocation {
+    size_t offset;
+    size_t branchCount; // сколько переходов стоит перед этим местом
+    size_t symbol;
+    long long addend;
+};
+
+// dd .a - .b в .text (таблица переходов): разность адресов меток известна только после выбора длин переходов
+struct TLabelDifference {
+    size_t offset;
+    size_t branchCount;
+    size_t symbol;
+    size_t base;
+};
+
+struct TAssembler {
+    TObject* object;
+    SectionType section;
+    char scope[kMaxLengthOfLabel]; // последняя метка без точки: область видимости локальных меток .name
+    size_t line;
+
+    TByteBuffer code; // .text без переходов к меткам
+    TBranch* branches;
+    size_t branchCount;
+    size_t branchCapacity;
+    TPendingRelocation* relocations;
+    size_t relocationCount;
+    size_t relocationCapacity;
+    TLabelDifference* differences;
+    size_t differenceCount;
+    size_t differenceCapacity;
+
+    size_t* labelBranches; // для меток .text: сколько переходов стоит перед меткой
+    size_t* table; // открытая адресация: индекс символа + 1, 0 - пусто
+    size_t tableCapacity;
+};
+
+struct TRegister {
+    const char* name;
+    int number;
+    int size;
+};
+
+struct TCondition {
+    const char* name;
+    int code;
+};
+
+// Инструкции SSE2: обязательный префикс, затем REX и 0F xx
+struct TSseInstruction {
+    const char* name;
+    unsigned char prefix;
+    unsigned opcode;
+    unsigned storeOpcode; // форма r/m <- xmm, 0 - нет
+    bool isWide; // REX.W: операнд общего назначения 64-битный
+};
+
+// Инструкции AVX и AVX2 с префиксом VEX: pp - обязательный префикс (1 - 66), map - 1 (0F), 2 (0F38) или 3 (0F3A)
+struct TVexInstruction {
+    const char* name;
+    unsigned char pp;
+    unsigned char map;
+    unsigned char opcode;
+    unsigned char storeOpcode; // форма r/m <- ymm, 0 - нет
+    bool hasSource; // op dst, src1, src2/m: src1 кодируется в VEX.vvvv
+};
+
+static const TRegister kRegisters[] = {
+    {"rax",  0, 8}, {"rcx",  1, 8}, {"rdx",  2, 8}, {"rbx",  3, 8},
+    {"rsp",  4, 8}, {"rbp",  5, 8}, {"rsi",  6, 8}, {"rdi",  7, 8},
+    {"r8",   8, 8}, {"r9",   9, 8}, {"r10", 10, 8}, {"r11", 11, 8},
+    {"r12", 12, 8}, {"r13", 13, 8}, {"r14", 14, 8}, {"r15", 15, 8},
+    {"eax",  0, 4}, {"ecx",  1, 4}, {"edx",  2, 4}, {"ebx",  3, 4},
+    {"esp",  4, 4}, {"ebp",  5, 4}, {"esi",  6, 4}, {"edi",  7, 4},
+    {"r8d",  8, 4}, {"r9d",  9, 4}, {"r10d",10, 4}, {"r11d",11, 4},
+    {"r12d",12, 4}, {"r13d",13, 4}, {"r14d",14, 4}, {"r15d",15, 4},
+    {"al",   0, 1}, {"cl",   1, 1}, {"dl",   2, 1}, {"bl",   3, 1},
+    {"spl",  4, 1}, {"bpl",  5, 1}, {"sil",  6, 1}, {"dil",  7, 1},
+    {"r8b",  8, 1}, {"r9b",  9, 1}, {"r10b",10, 1}, {"r11b",11, 1},
+    {"r12b",12, 1}, {"r13b",13, 1}, {"r14b",14, 1}, {"r15b",15, 1},
+    {"xmm0", 0,16}, {"xmm1", 1,16}, {"xmm2", 2,16}, {"xmm3", 3,16},
+    {"xmm4", 4,16}, {"xmm5", 5,16}, {"xmm6", 6,16}, {"xmm7", 7,16},
+    {"xmm8", 8,16}, {"xmm9", 9,16}, {"xmm10",10,16}, {"xmm11",11,16},
+    {"xmm12",12,16}, {"xmm13",13,16}, {"xmm14",14,16}, {"xmm15",15,16},
+    {"ymm0", 0,32}, {"ymm1", 1,32}, {"ymm2", 2,32}, {"ymm3", 3,32},
+    {"ymm4", 4,32}, {"ymm5", 5,32}, {"ymm6", 6,32}, {"ymm7", 7,32},
+    {"ymm8", 8,32}, {"ymm9", 9,32}, {"ymm10",10,32}, {"ymm11",11,32},
+    {"ymm12",12,32}, {"ymm13",13,32}, {"ymm14",14,32}, {"ymm15",15,32},
+};
+
+static const TCondition kConditions[] = {
+    {"o",   0}, {"no",  1}, {"b",   2}, {"c",   2}, {"nae", 2}, {"ae",  3}, {"nb",  3}, {"nc",  3},
+    {"e",   4}, {"z",   4}, {"ne",  5}, {"nz",  5}, {"be",  6}, {"na",  6}, {"a",   7}, {"nbe", 7},
+    {"s",   8}, {"ns",  9}, {"p",  10}, {"pe", 10}, {"np", 11}, {"po", 11}, {"l",  12}, {"nge",12},
+    {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14}, {"g",  15}, {"nle",15},
+};
+
+// /n в поле reg байта ModRM для групп инструкций
+static const TCondition kArithmetic[] = {
+    {"add", 0}, {"or",  1}, {"adc", 2}, {"sbb", 3}, {"and", 4}, {"sub", 5}, {"xor", 6}, {"cmp", 7},
+};
+static const TSseInstruction kSseInstructions[] = {
+    {"movsd",     0xF2, 0x0F10, 0x0F11, false},
+    {"movapd",    0x66, 0x0F28, 0,      false},
+    {"sqrtsd",    0xF2, 0x0F51, 0,      false},
+    {"xorpd",     0x66, 0x0F57, 0,      false},
+    {"addsd",     0xF2, 0x0F58, 0,      false},
+    {"mulsd",     0xF2, 0x0F59, 0,      false},
+    {"subsd",     0xF2, 0x0F5C, 0,      false},
+    {"divsd",     0xF2, 0x0F5E, 0,      false},
+    {"ucomisd",   0x66, 0x0F2E, 0,      false},
+    {"cvtsi2sd",  0xF2, 0x0F2A, 0,      true},
+    {"cvttsd2si", 0xF2, 0x0F2C, 0,      true},
+    {"cvtsd2si",  0xF2, 0x0F2D, 0,      true},
+    {"movq",      0x66, 0x0F6E, 0x0F7E, true},
+    {"movupd",    0x66, 0x0F10, 0x0F11, false},
+    {"unpcklpd",  0x66, 0x0F14, 0,      false},
+    {"unpckhpd",  0x66, 0x0F15, 0,      false},
+    {"sqrtpd",    0x66, 0x0F51, 0,      false},
+    {"addpd",     0x66, 0x0F58, 0,      false},
+    {"mulpd",     0x66, 0x0F59, 0,      false},
+    {"subpd",     0x66, 0x0F5C, 0,      false},
+    {"divpd",     0x66, 0x0F5E, 0,      false},
+    {"punpcklqdq",0x66, 0x0F6C, 0,      false},
+    {"punpckhqdq",0x66, 0x0F6D, 0,      false},
+    {"paddq",     0x66, 0x0FD4, 0,      false},
+    {"psubq",     0x66, 0x0FFB, 0,      false},
+};
+static const TVexInstruction kVexInstructions[] = {
+    {"vmovupd",      1, 1, 0x10, 0x11, false},
+    {"vsqrtpd",      1, 1, 0x51, 0,    false},
+    {"vxorpd",       1, 1, 0x57, 0,    true},
+    {"vaddpd",       1, 1, 0x58, 0,    true},
+    {"vmulpd",       1, 1, 0x59, 0,    true},
+    {"vsubpd",       1, 1, 0x5C, 0,    true},
+    {"vdivpd",       1, 1, 0x5E, 0,    true},
+    {"vpaddq",       1, 1, 0xD4, 0,    true},
+    {"vpsubq",       1, 1, 0xFB, 0,    true},
+    {"vbroadcastsd", 1, 2, 0x19, 0,    false},
+    {"vpbroadcastq", 1, 2, 0x59, 0,    false},
+};
+
+static const TCondition kUnary[] = {
+    {"not", 2}, {"neg", 3}, {"mul", 4}, {"div", 6}, {"idiv", 7},
+};
+static const TCondition kShifts[] = {
+    {"rol", 0}, {"ror", 1}, {"shl", 4}, {"sal", 4}, {"shr", 5}, {"sar", 7},
+};
+
+[[noreturn]] static void AssemblerError(TAssembler* as, const char* message, const char* detail);
+
+static void AssembleLine(TAssembler* as, char* line);
+static void AssembleDirective(TAssembler* as, const char* directive, char* arguments);
+static void AssembleData(TAssembler* as, const char* type, char* arguments);
+static void AssembleReserve(TAssembler* as, const char* type, char* argument);
+static void AssembleLabelDifference(TAssembler* as, char* arguments);
+static void AssembleInstruction(TAssembler* as, const char* mnemonic, TAsmOperand* operands, size_t count);
+static bool AssembleGroup(TAssembler* as, const char* mnemonic, TAsmOperand* operands, size_t count);
+static bool AssembleSse(TAssembler* as, const char* mnemonic, TAsmOperand* operands, size_t count);
+static bool AssembleVex(TAssembler* as, const char* mnemonic, TAsmOperand* operands, size_t count);
+static void Finish(TAssembler* as);
+
+static char* Trim(char* text);
+static size_t SplitOperands(char* text, char** parts, size_t maxParts);
+static void ParseOperand(TAssembler* as, char* text, TAsmOperand* operand);
+static void ParseAddress(TAssembler* as, char* text, TAsmOperand* operand);
+static const TRegister* FindRegister(const char* name);
+static int FindCode(const TCondition* table, size_t size, const char* name);
+static bool ParseNumber(const char* text, long long* value);
+static void GetScopedName(TAssembler* as, const char* name, char* scoped);
+
+static size_t FindSymbol(TAssembler* as, const char* name);
+static void DefineLabel(TAssembler* as, const char* name);
+static size_t HashName(const char* name);
+static void GrowTable(TAssembler* as);
+
+static void EmitByte(TAssembler* as, unsigned char byte);
+static void EmitValue(TAssembler* as, long long value, size_t size);
+static void EmitModRM(TAssembler* as, unsigned opcode, int size, int regField, TAsmOperand* rm,
+                      size_t immediateSize);
+static void EmitVex(TAssembler* as, const TVexInstruction* instruction, int length, int source, int regField,
+                    TAsmOperand* rm, size_t immediateSize);
+static void EmitAddressing(TAssembler* as, int regField, TAsmOperand* rm, size_t immediateSize);
+static void EmitBranch(TAssembler* as, BranchType type, int condition, TAsmOperand* target);
+static bool FitsInt8(long long value);
+static bool FitsInt32(long long value);
+static int GetOperationSize(TAsmOperand* first, TAsmOperand* second);
+
+static void* GrowArray(void* array, size_t* capacity, size_t count, size_t elementSize);
+
+// global ------------------------------------------------------------------------------------------
+
+// Ассемблер для подмножества NASM, которое выдает генератор: секции .data, .bss и .text, метки
+// с локальными .name внутри ближайшей глобальной, db/dq, dd .a - .b в .text, resb/resq, align в
+// .data и .bss, целочисленные инструкции x86-64, SSE2 и AVX2
+void Assemble(const char* source, TObject* object) {
+    assert(source);
+    assert(object);
+
+    TAssembler as = {};
+    as.object = object;
+    as.section = TextSection;
+    as.tableCapacity = kInitialCapacity;
+    as.table = (size_t*)calloc(as.tableCapacity, sizeof(size_t));
+    assert(as.table);
+
+    char line[kMaxLengthOfLine] = "";
+    for (const char* start = source; *start; ) {
+        const char* end = strchr(start, '\n');
+        size_t length = (end) ? (size_t)(end - start) : strlen(start);
+        as.line++;
+        if (length >= kMaxLengthOfLine) {
+            AssemblerError(&as, "line is too long", "");
+        }
+
+        memcpy(line, start, length);
+        line[length] = '\0';
+        AssembleLine(&as, line);
+
+        start += length + ((end) ? 1 : 0);
+    }
+
+    Finish(&as);
+
+    BufferFree(&as.code);
+    free(as.branches);
+    free(as.relocations);
+    free(as.differences);
+    free(as.labelBranches);
+    free(as.table);
+}
+
+void ObjectDtor(TObject* object) {
+    for (size_t i = 0; i < object->symbolCount; i++) {
+        free(object->symbols[i].name);
+    }
+    free(object->symbols);
+    free(object->relocations);
+    BufferFree(&object->text);
+    BufferFree(&object->data);
+}
+
+void BufferAppend(TByteBuffer* buffer, const void* bytes, size_t size) {
+    if (!size) {
+        return;
+    }
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = (buffer->capacity) ? buffer->capacity : kInitialCapacity;
+        while (capacity < buffer->size + size) {
+            capacity *= 2;
+        }
+
+        buffer->data = (unsigned char*)realloc(buffer->data, capacity);
+        assert(buffer->data);
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, bytes, size);
+    buffer->size += size;
+}
+
+void BufferFree(TByteBuffer* buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void AssemblerError(TAssembler* as, const char* message, const char* detail) {
+    fprintf(stderr, "Error: assembler, line %zu: %s %s\n", as->line, message, detail);
+    exit(EXIT_FAILURE);
+}
+
+static void AssembleLine(TAssembler* as, char* line) {
+    bool isQuoted = false;
+    for (char* c = line; *c; c++) { // комментарий до конца строки, если ';' не внутри строки
+        if (*c == '"' || *c == '\'') {
+            isQuoted = !isQuoted;
+        } else if (*c == ';' && !isQuoted) {
+            *c = '\0';
+            break;
+        }
+    }
+
+    char* text = Trim(line);
+    if (!*text) {
+        return;
+    }
+
+    size_t length = strlen(text);
+    if (text[length - 1] == ':') {
+        text[length - 1] = '\0';
+        DefineLabel(as, Trim(text));
+        return;
+    }
+
+    char* arguments = text;
+    while (*arguments && !isspace((unsigned char)*arguments)) {
+        arguments++;
+    }
+    if (*arguments) {
+        *arguments++ = '\0';
+    }
+    arguments = Trim(arguments);
+
+    if (!strcmp(text, "global") || !strcmp(text, "extern") || !strcmp(text, "section") || !strcmp(text, "align")) {
+        AssembleDirective(as, text, arguments);
+        return;
+    }
+    if (!strcmp(text, "dd") && as->section == TextSection) {
+        AssembleLabelDifference(as, arguments);
+        return;
+    }
+
+    // name db ... / name dq ...
+    char* type = arguments;
+    char* values = type;
+    while (*values && !isspace((unsigned char)*values)) {
+        values++;
+    }
+    if (*values) {
+        *values++ = '\0';
+    }
+    if (!strcmp(type, "db") || !strcmp(type, "dw") || !strcmp(type, "dd") || !strcmp(type, "dq")) {
+        DefineLabel(as, text);
+        AssembleData(as, type, Trim(values));
+        return;
+    }
+    if (!strcmp(type, "resb") || !strcmp(type, "resw") || !strcmp(type, "resd") || !strcmp(type, "resq")) {
+        DefineLabel(as, text);
+        AssembleReserve(as, type, Trim(values));
+        return;
+    }
+    if (*values) {
+        values[-1] = ' '; // не данные: вернуть строку операндов на место
+    }
+
+    char* parts[kMaxOperands] = {};
+    size_t count = SplitOperands(arguments, parts, kMaxOperands);
+    TAsmOperand operands[kMaxOperands] = {};
+    for (size_t i = 0; i < count; i++) {
+        ParseOperand(as, parts[i], &operands[i]);
+    }
+
+    AssembleInstruction(as, text, operands, count);
+}
+
+static void AssembleDirective(TAssembler* as, const char* directive, char* arguments) {
+    if (!strcmp(directive, "section")) {
+        if (!strcmp(arguments, ".text")) {
+            as->section = TextSection;
+        } else if (!strcmp(arguments, ".data")) {
+            as->section = DataSection;
+        } else if (!strcmp(arguments, ".bss")) {
+            as->section = BssSection;
+        } else {
+            AssemblerError(as, "unsupported section", arguments);
+        }
+        return;
+    }
+    if (!strcmp(directive, "align")) { // в .text выравнивание сдвигало бы уже посчитанные переходы
+        long long alignment = 0;
+        if (!ParseNumber(arguments, &alignment) || alignment <= 0 || (alignment & (alignment - 1))
+            || as->section == TextSection) {
+            AssemblerError(as, "unsupported align", arguments);
+        }
+        if (as->section == BssSection) {
+            as->object->bssSize = (as->object->bssSize + (size_t)alignment - 1) & ~((size_t)alignment - 1);
+        }
+        while (as->section == DataSection && as->object->data.size % (size_t)alignment) {
+            unsigned char zero = 0;
+            BufferAppend(&as->object->data, &zero, 1);
+        }
+        return;
+    }
+
+    char* names[kMaxLengthOfLine] = {};
+    size_t count = SplitOperands(arguments, names, kMaxLengthOfLine);
+    for (size_t i = 0; i < count; i++) {
+        size_t index = FindSymbol(as, names[i]); // может перевыделить массив символов
+        TObjectSymbol* symbol = &as->object->symbols[index];
+        if (!strcmp(directive, "global")) {
+            symbol->isGlobal = true;
+        } else if (symbol->section == UndefinedSection) {
+            symbol->section = ExternSection;
+        }
+    }
+}
+
+static void AssembleData(TAssembler* as, const char* type, char* arguments) {
+    if (as->section != DataSection) {
+        AssemblerError(as, "data outside of .data:", type);
+    }
+
+    size_t size = (type[1] == 'b') ? 1 : (type[1] == 'w') ? 2 : (type[1] == 'd') ? 4 : 8;
+    char* values[kMaxLengthOfLine] = {};
+    size_t count = SplitOperands(arguments, values, kMaxLengthOfLine);
+
+    for (size_t i = 0; i < count; i++) {
+        char* value = values[i];
+        size_t length = strlen(value);
+
+        if (length >= 2 && (value[0] == '"' || value[0] == '\'') && value[length - 1] == value[0]) {
+            BufferAppend(&as->object->data, value + 1, length - 2);
+            continue;
+        }
+
+        long long number = 0;
+        if (!ParseNumber(value, &number)) {
+            AssemblerError(as, "unsupported data value", value);
+        }
+        BufferAppend(&as->object->data, &number, size); // little endian: младшие size байт
+    }
+}
+
+static void AssembleReserve(TAssembler* as, const char* type, char* argument) {
+    if (as->section != BssSection) {
+        AssemblerError(as, "reserve outside of .bss:", type);
+    }
+
+    size_t size = (type[3] == 'b') ? 1 : (type[3] == 'w') ? 2 : (type[3] == 'd') ? 4 : 8;
+    long long count = 0;
+    if (!ParseNumber(argument, &count) || count < 0) {
+        AssemblerError(as, "unsupported reserve count", argument);
+    }
+    as->object->bssSize += size * (size_t)count;
+}
+
+static void AssembleLabelDifference(TAssembler* as, char* arguments) {
+    char* minus = strchr(arguments, '-');
+    if (!minus) {
+        AssemblerError(as, "expected label - label:", arguments);
+    }
+    *minus = '\0';
+
+    char first[kMaxLengthOfLabel] = "";
+    char second[kMaxLengthOfLabel] = "";
+    GetScopedName(as, Trim(arguments), first);
+    GetScopedName(as, Trim(minus + 1), second);
+    size_t symbol = FindSymbol(as, first);
+    size_t base = FindSymbol(as, second);
+
+    as->differences = (TLabelDifference*)GrowArray(as->differences, &as->differenceCapacity, as->differenceCount,
+                                                   sizeof(TLabelDifference));
+    as->differences[as->differenceCount++] = {
+        .offset = as->code.size,
+        .branchCount = as->branchCount,
+        .symbol = symbol,
+        .base = base,
+    };
+    EmitValue(as, 0, 4);
+}
+
+static void AssembleInstruction(TAssembler* as, const char* mnemonic, TAsmOperand* operands, size_t count) {
+    TAsmOperand* first = &operands[0];
+    TAsmOperand* second = &operands[1];
+
+    if (as->section != TextSection) {
+        AssemblerError(as, "instruction outside of .text:", mnemonic);
+    }
+
+    if (count == 0) {
+        if      (!strcmp(mnemonic, "ret"))     EmitByte(as, 0xC3);
+        else if (!strcmp(mnemonic, "leave"))   EmitByte(as, 0xC9);
+        else if (!strcmp(mnemonic, "nop"))     EmitByte(as, 0x90);
+        else if (!strcmp(mnemonic, "cqo"))     { EmitByte(as, 0x48); EmitByte(as, 0x99); }
+        else if (!strcmp(mnemonic, "cdq"))     EmitByte(as, 0x99);
+        else if (!strcmp(mnemonic, "syscall")) { EmitByte(as, 0x0F); EmitByte(as, 0x05); }
+        else if (!strcmp(mnemonic, "ud2"))     { EmitByte(as, 0x0F); EmitByte(as, 0x0B); }
+        else if (!strcmp(mnemonic, "cpuid"))   { EmitByte(as, 0x0F); EmitByte(as, 0xA2); }
+        else if (!strcmp(mnemonic, "xgetbv"))  { EmitByte(as, 0x0F); EmitByte(as, 0x01); EmitByte(as, 0xD0); }
+        else if (!strcmp(mnemonic, "vzeroupper")) { EmitByte(as, 0xC5); EmitByte(as, 0xF8); EmitByte(as, 0x77); }
+        else if (!strcmp(mnemonic, "pause"))   { EmitByte(as, 0xF3); EmitByte(as, 0x90); }
+        else AssemblerError(as, "unsupported instruction", mnemonic);
+        return;
+    }
+
+    if (!strcmp(mnemonic, "jmp") || !strcmp(mnemonic, "call")) {
+        bool isCall = (mnemonic[0] == 'c');
+        if (count != 1) {
+            AssemblerError(as, "wrong number of operands:", mnemonic);
+        }
+        if (first->kind == SymbolOperand) {
+            EmitBranch(as, (isCall) ? CallBranch : JumpBranch, 0, first);
+        } else {
+            const unsigned opcode = 0xFF;
+            first->size = (first->kind == RegisterOperand) ? 4 : first->size; // 64 бита по умолчанию, REX.W не нужен
+            EmitModRM(as, opcode, 4, (isCall) ? 2 : 4, first, 0);
+        }
+        return;
+    }
+
+    if (mnemonic[0] == 'j' && count == 1 && first->kind == SymbolOperand) {
+        int condition = FindCode(kConditions, sizeof(kConditions) / sizeof(kConditions[0]), mnemonic + 1);
+        if (condition < 0) {
+            AssemblerError(as, "unsupported instruction", mnemonic);
+        }
+        EmitBranch(as, ConditionalBranch, condition, first);
+        return;
+    }
+
+    if (!strncmp(mnemonic, "set", 3) && count == 1) {
+        int condition = FindCode(kConditions, sizeof(kConditions) / sizeof(kConditions[0]), mnemonic + 3);
+        if (condition < 0 || first->kind == ImmediateOperand) {
+            AssemblerError(as, "unsupported instruction", mnemonic);
+        }
+        const unsigned opcode = 0x0F90 + (unsigned)condition;
+        first->size = 1;
+        EmitModRM(as, opcode, 1, 0, first, 0);
+        return;
+    }
+
+    if (!strncmp(mnemonic, "cmov", 4) && count == 2 && first->kind == RegisterOperand) {
+        int condition = FindCode(kConditions, sizeof(kConditions) / sizeof(kConditions[0]), mnemonic + 4);
+        if (condition < 0 || second->kind == ImmediateOperand || second->kind == SymbolOperand) {
+            AssemblerError(as, "unsupported instruction", mnemonic);
+        }
+        const unsigned opcode = 0x0F40 + (unsigned)condition;
+        EmitModRM(as, opcode, first->size, first->reg, second, 0);
+        return;
+    }
+
+    if (!AssembleSse(as, mnemonic, operands, count) && !AssembleVex(as, mnemonic, operands, count)
+        && !AssembleGroup(as, mnemonic, operands, count)) {
+        AssemblerError(as, "unsupported instruction or operands:", mnemonic);
+    }
+}
+
+static bool AssembleSse(TAssembler* as, const char* mnemonic, TAsmOperand* operands, size_t count) {
+    const TSseInstruction* instruction = NULL;
+    for (size_t i = 0; i < sizeof(kSseInstructions) / sizeof(kSseInstructions[0]); i++) {
+        if (!strcmp(kSseInstructions[i].name, mnemonic)) {
+            instruction = &kSseInstructions[i];
+            break;
+        }
+    }
+    if (!instruction) {
+        return false;
+    }
+
+    TAsmOperand* first = &operands[0];
+    TAsmOperand* second = &operands[1];
+    if (count != 2 || first->kind == ImmediateOperand || first->kind == SymbolOperand
+        || second->kind == ImmediateOperand || second->kind == SymbolOperand) {
+        AssemblerError(as, "unsupported operands:", mnemonic);
+    }
+
+    // xmm в поле reg; для формы сохранения операнды меняются местами
+    bool isStore = !(first->kind == RegisterOperand && first->size == 16);
+    if (isStore && (!instruction->storeOpcode || second->kind != RegisterOperand || second->size != 16)) {
+        if (!(first->kind == RegisterOperand && instruction->isWide && !instruction->storeOpcode)) {
+            AssemblerError(as, "unsupported operands:", mnemonic);
+        }
+        isStore = false; // cvtsd2si r64, xmm/m64: регистр общего назначения в поле reg
+    }
+
+    EmitByte(as, instruction->prefix);
+    if (isStore) {
+        EmitModRM(as, instruction->storeOpcode, (instruction->isWide) ? 8 : 4, second->reg, first, 0);
+    } else {
+        EmitModRM(as, instruction->opcode, (instruction->isWide) ? 8 : 4, first->reg, second, 0);
+    }
+    return true;
+}
+
+static bool AssembleVex(TAssembler* as, const char* mnemonic, TAsmOperand* operands, size_t count) {
+    TAsmOperand* first = &operands[0];
+    TAsmOperand* second = &operands[1];
+
+    // vextractf128 xmm/m128, ymm, imm8: ymm в поле reg, длина всегда 256 бит
+    if (!strcmp(mnemonic, "vextractf128")) {
+        const TVexInstruction kExtract = {"vextractf128", 1, 3, 0x19, 0, false};
+        if (count != 3 || first->kind == ImmediateOperand || first->kind == SymbolOperand
+            || second->kind != RegisterOperand || second->size != 32 || operands[2].kind != ImmediateOperand) {
+            AssemblerError(as, "unsupported operands:", mnemonic);
+        }
+        EmitVex(as, &kExtract, 1, 0, second->reg, first, 1);
+        EmitValue(as, operands[2].value, 1);
+        return true;
+    }
+
+    const TVexInstruction* instruction = NULL;
+    for (size_t i = 0; i < sizeof(kVexInstructions) / sizeof(kVexInstructions[0]); i++) {
+        if (!strcmp(kVexInstructions[i].name, mnemonic)) {
+            instruction = &kVexInstructions[i];
+            break;
+        }
+    }
+    if (!instruction) {
+        return false;
+    }
+
+    TAsmOperand* rm = (instruction->hasSource) ? &operands[2] : second;
+    if (count != ((instruction->hasSource) ? 3u : 2u) || rm->kind == ImmediateOperand || rm->kind == SymbolOperand
+        || first->kind == ImmediateOperand || first->kind == SymbolOperand
+        || (instruction->hasSource && (second->kind != RegisterOperand || second->size < 16))) {
+        AssemblerError(as, "unsupported operands:", mnemonic);
+    }
+
+    int source = (instruction->hasSource) ? second->reg : 0;
+    if (first->kind == RegisterOperand && first->size >= 16) {
+        EmitVex(as, instruction, (first->size == 32) ? 1 : 0, source, first->reg, rm, 0);
+    } else if (instruction->storeOpcode && rm->kind == RegisterOperand && rm->size >= 16) {
+        const TVexInstruction store = {instruction->name, instruction->pp, instruction->map,
+                                       instruction->storeOpcode, 0, false};
+        EmitVex(as, &store, (rm->size == 32) ? 1 : 0, 0, rm->reg, first, 0);
+    } else {
+        AssemblerError(as, "unsupported operands:", mnemonic);
+    }
+    return true;
+}
+
+static bool AssembleGroup(TAssembler* as, const char* mnemonic, TAsmOperand* operands, size_t count) {
+    TAsmOperand* first = &operands[0];
+    TAsmOperand* second = &operands[1];
+    int size = GetOperationSize(first, (count > 1) ? second : NULL);
+
+    int code = FindCode(kArithmetic, sizeof(kArithmetic) / sizeof(kArithmetic[0]), mnemonic);
+    if (code >= 0 && count == 2) {
+        if (second->kind == ImmediateOperand && first->kind == RegisterOperand && first->reg == 0 && size != 1
+            && !FitsInt8(second->value) && FitsInt32(second->value)) { // короткая форма для rax: op rax, imm32
+            if (size == 8) {
+                EmitByte(as, 0x48);
+            }
+            EmitByte(as, (unsigned char)(8 * code + 0x05));
+            EmitValue(as, second->value, 4);
+        } else if (second->kind == ImmediateOperand) {
+            unsigned opcode = (size == 1) ? 0x80 : (FitsInt8(second->value)) ? 0x83 : 0x81;
+            size_t immediateSize = (opcode == 0x81) ? 4 : 1;
+            if (!FitsInt32(second->value)) {
+                return false;
+            }
+            EmitModRM(as, opcode, size, code, first, immediateSize);
+            EmitValue(as, second->value, immediateSize);
+        } else if (second->kind == RegisterOperand) {
+            unsigned opcode = (unsigned)(8 * code + ((size == 1) ? 0x00 : 0x01));
+            EmitModRM(as, opcode, size, second->reg, first, 0);
+        } else if (first->kind == RegisterOperand && second->kind == MemoryOperand) {
+            unsigned opcode = (unsigned)(8 * code + ((size == 1) ? 0x02 : 0x03));
+            EmitModRM(as, opcode, size, first->reg, second, 0);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    if (!strcmp(mnemonic, "test") && count == 2) {
+        if (second->kind == ImmediateOperand && FitsInt32(second->value)) {
+            unsigned opcode = (size == 1) ? 0xF6 : 0xF7;
+            size_t immediateSize = (size == 1) ? 1 : 4;
+            EmitModRM(as, opcode, size, 0, first, immediateSize);
+            EmitValue(as, second->value, immediateSize);
+            return true;
+        }
+        if (second->kind != RegisterOperand) {
+            return false;
+        }
+        unsigned opcode = (size == 1) ? 0x84 : 0x85;
+        EmitModRM(as, opcode, size, second->reg, first, 0);
+        return true;
+    }
+
+    if (!strcmp(mnemonic, "mov") && count == 2) {
+        if (first->kind == RegisterOperand && second->kind == SymbolOperand) { // адрес метки: lea reg, [rel name]
+            const unsigned opcode = 0x8D;
+            second->kind = MemoryOperand;
+            second->base = kNoRegister;
+            second->index = kNoRegister;
+            second->value = 0;
+            EmitModRM(as, opcode, 8, first->reg, second, 0);
+        } else if (first->kind == RegisterOperand && second->kind == ImmediateOperand) {
+            unsigned long long value = (unsigned long long)second->value;
+            if (size == 8 && !FitsInt32(second->value) && value > UINT32_MAX) { // mov r64, imm64
+                EmitByte(as, (unsigned char)(0x48 | (first->reg >> 3)));
+                EmitByte(as, (unsigned char)(0xB8 + (first->reg & 7)));
+                EmitValue(as, second->value, 8);
+            } else if (size == 4 || (size == 8 && value <= UINT32_MAX)) { // mov r32, imm32 обнуляет старшую половину
+                if (first->reg >= 8) {
+                    EmitByte(as, 0x41);
+                }
+                EmitByte(as, (unsigned char)(0xB8 + (first->reg & 7)));
+                EmitValue(as, second->value, 4);
+            } else {
+                const unsigned opcode = (size == 1) ? 0xC6 : 0xC7;
+                EmitModRM(as, opcode, size, 0, first, (size == 1) ? 1 : 4);
+                EmitValue(as, second->value, (size == 1) ? 1 : 4);
+            }
+        } else if (second->kind == ImmediateOperand) {
+            if (!FitsInt32(second->value)) {
+                return false;
+            }
+            const unsigned opcode = (size == 1) ? 0xC6 : 0xC7;
+            EmitModRM(as, opcode, size, 0, first, (size == 1) ? 1 : 4);
+            EmitValue(as, second->value, (size == 1) ? 1 : 4);
+        } else if (second->kind == RegisterOperand) {
+            const unsigned opcode = (size == 1) ? 0x88 : 0x89;
+            EmitModRM(as, opcode, size, second->reg, first, 0);
+        } else if (first->kind == RegisterOperand && second->kind == MemoryOperand) {
+            const unsigned opcode = (size == 1) ? 0x8A : 0x8B;
+            EmitModRM(as, opcode, size, first->reg, second, 0);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    if (!strcmp(mnemonic, "xchg") && count == 2) { // с памятью выполняется атомарно и без префикса lock
+        if (second->kind == RegisterOperand && first->kind != ImmediateOperand && first->kind != SymbolOperand) {
+            EmitModRM(as, (size == 1) ? 0x86 : 0x87, size, second->reg, first, 0);
+        } else if (first->kind == RegisterOperand && second->kind == MemoryOperand) {
+            EmitModRM(as, (size == 1) ? 0x86 : 0x87, size, first->reg, second, 0);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    if ((!strcmp(mnemonic, "movzx") || !strcmp(mnemonic, "movsx")) && count == 2 && first->kind == RegisterOperand
+        && second->kind != ImmediateOperand && second->kind != SymbolOperand) {
+        const unsigned opcode = (mnemonic[3] == 'z') ? 0x0FB6 : 0x0FBE;
+        EmitModRM(as, opcode, first->size, first->reg, second, 0);
+        return true;
+    }
+
+    if (!strcmp(mnemonic, "movsxd") && count == 2 && first->kind == RegisterOperand && first->size == 8
+        && second->kind != ImmediateOperand && second->kind != SymbolOperand) {
+        const unsigned opcode = 0x63;
+        EmitModRM(as, opcode, 8, first->reg, second, 0);
+        return true;
+    }
+
+    if (!strcmp(mnemonic, "lea") && count == 2 && first->kind == RegisterOperand && second->kind == MemoryOperand) {
+        const unsigned opcode = 0x8D;
+        EmitModRM(as, opcode, first->size, first->reg, second, 0);
+        return true;
+    }
+
+    if (!strcmp(mnemonic, "imul") && count >= 2) {
+        TAsmOperand* source = second;
+        TAsmOperand* immediate = (count == 3) ? &operands[2] : NULL;
+        if (count == 2 && second->kind == ImmediateOperand) { // imul reg, imm == imul reg, reg, imm
+            immediate = second;
+            source = first;
+        }
+        if (first->kind != RegisterOperand || source->kind == ImmediateOperand || source->kind == SymbolOperand) {
+            return false;
+        }
+
+        if (!immediate) {
+            const unsigned opcode = 0x0FAF;
+            EmitModRM(as, opcode, first->size, first->reg, source, 0);
+        } else {
+            if (immediate->kind != ImmediateOperand || !FitsInt32(immediate->value)) {
+                return false;
+            }
+            const unsigned opcode = (FitsInt8(immediate->value)) ? 0x6B : 0x69;
+            size_t immediateSize = (opcode == 0x6B) ? 1 : 4;
+            EmitModRM(as, opcode, first->size, first->reg, source, immediateSize);
+            EmitValue(as, immediate->value, immediateSize);
+        }
+        return true;
+    }
+
+    code = FindCode(kUnary, sizeof(kUnary) / sizeof(kUnary[0]), mnemonic);
+    if (code < 0 && !strcmp(mnemonic, "imul")) {
+        code = 5;
+    }
+    if (code >= 0 && count == 1 && first->kind != ImmediateOperand && first->kind != SymbolOperand) {
+        const unsigned opcode = (size == 1) ? 0xF6 : 0xF7;
+        EmitModRM(as, opcode, size, code, first, 0);
+        return true;
+    }
+
+    if ((!strcmp(mnemonic, "inc") || !strcmp(mnemonic, "dec")) && count == 1 && first->kind != ImmediateOperand
+        && first->kind != SymbolOperand) {
+        const unsigned opcode = (size == 1) ? 0xFE : 0xFF;
+        EmitModRM(as, opcode, size, (mnemonic[0] == 'd') ? 1 : 0, first, 0);
+        return true;
+    }
+
+    code = FindCode(kShifts, sizeof(kShifts) / sizeof(kShifts[0]), mnemonic);
+    if (code >= 0 && count == 2 && first->kind != ImmediateOperand && first->kind != SymbolOperand) {
+        if (second->kind == RegisterOperand && second->reg == 1 && second->size == 1) { // shl r/m, cl
+            const unsigned opcode = (size == 1) ? 0xD2 : 0xD3;
+            EmitModRM(as, opcode, size, code, first, 0);
+        } else if (second->kind == ImmediateOperand && second->value == 1) {
+            const unsigned opcode = (size == 1) ? 0xD0 : 0xD1;
+            EmitModRM(as, opcode, size, code, first, 0);
+        } else if (second->kind == ImmediateOperand) {
+            const unsigned opcode = (size == 1) ? 0xC0 : 0xC1;
+            EmitModRM(as, opcode, size, code, first, 1);
+            EmitValue(as, second->value, 1);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    if ((!strcmp(mnemonic, "push") || !strcmp(mnemonic, "pop")) && count == 1) {
+        bool isPush = (mnemonic[1] == 'u');
+        if (first->kind == RegisterOperand) {
+            if (first->reg >= 8) {
+                EmitByte(as, 0x41);
+            }
+            EmitByte(as, (unsigned char)(((isPush) ? 0x50 : 0x58) + (first->reg & 7)));
+        } else if (first->kind == ImmediateOperand && isPush && FitsInt32(first->value)) {
+            EmitByte(as, (FitsInt8(first->value)) ? 0x6A : 0x68);
+            EmitValue(as, first->value, (FitsInt8(first->value)) ? 1 : 4);
+        } else if (first->kind == MemoryOperand) {
+            const unsigned opcode = (isPush) ? 0xFF : 0x8F;
+            first->size = 4; // 64 бита по умолчанию
+            EmitModRM(as, opcode, 4, (isPush) ? 6 : 0, first, 0);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+// Раскладка .text: сначала все переходы короткие, длинными становятся только те, что не достают до цели
+static void Finish(TAssembler* as) {
+    TObject* object = as->object;
+
+    for (size_t i = 0; i < object->symbolCount; i++) {
+        if (object->symbols[i].section == UndefinedSection) {
+            as->line = 0;
+            AssemblerError(as, "undefined symbol", object->symbols[i].name);
+        }
+    }
+
+    for (size_t i = 0; i < as->branchCount; i++) {
+        SectionType section = object->symbols[as->branches[i].symbol].section;
+        if (section == DataSection || section == BssSection) {
+            as->line = 0;
+            AssemblerError(as, "jump to data:", object->symbols[as->branches[i].symbol].name);
+        }
+        as->branches[i].isLong |= (section == ExternSection); // адрес внешней функции известен только компоновщику
+    }
+
+    size_t* shifts = (size_t*)calloc(as->branchCount + 1, sizeof(size_t)); // суммарная длина первых i переходов
+    assert(shifts);
+
+    for (bool isChanged = true; isChanged; ) {
+        isChanged = false;
+        for (size_t i = 0; i < as->branchCount; i++) {
+            TBranch* branch = &as->branches[i];
+            size_t branchSize = (!branch->isLong) ? kShortBranchSize
+                              : (branch->type == ConditionalBranch) ? kConditionalJumpSize
+                              : (branch->type == JumpBranch) ? kJumpSize : kCallSize;
+            shifts[i + 1] = shifts[i] + branchSize;
+        }
+
+        for (size_t i = 0; i < as->branchCount; i++) {
+            TBranch* branch = &as->branches[i];
+            if (branch->isLong) {
+                continue;
+            }
+
+            TObjectSymbol* target = &object->symbols[branch->symbol];
+            long long targetAddress = (long long)(target->offset + shifts[as->labelBranches[branch->symbol]]);
+            long long nextAddress = (long long)(branch->offset + shifts[i] + kShortBranchSize);
+            if (!FitsInt8(targetAddress - nextAddress)) {
+                branch->isLong = true;
+                isChanged = true;
+            }
+        }
+    }
+
+    size_t position = 0;
+    for (size_t i = 0; i < as->branchCount; i++) {
+        TBranch* branch = &as->branches[i];
+        BufferAppend(&object->text, as->code.data + position, branch->offset - position);
+        position = branch->offset;
+
+        TObjectSymbol* target = &object->symbols[branch->symbol];
+        long long targetAddress = (target->section == TextSection)
+                                ? (long long)(target->offset + shifts[as->labelBranches[branch->symbol]]) : 0;
+
+        unsigned long long bytes = 0; // опкод и смещение, little endian
+        size_t size = 1;
+        if (!branch->isLong) {
+            bytes = (branch->type == JumpBranch) ? 0xEB : 0x70 + (unsigned)branch->condition;
+        } else if (branch->type == ConditionalBranch) {
+            bytes = 0x800F + ((unsigned)branch->condition << 8);
+            size = 2;
+        } else {
+            bytes = (branch->type == JumpBranch) ? 0xE9 : 0xE8;
+        }
+
+        size_t displacementSize = (branch->isLong) ? 4 : 1;
+        long long displacement = targetAddress - (long long)(object->text.size + size + displacementSize);
+        if (target->section == ExternSection) { // адрес известен только компоновщику
+            object->relocations = (TRelocation*)GrowArray(object->relocations, &object->relocationCapacity,
+                                                          object->relocationCount, sizeof(TRelocation));
+            object->relocations[object->relocationCount++] = {
+                .offset = object->text.size + size,
+                .symbol = branch->symbol,
+                .type = PltRelative32,
+                .addend = -4,
+            };
+            target->isReferenced = true;
+            displacement = 0;
+        }
+        bytes |= ((unsigned long long)displacement & ((displacementSize == 1) ? 0xFF : 0xFFFFFFFF)) << (8 * size);
+        BufferAppend(&object->text, &bytes, size + displacementSize);
+    }
+    BufferAppend(&object->text, as->code.data + position, as->code.size - position);
+
+    for (size_t i = 0; i < as->relocationCount; i++) {
+        TPendingRelocation* pending = &as->relocations[i];
+        object->relocations = (TRelocation*)GrowArray(object->relocations, &object->relocationCapacity,
+                                                      object->relocationCount, sizeof(TRelocation));
+        object->relocations[object->relocationCount++] = {
+            .offset = pending->offset + shifts[pending->branchCount],
+            .symbol = pending->symbol,
+            .type = PcRelative32,
+            .addend = pending->addend,
+        };
+        object->symbols[pending->symbol].isReferenced = true;
+    }
+
+    for (size_t i = 0; i < object->symbolCount; i++) {
+        if (object->symbols[i].section == TextSection) {
+            object->symbols[i].offset += shifts[as->labelBranches[i]];
+        }
+    }
+
+    for (size_t i = 0; i < as->differenceCount; i++) {
+        TLabelDifference* difference = &as->differences[i];
+        TObjectSymbol* symbol = &object->symbols[difference->symbol];
+        TObjectSymbol* base = &object->symbols[difference->base];
+        if (symbol->section != TextSection || base->section != TextSection) {
+            as->line = 0;
+            AssemblerError(as, "label difference outside of .text:", symbol->name);
+        }
+        int value = (int)((long long)symbol->offset - (long long)base->offset);
+        memcpy(object->text.data + difference->offset + shifts[difference->branchCount], &value, sizeof(value));
+    }
+
+    free(shifts);
+}
+
+static char* Trim(char* text) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+
+    size_t length = strlen(text);
+    while (length && isspace((unsigned char)text[length - 1])) {
+        text[--length] = '\0';
+    }
+    return text;
+}
+
+// Делит строку по запятым вне кавычек и квадратных скобок
+static size_t SplitOperands(char* text, char** parts, size_t maxParts) {
+    size_t count = 0;
+    if (!*text) {
+        return 0;
+    }
+
+    char quote = '\0';
+    int depth = 0;
+    parts[count++] = text;
+    for (char* c = text; *c; c++) {
+        if (quote) {
+            quote = (*c == quote) ? '\0' : quote;
+        } else if (*c == '"' || *c == '\'') {
+            quote = *c;
+        } else if (*c == '[') {
+            depth++;
+        } else if (*c == ']') {
+            depth--;
+        } else if (*c == ',' && !depth && count < maxParts) {
+            *c = '\0';
+            parts[count++] = c + 1;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        parts[i] = Trim(parts[i]);
+    }
+    return count;
+}
+
+static void ParseOperand(TAssembler* as, char* text, TAsmOperand* operand) {
+    operand->base = kNoRegister;
+    operand->index = kNoRegister;
+
+    const char* const kSizes[] = {"byte", "word", "dword", "qword"};
+    const int kSizeValues[] = {1, 2, 4, 8};
+    for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); i++) {
+        size_t length = strlen(kSizes[i]);
+        if (!strncmp(text, kSizes[i], length) && isspace((unsigned char)text[length])) {
+            operand->size = kSizeValues[i];
+            text = Trim(text + length);
+            break;
+        }
+    }
+
+    if (*text == '[') {
+        ParseAddress(as, text, operand);
+        return;
+    }
+
+    const TRegister* reg = FindRegister(text);
+    if (reg) {
+        operand->kind = RegisterOperand;
+        operand->reg = reg->number;
+        operand->size = reg->size;
+        return;
+    }
+
+    if (ParseNumber(text, &operand->value)) {
+        operand->kind = ImmediateOperand;
+        return;
+    }
+
+    operand->kind = SymbolOperand;
+    GetScopedName(as, text, operand->symbol);
+}
+
+// [base + index * scale + disp], [name + disp] или [rel name]
+static void ParseAddress(TAssembler* as, char* text, TAsmOperand* operand) {
+    operand->kind = MemoryOperand;
+    operand->size = (operand->size) ? operand->size : 8;
+
+    size_t length = strlen(text);
+    if (text[length - 1] != ']') {
+        AssemblerError(as, "malformed address", text);
+    }
+    text[length - 1] = '\0';
+    text = Trim(text + 1);
+    if (!strncmp(text, "rel ", 4)) {
+        text = Trim(text + 4);
+    }
+
+    int sign = 1;
+    while (*text) {
+        char term[kMaxLengthOfLabel] = "";
+        size_t termLength = 0;
+        while (*text && *text != '+' && *text != '-' && termLength < kMaxLengthOfLabel - 1) {
+            if (!isspace((unsigned char)*text)) {
+                term[termLength++] = *text;
+            }
+            text++;
+        }
+        term[termLength] = '\0';
+
+        char* star = strchr(term, '*');
+        if (star) {
+            *star = '\0';
+            const TRegister* reg = FindRegister(term);
+            long long scale = 0;
+            if (!reg) {
+                reg = FindRegister(star + 1);
+                ParseNumber(term, &scale);
+            } else {
+                ParseNumber(star + 1, &scale);
+            }
+            if (!reg || sign < 0 || (scale != 1 && scale != 2 && scale != 4 && scale != 8)) {
+                AssemblerError(as, "malformed index", term);
+            }
+            operand->index = reg->number;
+            operand->scale = (int)scale;
+        } else if (*term) {
+            const TRegister* reg = FindRegister(term);
+            long long value = 0;
+            if (reg && sign > 0 && operand->base == kNoRegister) {
+                operand->base = reg->number;
+            } else if (reg && sign > 0 && operand->index == kNoRegister) {
+                operand->index = reg->number;
+                operand->scale = 1;
+            } else if (ParseNumber(term, &value)) {
+                operand->value += sign * value;
+            } else if (!reg && sign > 0 && !*operand->symbol) {
+                GetScopedName(as, term, operand->symbol);
+            } else {
+                AssemblerError(as, "malformed address term", term);
+            }
+        }
+
+        if (*text == '+' || *text == '-') {
+            sign = (*text == '-') ? -1 : 1;
+            text++;
+        }
+    }
+
+    if (*operand->symbol && (operand->base != kNoRegister || operand->index != kNoRegister)) {
+        AssemblerError(as, "symbol with registers in address", operand->symbol);
+    }
+}
+
+static const TRegister* FindRegister(const char* name) {
+    for (size_t i = 0; i < sizeof(kRegisters) / sizeof(kRegisters[0]); i++) {
+        if (!strcmp(kRegisters[i].name, name)) {
+            return &kRegisters[i];
+        }
+    }
+    return NULL;
+}
+
+static int FindCode(const TCondition* table, size_t size, const char* name) {
+    for (size_t i = 0; i < size; i++) {
+        if (!strcmp(table[i].name, name)) {
+            return table[i].code;
+        }
+    }
+    return -1;
+}
+
+static bool ParseNumber(const char* text, long long* value) {
+    const char* digits = (*text == '-' || *text == '+') ? text + 1 : text;
+    if (!isdigit((unsigned char)*digits)) {
+        return false;
+    }
+
+    char* end = NULL;
+    unsigned long long number = strtoull(digits, &end, 0);
+    if (*end) {
+        return false;
+    }
+
+    *value = (*text == '-') ? -(long long)number : (long long)number;
+    return true;
+}
+
+static void GetScopedName(TAssembler* as, const char* name, char* scoped) {
+    if (name[0] == '.') {
+        snprintf(scoped, kMaxLengthOfLabel, "%s%s", as->scope, name);
+    } else {
+        snprintf(scoped, kMaxLengthOfLabel, "%s", name);
+    }
+}
+
+static size_t FindSymbol(TAssembler* as, const char* name) {
+    TObject* object = as->object;
+
+    size_t mask = as->tableCapacity - 1;
+    for (size_t i = HashName(name) & mask; ; i = (i + 1) & mask) {
+        size_t entry = as->table[i];
+        if (!entry) {
+            break;
+        }
+        if (!strcmp(object->symbols[entry - 1].name, name)) {
+            return entry - 1;
+        }
+    }
+
+    size_t capacity = object->symbolCapacity;
+    object->symbols = (TObjectSymbol*)GrowArray(object->symbols, &object->symbolCapacity, object->symbolCount,
+                                                sizeof(TObjectSymbol));
+    if (capacity != object->symbolCapacity) {
+        as->labelBranches = (size_t*)realloc(as->labelBranches, object->symbolCapacity * sizeof(size_t));
+        assert(as->labelBranches);
+    }
+
+    size_t index = object->symbolCount++;
+    object->symbols[index] = {
+        .name = strdup(name),
+        .section = UndefinedSection,
+        .offset = 0,
+        .isGlobal = false,
+        .isReferenced = false,
+    };
+    assert(object->symbols[index].name);
+    as->labelBranches[index] = 0;
+
+    if (2 * object->symbolCount > as->tableCapacity) {
+        GrowTable(as);
+    } else {
+        for (size_t i = HashName(name) & mask; ; i = (i + 1) & mask) {
+            if (!as->table[i]) {
+                as->table[i] = index + 1;
+                break;
+            }
+        }
+    }
+    return index;
+}
+
+static void DefineLabel(TAssembler* as, const char* name) {
+    char scoped[kMaxLengthOfLabel] = "";
+    GetScopedName(as, name, scoped);
+
+    size_t index = FindSymbol(as, scoped);
+    TObjectSymbol* symbol = &as->object->symbols[index];
+    if (symbol->section != UndefinedSection) {
+        AssemblerError(as, "symbol redefined:", scoped);
+    }
+
+    symbol->section = as->section;
+    symbol->offset = (as->section == TextSection) ? as->code.size
+                   : (as->section == BssSection) ? as->object->bssSize : as->object->data.size;
+    as->labelBranches[index] = as->branchCount;
+
+    if (name[0] != '.') {
+        snprintf(as->scope, kMaxLengthOfLabel, "%s", name);
+    }
+}
+
+static size_t HashName(const char* name) {
+    size_t hash = 14695981039346656037ULL; // FNV-1a
+    for (const char* c = name; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void GrowTable(TAssembler* as) {
+    free(as->table);
+    as->tableCapacity *= 2;
+    as->table = (size_t*)calloc(as->tableCapacity, sizeof(size_t));
+    assert(as->table);
+
+    size_t mask = as->tableCapacity - 1;
+    for (size_t index = 0; index < as->object->symbolCount; index++) {
+        for (size_t i = HashName(as->object->symbols[index].name) & mask; ; i = (i + 1) & mask) {
+            if (!as->table[i]) {
+                as->table[i] = index + 1;
+                break;
+            }
+        }
+    }
+}
+
+static void EmitByte(TAssembler* as, unsigned char byte) {
+    BufferAppend(&as->code, &byte, 1);
+}
+
+static void EmitValue(TAssembler* as, long long value, size_t size) {
+    BufferAppend(&as->code, &value, size);
+}
+
+// REX, опкод, ModRM, SIB и смещение; immediateSize нужен для rip-relative адреса, который считается от конца инструкции
+// opcode: один байт или 0x0F и второй байт, например 0x0FAF
+static void EmitModRM(TAssembler* as, unsigned opcode, int size, int regField, TAsmOperand* rm,
+                      size_t immediateSize) {
+    bool isRegister = (rm->kind == RegisterOperand);
+    int base = (isRegister) ? rm->reg : rm->base;
+    int index = (isRegister) ? kNoRegister : rm->index;
+
+    unsigned char rex = (unsigned char)(0x40 | ((size == 8) ? 0x08 : 0) | ((regField & 8) ? 0x04 : 0)
+                                        | ((index != kNoRegister && (index & 8)) ? 0x02 : 0)
+                                        | ((base != kNoRegister && (base & 8)) ? 0x01 : 0));
+    // spl, bpl, sil и dil доступны только с REX; у групповых опкодов в поле reg номер операции, а не регистр
+    bool isGroup = opcode > 0xFF || opcode == 0x80 || opcode == 0xC0 || opcode == 0xC6 || opcode == 0xD0
+                || opcode == 0xD2 || opcode == 0xF6 || opcode == 0xFE;
+    bool isByteRegister = (isRegister && rm->size == 1 && rm->reg >= 4 && rm->reg < 8)
+                       || (size == 1 && !isGroup && regField >= 4 && regField < 8);
+    if (rex != 0x40 || isByteRegister) {
+        EmitByte(as, rex);
+    }
+    if (opcode > 0xFF) {
+        EmitByte(as, (unsigned char)(opcode >> 8));
+    }
+    EmitByte(as, (unsigned char)(opcode & 0xFF));
+
+    EmitAddressing(as, regField, rm, immediateSize);
+}
+
+// Двухбайтовый VEX (C5) возможен для карты 0F без расширенных index и base и без VEX.W
+static void EmitVex(TAssembler* as, const TVexInstruction* instruction, int length, int source, int regField,
+                    TAsmOperand* rm, size_t immediateSize) {
+    bool isRegister = (rm->kind == RegisterOperand);
+    int base = (isRegister) ? rm->reg : rm->base;
+    int index = (isRegister) ? kNoRegister : rm->index;
+    bool hasR = regField & 8;
+    bool hasX = index != kNoRegister && (index & 8);
+    bool hasB = base != kNoRegister && (base & 8);
+    unsigned char tail = (unsigned char)((((~source) & 15) << 3) | (length << 2) | instruction->pp);
+
+    if (!hasX && !hasB && instruction->map == 1) {
+        EmitByte(as, 0xC5);
+        EmitByte(as, (unsigned char)(((hasR) ? 0 : 0x80) | tail));
+    } else {
+        EmitByte(as, 0xC4);
+        EmitByte(as, (unsigned char)(((hasR) ? 0 : 0x80) | ((hasX) ? 0 : 0x40) | ((hasB) ? 0 : 0x20) | instruction->map));
+        EmitByte(as, tail);
+    }
+    EmitByte(as, instruction->opcode);
+
+    EmitAddressing(as, regField, rm, immediateSize);
+}
+
+// ModRM, SIB и смещение; регистр rm или адрес [base + index * scale + disp] либо [rel name]
+static void EmitAddressing(TAssembler* as, int regField, TAsmOperand* rm, size_t immediateSize) {
+    bool isRegister = (rm->kind == RegisterOperand);
+    int base = (isRegister) ? rm->reg : rm->base;
+    int index = (isRegister) ? kNoRegister : rm->index;
+
+    int reg = regField & 7;
+    if (isRegister) {
+        EmitByte(as, (unsigned char)(0xC0 | (reg << 3) | (rm->reg & 7)));
+        return;
+    }
+
+    if (*rm->symbol) { // [rel name]
+        EmitByte(as, (unsigned char)(0x05 | (reg << 3)));
+        as->relocations = (TPendingRelocation*)GrowArray(as->relocations, &as->relocationCapacity,
+                                                         as->relocationCount, sizeof(TPendingRelocation));
+        as->relocations[as->relocationCount++] = {
+            .offset = as->code.size,
+            .branchCount = as->branchCount,
+            .symbol = FindSymbol(as, rm->symbol),
+            .addend = rm->value - 4 - (long long)immediateSize,
+        };
+        EmitValue(as, 0, 4);
+        return;
+    }
+
+    int scaleBits = (rm->scale == 8) ? 3 : (rm->scale == 4) ? 2 : (rm->scale == 2) ? 1 : 0;
+    if (base == kNoRegister) { // [index * scale + disp32]
+        EmitByte(as, (unsigned char)(0x04 | (reg << 3)));
+        EmitByte(as, (unsigned char)((scaleBits << 6) | (((index == kNoRegister) ? 4 : index & 7) << 3) | 5));
+        EmitValue(as, rm->value, 4);
+        return;
+    }
+
+    // rbp и r13 без смещения не кодируются, rsp и r12 требуют SIB
+    int mod = (rm->value == 0 && (base & 7) != 5) ? 0 : (FitsInt8(rm->value)) ? 1 : 2;
+    if (index != kNoRegister || (base & 7) == 4) {
+        EmitByte(as, (unsigned char)((mod << 6) | (reg << 3) | 4));
+        EmitByte(as, (unsigned char)((scaleBits << 6) | (((index == kNoRegister) ? 4 : index & 7) << 3) | (base & 7)));
+    } else {
+        EmitByte(as, (unsigned char)((mod << 6) | (reg << 3) | (base & 7)));
+    }
+    if (mod) {
+        EmitValue(as, rm->value, (mod == 1) ? 1 : 4);
+    }
+}
+
+static void EmitBranch(TAssembler* as, BranchType type, int condition, TAsmOperand* target) {
+    size_t symbol = FindSymbol(as, target->symbol);
+
+    as->branches = (TBranch*)GrowArray(as->branches, &as->branchCapacity, as->branchCount, sizeof(TBranch));
+    as->branches[as->branchCount++] = {
+        .offset = as->code.size,
+        .type = type,
+        .condition = condition,
+        .symbol = symbol,
+        .isLong = (type == CallBranch), // у call нет короткой формы
+    };
+}
+
+static bool FitsInt8(long long value) {
+    return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+static bool FitsInt32(long long value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static int GetOperationSize(TAsmOperand* first, TAsmOperand* second) {
+    if (first->kind == RegisterOperand) {
+        return first->size;
+    }
+    if (second && second->kind == RegisterOperand) {
+        return second->size;
+    }
+    return (first->size) ? first->size : 8;
+}
+
+static void* GrowArray(void* array, size_t* capacity, size_t count, size_t elementSize) {
+    if (count < *capacity) {
+        return array;
+    }
+
+    *capacity = (*capacity) ? 2 * *capacity : kInitialCapacity;
+    array = realloc(array, *capacity * elementSize);
+    assert(array);
+    return array;
+}
@@ -0,0 +1,261 @@
+#include "dataLayout.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const double kLoopTrips = 8; // оценка числа итераций цикла без профиля
+const double kMaxFrequency = 1e15; // рекурсия умножала бы частоты бесконечно
+const size_t kCallPropagationRounds = 8; // глубина цепочек вызовов, через которые передается частота
+const size_t kInitialSizeOfFunctionVector = 16;
+const size_t kInitialSizeOfNameVector = 16;
+
+enum DataGroup {
+    HotWrittenGroup     = 0, // пишется в циклах: эти строки кеша меняются
+    HotReadGroup        = 1, // в циклах только читается: строки остаются общими для всех ядер
+    SharedWrittenGroup  = 2, // суммы и последние значения parallel while: потоки пишут их, когда другие еще читают
+    ColdGroup           = 3,
+    DataGroupCount      = 4,
+};
+
+// Оценка обращений к глобальной переменной за один запуск программы
+struct TGlobalHeat {
+    size_t index; // в таблице символов
+    double reads;
+    double writes;
+    size_t loop; // номер самого горячего цикла, где к ней обращаются, 0 - вне циклов
+    double loopHeat;
+    bool isParallelWritten;
+    DataGroup group;
+};
+
+struct TDataLayout {
+    TSymbol* symbols;
+    size_t count;
+    TGlobalHeat* heat;
+    Vector globals; // имена из symbols для CollectLocals
+    Vector functions;
+    double* frequencies; // для functions [ i ]: сколько раз она вызывается
+    size_t loopCount;
+};
+
+static void CollectFunctionNodes(tNode* node, Vector* functions);
+static void EstimateFrequencies(TDataLayout* layout, tNode* root);
+static void AccumulateCalls(TDataLayout* layout, tNode* node, double weight, double* frequencies);
+static void CountAccesses(TDataLayout* layout, tNode* node, double weight, size_t loop, bool inParallelLoop,
+                          Vector* locals);
+static void AddAccess(TDataLayout* layout, const char* name, double weight, size_t loop, bool isWrite,
+                      bool inParallelLoop, Vector* locals);
+static size_t FindFunctionIndex(TDataLayout* layout, const char* name);
+static bool IsLoop(tNode* node);
+static int CompareHeat(const void* first, const void* second);
+
+// global ------------------------------------------------------------------------------------------
+
+// Глобальные переменные в .data группируются по оценке обращений: циклы умножают частоту на kLoopTrips,
+// вызовы передают частоту вызывающего. Горячие переменные одного цикла лежат рядом, чтобы занять
+// меньше строк кеша, изменяемые отделены от только читаемых, холодные - в конце. Каждая группа
+// начинается с новой строки
+void EmitGlobalData(TEmitter* output, tNode* root, TSymbol* symbols, size_t count) {
+    TDataLayout layout = {
+        .symbols = symbols,
+        .count = count,
+        .heat = (TGlobalHeat*)calloc(count + 1, sizeof(TGlobalHeat)),
+        .globals = {},
+        .functions = {},
+        .frequencies = NULL,
+        .loopCount = 0,
+    };
+    assert(layout.heat);
+    vectorInit(&layout.globals, kInitialSizeOfNameVector);
+    vectorInit(&layout.functions, kInitialSizeOfFunctionVector);
+    for (size_t i = 0; i < count; i++) {
+        layout.heat[i].index = i;
+        vectorPush(&layout.globals, symbols[i].name);
+    }
+    CollectFunctionNodes(root, &layout.functions);
+
+    EstimateFrequencies(&layout, root);
+    CountAccesses(&layout, root, 1, 0, false, NULL);
+    for (size_t i = 0; i < layout.functions.size; i++) {
+        tNode* function = (tNode*)layout.functions.data[i];
+        Vector locals = {};
+        vectorInit(&locals, kInitialSizeOfNameVector);
+        CollectLocals(function, &layout.globals, &locals);
+        CountAccesses(&layout, function->right, layout.frequencies[i], 0, false, &locals);
+        vectorFree(&locals);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        TGlobalHeat* heat = &layout.heat[i];
+        heat->group = (heat->isParallelWritten) ? SharedWrittenGroup
+                    : (heat->writes >= kLoopTrips) ? HotWrittenGroup
+                    : (heat->reads + heat->writes >= kLoopTrips) ? HotReadGroup : ColdGroup;
+    }
+    qsort(layout.heat, count, sizeof(TGlobalHeat), CompareHeat);
+
+    for (size_t i = 0; i < count; i++) {
+        const TSymbol* symbol = &symbols[layout.heat[i].index];
+        if (!i || layout.heat[i].group != layout.heat[i - 1].group) {
+            Emit(output, "    align %zu\n", kCacheLineSize);
+        }
+        Emit(output, "    %s dq %s\n", symbol->name, symbol->initialValue);
+    }
+
+    free(layout.frequencies);
+    vectorFree(&layout.functions);
+    vectorFree(&layout.globals);
+    free(layout.heat);
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void CollectFunctionNodes(tNode* node, Vector* functions) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        vectorPush(functions, node);
+    } else if (IsOperation(node, Semicolon)) {
+        CollectFunctionNodes(node->left, functions);
+        CollectFunctionNodes(node->right, functions);
+    }
+}
+
+// Частота функции - сумма по местам вызова частоты вызывающего, умноженной на kLoopTrips в степени
+// вложенности циклов. Код вне функций выполняется один раз
+static void EstimateFrequencies(TDataLayout* layout, tNode* root) {
+    size_t count = layout->functions.size;
+    layout->frequencies = (double*)calloc(count + 1, sizeof(double));
+    double* next = (double*)calloc(count + 1, sizeof(double));
+    assert(layout->frequencies && next);
+
+    for (size_t round = 0; round < kCallPropagationRounds; round++) {
+        memset(next, 0, (count + 1) * sizeof(double));
+        AccumulateCalls(layout, root, 1, next);
+        for (size_t i = 0; i < count; i++) {
+            if (layout->frequencies[i] > 0) {
+                AccumulateCalls(layout, ((tNode*)layout->functions.data[i])->right, layout->frequencies[i], next);
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            layout->frequencies[i] = (next[i] < kMaxFrequency) ? next[i] : kMaxFrequency;
+        }
+    }
+
+    free(next);
+}
+
+static void AccumulateCalls(TDataLayout* layout, tNode* node, double weight, double* frequencies) {
+    if (!node || node->type == Function) {
+        return; // тело функции учитывается с ее частотой
+    }
+
+    if (node->type == Calling) {
+        size_t index = FindFunctionIndex(layout, node->value);
+        if (index < layout->functions.size) {
+            frequencies[index] += weight;
+        }
+    }
+
+    double inner = (IsLoop(node)) ? weight * kLoopTrips : weight;
+    AccumulateCalls(layout, node->left, weight, frequencies);
+    AccumulateCalls(layout, node->right, inner, frequencies);
+}
+
+// locals == NULL - код вне функций, где все переменные глобальные
+static void CountAccesses(TDataLayout* layout, tNode* node, double weight, size_t loop, bool inParallelLoop,
+                          Vector* locals) {
+    if (!node || node->type == Function) {
+        return;
+    }
+
+    if (IsOperation(node, Equal)) {
+        AddAccess(layout, node->left->value, weight, loop, true, inParallelLoop, locals);
+        CountAccesses(layout, node->right, weight, loop, inParallelLoop, locals);
+        return;
+    }
+    if (node->type == Identifier) {
+        AddAccess(layout, node->value, weight, loop, false, inParallelLoop, locals);
+        return;
+    }
+
+    if (IsLoop(node)) {
+        size_t inner = ++layout->loopCount;
+        bool isParallel = inParallelLoop || IsOperation(node, ParallelWhile);
+        CountAccesses(layout, node->left, weight * kLoopTrips, inner, isParallel, locals); // условие на каждой итерации
+        CountAccesses(layout, node->right, weight * kLoopTrips, inner, isParallel, locals);
+        return;
+    }
+    CountAccesses(layout, node->left, weight, loop, inParallelLoop, locals);
+    CountAccesses(layout, node->right, weight, loop, inParallelLoop, locals);
+}
+
+static void AddAccess(TDataLayout* layout, const char* name, double weight, size_t loop, bool isWrite,
+                      bool inParallelLoop, Vector* locals) {
+    if (locals && ContainsName(locals, name)) {
+        return;
+    }
+
+    for (size_t i = 0; i < layout->count; i++) {
+        if (strcmp(layout->symbols[i].name, name)) {
+            continue;
+        }
+
+        TGlobalHeat* heat = &layout->heat[i];
+        if (isWrite) {
+            heat->writes += weight;
+            heat->isParallelWritten |= inParallelLoop;
+        } else {
+            heat->reads += weight;
+        }
+        if (loop && weight > heat->loopHeat) {
+            heat->loop = loop;
+            heat->loopHeat = weight;
+        }
+        return;
+    }
+}
+
+static size_t FindFunctionIndex(TDataLayout* layout, const char* name) {
+    for (size_t i = 0; i < layout->functions.size; i++) {
+        if (!strcmp(((tNode*)layout->functions.data[i])->value, name)) {
+            return i;
+        }
+    }
+    return layout->functions.size;
+}
+
+static bool IsLoop(tNode* node) {
+    return IsOperation(node, While) || IsOperation(node, VectorWhile) || IsOperation(node, ParallelWhile);
+}
+
+// По группам; в горячих группах - по самому горячему циклу, чтобы его переменные шли подряд, затем по
+// частоте; холодные остаются в порядке появления в программе
+static int CompareHeat(const void* first, const void* second) {
+    const TGlobalHeat* a = (const TGlobalHeat*)first;
+    const TGlobalHeat* b = (const TGlobalHeat*)second;
+
+    if (a->group != b->group) {
+        return (a->group < b->group) ? -1 : 1;
+    }
+    if (a->group != ColdGroup) {
+        if (a->loopHeat < b->loopHeat || a->loopHeat > b->loopHeat) {
+            return (a->loopHeat > b->loopHeat) ? -1 : 1;
+        }
+        if (a->loop != b->loop) {
+            return (a->loop < b->loop) ? -1 : 1;
+        }
+        double aTotal = a->reads + a->writes;
+        double bTotal = b->reads + b->writes;
+        if (aTotal < bTotal || aTotal > bTotal) {
+            return (aTotal > bTotal) ? -1 : 1;
+        }
+    }
+    return (a->index > b->index) - (a->index < b->index);
+}
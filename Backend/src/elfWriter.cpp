@@ -0,0 +1,323 @@
+#include "elfWriter.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <elf.h>
+#include <sys/stat.h>
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kTextAlignment = 16;
+const size_t kDataAlignment = 64; // align 64 в .data и .bss - строка кеша
+const size_t kBssAlignment = 64;
+
+enum ObjectSection {
+    NullSectionIndex        = 0,
+    TextSectionIndex        = 1,
+    DataSectionIndex        = 2,
+    BssSectionIndex         = 3,
+    SymtabSectionIndex      = 4,
+    StrtabSectionIndex      = 5,
+    RelaSectionIndex        = 6,
+    StackSectionIndex       = 7,
+    ShstrtabSectionIndex    = 8,
+    ObjectSectionCount      = 9,
+};
+
+static const char* const kEntryNames[] = {"_start", "main"};
+
+static void Pad(TByteBuffer* buffer, size_t alignment);
+static Elf64_Half GetSectionIndex(SectionType section);
+static size_t AddString(TByteBuffer* strings, const char* string);
+static Elf64_Sym MakeSymbol(TByteBuffer* strings, TObjectSymbol* symbol, unsigned binding);
+static void WriteFile(const char* fileName, TByteBuffer* buffer);
+
+// global ------------------------------------------------------------------------------------------
+
+// Смещение .bss от начала .data в загруженном образе: .bss следует сразу за данными
+size_t GetBssOffset(const TObject* object) {
+    return (object->data.size + kBssAlignment - 1) / kBssAlignment * kBssAlignment;
+}
+
+// Перемещаемый ELF64: .text, .data, .bss, таблица символов и R_X86_64_PC32/PLT32 для компоновщика
+void WriteObjectFile(const char* fileName, TObject* object) {
+    TByteBuffer strings = {};
+    TByteBuffer symbols = {};
+    TByteBuffer relocations = {};
+    AddString(&strings, "");
+
+    size_t* indices = (size_t*)calloc(object->symbolCount + 1, sizeof(size_t)); // индекс в .symtab
+    assert(indices);
+
+    Elf64_Sym symbol = {};
+    BufferAppend(&symbols, &symbol, sizeof(symbol));
+    symbol.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+    symbol.st_shndx = TextSectionIndex;
+    BufferAppend(&symbols, &symbol, sizeof(symbol));
+    symbol.st_shndx = DataSectionIndex;
+    BufferAppend(&symbols, &symbol, sizeof(symbol));
+    symbol.st_shndx = BssSectionIndex;
+    BufferAppend(&symbols, &symbol, sizeof(symbol));
+
+    // локальные символы идут раньше глобальных; метки .name в таблицу не попадают
+    size_t count = 4;
+    for (size_t i = 0; i < object->symbolCount; i++) {
+        TObjectSymbol* current = &object->symbols[i];
+        if (!current->isGlobal && current->section != ExternSection && !strchr(current->name, '.')) {
+            symbol = MakeSymbol(&strings, current, STB_LOCAL);
+            BufferAppend(&symbols, &symbol, sizeof(symbol));
+            indices[i] = count++;
+        }
+    }
+    size_t firstGlobal = count;
+    for (size_t i = 0; i < object->symbolCount; i++) {
+        TObjectSymbol* current = &object->symbols[i];
+        if (current->isGlobal || (current->section == ExternSection && current->isReferenced)) {
+            symbol = MakeSymbol(&strings, current, STB_GLOBAL);
+            BufferAppend(&symbols, &symbol, sizeof(symbol));
+            indices[i] = count++;
+        }
+    }
+
+    for (size_t i = 0; i < object->relocationCount; i++) {
+        TRelocation* relocation = &object->relocations[i];
+        TObjectSymbol* target = &object->symbols[relocation->symbol];
+
+        Elf64_Rela rela = {};
+        rela.r_offset = relocation->offset;
+        if (target->section == ExternSection) {
+            rela.r_info = ELF64_R_INFO(indices[relocation->symbol], (unsigned)relocation->type);
+            rela.r_addend = relocation->addend;
+        } else { // относительно начала секции: локальные метки в .symtab не попадают
+            rela.r_info = ELF64_R_INFO(GetSectionIndex(target->section), (unsigned)relocation->type);
+            rela.r_addend = relocation->addend + (long long)target->offset;
+        }
+        BufferAppend(&relocations, &rela, sizeof(rela));
+    }
+    free(indices);
+
+    TByteBuffer names = {};
+    const char* const kSectionNames[ObjectSectionCount] = {
+        "", ".text", ".data", ".bss", ".symtab", ".strtab", ".rela.text", ".note.GNU-stack", ".shstrtab",
+    };
+    size_t nameOffsets[ObjectSectionCount] = {};
+    for (size_t i = 0; i < ObjectSectionCount; i++) {
+        nameOffsets[i] = AddString(&names, kSectionNames[i]);
+    }
+
+    TByteBuffer file = {};
+    Elf64_Ehdr header = {};
+    BufferAppend(&file, &header, sizeof(header));
+
+    Elf64_Shdr sections[ObjectSectionCount] = {};
+    TByteBuffer* contents[ObjectSectionCount] = {
+        NULL, &object->text, &object->data, NULL, &symbols, &strings, &relocations, NULL, &names,
+    };
+    const size_t alignments[ObjectSectionCount] = {0, kTextAlignment, kDataAlignment, kBssAlignment, 8, 1, 8, 1, 1};
+    for (size_t i = 1; i < ObjectSectionCount; i++) {
+        Pad(&file, alignments[i]);
+        sections[i].sh_name = (Elf64_Word)nameOffsets[i];
+        sections[i].sh_offset = file.size;
+        sections[i].sh_size = (contents[i]) ? contents[i]->size : 0;
+        sections[i].sh_addralign = alignments[i];
+        if (contents[i] && contents[i]->size) {
+            BufferAppend(&file, contents[i]->data, contents[i]->size);
+        }
+    }
+
+    sections[TextSectionIndex].sh_type = SHT_PROGBITS;
+    sections[TextSectionIndex].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    sections[DataSectionIndex].sh_type = SHT_PROGBITS;
+    sections[DataSectionIndex].sh_flags = SHF_ALLOC | SHF_WRITE;
+    sections[BssSectionIndex].sh_type = SHT_NOBITS;
+    sections[BssSectionIndex].sh_flags = SHF_ALLOC | SHF_WRITE;
+    sections[BssSectionIndex].sh_size = object->bssSize;
+    sections[SymtabSectionIndex].sh_type = SHT_SYMTAB;
+    sections[SymtabSectionIndex].sh_link = StrtabSectionIndex;
+    sections[SymtabSectionIndex].sh_info = (Elf64_Word)firstGlobal;
+    sections[SymtabSectionIndex].sh_entsize = sizeof(Elf64_Sym);
+    sections[StrtabSectionIndex].sh_type = SHT_STRTAB;
+    sections[RelaSectionIndex].sh_type = SHT_RELA;
+    sections[RelaSectionIndex].sh_flags = SHF_INFO_LINK;
+    sections[RelaSectionIndex].sh_link = SymtabSectionIndex;
+    sections[RelaSectionIndex].sh_info = TextSectionIndex;
+    sections[RelaSectionIndex].sh_entsize = sizeof(Elf64_Rela);
+    sections[StackSectionIndex].sh_type = SHT_PROGBITS; // неисполняемый стек
+    sections[ShstrtabSectionIndex].sh_type = SHT_STRTAB;
+
+    Pad(&file, 8);
+    size_t sectionOffset = file.size;
+    BufferAppend(&file, sections, sizeof(sections));
+
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_REL;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_shoff = sectionOffset;
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_shentsize = sizeof(Elf64_Shdr);
+    header.e_shnum = ObjectSectionCount;
+    header.e_shstrndx = ShstrtabSectionIndex;
+    memcpy(file.data, &header, sizeof(header));
+
+    WriteFile(fileName, &file);
+
+    BufferFree(&file);
+    BufferFree(&names);
+    BufferFree(&relocations);
+    BufferFree(&symbols);
+    BufferFree(&strings);
+}
+
+// Статический исполняемый файл: .text и .data с .bss в отдельных сегментах, релокации разрешаются здесь же
+void WriteExecutable(const char* fileName, TObject* object) {
+    size_t textOffset = kPageSize;
+    size_t dataOffset = (textOffset + object->text.size + kPageSize - 1) / kPageSize * kPageSize;
+    unsigned long long textAddress = kImageBase + textOffset;
+    unsigned long long dataAddress = kImageBase + dataOffset;
+    unsigned long long bssAddress = dataAddress + GetBssOffset(object);
+    bool hasData = object->data.size || object->bssSize;
+
+    unsigned long long entry = 0;
+    for (size_t i = 0; i < sizeof(kEntryNames) / sizeof(kEntryNames[0]) && !entry; i++) {
+        for (size_t j = 0; j < object->symbolCount; j++) {
+            if (object->symbols[j].section == TextSection && !strcmp(object->symbols[j].name, kEntryNames[i])) {
+                entry = textAddress + object->symbols[j].offset;
+                break;
+            }
+        }
+    }
+    if (!entry) {
+        fprintf(stderr, "Error: no entry point for executable\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < object->relocationCount; i++) {
+        TRelocation* relocation = &object->relocations[i];
+        TObjectSymbol* target = &object->symbols[relocation->symbol];
+        if (target->section == ExternSection) {
+            fprintf(stderr, "Error: external symbol '%s' cannot be used in a static executable, "
+                            "use --emit=obj and link it with libc\n", target->name);
+            exit(EXIT_FAILURE);
+        }
+
+        unsigned long long address = ((target->section == TextSection) ? textAddress
+                                    : (target->section == BssSection) ? bssAddress : dataAddress) + target->offset;
+        long long value = (long long)(address - (textAddress + relocation->offset)) + relocation->addend;
+        int32_t displacement = (int32_t)value;
+        assert(displacement == value);
+        memcpy(object->text.data + relocation->offset, &displacement, sizeof(displacement));
+    }
+
+    const size_t kSegmentCount = 3;
+    Elf64_Phdr segments[kSegmentCount] = {};
+    segments[0].p_type = PT_LOAD; // заголовки и код
+    segments[0].p_flags = PF_R | PF_X;
+    segments[0].p_offset = 0;
+    segments[0].p_vaddr = kImageBase;
+    segments[0].p_paddr = kImageBase;
+    segments[0].p_filesz = textOffset + object->text.size;
+    segments[0].p_memsz = segments[0].p_filesz;
+    segments[0].p_align = kPageSize;
+    segments[1].p_type = PT_LOAD;
+    segments[1].p_flags = PF_R | PF_W;
+    segments[1].p_offset = dataOffset;
+    segments[1].p_vaddr = dataAddress;
+    segments[1].p_paddr = dataAddress;
+    segments[1].p_filesz = object->data.size;
+    segments[1].p_memsz = (object->bssSize) ? GetBssOffset(object) + object->bssSize : object->data.size;
+    segments[1].p_align = kPageSize;
+    segments[2].p_type = PT_GNU_STACK;
+    segments[2].p_flags = PF_R | PF_W;
+
+    Elf64_Ehdr header = {};
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS64;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header.e_type = ET_EXEC;
+    header.e_machine = EM_X86_64;
+    header.e_version = EV_CURRENT;
+    header.e_entry = entry;
+    header.e_phoff = sizeof(Elf64_Ehdr);
+    header.e_ehsize = sizeof(Elf64_Ehdr);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum = (hasData) ? kSegmentCount : kSegmentCount - 1;
+    if (!hasData) {
+        segments[1] = segments[2];
+    }
+
+    TByteBuffer file = {};
+    BufferAppend(&file, &header, sizeof(header));
+    BufferAppend(&file, segments, header.e_phnum * sizeof(Elf64_Phdr));
+    Pad(&file, textOffset);
+    BufferAppend(&file, object->text.data, object->text.size);
+    if (hasData) {
+        Pad(&file, kPageSize);
+        BufferAppend(&file, object->data.data, object->data.size);
+    }
+
+    WriteFile(fileName, &file);
+    chmod(fileName, 0755);
+
+    BufferFree(&file);
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void Pad(TByteBuffer* buffer, size_t alignment) {
+    const unsigned char zero = 0;
+    while (alignment > 1 && buffer->size % alignment) {
+        BufferAppend(buffer, &zero, 1);
+    }
+}
+
+static Elf64_Half GetSectionIndex(SectionType section) {
+    switch (section) {
+        case TextSection:   return TextSectionIndex;
+        case DataSection:   return DataSectionIndex;
+        case BssSection:    return BssSectionIndex;
+        case UndefinedSection:
+        case ExternSection:
+        default:            return SHN_UNDEF;
+    }
+}
+
+static size_t AddString(TByteBuffer* strings, const char* string) {
+    size_t offset = strings->size;
+    BufferAppend(strings, string, strlen(string) + 1);
+    return offset;
+}
+
+static Elf64_Sym MakeSymbol(TByteBuffer* strings, TObjectSymbol* symbol, unsigned binding) {
+    Elf64_Sym result = {};
+    result.st_name = (Elf64_Word)AddString(strings, symbol->name);
+
+    if (symbol->section == ExternSection) {
+        result.st_info = (unsigned char)ELF64_ST_INFO(binding, STT_NOTYPE);
+        result.st_shndx = SHN_UNDEF;
+    } else {
+        bool isText = (symbol->section == TextSection);
+        result.st_info = (unsigned char)ELF64_ST_INFO(binding, (isText) ? STT_FUNC : STT_OBJECT);
+        result.st_shndx = GetSectionIndex(symbol->section);
+        result.st_value = symbol->offset;
+    }
+    return result;
+}
+
+static void WriteFile(const char* fileName, TByteBuffer* buffer) {
+    FILE* output = fopen(fileName, "wb");
+    if (!output) {
+        fprintf(stderr, "Error: cannot open '%s' for writing\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+
+    fwrite(buffer->data, sizeof(unsigned char), buffer->size, output);
+    fclose(output);
+}
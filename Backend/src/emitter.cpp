@@ -0,0 +1,187 @@
+#include "emitter.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kMaxLengthOfInteger = 24;
+
+static void Reserve(TEmitter* emitter, size_t size);
+static void EmitUnsigned(TEmitter* emitter, unsigned long long value);
+static void EmitSigned(TEmitter* emitter, long long value);
+
+// global ------------------------------------------------------------------------------------------
+
+void EmitterCtor(TEmitter* emitter, bool withComments) {
+    assert(emitter);
+
+    emitter->data = (char*)malloc(kInitialEmitterCapacity);
+    assert(emitter->data);
+    emitter->size = 0;
+    emitter->capacity = kInitialEmitterCapacity;
+    emitter->withComments = withComments;
+}
+
+void EmitterDtor(TEmitter* emitter) {
+    free(emitter->data);
+    emitter->data = NULL;
+    emitter->size = 0;
+    emitter->capacity = 0;
+}
+
+// Подмножество printf без stdio: %s %c %d %u %zu %lld %llu и %%
+void Emit(TEmitter* emitter, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    bool isComment = false;
+    bool isCommentLine = false; // комментарий занимает всю строку - перевод строки тоже не нужен
+    bool isQuoted = false;
+    for (const char* c = format; *c; ) {
+        if (*c != '%') {
+            const char* end = c;
+            while (*end && *end != '%') {
+                if (!emitter->withComments) {
+                    if (!isComment && *end == '"') {
+                        isQuoted = !isQuoted;
+                    } else if (!isComment && !isQuoted && *end == ';') {
+                        EmitText(emitter, c, (size_t)(end - c));
+                        isComment = true;
+                        isCommentLine = (!emitter->size || emitter->data[emitter->size - 1] == '\n');
+                        c = end;
+                    } else if (isComment && *end == '\n') {
+                        isComment = false;
+                        c = (isCommentLine) ? end + 1 : end;
+                    }
+                }
+                end++;
+            }
+            if (!isComment) {
+                EmitText(emitter, c, (size_t)(end - c));
+            }
+            c = end;
+            continue;
+        }
+
+        c++;
+        bool isLong = false;
+        while (*c == 'l' || *c == 'z') {
+            isLong = true;
+            c++;
+        }
+
+        switch (*c) {
+            case 's': {
+                const char* text = va_arg(args, const char*);
+                if (!isComment) {
+                    EmitText(emitter, text, strlen(text));
+                }
+                break;
+            }
+            case 'c': {
+                char symbol = (char)va_arg(args, int);
+                if (!isComment) {
+                    EmitText(emitter, &symbol, 1);
+                }
+                break;
+            }
+            case 'd': {
+                long long value = (isLong) ? va_arg(args, long long) : va_arg(args, int);
+                if (!isComment) {
+                    EmitSigned(emitter, value);
+                }
+                break;
+            }
+            case 'u': {
+                unsigned long long value = (isLong) ? va_arg(args, unsigned long long) : va_arg(args, unsigned);
+                if (!isComment) {
+                    EmitUnsigned(emitter, value);
+                }
+                break;
+            }
+            case '%':
+                if (!isComment) {
+                    EmitText(emitter, "%", 1);
+                }
+                break;
+            default:
+                fprintf(stderr, "Error: unsupported emitter format '%s'\n", format);
+                exit(EXIT_FAILURE);
+        }
+        c++;
+    }
+
+    va_end(args);
+}
+
+void EmitText(TEmitter* emitter, const char* text, size_t length) {
+    Reserve(emitter, length);
+    memcpy(emitter->data + emitter->size, text, length);
+    emitter->size += length;
+}
+
+// Текст с завершающим нулем для встроенного ассемблера
+const char* GetEmitterText(TEmitter* emitter) {
+    Reserve(emitter, 1);
+    emitter->data[emitter->size] = '\0';
+    return emitter->data;
+}
+
+void WriteEmitter(TEmitter* emitter, const char* fileName) {
+    int file = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0) {
+        fprintf(stderr, "Error: cannot open '%s' for writing\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t written = 0; written < emitter->size; ) {
+        ssize_t result = write(file, emitter->data + written, emitter->size - written);
+        if (result < 0) {
+            fprintf(stderr, "Error: cannot write '%s'\n", fileName);
+            exit(EXIT_FAILURE);
+        }
+        written += (size_t)result;
+    }
+    close(file);
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void Reserve(TEmitter* emitter, size_t size) {
+    if (emitter->size + size <= emitter->capacity) {
+        return;
+    }
+
+    size_t capacity = (emitter->capacity) ? emitter->capacity : kInitialEmitterCapacity;
+    while (capacity < emitter->size + size) {
+        capacity *= 2;
+    }
+    emitter->data = (char*)realloc(emitter->data, capacity);
+    assert(emitter->data);
+    emitter->capacity = capacity;
+}
+
+static void EmitUnsigned(TEmitter* emitter, unsigned long long value) {
+    char digits[kMaxLengthOfInteger] = "";
+    size_t position = kMaxLengthOfInteger;
+    do {
+        digits[--position] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    EmitText(emitter, digits + position, kMaxLengthOfInteger - position);
+}
+
+static void EmitSigned(TEmitter* emitter, long long value) {
+    if (value < 0) {
+        EmitText(emitter, "-", 1);
+        EmitUnsigned(emitter, 0 - (unsigned long long)value);
+    } else {
+        EmitUnsigned(emitter, (unsigned long long)value);
+    }
+}
@@ -0,0 +1,187 @@
+#include "jit.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "elfWriter.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kStubSize = 14; // jmp [rip + 0] ; dq address
+
+// Внешние символы программы связываются с функциями самого компилятора
+struct TRuntimeFunction {
+    const char* name;
+    uintptr_t address;
+};
+
+static const TRuntimeFunction kRuntimeFunctions[] = {
+    {"printf", (uintptr_t)&printf},
+    {"calloc", (uintptr_t)&calloc},
+    {"free",   (uintptr_t)&free},
+    {"exit",   (uintptr_t)&exit}, // --overflow=bignum: кончилась арена длинных чисел
+    {"sin",    (uintptr_t)(double (*)(double))&sin}, // --precise-math
+    {"cos",    (uintptr_t)(double (*)(double))&cos},
+    {"pthread_create", (uintptr_t)&pthread_create}, // parallel while
+    {"pthread_join",   (uintptr_t)&pthread_join},
+};
+
+// Код, заглушки для внешних функций, данные и .bss лежат в одном отображении: rel32 из кода достает до всего
+struct TJitImage {
+    unsigned char* base;
+    size_t codeSize; // выровнено по странице
+    size_t dataSize;
+    unsigned char* data;
+    unsigned char* bss;
+    void (*entry)();
+    void (*release)(); // rt_release: массивы и арена длинных чисел, оставшиеся от запуска
+};
+
+static void LoadImage(TObject* object, TJitImage* image);
+static uintptr_t FindTextSymbol(TObject* object, const uintptr_t* addresses, const char* name);
+static uintptr_t FindRuntimeFunction(const char* name);
+static size_t AlignToPage(size_t size);
+static double GetTime();
+
+// global ------------------------------------------------------------------------------------------
+
+// Выполняет программу внутри процесса компилятора; после каждого запуска runtime освобождает выделенную им память,
+// перед каждым запуском .data и .bss возвращаются к исходному виду
+void RunJit(TObject* object, size_t runs) {
+    TJitImage image = {};
+    LoadImage(object, &image);
+
+    double start = GetTime();
+    for (size_t i = 0; i < runs; i++) {
+        if (object->data.size) {
+            memcpy(image.data, object->data.data, object->data.size);
+        }
+        memset(image.bss, 0, object->bssSize);
+        image.entry();
+        if (image.release) {
+            image.release();
+        }
+    }
+    double elapsed = GetTime() - start;
+    fflush(stdout);
+
+    if (runs > 1) {
+        fprintf(stderr, "jit: %zu runs, %.2f us per run\n", runs, elapsed * 1e6 / (double)runs);
+    }
+
+    munmap(image.base, image.codeSize + image.dataSize);
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void LoadImage(TObject* object, TJitImage* image) {
+    size_t externCount = 0;
+    for (size_t i = 0; i < object->symbolCount; i++) {
+        externCount += (object->symbols[i].section == ExternSection && object->symbols[i].isReferenced);
+    }
+
+    size_t stubOffset = object->text.size;
+    image->codeSize = AlignToPage(stubOffset + externCount * kStubSize);
+    image->dataSize = AlignToPage(GetBssOffset(object) + object->bssSize);
+
+    void* memory = mmap(NULL, image->codeSize + image->dataSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        perror("Error: jit mmap");
+        exit(EXIT_FAILURE);
+    }
+    image->base = (unsigned char*)memory;
+    image->data = image->base + image->codeSize;
+    image->bss = image->data + GetBssOffset(object);
+    unsigned char* code = image->base;
+
+    memcpy(code, object->text.data, object->text.size);
+
+    // адрес каждого символа в образе; внешние функции вызываются через заглушки
+    uintptr_t* addresses = (uintptr_t*)calloc(object->symbolCount + 1, sizeof(uintptr_t));
+    assert(addresses);
+    unsigned char* stub = code + stubOffset;
+    for (size_t i = 0; i < object->symbolCount; i++) {
+        TObjectSymbol* symbol = &object->symbols[i];
+        if (symbol->section == TextSection) {
+            addresses[i] = (uintptr_t)(code + symbol->offset);
+        } else if (symbol->section == DataSection) {
+            addresses[i] = (uintptr_t)(image->data + symbol->offset);
+        } else if (symbol->section == BssSection) {
+            addresses[i] = (uintptr_t)(image->bss + symbol->offset);
+        } else if (symbol->isReferenced) {
+            uintptr_t target = FindRuntimeFunction(symbol->name);
+            memset(stub, 0, kStubSize);
+            stub[0] = 0xFF;
+            stub[1] = 0x25;
+            memcpy(stub + kStubSize - sizeof(target), &target, sizeof(target));
+            addresses[i] = (uintptr_t)stub;
+            stub += kStubSize;
+        }
+    }
+
+    for (size_t i = 0; i < object->relocationCount; i++) {
+        TRelocation* relocation = &object->relocations[i];
+        uintptr_t place = (uintptr_t)(code + relocation->offset);
+        int64_t value = (int64_t)(addresses[relocation->symbol] - place) + relocation->addend;
+        int32_t displacement = (int32_t)value;
+        assert(displacement == value);
+        memcpy(code + relocation->offset, &displacement, sizeof(displacement));
+    }
+
+    // точка входа - обычная функция без аргументов: runtime сам вызывает main1 с нужным выравниванием стека
+    uintptr_t entry = 0;
+    for (size_t i = 0; i < sizeof(kJitEntryNames) / sizeof(kJitEntryNames[0]) && !entry; i++) {
+        entry = FindTextSymbol(object, addresses, kJitEntryNames[i]);
+    }
+    uintptr_t release = FindTextSymbol(object, addresses, kJitReleaseName);
+    free(addresses);
+    if (!entry) {
+        fprintf(stderr, "Error: no entry point for jit\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // W^X: код становится исполняемым только после того, как в него перестали писать
+    if (mprotect(code, image->codeSize, PROT_READ | PROT_EXEC)) {
+        perror("Error: jit mprotect");
+        exit(EXIT_FAILURE);
+    }
+    image->entry = (void (*)())entry;
+    image->release = (void (*)())release;
+}
+
+static uintptr_t FindTextSymbol(TObject* object, const uintptr_t* addresses, const char* name) {
+    for (size_t i = 0; i < object->symbolCount; i++) {
+        if (object->symbols[i].section == TextSection && !strcmp(object->symbols[i].name, name)) {
+            return addresses[i];
+        }
+    }
+    return 0;
+}
+
+static uintptr_t FindRuntimeFunction(const char* name) {
+    for (size_t i = 0; i < sizeof(kRuntimeFunctions) / sizeof(kRuntimeFunctions[0]); i++) {
+        if (!strcmp(kRuntimeFunctions[i].name, name)) {
+            return kRuntimeFunctions[i].address;
+        }
+    }
+
+    fprintf(stderr, "Error: no runtime function for external symbol '%s'\n", name);
+    exit(EXIT_FAILURE);
+}
+
+static size_t AlignToPage(size_t size) {
+    return (size + kPageSize - 1) / kPageSize * kPageSize;
+}
+
+static double GetTime() {
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
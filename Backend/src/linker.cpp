@@ -0,0 +1,154 @@
+#include "linker.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kSectionAlignment = 16;
+const size_t kDataAlignment = 64; // строки кеша, на которые модуль разложил свои переменные
+const unsigned char kTextPadding = 0xCC; // int3 между кодом модулей
+
+struct TLinkedSection {
+    size_t text;
+    size_t data;
+    size_t bss;
+};
+
+static size_t AlignUp(size_t value, size_t alignment);
+static void AppendPadding(TByteBuffer* buffer, unsigned char byte, size_t alignment);
+static size_t FindDefinition(const TObject* result, const char* name);
+static size_t FindExtern(const TObject* result, const char* name);
+static size_t AddSymbol(TObject* result, const TObjectSymbol* symbol, size_t offset);
+
+// global ------------------------------------------------------------------------------------------
+
+// Объекты модулей склеиваются по секциям в один, как после ld -r: внешние символы, которые определены
+// глобально в другом объекте, связываются с определением, остальные (функции libc) остаются внешними
+void LinkObjects(const TObject* objects, size_t count, TObject* result) {
+    assert(objects);
+    assert(result);
+
+    TLinkedSection* bases = (TLinkedSection*)calloc(count + 1, sizeof(TLinkedSection));
+    size_t** indices = (size_t**)calloc(count + 1, sizeof(size_t*));
+    assert(bases && indices);
+
+    size_t symbolCount = 0;
+    size_t relocationCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        AppendPadding(&result->text, kTextPadding, kSectionAlignment);
+        AppendPadding(&result->data, 0, kDataAlignment);
+        bases[i] = {
+            .text = result->text.size,
+            .data = result->data.size,
+            .bss = AlignUp(result->bssSize, kDataAlignment),
+        };
+        BufferAppend(&result->text, objects[i].text.data, objects[i].text.size);
+        BufferAppend(&result->data, objects[i].data.data, objects[i].data.size);
+        result->bssSize = bases[i].bss + objects[i].bssSize;
+
+        symbolCount += objects[i].symbolCount;
+        relocationCount += objects[i].relocationCount;
+    }
+
+    result->symbols = (TObjectSymbol*)calloc(symbolCount + 1, sizeof(TObjectSymbol));
+    result->symbolCapacity = symbolCount + 1;
+    result->relocations = (TRelocation*)calloc(relocationCount + 1, sizeof(TRelocation));
+    result->relocationCapacity = relocationCount + 1;
+    assert(result->symbols && result->relocations);
+
+    for (size_t i = 0; i < count; i++) {
+        indices[i] = (size_t*)calloc(objects[i].symbolCount + 1, sizeof(size_t));
+        assert(indices[i]);
+
+        for (size_t j = 0; j < objects[i].symbolCount; j++) {
+            const TObjectSymbol* symbol = &objects[i].symbols[j];
+            if (symbol->section == ExternSection) {
+                continue;
+            }
+            size_t base = (symbol->section == TextSection) ? bases[i].text
+                        : (symbol->section == DataSection) ? bases[i].data : bases[i].bss;
+            if (symbol->isGlobal && FindDefinition(result, symbol->name) != result->symbolCount) {
+                fprintf(stderr, "Error: symbol '%s' is defined in two modules\n", symbol->name);
+                exit(EXIT_FAILURE);
+            }
+            indices[i][j] = AddSymbol(result, symbol, base + symbol->offset);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < objects[i].symbolCount; j++) {
+            const TObjectSymbol* symbol = &objects[i].symbols[j];
+            if (symbol->section != ExternSection) {
+                continue;
+            }
+            size_t index = FindDefinition(result, symbol->name);
+            if (index == result->symbolCount) {
+                index = FindExtern(result, symbol->name);
+            }
+            if (index == result->symbolCount) {
+                index = AddSymbol(result, symbol, 0);
+            }
+            result->symbols[index].isReferenced |= symbol->isReferenced;
+            indices[i][j] = index;
+        }
+
+        for (size_t j = 0; j < objects[i].relocationCount; j++) {
+            const TRelocation* relocation = &objects[i].relocations[j];
+            result->relocations[result->relocationCount++] = {
+                .offset = bases[i].text + relocation->offset,
+                .symbol = indices[i][relocation->symbol],
+                .type = relocation->type,
+                .addend = relocation->addend,
+            };
+        }
+        free(indices[i]);
+    }
+
+    free(indices);
+    free(bases);
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static size_t AlignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void AppendPadding(TByteBuffer* buffer, unsigned char byte, size_t alignment) {
+    while (buffer->size % alignment) {
+        BufferAppend(buffer, &byte, 1);
+    }
+}
+
+// Индекс глобального определения или symbolCount, если его нет
+static size_t FindDefinition(const TObject* result, const char* name) {
+    for (size_t i = 0; i < result->symbolCount; i++) {
+        const TObjectSymbol* symbol = &result->symbols[i];
+        if (symbol->isGlobal && symbol->section != ExternSection && !strcmp(symbol->name, name)) {
+            return i;
+        }
+    }
+    return result->symbolCount;
+}
+
+static size_t FindExtern(const TObject* result, const char* name) {
+    for (size_t i = 0; i < result->symbolCount; i++) {
+        if (result->symbols[i].section == ExternSection && !strcmp(result->symbols[i].name, name)) {
+            return i;
+        }
+    }
+    return result->symbolCount;
+}
+
+static size_t AddSymbol(TObject* result, const TObjectSymbol* symbol, size_t offset) {
+    assert(result->symbolCount < result->symbolCapacity);
+
+    TObjectSymbol* copy = &result->symbols[result->symbolCount];
+    *copy = *symbol;
+    copy->name = strdup(symbol->name);
+    assert(copy->name);
+    copy->offset = offset;
+    return result->symbolCount++;
+}
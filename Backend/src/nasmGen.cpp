@@ -4,327 +4,2495 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "astUtils.h"
+#include "assembler.h"
+#include "dataLayout.h"
+#include "emitter.h"
+#include "elfWriter.h"
+#include "jit.h"
+#include "parallelizer.h"
+#include "runtime.h"
+#include "superoptimizer.h"
+#include "vectorizer.h"
 
 // static ------------------------------------------------------------------------------------------
 
-static const char* const kNasmFileName = "nasm.s";
+static const char* const kFunctionPrefix = "fn_";
+
+static const char* const kArgumentRegisters[kMaxRegisterArguments] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+// rdx и rcx нужны при вычислении выражений, поэтому третий и четвертый параметры переезжают в r10 и r11
+static const char* const kLeafRegisters[kMaxRegisterArguments] = {"rdi", "rsi", "r10", "r11", "r8", "r9"};
+
+static const size_t kMaxLengthOfOperand = 64;
+static const char* const kMemoTablePrefix = "rt_memo_";
+static const unsigned long long kMemoHashMultiplier = 11400714819323198485ULL; // 2^64 / золотое сечение
+static const size_t kMemoProbes = 4; // записи подряд, в которых ищется ключ; при промахе вытесняется первая
+static const size_t kInitialSizeOfArrayVector = 8;
+static const size_t kInitialSizeOfFunctionVector = 64;
+static const size_t kMinFunctionsPerThread = 16; // поток дороже, чем генерация нескольких небольших функций
+static const size_t kInitialSizeOfLoopVector = 4;
+static const size_t kInitialSizeOfNameVector = 16;
+static const size_t kInitialSizeOfSelectVector = 4;
+static const size_t kInitialSizeOfSymbolTable = 16;
+static const char* const kParallelWorkerSuffix = ".parallel";
+static const unsigned long long kMaxJumpTableSize = 1024;
+static const size_t kMaxLinearCases = 3; // столько вариантов проверяются подряд, больше - делятся пополам
+static const size_t kMaxUnrolledZeroing = 8; // больше локальных переменных обнуляется циклом
+
+// Правый операнд двухадресной инструкции: непосредственное значение, память или регистр
+struct TOperand {
+    char text[kMaxLengthOfOperand];
+    bool isImmediate;
+    long long value;
+};
+
+// Адресное выражение base + index * scale + disp для lea
+// Функция генерируется в буфер потока, который ее взял; код собирается по порядку функций в программе
+struct TFunctionCode {
+    tNode* node;
+    TEmitter* emitter;
+    size_t offset;
+    size_t size;
+};
+
+struct TCodegenPool {
+    TSymbolTable* globals;
+    TFunctionCode* functions;
+    size_t functionCount;
+    size_t next; // следующая функция для свободного потока
+};
+
+struct TCodegenWorker {
+    TCodegenPool* pool;
+    TEmitter emitter;
+    pthread_t thread;
+};
+
+struct TAddress {
+    tNode* base;
+    tNode* index;
+    long long scale;
+    long long disp;
+};
+
+// Вариант switch: число из условия и номер if в цепочке, под которым стоит метка его тела
+struct TSwitchCase {
+    long long value;
+    size_t index;
+};
 
-static Operations GetOperationType(const char* const word);
 static TSymbol* FindSymbol(TSymbolTable* st, const char* name);
+static TSymbol* AddSymbol(TSymbolTable* st, const char* name, const char* initialValue);
 static void GetGlobals(TSymbolTable* st, tNode* node);
-static void GenerateCode(TSymbolTable* st, tNode* node, FILE* output);
-
-static void EmitNumber(FILE* output, tNode* node);
-static void EmitIdentifier(FILE* output, tNode* node);
-static void EmitSemicolon(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitEqual(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitPrint(FILE* output, tNode* node);
-static void EmitAdd(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitSub(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitMul(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitDiv(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitWhile(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitIf(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitIdentical(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitLess(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitGreater(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitNotIdentical(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitLessOrEqual(FILE* output, tNode* node, TSymbolTable* st);
-static void EmitGreaterOrEqual(FILE* output, tNode* node, TSymbolTable* st);
+static void GetLocals(TSymbolTable* st, tNode* node);
+static void GenerateCode(TSymbolTable* st, tNode* node, TEmitter* output);
+static void GetVariable(TSymbolTable* st, const char* name, char* operand);
+
+static bool ContainsCall(tNode* node);
+static void CheckCalls(const TFunctionTable* functions, tNode* node);
+static void CollectFunctions(tNode* node, Vector* functions);
+static void EmitLinkage(TEmitter* output, tNode* node, const TUnit* unit);
+static void EmitFunctions(TSymbolTable* globals, tNode* root, TEmitter* output, size_t threadCount);
+static void* GenerateFunctions(void* argument);
+static void EmitFunction(TSymbolTable* globals, tNode* node, TEmitter* output);
+static void EmitZeroLocals(TEmitter* output, TSymbolTable* st, size_t paramCount, bool isLeaf);
+static void EmitMemoTables(TEmitter* output, tNode* root);
+static void EmitMemoWrapper(TEmitter* output, tNode* node, size_t paramCount);
+
+static long long GetNumberValue(tNode* node);
+static bool IsImmediate(tNode* node, long long* value);
+static bool IsLeaf(tNode* node);
+static bool GetLeafOperand(tNode* node, TSymbolTable* st, TOperand* operand);
+static const char* LoadLeaf(TEmitter* output, TSymbolTable* st, tNode* node, const char* scratch);
+static void EmitOperands(TEmitter* output, tNode* node, TSymbolTable* st, TOperand* operand);
+static int GetPowerOfTwo(unsigned long long value);
+static void GetSignedMagic(long long divisor, long long* magic, int* shift);
+static bool MatchAddress(tNode* node, TAddress* address);
+static bool EmitLea(TEmitter* output, tNode* node, TSymbolTable* st);
+static bool EmitStoreTile(TEmitter* output, tNode* node, TSymbolTable* st);
+static const char* GetConditionCode(Operations op);
+static const char* GetInverseConditionCode(Operations op);
+static bool IsComparison(tNode* node);
+static void EmitCompare(TEmitter* output, tNode* node, TSymbolTable* st);
+static void CheckBignumLiterals(tNode* node);
+static size_t EmitBignumChecks(TEmitter* output, TSymbolTable* st, const TOperand* operand);
+static void EmitBignumCall(TEmitter* output, TSymbolTable* st, const char* function, const TOperand* operand,
+                           size_t number);
+static void EmitCheckedArithmetic(TEmitter* output, tNode* node, TSymbolTable* st, Operations op);
+static void EmitIntToFloat(TEmitter* output, TSymbolTable* st, const char* reg, const char* operand);
+static void EmitCondition(TEmitter* output, tNode* node, TSymbolTable* st, const char* falseLabel, size_t labelNumber);
+
+static bool IsFloat(TSymbolTable* st, tNode* node);
+static bool IsFloatComparison(TSymbolTable* st, tNode* node);
+static bool IsFloatParameter(TSymbolTable* st, tNode* callee, size_t index);
+static void GenerateFloatCode(TSymbolTable* st, tNode* node, TEmitter* output);
+static void LoadFloatConstant(TEmitter* output, double value, const char* reg);
+static void LoadFloatLeaf(TEmitter* output, TSymbolTable* st, tNode* node, const char* reg);
+static void EmitFloatOperands(TEmitter* output, tNode* node, TSymbolTable* st, char* source);
+static const char* GetFloatConditionCode(Operations op);
+static const char* GetInverseFloatConditionCode(Operations op);
+static Operations EmitFloatCompare(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitFloatArithmetic(TEmitter* output, tNode* node, TSymbolTable* st, Operations op);
+static void EmitSqrt(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitTrigonometry(TEmitter* output, tNode* node, TSymbolTable* st, Operations op);
+static void EmitFloatEqual(TEmitter* output, tNode* node, TSymbolTable* st);
+
+static void CollectStaticArrays(TSymbolTable* st, tNode* node);
+static void GetElementAddress(TEmitter* output, TSymbolTable* st, tNode* node, const char* indexRegister,
+                              char* address);
+static void EmitIndex(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitStore(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitArray(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitVectorWhile(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitVectorLoop(TEmitter* output, tNode* node, TSymbolTable* st, TVectorLoop* vector, bool isAvx,
+                           size_t labelNumber);
+static void EmitVectorStatements(TEmitter* output, tNode* node, TSymbolTable* st, TVectorLoop* vector,
+                                 tNode* update, bool isAvx);
+static int EmitVectorExpression(TEmitter* output, tNode* node, TSymbolTable* st, TVectorLoop* vector, int reg,
+                                bool isAvx);
+static void EmitReductionTotal(TEmitter* output, TSymbolTable* st, TVectorLoop* vector, const char* name);
+
+static void GetWorkerLabel(TSymbolTable* st, size_t index, char* label);
+static bool IsFrameVariable(TSymbolTable* st, const char* name);
+static void GetParentVariable(TSymbolTable* st, const char* name, char* operand);
+static void EmitParallelWhile(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitParallelWorkers(TEmitter* output, TSymbolTable* st);
+static void EmitParallelWorker(TEmitter* output, TSymbolTable* st, tNode* node, size_t index);
+
+static void EmitNumber(TEmitter* output, tNode* node);
+static void EmitIdentifier(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitSemicolon(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitEqual(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitPrint(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitAdd(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitSub(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitMul(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitDiv(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitWhile(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitIf(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitSelectIf(TEmitter* output, tNode* node, TSymbolTable* st);
+static const char* EmitSelectCondition(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitSwitch(TEmitter* output, tNode* node, TSymbolTable* st);
+static void EmitJumpTable(TEmitter* output, const TSwitchCase* cases, size_t count, size_t label);
+static void EmitSearchTree(TEmitter* output, const TSwitchCase* cases, size_t count, size_t label);
+static void EmitCaseCompare(TEmitter* output, long long value);
+static int CompareCases(const void* first, const void* second);
+static void CollectSelectStatements(tNode* node, Vector* statements);
+static bool UsesRdx(tNode* node);
+static void EmitComparison(TEmitter* output, tNode* node, TSymbolTable* st, Operations op);
+static void EmitCall(TEmitter* output, tNode* node, TSymbolTable* st);
+static long long GetArgumentValue(TSymbolTable* st, tNode* callee, size_t index, tNode* arg);
+static void EmitReturn(TEmitter* output, tNode* node, TSymbolTable* st);
 
 // global ------------------------------------------------------------------------------------------
 
-void RunGenerator(tNode* root) {
-    FILE* output = fopen(kNasmFileName, "w");
-    assert(output);
+void RunGenerator(tNode* root, const Options* options, TTypeInfo* types) {
+    // для встроенного ассемблера текст остается в памяти, nasm.s записывается одним вызовом write
+    TEmitter emitter = {};
+    EmitterCtor(&emitter, options->emitComments);
+    TEmitter* output = &emitter;
+
+    // с длинными числами parallel while выполняется одним потоком: арена runtime общая
+    TUnit unit = {
+        .exports = {},
+        .hasParallelLoops = ContainsParallelLoop(root) && options->overflow != BignumOverflow,
+    };
+    GenerateUnit(root, options, types, &unit, output);
+
+    if (options->outputFormat == AsmOutput) {
+        WriteEmitter(output, kNasmFileName);
+    } else {
+        TObject object = {};
+        Assemble(GetEmitterText(output), &object);
+        if (options->outputFormat == ObjectOutput) {
+            WriteObjectFile(kObjectFileName, &object);
+        } else if (options->outputFormat == JitOutput) {
+            RunJit(&object, options->jitRuns);
+        } else {
+            WriteExecutable(kExecutableFileName, &object);
+        }
+
+        ObjectDtor(&object);
+    }
+
+    EmitterDtor(output);
+}
+
+// Программа - runtime, глобальные переменные, main1 и функции. Модуль --separate (options->module) - только
+// функции: runtime и функции других модулей он берет через extern, а unit->exports отдает другим объектам
+void GenerateUnit(tNode* root, const Options* options, TTypeInfo* types, const TUnit* unit, TEmitter* output) {
+    bool isBignum = options->overflow == BignumOverflow;
+    if (options->module) {
+        EmitRuntimeSymbols(output, options, ContainsParallelLoop(root), "extern");
+    } else {
+        EmitRuntime(output, options, unit->hasParallelLoops);
+        if (options->separateCompilation) {
+            EmitRuntimeSymbols(output, options, unit->hasParallelLoops, "global");
+        }
+    }
+    EmitLinkage(output, root, unit);
+    TEmitter slowPaths = {};
+    if (isBignum) {
+        CheckBignumLiterals(root);
+        EmitterCtor(&slowPaths, options->emitComments);
+    }
 
-    fprintf(output, "global main\n");
-    fprintf(output, "extern sin, cos, sqrt, printf\n");
-    
+    TFunctionTable functions = {};
+    FunctionTableCtor(&functions, root);
     TSymbolTable st = {
         .count = 0,
+        .types = types,
+        .functions = &functions,
+        .function = NULL,
+        .preciseMath = options->preciseMath,
+        .staticArrays = {},
+        .labelCount = 0,
+        .parallelLoops = {},
+        .inParallelLoop = false,
+        .slowPaths = (isBignum) ? &slowPaths : NULL,
     };
+    vectorInit(&st.staticArrays, kInitialSizeOfArrayVector);
+    vectorInit(&st.parallelLoops, kInitialSizeOfLoopVector);
     GetGlobals(&st, root); // найти все глобальные переменные 
-
-    fprintf(output, "\nsection .data\n");
-    fprintf(output, "    fmt db \"%%zu\", 10, 0\n");
+    CheckCalls(&functions, root);
 
     for (size_t i = 0; i < st.count; i++) {
-        fprintf(output, "    %s dq %s\n", st.symbols[i].name, st.symbols[i].initialValue);
-    } // распечатать все глобалки в цикле 
+        if (IsFloatVariable(types, NULL, st.symbols[i].name)) { // dq с битами double
+            snprintf(st.symbols[i].initialValue, kMaxLengthOfNumber, "%llu",
+                     GetDoubleBits(strtod(st.symbols[i].initialValue, NULL)));
+        }
+    }
 
-    fprintf(output, "section .text\n");
-    fprintf(output, "main:\n");
-    fprintf(output, "    call main1\n");
-    fprintf(output, "    mov rax, 60\n");
-    fprintf(output, "    xor rdi, rdi\n");
-    fprintf(output, "    syscall\n");
+    Emit(output, "\nsection .data\n");
+    EmitGlobalData(output, root, st.symbols, st.count);
+
+    CollectStaticArrays(&st, root);
+    Emit(output, "section .bss\n");
+    for (size_t i = 0; i < st.staticArrays.size; i++) {
+        long long size = 0;
+        GetNumber(((tNode*)st.staticArrays.data[i])->left, &size);
+        Emit(output, "    align %zu\n", kCacheLineSize); // потоки parallel while пишут в соседние массивы
+        Emit(output, "    rt_array%zu resq %lld\n", i, size);
+    }
+    EmitMemoTables(output, root);
 
+    Emit(output, "section .text\n");
+    size_t codeStart = output->size;
+    if (!options->module) {
+        Emit(output, "main1:\n");
+        GenerateCode(&st, root, output); // TODO генерация кода
+        Emit(output, ".return:\n");
+        Emit(output, "    ret\n");
+    }
+    if (isBignum) {
+        EmitText(output, GetEmitterText(&slowPaths), slowPaths.size);
+    }
+    EmitParallelWorkers(output, &st);
 
-    fprintf(output, "\nmain1:\n");
-    GenerateCode(&st, root, output); // TODO генерация кода
-    fprintf(output, "    ret\n");
+    EmitFunctions(&st, root, output, options->codegenThreads);
+    Superoptimize(output, codeStart, options);
 
-    fclose(output);
+    if (isBignum) {
+        EmitterDtor(&slowPaths);
+    }
+    vectorFree(&st.parallelLoops);
+    vectorFree(&st.staticArrays);
+    free(st.symbols);
+    FunctionTableDtor(&functions);
 }
 
 // static ------------------------------------------------------------------------------------------
 
-static void GenerateCode(TSymbolTable* st, tNode* node, FILE* output) {
+static void GenerateCode(TSymbolTable* st, tNode* node, TEmitter* output) {
     if (!node) {
         return;
     }
+    if (node->type == Operation && IsFloat(st, node)) {
+        GenerateFloatCode(st, node, output);
+        Emit(output, "    movq rax, xmm0\n"); // double там, где ждут целое, передается битами
+        return;
+    }
 
     switch(node->type) {
         case Number:                    EmitNumber(output, node); break;
-        case Identifier:                EmitIdentifier(output, node); break;
+        case Identifier:                EmitIdentifier(output, node, st); break;
+        case Calling:                   EmitCall(output, node, st); break;
+        case Function:                  break; // тела функций генерируются в EmitFunctions
         case Operation: {
             switch (GetOperationType(node->value)) {
                 case Semicolon:         EmitSemicolon(output, node, st); break;
                 case Equal:             EmitEqual(output, node, st); break;
-                case Print:             EmitPrint(output, node); break;
+                case Print:             EmitPrint(output, node, st); break;
                 case Add:               EmitAdd(output, node, st); break;
                 case Sub:               EmitSub(output, node, st); break;
                 case Mul:               EmitMul(output, node, st); break;
                 case Div:               EmitDiv(output, node, st); break;
                 case While:             EmitWhile(output, node, st); break;
                 case If:                EmitIf(output, node, st); break;
-                case Identical:         EmitIdentical(output, node, st); break;
-                case Less:              EmitLess(output, node, st); break;
-                case Greater:           EmitGreater(output, node, st); break;
-                case NotIdentical:      EmitNotIdentical(output, node, st); break;
-                case LessOrEqual:       EmitLessOrEqual(output, node, st); break;
-                case GreaterOrEqual:    EmitGreaterOrEqual(output, node, st); break;
+                case SelectIf:          EmitSelectIf(output, node, st); break;
+                case Switch:            EmitSwitch(output, node, st); break;
+                case Return:            EmitReturn(output, node, st); break;
+                case Index:             EmitIndex(output, node, st); break;
+                case Store:             EmitStore(output, node, st); break;
+                case Array:             EmitArray(output, node, st); break;
+                case VectorWhile:       EmitVectorWhile(output, node, st); break;
+                case ParallelWhile:
+                    if (st->inParallelLoop || st->slowPaths) {
+                        EmitWhile(output, node, st);
+                    } else {
+                        EmitParallelWhile(output, node, st);
+                    }
+                    break;
+                case Memoize:           GenerateCode(st, node->left, output); break;
+                case Identical:
+                case Less:
+                case Greater:
+                case NotIdentical:
+                case LessOrEqual:
+                case GreaterOrEqual:    EmitComparison(output, node, st, GetOperationType(node->value)); break;
+                default:                break;
             }
+            break;
         }
+        default: break;
     }
 }
 
 static void GetGlobals(TSymbolTable* st, tNode* node) {
-    if (!node) {
-        return;
+    if (!node || node->type == Function) {
+        return; // у функций своя область видимости
     }
 
     if ((node->type == Operation) && (GetOperationType(node->value) == Equal)) {
         TSymbol* sym = FindSymbol(st, node->left->value);
         if (!sym) {
-            for (size_t i = 0; node->right->value[i]; i++) {
-                assert(isdigit(node->right->value[i]));
-            }
-            strncpy(st->symbols[st->count].name, node->left->value, kMaxLengthOfSymbol);
-            strncpy(st->symbols[st->count].initialValue, node->right->value, kMaxLengthOfNumber);
-            st->count++;
+            AddSymbol(st, node->left->value, (node->right->type == Number) ? node->right->value : "0");
         }
+    } else if (node->type == Identifier && !FindSymbol(st, node->value)) {
+        AddSymbol(st, node->value, "0");
     }
 
     GetGlobals(st, node->left);
     GetGlobals(st, node->right);
 }
 
+// Локальные переменные функции: все, чему она присваивает, кроме глобальных
+static void GetLocals(TSymbolTable* st, tNode* node) {
+    if (!node) {
+        return;
+    }
+
+    if ((node->type == Operation) && (GetOperationType(node->value) == Equal) && !FindSymbol(st, node->left->value)) {
+        AddSymbol(st, node->left->value, "0");
+    }
+
+    GetLocals(st, node->left);
+    GetLocals(st, node->right);
+}
+
 static TSymbol* FindSymbol(TSymbolTable* st, const char* name) {
     for (size_t i = 0; i < st->count; i++) {
         if (!strcmp(st->symbols[i].name, name)) {
             return &(st->symbols[i]);
         }
     }
-    return NULL;
+    return (st->parent) ? FindSymbol(st->parent, name) : NULL;
 }
 
-static Operations GetOperationType(const char* const word) {
-    assert(word);          
+static TSymbol* AddSymbol(TSymbolTable* st, const char* name, const char* initialValue) {
+    if (strlen(name) >= kMaxLengthOfSymbol) {
+        fprintf(stderr, "Error: name of variable '%s' is longer than %zu characters\n", name, kMaxLengthOfSymbol - 1);
+        exit(EXIT_FAILURE);
+    }
+    if (st->count == st->capacity) {
+        st->capacity = (st->capacity) ? 2 * st->capacity : kInitialSizeOfSymbolTable;
+        st->symbols = (TSymbol*)realloc(st->symbols, st->capacity * sizeof(TSymbol));
+        assert(st->symbols);
+    }
 
-         if (!strcmp(word, "if"    )) return If;                // done
-    else if (!strcmp(word, "+"     )) return Add;               // done
-    else if (!strcmp(word, "-"     )) return Sub;               // done
-    else if (!strcmp(word, "*"     )) return Mul;               // done
-    else if (!strcmp(word, "/"     )) return Div;               // done
-    else if (!strcmp(word, "sin"   )) return Sin; // done
-    else if (!strcmp(word, "cos"   )) return Cos; // done
-    else if (!strcmp(word, "sqrt"  )) return Sqrt; // done
-    else if (!strcmp(word, "<"     )) return Less;              // done
-    else if (!strcmp(word, "while" )) return While;             // done
-    else if (!strcmp(word, "="     )) return Equal;             // done
-    else if (!strcmp(word, "print" )) return Print;             // done
-    else if (!strcmp(word, "return")) return Return; // done
-    else if (!strcmp(word, ">"     )) return Greater;           // done
-    else if (!strcmp(word, ";"     )) return Semicolon;         // done
-    else if (!strcmp(word, "=="    )) return Identical;         // done
-    else if (!strcmp(word, "<="    )) return LessOrEqual;       // done
-    else if (!strcmp(word, "!="    )) return NotIdentical;      // done
-    else if (!strcmp(word, ">="    )) return GreaterOrEqual;    // done
+    TSymbol* sym = &st->symbols[st->count++];
+    memset(sym, 0, sizeof(TSymbol));
+    strncpy(sym->name, name, kMaxLengthOfSymbol - 1);
+    strncpy(sym->initialValue, initialValue, kMaxLengthOfNumber - 1);
 
-    else return NoOperation;
+    return sym;
 }
 
-static void EmitNumber(FILE* output, tNode* node) {
-    fprintf(output, "\n    push %s; Number\n", node->value);
+static void GetVariable(TSymbolTable* st, const char* name, char* operand) {
+    TSymbol* sym = FindSymbol(st, name);
+    if (!sym) {
+        fprintf(stderr, "Error: undefined variable '%s'\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (sym->reg) {
+        snprintf(operand, kMaxLengthOfOperand, "%s", sym->reg);
+    } else if (sym->offset) {
+        snprintf(operand, kMaxLengthOfOperand, "qword [rbp %c %d]", (sym->offset < 0) ? '-' : '+', abs(sym->offset));
+    } else {
+        snprintf(operand, kMaxLengthOfOperand, "qword [%s]", sym->name);
+    }
 }
 
-static void EmitIdentifier(FILE* output, tNode* node) {
-    fprintf(output, "\n    mov rax, [%s]; start Identifier\n", node->value);
-    fprintf(output, "    push rax; end Identifier\n");
+// instruction selection ---------------------------------------------------------------------------
+
+static long long GetNumberValue(tNode* node) {
+    assert(node && node->type == Number);
+
+    return (long long)strtoull(node->value, NULL, 10);
 }
 
-static void EmitSemicolon(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->left, output);
-    GenerateCode(st, node->right, output);
+static bool IsImmediate(tNode* node, long long* value) {
+    if (!node || node->type != Number || IsFloatLiteral(node)) {
+        return false;
+    }
+
+    *value = GetNumberValue(node);
+    return (*value >= INT32_MIN) && (*value <= INT32_MAX); // imm32 со знаковым расширением
 }
 
-static void EmitEqual(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->right, output);
-    fprintf(output, "\n    pop rax; start Equal\n");
-    fprintf(output, "    mov [%s], rax; end Equal\n", node->left->value); 
+static bool IsLeaf(tNode* node) {
+    return node && ((node->type == Number) || (node->type == Identifier));
 }
 
-static void EmitPrint(FILE* output, tNode* node) {
-    fprintf(output, "\n    mov rsi, [%s]; start Print\n", node->left->value);  
-    fprintf(output, "    mov rdi, fmt\n");
-    fprintf(output, "    xor rax, rax\n");
-    fprintf(output, "    call printf; end Print\n");
+static bool GetLeafOperand(tNode* node, TSymbolTable* st, TOperand* operand) {
+    operand->isImmediate = false;
+    operand->value = 0;
+
+    if (IsImmediate(node, &operand->value)) {
+        operand->isImmediate = true;
+        snprintf(operand->text, kMaxLengthOfOperand, "%lld", operand->value);
+        return true;
+    }
+    if (node && node->type == Identifier) {
+        GetVariable(st, node->value, operand->text);
+        return true;
+    }
+    return false;
 }
 
-static void EmitAdd(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->left, output);
-    GenerateCode(st, node->right, output);
+// Регистр со значением переменной: ее собственный или scratch после загрузки
+static const char* LoadLeaf(TEmitter* output, TSymbolTable* st, tNode* node, const char* scratch) {
+    TSymbol* sym = FindSymbol(st, node->value);
+    if (sym && sym->reg) {
+        return sym->reg;
+    }
 
-    fprintf(output, "\n    pop rbx; start Add\n");
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    add rax, rbx\n");
-    fprintf(output, "    push rax; end Add\n");
+    char operand[kMaxLengthOfOperand] = "";
+    GetVariable(st, node->value, operand);
+    Emit(output, "    mov %s, %s\n", scratch, operand);
+    return scratch;
 }
 
-static void EmitSub(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->left, output);
+// Левый операнд попадает в rax, правый описывается operand (imm, память или rcx)
+static void EmitOperands(TEmitter* output, tNode* node, TSymbolTable* st, TOperand* operand) {
+    if (GetLeafOperand(node->right, st, operand)) {
+        GenerateCode(st, node->left, output);
+        return;
+    }
+
     GenerateCode(st, node->right, output);
+    if (IsLeaf(node->left)) {
+        Emit(output, "    mov rcx, rax\n");
+        GenerateCode(st, node->left, output);
+    } else {
+        Emit(output, "    push rax\n");
+        GenerateCode(st, node->left, output);
+        Emit(output, "    pop rcx\n");
+    }
 
-    fprintf(output, "\n    pop rbx; start Sub\n");
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    sub rax, rbx\n");
-    fprintf(output, "    push rax; end Sub\n");
+    operand->isImmediate = false;
+    strncpy(operand->text, "rcx", kMaxLengthOfOperand);
 }
 
-static void EmitMul(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->left, output);
-    GenerateCode(st, node->right, output);
+static int GetPowerOfTwo(unsigned long long value) {
+    if (!value || (value & (value - 1))) {
+        return -1;
+    }
 
-    fprintf(output, "\n    pop rbx; start Mul\n");
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    imul rax, rbx\n");
-    fprintf(output, "    push rax; end Mul\n");
+    int power = 0;
+    while (value >>= 1) {
+        power++;
+    }
+    return power;
 }
 
-static void EmitDiv(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->left, output);
-    GenerateCode(st, node->right, output);
+// Магическое число для знакового деления на константу (Hacker's Delight, 10-1), |divisor| >= 2
+static void GetSignedMagic(long long divisor, long long* magic, int* shift) {
+    const unsigned long long kTwo63 = 1ULL << 63;
+
+    unsigned long long ad = (divisor < 0) ? -(unsigned long long)divisor : (unsigned long long)divisor;
+    unsigned long long t = kTwo63 + ((unsigned long long)divisor >> 63);
+    unsigned long long anc = t - 1 - t % ad;
+    int p = 63;
+    unsigned long long q1 = kTwo63 / anc;
+    unsigned long long r1 = kTwo63 - q1 * anc;
+    unsigned long long q2 = kTwo63 / ad;
+    unsigned long long r2 = kTwo63 - q2 * ad;
+    unsigned long long delta = 0;
+
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
 
-    fprintf(output, "\n    pop rbx; start Div\n");
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    cqo\n"); // signed extension rax -> rdx:rax
-    fprintf(output, "    idiv rbx\n"); 
-    fprintf(output, "    push rax; end Div\n"); 
+    *magic = (long long)(q2 + 1);
+    if (divisor < 0) {
+        *magic = -*magic;
+    }
+    *shift = p - 64;
 }
 
-static void EmitWhile(FILE* output, tNode* node, TSymbolTable* st) {
-    static size_t whileCounter = 0;
-    size_t currentWhile = whileCounter++;
-    
-    fprintf(output, "\n.while%zu:; start While\n", currentWhile);
+// Раскладывает сумму на base + index * scale + disp, где base и index - переменные
+static bool MatchAddress(tNode* node, TAddress* address) {
+    *address = {};
 
-    GenerateCode(st, node->left, output);
+    tNode* terms[2] = {};
+    long long scales[2] = {};
+    size_t termCount = 0;
 
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    test rax, rax\n");
-    fprintf(output, "    jz .endwhile%zu\n", currentWhile);
+    tNode* stack[8] = {node};
+    size_t top = 1;
+    while (top) {
+        tNode* current = stack[--top];
+        long long value = 0;
+        if (current->type == Operation && GetOperationType(current->value) == Add) {
+            if (top + 2 > sizeof(stack) / sizeof(stack[0])) {
+                return false;
+            }
+            stack[top++] = current->right;
+            stack[top++] = current->left;
+        } else if (current->type == Operation && GetOperationType(current->value) == Sub
+                   && IsImmediate(current->right, &value)) {
+            address->disp -= value;
+            stack[top++] = current->left;
+        } else if (IsImmediate(current, &value)) {
+            address->disp += value;
+        } else if (termCount < 2 && current->type == Identifier) {
+            terms[termCount] = current;
+            scales[termCount++] = 1;
+        } else if (termCount < 2 && current->type == Operation && GetOperationType(current->value) == Mul
+                   && current->left->type == Identifier && IsImmediate(current->right, &value)
+                   && (value == 2 || value == 3 || value == 4 || value == 5 || value == 8 || value == 9)) {
+            terms[termCount] = current->left;
+            scales[termCount++] = value;
+        } else {
+            return false;
+        }
+    }
 
-    GenerateCode(st, node->right, output);
+    if (address->disp < INT32_MIN || address->disp > INT32_MAX || !termCount) {
+        return false;
+    }
+
+    if (termCount == 1) {
+        address->index = terms[0];
+        address->scale = scales[0];
+        if (scales[0] == 3 || scales[0] == 5 || scales[0] == 9) {
+            address->base = terms[0];
+            address->scale--;
+        }
+        // x + c и x * 2 дешевле обычными add/shl
+        return (address->scale > 1) && (address->base || address->disp);
+    }
 
-    fprintf(output, "    jmp .while%zu\n", currentWhile);
-    fprintf(output, ".endwhile%zu:; end While\n", currentWhile);
+    // база уже занята вторым слагаемым: x * 3 = x + x * 2 не получить
+    if ((scales[0] != 1 && scales[1] != 1) || scales[0] == 3 || scales[0] == 5 || scales[0] == 9
+        || scales[1] == 3 || scales[1] == 5 || scales[1] == 9) {
+        return false;
+    }
+    if (scales[0] != 1) {
+        address->base = terms[1];
+        address->index = terms[0];
+        address->scale = scales[0];
+    } else {
+        address->base = terms[0];
+        address->index = terms[1];
+        address->scale = scales[1];
+    }
+    // a + b выгоднее как mov + add с операндом в памяти
+    return address->scale > 1;
 }
 
-static void EmitIf(FILE* output, tNode* node, TSymbolTable* st) {
-    static size_t ifCounter = 0;
-    size_t currentIf = ifCounter++;
+static bool EmitLea(TEmitter* output, tNode* node, TSymbolTable* st) {
+    TAddress address = {};
+    if (!MatchAddress(node, &address)) {
+        return false;
+    }
 
-    GenerateCode(st, node->left, output);
+    Emit(output, "\n; start Lea\n");
+    const char* index = LoadLeaf(output, st, address.index, "rax");
+    if (address.base && address.base != address.index) {
+        const char* base = LoadLeaf(output, st, address.base, "rcx");
+        Emit(output, "    lea rax, [%s + %s * %lld + %lld]; end Lea\n", base, index, address.scale, address.disp);
+    } else if (address.base) {
+        Emit(output, "    lea rax, [%s + %s * %lld + %lld]; end Lea\n", index, index, address.scale, address.disp);
+    } else {
+        Emit(output, "    lea rax, [%s * %lld + %lld]; end Lea\n", index, address.scale, address.disp);
+    }
+
+    return true;
+}
 
-    fprintf(output, "\n    pop rax; start If\n");
-    fprintf(output, "    test rax, rax\n");
-    fprintf(output, "    jz .endif%zu\n", currentIf);
+// x = x op y и x = imm выполняются прямо над памятью
+static bool EmitStoreTile(TEmitter* output, tNode* node, TSymbolTable* st) {
+    tNode* dest = node->left;
+    tNode* expr = node->right;
+    TOperand operand = {};
 
-    GenerateCode(st, node->right, output);
+    char destination[kMaxLengthOfOperand] = "";
+    GetVariable(st, dest->value, destination);
+
+    if (IsImmediate(expr, &operand.value)) {
+        Emit(output, "\n    mov %s, %lld; Store\n", destination, operand.value);
+        return true;
+    }
+
+    if (expr->type == Identifier) {
+        GetLeafOperand(expr, st, &operand);
+        if (strchr(destination, '[') && strchr(operand.text, '[')) {
+            return false;
+        }
+        Emit(output, "\n    mov %s, %s; Store\n", destination, operand.text);
+        return true;
+    }
+
+    if (expr->type != Operation || st->slowPaths) {
+        return false; // с длинными числами сложение проверяется на переполнение
+    }
+    Operations op = GetOperationType(expr->value);
+    if ((op != Add && op != Sub) || expr->left->type != Identifier || strcmp(expr->left->value, dest->value)
+        || !GetLeafOperand(expr->right, st, &operand)) {
+        return false;
+    }
 
-    fprintf(output, ".endif%zu:; end If\n", currentIf);
+    const char* instruction = (op == Add) ? "add" : "sub";
+    bool bothInMemory = strchr(destination, '[') && strchr(operand.text, '[');
+    if (operand.isImmediate && operand.value == 1) {
+        Emit(output, "\n    %s %s; Store\n", (op == Add) ? "inc" : "dec", destination);
+    } else if (!bothInMemory) {
+        Emit(output, "\n    %s %s, %s; Store\n", instruction, destination, operand.text);
+    } else {
+        Emit(output, "\n    mov rax, %s; start Store\n", operand.text);
+        Emit(output, "    %s %s, rax; end Store\n", instruction, destination);
+    }
+    return true;
 }
 
-static void EmitIdentical(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->left, output);
-    GenerateCode(st, node->right, output);
+static const char* GetConditionCode(Operations op) {
+    switch (op) {
+        case Identical:         return "e";
+        case NotIdentical:      return "ne";
+        case Less:              return "l";
+        case Greater:           return "g";
+        case LessOrEqual:       return "le";
+        case GreaterOrEqual:    return "ge";
+        default:                assert(0);
+    }
+}
 
-    fprintf(output, "\n    pop rbx; start Identical\n");
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    cmp rax, rbx\n");
-    fprintf(output, "    sete al\n");     
-    fprintf(output, "    movzx rax, al\n"); 
-    fprintf(output, "    push rax; end Identical\n");
+static const char* GetInverseConditionCode(Operations op) {
+    switch (op) {
+        case Identical:         return "ne";
+        case NotIdentical:      return "e";
+        case Less:              return "ge";
+        case Greater:           return "le";
+        case LessOrEqual:       return "g";
+        case GreaterOrEqual:    return "l";
+        default:                assert(0);
+    }
 }
 
-static void EmitLess(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->left, output);
-    GenerateCode(st, node->right, output);
+static bool IsComparison(tNode* node) {
+    if (!node || node->type != Operation) {
+        return false;
+    }
 
-    fprintf(output, "\n    pop rbx; start Less\n");
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    cmp rax, rbx\n");
-    fprintf(output, "    setl al\n");     
-    fprintf(output, "    movzx rax, al\n"); 
-    fprintf(output, "    push rax; end Less\n");
+    Operations op = GetOperationType(node->value);
+    return op == Identical || op == NotIdentical || op == Less || op == Greater
+        || op == LessOrEqual || op == GreaterOrEqual;
 }
 
-static void EmitGreater(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->left, output);
-    GenerateCode(st, node->right, output);
+static void EmitCompare(TEmitter* output, tNode* node, TSymbolTable* st) {
+    TOperand operand = {};
+    EmitOperands(output, node, st, &operand);
+    size_t number = (st->slowPaths) ? EmitBignumChecks(output, st, &operand) : 0;
 
-    fprintf(output, "\n    pop rbx; start Greater\n");
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    cmp rax, rbx\n");
-    fprintf(output, "    setg al\n");     
-    fprintf(output, "    movzx rax, al\n"); 
-    fprintf(output, "    push rax; end Greater\n");
+    if (operand.isImmediate && !operand.value) {
+        Emit(output, "    test rax, rax\n");
+    } else {
+        Emit(output, "    cmp rax, %s\n", operand.text);
+    }
+    if (st->slowPaths) {
+        EmitBignumCall(output, st, "compare", &operand, number); // флаги как у cmp
+    }
 }
 
-static void EmitNotIdentical(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->left, output);
-    GenerateCode(st, node->right, output);
+// Сравнение в условии сливается с переходом: cmp + jcc вместо setcc/test/jz
+static void EmitCondition(TEmitter* output, tNode* node, TSymbolTable* st, const char* falseLabel, size_t labelNumber) {
+    if (IsFloatComparison(st, node)) {
+        Operations op = EmitFloatCompare(output, node, st);
+        Emit(output, "    j%s %s%zu\n", GetInverseFloatConditionCode(op), falseLabel, labelNumber);
+        return;
+    }
+    if (IsFloat(st, node)) {
+        GenerateFloatCode(st, node, output);
+        Emit(output, "    xorpd xmm1, xmm1\n");
+        Emit(output, "    ucomisd xmm0, xmm1\n");
+        Emit(output, "    je %s%zu\n", falseLabel, labelNumber);
+        return;
+    }
+    if (IsComparison(node)) {
+        EmitCompare(output, node, st);
+        Emit(output, "    j%s %s%zu\n", GetInverseConditionCode(GetOperationType(node->value)),
+                falseLabel, labelNumber);
+        return;
+    }
 
-    fprintf(output, "\n    pop rbx; start NotIdentical\n");
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    cmp rax, rbx\n");
-    fprintf(output, "    setne al\n");     
-    fprintf(output, "    movzx rax, al\n"); 
-    fprintf(output, "    push rax; end NotIdentical\n");
+    GenerateCode(st, node, output);
+    Emit(output, "    test rax, rax\n");
+    Emit(output, "    jz %s%zu\n", falseLabel, labelNumber);
 }
 
-static void EmitLessOrEqual(FILE* output, tNode* node, TSymbolTable* st) {
-    GenerateCode(st, node->left, output);
-    GenerateCode(st, node->right, output);
+// arbitrary precision -----------------------------------------------------------------------------
+
+// Номера длинных чисел занимают самые большие значения слова, и литерал из этого диапазона был бы номером
+static void CheckBignumLiterals(tNode* node) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Number && !IsFloatLiteral(node)
+        && strtoull(node->value, NULL, 10) > (unsigned long long)kMaxSmallInteger) {
+        fprintf(stderr, "Error: integer literal %s does not fit in a machine word with --overflow=bignum, "
+                        "the largest is %lld\n", node->value, kMaxSmallInteger);
+        exit(EXIT_FAILURE);
+    }
+    CheckBignumLiterals(node->left);
+    CheckBignumLiterals(node->right);
+}
+
+// cmp x, kBignumCheck переполняется, только если x - номер длинного числа. Возвращает номер меток .bignum
+// и .checked; непосредственный операнд всегда машинное слово
+static size_t EmitBignumChecks(TEmitter* output, TSymbolTable* st, const TOperand* operand) {
+    size_t number = st->labelCount++;
+
+    Emit(output, "    cmp rax, %lld; start BignumCheck\n", kBignumCheck);
+    Emit(output, "    jo .bignum%zu\n", number);
+    if (!operand->isImmediate) {
+        Emit(output, "    cmp %s, %lld\n", operand->text, kBignumCheck);
+        Emit(output, "    jo .bignum%zu\n", number);
+    }
+    return number;
+}
+
+// Медленный путь лежит после ret функции: операнды rax и operand уходят в rt_bignum_<function>, результат
+// возвращается в rax (у compare - во флагах) и выполнение продолжается с .checked
+static void EmitBignumCall(TEmitter* output, TSymbolTable* st, const char* function, const TOperand* operand,
+                           size_t number) {
+    Emit(output, ".checked%zu:; end BignumCheck\n", number);
+
+    Emit(st->slowPaths, ".bignum%zu:\n", number);
+    if (strcmp(operand->text, "rcx")) {
+        Emit(st->slowPaths, "    mov rcx, %s\n", operand->text);
+    }
+    Emit(st->slowPaths, "    call rt_bignum_%s\n", function);
+    Emit(st->slowPaths, "    jmp .checked%zu\n", number);
+}
+
+// Результат из диапазона номеров тоже считается переполнением; тогда rax восстанавливается
+// и операция повторяется над длинными числами
+static void EmitCheckedArithmetic(TEmitter* output, tNode* node, TSymbolTable* st, Operations op) {
+    TOperand operand = {};
+    EmitOperands(output, node, st, &operand);
+    size_t number = EmitBignumChecks(output, st, &operand);
+
+    const char* function = NULL;
+    switch (op) {
+        case Add:
+            function = "add";
+            Emit(output, "    add rax, %s; Add\n", operand.text);
+            Emit(st->slowPaths, ".overflow%zu:\n", number);
+            Emit(st->slowPaths, "    sub rax, %s\n", operand.text);
+            break;
+        case Sub:
+            function = "sub";
+            Emit(output, "    sub rax, %s; Sub\n", operand.text);
+            Emit(st->slowPaths, ".overflow%zu:\n", number);
+            Emit(st->slowPaths, "    add rax, %s\n", operand.text);
+            break;
+        case Mul:
+            function = "mul";
+            Emit(output, "    mov rdx, rax\n");
+            if (operand.isImmediate) {
+                Emit(output, "    imul rax, rax, %s; Mul\n", operand.text);
+            } else {
+                Emit(output, "    imul rax, %s; Mul\n", operand.text);
+            }
+            Emit(st->slowPaths, ".overflow%zu:\n", number);
+            Emit(st->slowPaths, "    mov rax, rdx\n");
+            break;
+        default:
+            assert(0);
+    }
+    Emit(output, "    jo .overflow%zu\n", number);
+    Emit(output, "    cmp rax, %lld\n", kBignumCheck);
+    Emit(output, "    jo .overflow%zu\n", number);
+    EmitBignumCall(output, st, function, &operand, number); // .bignum сразу за .overflow
+}
+
+// Длинное число переводится в double в runtime; остальные регистры общего назначения не меняются
+static void EmitIntToFloat(TEmitter* output, TSymbolTable* st, const char* reg, const char* operand) {
+    if (!st->slowPaths) {
+        Emit(output, "    cvtsi2sd %s, %s\n", reg, operand);
+        return;
+    }
+
+    size_t number = st->labelCount++;
+    Emit(output, "    cmp %s, %lld; start BignumCheck\n", operand, kBignumCheck);
+    Emit(output, "    jo .bignum%zu\n", number);
+    Emit(output, "    cvtsi2sd %s, %s\n", reg, operand);
+    Emit(output, ".checked%zu:; end BignumCheck\n", number);
+
+    Emit(st->slowPaths, ".bignum%zu:\n", number);
+    Emit(st->slowPaths, "    push rax\n");
+    if (strcmp(operand, "rax")) {
+        Emit(st->slowPaths, "    mov rax, %s\n", operand);
+    }
+    Emit(st->slowPaths, "    call rt_bignum_float\n");
+    Emit(st->slowPaths, "    movq %s, rax\n", reg);
+    Emit(st->slowPaths, "    pop rax\n");
+    Emit(st->slowPaths, "    jmp .checked%zu\n", number);
+}
+
+// floating point ----------------------------------------------------------------------------------
+
+static bool IsFloat(TSymbolTable* st, tNode* node) {
+    return IsFloatExpression(st->types, st->function, node);
+}
+
+static bool IsFloatComparison(TSymbolTable* st, tNode* node) {
+    return IsComparison(node) && (IsFloat(st, node->left) || IsFloat(st, node->right));
+}
+
+static bool IsFloatParameter(TSymbolTable* st, tNode* callee, size_t index) {
+    tNode* param = callee->left;
+    for (size_t i = 0; i < index; i++) {
+        param = param->left;
+    }
+    return IsFloatVariable(st->types, callee, param->value);
+}
+
+// Результат в xmm0; целые подвыражения вычисляются как обычно и переводятся в double
+static void GenerateFloatCode(TSymbolTable* st, tNode* node, TEmitter* output) {
+    if (IsLeaf(node)) {
+        LoadFloatLeaf(output, st, node, "xmm0");
+        return;
+    }
+    if (!IsFloat(st, node)) {
+        GenerateCode(st, node, output);
+        EmitIntToFloat(output, st, "xmm0", "rax");
+        return;
+    }
+    if (node->type == Calling) {
+        EmitCall(output, node, st);
+        Emit(output, "    movq xmm0, rax\n");
+        return;
+    }
+
+    Operations op = GetOperationType(node->value);
+    switch (op) {
+        case Add:
+        case Sub:
+        case Mul:
+        case Div:   EmitFloatArithmetic(output, node, st, op); break;
+        case Sqrt:  EmitSqrt(output, node, st); break;
+        case Sin:
+        case Cos:   EmitTrigonometry(output, node, st, op); break;
+        case Index: EmitIndex(output, node, st); break;
+        default:    assert(0);
+    }
+}
+
+static void LoadFloatConstant(TEmitter* output, double value, const char* reg) {
+    unsigned long long bits = GetDoubleBits(value);
+    if (!bits) {
+        Emit(output, "    xorpd %s, %s\n", reg, reg);
+    } else {
+        Emit(output, "    mov rax, %llu\n", bits);
+        Emit(output, "    movq %s, rax\n", reg);
+    }
+}
+
+// Целая переменная переводится cvtsi2sd, double в регистре общего назначения переносится movq
+static void LoadFloatLeaf(TEmitter* output, TSymbolTable* st, tNode* node, const char* reg) {
+    if (node->type == Number) {
+        LoadFloatConstant(output, GetFloatValue(node), reg);
+        return;
+    }
+
+    char operand[kMaxLengthOfOperand] = "";
+    GetVariable(st, node->value, operand);
+    if (!IsFloat(st, node)) {
+        EmitIntToFloat(output, st, reg, operand);
+    } else if (strchr(operand, '[')) {
+        Emit(output, "    movsd %s, %s\n", reg, operand);
+    } else {
+        Emit(output, "    movq %s, %s\n", reg, operand);
+    }
+}
+
+// Левый операнд попадает в xmm0, правый - в source: double в памяти или xmm1
+static void EmitFloatOperands(TEmitter* output, tNode* node, TSymbolTable* st, char* source) {
+    tNode* right = node->right;
+    if (right->type == Identifier && IsFloat(st, right)) {
+        GetVariable(st, right->value, source);
+        if (strchr(source, '[')) {
+            GenerateFloatCode(st, node->left, output);
+            return;
+        }
+    }
+
+    if (IsLeaf(right)) {
+        GenerateFloatCode(st, node->left, output);
+        LoadFloatLeaf(output, st, right, "xmm1");
+    } else if (IsLeaf(node->left)) {
+        GenerateFloatCode(st, right, output);
+        Emit(output, "    movapd xmm1, xmm0\n");
+        LoadFloatLeaf(output, st, node->left, "xmm0");
+    } else {
+        // xmm-регистры не сохраняются через вызовы, поэтому промежуточный результат ждет на стеке
+        GenerateFloatCode(st, right, output);
+        Emit(output, "    sub rsp, 8\n");
+        Emit(output, "    movsd qword [rsp], xmm0\n");
+        GenerateFloatCode(st, node->left, output);
+        Emit(output, "    movsd xmm1, qword [rsp]\n");
+        Emit(output, "    add rsp, 8\n");
+    }
+    strncpy(source, "xmm1", kMaxLengthOfOperand);
+}
+
+// ucomisd выставляет флаги как беззнаковое сравнение
+static const char* GetFloatConditionCode(Operations op) {
+    switch (op) {
+        case Identical:         return "e";
+        case NotIdentical:      return "ne";
+        case Greater:           return "a";
+        case GreaterOrEqual:    return "ae";
+        default:                assert(0);
+    }
+}
+
+static const char* GetInverseFloatConditionCode(Operations op) {
+    switch (op) {
+        case Identical:         return "ne";
+        case NotIdentical:      return "e";
+        case Greater:           return "be";
+        case GreaterOrEqual:    return "b";
+        default:                assert(0);
+    }
+}
+
+// a < b сравнивается как b > a; возвращает сравнение, которое проверяют флаги
+static Operations EmitFloatCompare(TEmitter* output, tNode* node, TSymbolTable* st) {
+    Operations op = GetOperationType(node->value);
+    tNode swapped = {};
+    if (op == Less || op == LessOrEqual) {
+        swapped = {node->type, node->value, node->right, node->left};
+        node = &swapped;
+        op = (op == Less) ? Greater : GreaterOrEqual;
+    }
+
+    char source[kMaxLengthOfOperand] = "";
+    EmitFloatOperands(output, node, st, source);
+    Emit(output, "    ucomisd xmm0, %s\n", source);
+    return op;
+}
+
+static void EmitFloatArithmetic(TEmitter* output, tNode* node, TSymbolTable* st, Operations op) {
+    tNode swapped = {};
+    if ((op == Add || op == Mul) && IsLeaf(node->left) && !IsLeaf(node->right)) { // c + expr == expr + c
+        swapped = {node->type, node->value, node->right, node->left};
+        node = &swapped;
+    }
+
+    char source[kMaxLengthOfOperand] = "";
+    EmitFloatOperands(output, node, st, source);
+
+    switch (op) {
+        case Add:   Emit(output, "    addsd xmm0, %s; Add\n", source); break;
+        case Sub:   Emit(output, "    subsd xmm0, %s; Sub\n", source); break;
+        case Mul:   Emit(output, "    mulsd xmm0, %s; Mul\n", source); break;
+        case Div:   Emit(output, "    divsd xmm0, %s; Div\n", source); break;
+        default:    assert(0);
+    }
+}
+
+static void EmitSqrt(TEmitter* output, tNode* node, TSymbolTable* st) {
+    GenerateFloatCode(st, node->left, output);
+    Emit(output, "    sqrtsd xmm0, xmm0; Sqrt\n");
+}
+
+// x = k * pi/2 + r, |r| <= pi/4; по четности k берется многочлен для sin(r) или cos(r), по k & 2 - знак.
+// cos(x) = sin(x + pi/2), то есть тот же код с k + 1. Точность теряется при |x| порядка 2^20 * pi/2 и больше
+static void EmitTrigonometry(TEmitter* output, tNode* node, TSymbolTable* st, Operations op) {
+    GenerateFloatCode(st, node->left, output);
+    if (st->preciseMath) {
+        Emit(output, "    call rt_%s\n", (op == Sin) ? "sin" : "cos");
+        return;
+    }
+
+    size_t currentTrig = st->labelCount++;
+
+    Emit(output, "    movsd xmm1, qword [rt_two_over_pi]; start %s\n", (op == Sin) ? "Sin" : "Cos");
+    Emit(output, "    mulsd xmm1, xmm0\n");
+    Emit(output, "    cvtsd2si rax, xmm1\n");
+    Emit(output, "    cvtsi2sd xmm1, rax\n");
+    Emit(output, "    movapd xmm2, xmm1\n");
+    Emit(output, "    mulsd xmm2, qword [rt_pio2_hi]\n");
+    Emit(output, "    subsd xmm0, xmm2\n");
+    Emit(output, "    mulsd xmm1, qword [rt_pio2_lo]\n");
+    Emit(output, "    subsd xmm0, xmm1\n");
+    if (op == Cos) {
+        Emit(output, "    inc rax\n");
+    }
+    Emit(output, "    movapd xmm1, xmm0\n");
+    Emit(output, "    mulsd xmm1, xmm0\n");
+    Emit(output, "    test al, 1\n");
+    Emit(output, "    jnz .trigcos%zu\n", currentTrig);
+
+    // r + r * z * (S1 + z * (S2 + ... + z * S6)), z = r^2
+    Emit(output, "    movsd xmm2, qword [rt_sin%d]\n", kTrigonometryCoefficients);
+    for (int i = kTrigonometryCoefficients - 1; i > 0; i--) {
+        Emit(output, "    mulsd xmm2, xmm1\n");
+        Emit(output, "    addsd xmm2, qword [rt_sin%d]\n", i);
+    }
+    Emit(output, "    mulsd xmm2, xmm1\n");
+    Emit(output, "    mulsd xmm2, xmm0\n");
+    Emit(output, "    addsd xmm0, xmm2\n");
+    Emit(output, "    jmp .trigsign%zu\n", currentTrig);
+
+    // 1 - z / 2 + z^2 * (C1 + z * (C2 + ... + z * C6))
+    Emit(output, ".trigcos%zu:\n", currentTrig);
+    Emit(output, "    movsd xmm2, qword [rt_cos%d]\n", kTrigonometryCoefficients);
+    for (int i = kTrigonometryCoefficients - 1; i > 0; i--) {
+        Emit(output, "    mulsd xmm2, xmm1\n");
+        Emit(output, "    addsd xmm2, qword [rt_cos%d]\n", i);
+    }
+    Emit(output, "    mulsd xmm2, xmm1\n");
+    Emit(output, "    mulsd xmm2, xmm1\n");
+    Emit(output, "    movsd xmm3, qword [rt_half]\n");
+    Emit(output, "    mulsd xmm3, xmm1\n");
+    Emit(output, "    movsd xmm0, qword [rt_one]\n");
+    Emit(output, "    subsd xmm0, xmm3\n");
+    Emit(output, "    addsd xmm0, xmm2\n");
+
+    Emit(output, ".trigsign%zu:\n", currentTrig);
+    Emit(output, "    test al, 2\n");
+    Emit(output, "    jz .trigend%zu\n", currentTrig);
+    Emit(output, "    mov rcx, %llu\n", GetDoubleBits(-0.0)); // знаковый бит
+    Emit(output, "    movq xmm1, rcx\n");
+    Emit(output, "    xorpd xmm0, xmm1\n");
+    Emit(output, ".trigend%zu:; end %s\n", currentTrig, (op == Sin) ? "Sin" : "Cos");
+}
+
+// x = call f(...) с double-результатом сохраняет биты из rax без перевода через xmm0
+static void EmitFloatEqual(TEmitter* output, tNode* node, TSymbolTable* st) {
+    char destination[kMaxLengthOfOperand] = "";
+    GetVariable(st, node->left->value, destination);
+
+    if (node->right->type == Calling && IsFloat(st, node->right)) {
+        EmitCall(output, node->right, st);
+        Emit(output, "    mov %s, rax; Equal\n", destination);
+        return;
+    }
+
+    GenerateFloatCode(st, node->right, output);
+    if (strchr(destination, '[')) {
+        Emit(output, "    movsd %s, xmm0; Equal\n", destination);
+    } else {
+        Emit(output, "    movq %s, xmm0; Equal\n", destination);
+    }
+}
+
+// arrays ------------------------------------------------------------------------------------------
+
+// Массив - адрес в обычной переменной. array ( N ) на верхнем уровне программы выполняется один раз,
+// и его память резервируется в .bss; остальные массивы выделяет rt_alloc
+static void CollectStaticArrays(TSymbolTable* st, tNode* node) {
+    long long size = 0;
+    if (IsOperation(node, Semicolon)) {
+        CollectStaticArrays(st, node->left);
+        CollectStaticArrays(st, node->right);
+    } else if (IsOperation(node, Equal) && IsOperation(node->right, Array) && GetNumber(node->right->left, &size)
+               && size > 0) {
+        vectorPush(&st->staticArrays, node->right);
+    }
+}
+
+// Адрес a [ i ]: база в своем регистре или rcx, индекс - константа, переменная (rdx) или уже в indexRegister
+static void GetElementAddress(TEmitter* output, TSymbolTable* st, tNode* node, const char* indexRegister,
+                              char* address) {
+    if (IsFloat(st, node->right)) {
+        fprintf(stderr, "Error: index of array '%s' is not an integer\n", node->left->value);
+        exit(EXIT_FAILURE);
+    }
+
+    const char* base = LoadLeaf(output, st, node->left, "rcx");
+    long long value = 0;
+    if (indexRegister) {
+        snprintf(address, kMaxLengthOfOperand, "qword [%s + %s * 8]", base, indexRegister);
+    } else if (IsImmediate(node->right, &value) && value >= INT32_MIN / 8 && value <= INT32_MAX / 8) {
+        snprintf(address, kMaxLengthOfOperand, "qword [%s %c %lld]", base, (value < 0) ? '-' : '+', llabs(8 * value));
+    } else if (node->right->type == Number) {
+        Emit(output, "    mov rdx, %s\n", node->right->value);
+        snprintf(address, kMaxLengthOfOperand, "qword [%s + rdx * 8]", base);
+    } else {
+        const char* index = LoadLeaf(output, st, node->right, "rdx");
+        snprintf(address, kMaxLengthOfOperand, "qword [%s + %s * 8]", base, index);
+    }
+}
+
+static void EmitIndex(TEmitter* output, tNode* node, TSymbolTable* st) {
+    char address[kMaxLengthOfOperand] = "";
+    if (IsLeaf(node->right)) {
+        GetElementAddress(output, st, node, NULL, address);
+    } else {
+        GenerateCode(st, node->right, output);
+        GetElementAddress(output, st, node, "rax", address);
+    }
+
+    if (IsFloat(st, node)) {
+        Emit(output, "    movsd xmm0, %s; Index\n", address);
+    } else {
+        Emit(output, "    mov rax, %s; Index\n", address);
+    }
+}
+
+// Сначала значение, потом адрес; вычисленный индекс ждет на стеке
+static void EmitStore(TEmitter* output, tNode* node, TSymbolTable* st) {
+    tNode* element = node->left;
+    const char* indexRegister = NULL;
+    if (!IsLeaf(element->right)) {
+        GenerateCode(st, element->right, output);
+        Emit(output, "    push rax\n");
+        indexRegister = "rdx";
+    }
 
-    fprintf(output, "\n    pop rbx; start LessOrEqual\n");
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    cmp rax, rbx\n");
-    fprintf(output, "    setle al\n");     
-    fprintf(output, "    movzx rax, al\n"); 
-    fprintf(output, "    push rax; end LessOrEqual\n");
+    bool isFloat = IsFloat(st, element);
+    long long value = 0;
+    bool isImmediate = !isFloat && IsImmediate(node->right, &value);
+    if (isFloat) {
+        GenerateFloatCode(st, node->right, output);
+    } else if (!isImmediate) {
+        GenerateCode(st, node->right, output);
+    }
+    if (indexRegister) {
+        Emit(output, "    pop rdx\n");
+    }
+
+    char address[kMaxLengthOfOperand] = "";
+    GetElementAddress(output, st, element, indexRegister, address);
+    if (isFloat) {
+        Emit(output, "    movsd %s, xmm0; Store\n", address);
+    } else if (isImmediate) {
+        Emit(output, "    mov %s, %lld; Store\n", address, value);
+    } else {
+        Emit(output, "    mov %s, rax; Store\n", address);
+    }
 }
 
-static void EmitGreaterOrEqual(FILE* output, tNode* node, TSymbolTable* st) {
+static void EmitArray(TEmitter* output, tNode* node, TSymbolTable* st) {
+    for (size_t i = 0; i < st->staticArrays.size && !st->function; i++) {
+        if (st->staticArrays.data[i] == node) {
+            Emit(output, "\n    mov rax, rt_array%zu; Array\n", i);
+            return;
+        }
+    }
+    if (IsFloat(st, node->left)) {
+        fprintf(stderr, "Error: size of array is not an integer\n");
+        exit(EXIT_FAILURE);
+    }
+
     GenerateCode(st, node->left, output);
-    GenerateCode(st, node->right, output);
+    Emit(output, "    mov rdi, rax; start Array\n");
+    Emit(output, "    call rt_alloc; end Array\n");
+}
+
+// Векторная часть проходит по 4 (AVX2) или 2 (SSE2) элемента, пока они есть; AVX2 выбирается по rt_avx2,
+// который заполняет runtime. Инварианты размножены по всем элементам регистра, суммы копятся по элементам
+// и складываются после цикла. Остаток проходит исходный скалярный цикл
+static void EmitVectorWhile(TEmitter* output, tNode* node, TSymbolTable* st) {
+    size_t currentVector = st->labelCount++;
+
+    TVectorLoop vector = {};
+    bool isMatched = MatchVectorLoop(node, st->function, st->types, true, &vector);
+    assert(isMatched);
 
-    fprintf(output, "\n    pop rbx; start GreaterOrEqual\n");
-    fprintf(output, "    pop rax\n");
-    fprintf(output, "    cmp rax, rbx\n");
-    fprintf(output, "    setge al\n");     
-    fprintf(output, "    movzx rax, al\n"); 
-    fprintf(output, "    push rax; end GreaterOrEqual\n");
+    char operand[kMaxLengthOfOperand] = "";
+    GetVariable(st, vector.counter, operand);
+    Emit(output, "\n    mov rcx, %s; start VectorWhile\n", operand);
+    if (vector.limit->type == Number) {
+        Emit(output, "    mov rdx, %s\n", vector.limit->value);
+    } else {
+        GetVariable(st, vector.limit->value, operand);
+        Emit(output, "    mov rdx, %s\n", operand);
+    }
+
+    for (size_t i = 0; i < vector.invariants.size; i++) {
+        tNode* leaf = (tNode*)vector.invariants.data[i];
+        char reg[kMaxLengthOfOperand] = "";
+        snprintf(reg, kMaxLengthOfOperand, "xmm%d", kVectorRegisters - 1 - (int)i);
+        if (vector.isFloat) {
+            LoadFloatLeaf(output, st, leaf, reg);
+            Emit(output, "    unpcklpd %s, %s\n", reg, reg);
+            continue;
+        }
+
+        if (leaf->type == Number) {
+            Emit(output, "    mov rax, %s\n", leaf->value);
+        } else {
+            GetVariable(st, leaf->value, operand);
+            Emit(output, "    mov rax, %s\n", operand);
+        }
+        Emit(output, "    movq %s, rax\n", reg);
+        Emit(output, "    punpcklqdq %s, %s\n", reg, reg);
+    }
+    for (size_t i = 0; i < vector.reductions.size; i++) {
+        int reg = GetReductionRegister(&vector, (const char*)vector.reductions.data[i]);
+        Emit(output, "    xorpd xmm%d, xmm%d\n", reg, reg);
+    }
+
+    Emit(output, "    cmp qword [rt_avx2], 0\n");
+    Emit(output, "    je .vectorsse%zu\n", currentVector);
+    for (size_t i = 0; i < vector.invariants.size; i++) {
+        int reg = kVectorRegisters - 1 - (int)i;
+        Emit(output, "    vpbroadcastq ymm%d, xmm%d\n", reg, reg);
+    }
+    for (size_t i = 0; i < vector.reductions.size; i++) {
+        int reg = GetReductionRegister(&vector, (const char*)vector.reductions.data[i]);
+        Emit(output, "    vxorpd ymm%d, ymm%d, ymm%d\n", reg, reg, reg);
+    }
+    EmitVectorLoop(output, node, st, &vector, true, currentVector);
+    for (size_t i = 0; i < vector.reductions.size; i++) {
+        int reg = GetReductionRegister(&vector, (const char*)vector.reductions.data[i]);
+        Emit(output, "    vextractf128 xmm0, ymm%d, 1\n", reg);
+        Emit(output, "    v%s xmm%d, xmm%d, xmm0\n", (vector.isFloat) ? "addpd" : "paddq", reg, reg);
+    }
+    Emit(output, "    vzeroupper\n"); // без этого SSE-код после AVX замедляется
+
+    EmitVectorLoop(output, node, st, &vector, false, currentVector);
+    GetVariable(st, vector.counter, operand);
+    Emit(output, "    mov %s, rcx\n", operand);
+    for (size_t i = 0; i < vector.reductions.size; i++) {
+        EmitReductionTotal(output, st, &vector, (const char*)vector.reductions.data[i]);
+    }
+    Emit(output, "; end VectorWhile, scalar tail\n");
+
+    EmitWhile(output, node, st);
+    VectorLoopDtor(&vector);
+}
+
+static void EmitVectorLoop(TEmitter* output, tNode* node, TSymbolTable* st, TVectorLoop* vector, bool isAvx,
+                           size_t labelNumber) {
+    const char* kind = (isAvx) ? "avx" : "sse";
+    int width = (isAvx) ? 4 : 2;
+
+    Emit(output, ".vector%s%zu:\n", kind, labelNumber);
+    Emit(output, "    lea rax, [rcx + %d]\n", width);
+    Emit(output, "    cmp rax, rdx\n");
+    Emit(output, "    jg .vector%send%zu\n", kind, labelNumber);
+    EmitVectorStatements(output, node->right, st, vector, GetLastStatement(node->right), isAvx);
+    Emit(output, "    add rcx, %d\n", width);
+    Emit(output, "    jmp .vector%s%zu\n", kind, labelNumber);
+    Emit(output, ".vector%send%zu:\n", kind, labelNumber);
+}
+
+static void EmitVectorStatements(TEmitter* output, tNode* node, TSymbolTable* st, TVectorLoop* vector,
+                                 tNode* update, bool isAvx) {
+    if (IsOperation(node, Semicolon)) {
+        EmitVectorStatements(output, node->left, st, vector, update, isAvx);
+        EmitVectorStatements(output, node->right, st, vector, update, isAvx);
+        return;
+    }
+    if (node == update) {
+        return; // счетчик увеличивается на ширину вектора
+    }
+
+    const char* prefix = (isAvx) ? "ymm" : "xmm";
+    if (IsOperation(node, Store)) {
+        int value = EmitVectorExpression(output, node->right, st, vector, 0, isAvx);
+        const char* base = LoadLeaf(output, st, node->left->left, "rax");
+        Emit(output, "    %smovupd [%s + rcx * 8], %s%d\n", (isAvx) ? "v" : "", base, prefix, value);
+        return;
+    }
+
+    int sum = GetReductionRegister(vector, node->left->value);
+    int value = EmitVectorExpression(output, GetReductionOperand(node), st, vector, 0, isAvx);
+    const char* instruction = (vector->isFloat) ? "addpd" : "paddq";
+    if (isAvx) {
+        Emit(output, "    v%s ymm%d, ymm%d, ymm%d\n", instruction, sum, sum, value);
+    } else {
+        Emit(output, "    %s xmm%d, xmm%d\n", instruction, sum, value);
+    }
+}
+
+// Результат в регистре reg или в регистре инварианта; reg + 1 и выше свободны для правого операнда
+static int EmitVectorExpression(TEmitter* output, tNode* node, TSymbolTable* st, TVectorLoop* vector, int reg,
+                                bool isAvx) {
+    int invariant = GetInvariantRegister(vector, node);
+    if (invariant >= 0) {
+        return invariant;
+    }
+
+    const char* prefix = (isAvx) ? "ymm" : "xmm";
+    const char* vex = (isAvx) ? "v" : "";
+    Operations op = GetOperationType(node->value);
+    if (op == Index) {
+        const char* base = LoadLeaf(output, st, node->left, "rax");
+        Emit(output, "    %smovupd %s%d, [%s + rcx * 8]\n", vex, prefix, reg, base);
+        return reg;
+    }
+    if (op == Sqrt) {
+        int source = EmitVectorExpression(output, node->left, st, vector, reg, isAvx);
+        Emit(output, "    %ssqrtpd %s%d, %s%d\n", vex, prefix, reg, prefix, source);
+        return reg;
+    }
+
+    int left = EmitVectorExpression(output, node->left, st, vector, reg, isAvx);
+    int right = EmitVectorExpression(output, node->right, st, vector, reg + 1, isAvx);
+    const char* instruction = NULL;
+    switch (op) {
+        case Add:   instruction = (vector->isFloat) ? "addpd" : "paddq"; break;
+        case Sub:   instruction = (vector->isFloat) ? "subpd" : "psubq"; break;
+        case Mul:   instruction = "mulpd"; break;
+        case Div:   instruction = "divpd"; break;
+        default:    assert(0);
+    }
+
+    if (isAvx) {
+        Emit(output, "    v%s ymm%d, ymm%d, ymm%d\n", instruction, reg, left, right);
+    } else {
+        if (left != reg) {
+            Emit(output, "    movapd xmm%d, xmm%d\n", reg, left);
+        }
+        Emit(output, "    %s xmm%d, xmm%d\n", instruction, reg, right);
+    }
+    return reg;
+}
+
+// Сумма элементов xmm-регистра добавляется к переменной
+static void EmitReductionTotal(TEmitter* output, TSymbolTable* st, TVectorLoop* vector, const char* name) {
+    int reg = GetReductionRegister(vector, name);
+    char operand[kMaxLengthOfOperand] = "";
+    GetVariable(st, name, operand);
+
+    if (!vector->isFloat) {
+        Emit(output, "    movq rax, xmm%d\n", reg);
+        Emit(output, "    punpckhqdq xmm%d, xmm%d\n", reg, reg);
+        Emit(output, "    movq rcx, xmm%d\n", reg);
+        Emit(output, "    add rax, rcx\n");
+        Emit(output, "    add %s, rax\n", operand);
+        return;
+    }
+
+    Emit(output, "    movapd xmm0, xmm%d\n", reg);
+    Emit(output, "    unpckhpd xmm0, xmm0\n");
+    Emit(output, "    addsd xmm0, xmm%d\n", reg);
+    if (strchr(operand, '[')) {
+        Emit(output, "    addsd xmm0, %s\n", operand);
+        Emit(output, "    movsd %s, xmm0\n", operand);
+    } else {
+        Emit(output, "    movq xmm1, %s\n", operand);
+        Emit(output, "    addsd xmm0, xmm1\n");
+        Emit(output, "    movq %s, xmm0\n", operand);
+    }
+}
+
+// parallel loops ----------------------------------------------------------------------------------
+
+static void GetWorkerLabel(TSymbolTable* st, size_t index, char* label) {
+    if (st->function) {
+        snprintf(label, kMaxLengthOfOperand, "%s%s%s%zu", kFunctionPrefix, st->function->value, kParallelWorkerSuffix,
+                 index);
+    } else {
+        snprintf(label, kMaxLengthOfOperand, "main1%s%zu", kParallelWorkerSuffix, index);
+    }
+}
+
+// Переменная лежит в кадре функции-родителя, а не в .data
+static bool IsFrameVariable(TSymbolTable* st, const char* name) {
+    for (size_t i = 0; st->function && i < st->count; i++) {
+        if (!strcmp(st->symbols[i].name, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Переменная родителя из кода потока: кадр родителя адресуется через rcx
+static void GetParentVariable(TSymbolTable* st, const char* name, char* operand) {
+    TSymbol* sym = FindSymbol(st, name);
+    assert(sym);
+    if (IsFrameVariable(st, name)) {
+        snprintf(operand, kMaxLengthOfOperand, "qword [rcx %c %d]", (sym->offset < 0) ? '-' : '+', abs(sym->offset));
+    } else {
+        snprintf(operand, kMaxLengthOfOperand, "qword [%s]", sym->name);
+    }
+}
+
+// Родитель собирает задание на своем стеке и ждет в rt_parallel, пока потоки пройдут диапазон. Код потока
+// генерируется после родителя; цикл, который после оптимизаций уже не подходит, выполняется как обычный
+static void EmitParallelWhile(TEmitter* output, tNode* node, TSymbolTable* st) {
+    TParallelLoop parallel = {};
+    if (!MatchParallelLoop(node, &parallel)) {
+        EmitWhile(output, node, st);
+        return;
+    }
+    ParallelLoopDtor(&parallel);
+
+    char label[kMaxLengthOfOperand] = "";
+    GetWorkerLabel(st, st->parallelLoops.size, label);
+    vectorPush(&st->parallelLoops, node);
+
+    Emit(output, "\n    sub rsp, %zu; start ParallelWhile\n", kParallelTaskSize);
+    Emit(output, "    mov rax, %s\n", label);
+    Emit(output, "    mov qword [rsp], rax\n");
+    Emit(output, "    mov qword [rsp + %zu], rbp\n", kParallelFrameOffset);
+    GenerateCode(st, node->left->left, output);
+    Emit(output, "    mov qword [rsp + %zu], rax\n", kParallelBeginOffset);
+    GenerateCode(st, node->left->right, output);
+    Emit(output, "    mov qword [rsp + %zu], rax\n", kParallelEndOffset);
+    Emit(output, "    mov qword [rsp + %zu], 0\n", kParallelLockOffset);
+    Emit(output, "    mov rdi, rsp\n");
+    Emit(output, "    call rt_parallel\n");
+    Emit(output, "    add rsp, %zu; end ParallelWhile\n", kParallelTaskSize);
+}
+
+static void EmitParallelWorkers(TEmitter* output, TSymbolTable* st) {
+    for (size_t i = 0; i < st->parallelLoops.size; i++) {
+        EmitParallelWorker(output, st, (tNode*)st->parallelLoops.data[i], i);
+    }
+}
+
+// Поток (задание в rdi, номер в rsi) работает с копией кадра родителя: те же смещения от своего rbp,
+// над rbp - место для параметров со стека. Глобальные переменные, которым присваивает тело, получают
+// локальные копии. Суммы начинаются с нуля и под блокировкой задания прибавляются к переменным родителя,
+// остальные переменные возвращаются родителю из потока, который выполнил последнюю порцию
+static void EmitParallelWorker(TEmitter* output, TSymbolTable* st, tNode* node, size_t index) {
+    TParallelLoop parallel = {};
+    bool isMatched = MatchParallelLoop(node, &parallel);
+    assert(isMatched);
+
+    TSymbolTable* worker = (TSymbolTable*)calloc(1, sizeof(TSymbolTable));
+    assert(worker);
+    if (st->function) {
+        *worker = *st;
+        worker->symbols = (TSymbol*)calloc(st->capacity, sizeof(TSymbol));
+        assert(worker->symbols);
+        memcpy(worker->symbols, st->symbols, st->count * sizeof(TSymbol));
+    } else {
+        worker->parent = st;
+        worker->types = st->types;
+        worker->functions = st->functions;
+        worker->preciseMath = st->preciseMath;
+    }
+    worker->staticArrays = {};
+    worker->parallelLoops = {};
+    worker->labelCount = 0;
+    worker->inParallelLoop = true;
+
+    Vector shadows = {};
+    vectorInit(&shadows, kInitialSizeOfNameVector);
+    for (size_t i = 0; i < parallel.privates.size + parallel.reductions.size; i++) {
+        const char* name = (const char*)((i < parallel.privates.size) ? parallel.privates.data[i]
+                                                                       : parallel.reductions.data[i - parallel.privates.size]);
+        if (!IsFrameVariable(st, name)) {
+            TSymbol* sym = AddSymbol(worker, name, "0");
+            worker->currentOffset += 8;
+            sym->offset = -worker->currentOffset;
+            AddName(&shadows, name);
+        }
+    }
+
+    size_t paramCount = (st->function) ? CountChain(st->function->left) : 0;
+    size_t above = 16 + 8 * ((paramCount > kMaxRegisterArguments) ? paramCount - kMaxRegisterArguments : 0);
+    size_t below = (size_t)worker->currentOffset;
+    below += (above + below + 8) % 16; // после адреса возврата и четырех push стек выровнен на 16
+
+    char label[kMaxLengthOfOperand] = "";
+    GetWorkerLabel(st, index, label);
+    Emit(output, "\n%s:\n", label);
+    Emit(output, "    push rbx\n");
+    Emit(output, "    push r12\n");
+    Emit(output, "    push r13\n");
+    Emit(output, "    push rbp\n");
+    Emit(output, "    mov rbx, rdi\n");
+    Emit(output, "    mov r12, rsi\n");
+    Emit(output, "    sub rsp, %zu\n", above);
+    Emit(output, "    mov rbp, rsp\n");
+    Emit(output, "    sub rsp, %zu\n", below);
+
+    char source[kMaxLengthOfOperand] = "";
+    char destination[kMaxLengthOfOperand] = "";
+    Emit(output, "    mov rcx, qword [rbx + %zu]\n", kParallelFrameOffset);
+    for (size_t i = 0; st->function && i < st->count; i++) {
+        GetParentVariable(st, st->symbols[i].name, source);
+        GetVariable(worker, st->symbols[i].name, destination);
+        Emit(output, "    mov rax, %s\n", source);
+        Emit(output, "    mov %s, rax\n", destination);
+    }
+    for (size_t i = 0; i < shadows.size; i++) {
+        GetParentVariable(st, (const char*)shadows.data[i], source);
+        GetVariable(worker, (const char*)shadows.data[i], destination);
+        Emit(output, "    mov rax, %s\n", source);
+        Emit(output, "    mov %s, rax\n", destination);
+    }
+    for (size_t i = 0; i < parallel.reductions.size; i++) {
+        GetVariable(worker, (const char*)parallel.reductions.data[i], destination);
+        Emit(output, "    mov %s, 0\n", destination);
+    }
+
+    char counter[kMaxLengthOfOperand] = "";
+    GetVariable(worker, parallel.counter, counter);
+    Emit(output, ".parallel_next:\n");
+    Emit(output, "    mov rdi, rbx\n");
+    Emit(output, "    mov rsi, r12\n");
+    Emit(output, "    call rt_parallel_next\n");
+    Emit(output, "    cmp rax, rdx\n");
+    Emit(output, "    jge .parallel_done\n");
+    Emit(output, "    mov r13, rdx\n");
+    Emit(output, "    mov %s, rax\n", counter);
+    Emit(output, ".parallel_body:\n");
+    GenerateCode(worker, node->right, output);
+    Emit(output, "    cmp %s, r13\n", counter);
+    Emit(output, "    jl .parallel_body\n");
+
+    Emit(output, "    cmp r13, qword [rbx + %zu]\n", kParallelEndOffset);
+    Emit(output, "    jne .parallel_next\n");
+    Emit(output, "    mov rcx, qword [rbx + %zu]\n", kParallelFrameOffset);
+    for (size_t i = 0; i < parallel.privates.size; i++) {
+        GetVariable(worker, (const char*)parallel.privates.data[i], source);
+        GetParentVariable(st, (const char*)parallel.privates.data[i], destination);
+        Emit(output, "    mov rax, %s\n", source);
+        Emit(output, "    mov %s, rax\n", destination);
+    }
+    Emit(output, "    jmp .parallel_next\n");
+
+    Emit(output, ".parallel_done:\n");
+    Emit(output, "    lea rdi, [rbx + %zu]\n", kParallelLockOffset);
+    Emit(output, "    call rt_parallel_lock\n");
+    Emit(output, "    mov rcx, qword [rbx + %zu]\n", kParallelFrameOffset);
+    for (size_t i = 0; i < parallel.reductions.size; i++) {
+        const char* name = (const char*)parallel.reductions.data[i];
+        GetVariable(worker, name, source);
+        GetParentVariable(st, name, destination);
+        if (IsFloatVariable(st->types, st->function, name)) {
+            Emit(output, "    movsd xmm0, %s\n", destination);
+            Emit(output, "    addsd xmm0, %s\n", source);
+            Emit(output, "    movsd %s, xmm0\n", destination);
+        } else {
+            Emit(output, "    mov rax, %s\n", source);
+            Emit(output, "    add %s, rax\n", destination);
+        }
+    }
+    Emit(output, "    mov qword [rbx + %zu], 0\n", kParallelLockOffset);
+    Emit(output, "    lea rsp, [rbp + %zu]\n", above);
+    Emit(output, "    pop rbp\n");
+    Emit(output, "    pop r13\n");
+    Emit(output, "    pop r12\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    ret\n");
+
+    vectorFree(&shadows);
+    ParallelLoopDtor(&parallel);
+    free(worker->symbols);
+    free(worker);
+}
+
+// functions ---------------------------------------------------------------------------------------
+
+static bool ContainsCall(tNode* node) {
+    if (!node) {
+        return false;
+    }
+    if (node->type == Calling || IsOperation(node, Print) || IsOperation(node, Array)
+        || IsOperation(node, ParallelWhile)) {
+        return true;
+    }
+    return ContainsCall(node->left) || ContainsCall(node->right);
+}
+
+static void CheckCalls(const TFunctionTable* functions, tNode* node) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Calling) {
+        tNode* function = LookupFunction(functions, node->value);
+        if (!function) {
+            fprintf(stderr, "Error: call of undefined function '%s'\n", node->value);
+            exit(EXIT_FAILURE);
+        }
+        if (CountChain(function->left) != CountChain(node->left)) {
+            fprintf(stderr, "Error: function '%s' expects %zu arguments, %zu given\n",
+                    node->value, CountChain(function->left), CountChain(node->left));
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+
+    CheckCalls(functions, node->left);
+    CheckCalls(functions, node->right);
+}
+
+static void CollectFunctions(tNode* node, Vector* functions) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function && !IsImported(node)) {
+        vectorPush(functions, node);
+    } else if (node->type == Operation && GetOperationType(node->value) == Semicolon) {
+        CollectFunctions(node->left, functions);
+        CollectFunctions(node->right, functions);
+    }
+}
+
+// Функции других модулей вызываются через extern, модуль отдает свои функции другим объектам
+static void EmitLinkage(TEmitter* output, tNode* node, const TUnit* unit) {
+    if (!node) {
+        return;
+    }
+
+    if (IsImported(node)) {
+        Emit(output, "extern %s%s\n", kFunctionPrefix, node->value);
+    } else if (node->type == Function && ContainsName(&unit->exports, node->value)) {
+        Emit(output, "global %s%s\n", kFunctionPrefix, node->value);
+    } else if (IsOperation(node, Semicolon)) {
+        EmitLinkage(output, node->left, unit);
+        EmitLinkage(output, node->right, unit);
+    }
+}
+
+// Функции не разделяют изменяемого состояния: у каждой своя таблица символов и свои номера меток,
+// а AST, типы и глобальные символы только читаются. Поэтому их можно генерировать параллельно,
+// и результат не зависит от числа потоков
+static void EmitFunctions(TSymbolTable* globals, tNode* root, TEmitter* output, size_t threadCount) {
+    Vector nodes = {};
+    vectorInit(&nodes, kInitialSizeOfFunctionVector);
+    CollectFunctions(root, &nodes);
+
+    TCodegenPool pool = {
+        .globals = globals,
+        .functions = (TFunctionCode*)calloc(nodes.size + 1, sizeof(TFunctionCode)),
+        .functionCount = nodes.size,
+        .next = 0,
+    };
+    assert(pool.functions);
+    for (size_t i = 0; i < nodes.size; i++) {
+        pool.functions[i].node = (tNode*)nodes.data[i];
+    }
+    vectorFree(&nodes);
+
+    if (!threadCount) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = (cores > 0) ? (size_t)cores : 1;
+    }
+    if (threadCount > pool.functionCount / kMinFunctionsPerThread) {
+        threadCount = pool.functionCount / kMinFunctionsPerThread;
+    }
+    if (!threadCount) {
+        threadCount = 1;
+    }
+
+    TCodegenWorker* workers = (TCodegenWorker*)calloc(threadCount, sizeof(TCodegenWorker));
+    assert(workers);
+    for (size_t i = 0; i < threadCount; i++) {
+        workers[i].pool = &pool;
+        EmitterCtor(&workers[i].emitter, output->withComments);
+    }
+    for (size_t i = 1; i < threadCount; i++) {
+        if (pthread_create(&workers[i].thread, NULL, GenerateFunctions, &workers[i])) {
+            fprintf(stderr, "Error: cannot start code generation thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    GenerateFunctions(&workers[0]);
+    for (size_t i = 1; i < threadCount; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for (size_t i = 0; i < pool.functionCount; i++) {
+        TFunctionCode* function = &pool.functions[i];
+        EmitText(output, function->emitter->data + function->offset, function->size);
+    }
+
+    for (size_t i = 0; i < threadCount; i++) {
+        EmitterDtor(&workers[i].emitter);
+    }
+    free(workers);
+    free(pool.functions);
+}
+
+static void* GenerateFunctions(void* argument) {
+    TCodegenWorker* worker = (TCodegenWorker*)argument;
+    TCodegenPool* pool = worker->pool;
+
+    size_t i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+    for (; i < pool->functionCount; i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) {
+        TFunctionCode* function = &pool->functions[i];
+        function->emitter = &worker->emitter;
+        function->offset = worker->emitter.size;
+        EmitFunction(pool->globals, function->node, &worker->emitter);
+        function->size = worker->emitter.size - function->offset;
+    }
+    return NULL;
+}
+
+// System V: аргументы в rdi, rsi, rdx, rcx, r8, r9, остальные на стеке, результат в rax.
+// Листовая функция с не более чем шестью переменными держит их в регистрах и обходится без кадра.
+static void EmitFunction(TSymbolTable* globals, tNode* node, TEmitter* output) {
+    TSymbolTable st = {
+        .count = 0,
+        .currentOffset = 0,
+        .parent = globals,
+        .types = globals->types,
+        .functions = globals->functions,
+        .function = node,
+        .preciseMath = globals->preciseMath,
+        .parallelLoops = {},
+        .slowPaths = NULL,
+    };
+    vectorInit(&st.parallelLoops, kInitialSizeOfLoopVector);
+    TEmitter slowPaths = {};
+    if (globals->slowPaths) {
+        EmitterCtor(&slowPaths, globals->slowPaths->withComments);
+        st.slowPaths = &slowPaths;
+    }
+
+    size_t paramCount = 0;
+    for (tNode* param = node->left; param; param = param->left) {
+        for (size_t i = 0; i < st.count; i++) {
+            if (!strcmp(st.symbols[i].name, param->value)) {
+                fprintf(stderr, "Error: duplicate parameter '%s' in function '%s'\n", param->value, node->value);
+                exit(EXIT_FAILURE);
+            }
+        }
+        AddSymbol(&st, param->value, "0");
+        paramCount++;
+    }
+    tNode* body = node->right;
+    if (IsOperation(body, Memoize)) {
+        EmitMemoWrapper(output, node, paramCount);
+        body = body->left;
+    }
+    GetLocals(&st, body);
+
+    bool isLeaf = !ContainsCall(body) && st.count <= kMaxRegisterArguments;
+
+    if (IsOperation(node->right, Memoize)) {
+        Emit(output, "%s%s.body:\n", kFunctionPrefix, node->value);
+    } else {
+        Emit(output, "\n%s%s:\n", kFunctionPrefix, node->value);
+    }
+
+    if (isLeaf) {
+        for (size_t i = 0; i < st.count; i++) {
+            st.symbols[i].reg = kLeafRegisters[i];
+            if (i < paramCount && strcmp(kLeafRegisters[i], kArgumentRegisters[i])) {
+                Emit(output, "    mov %s, %s\n", kLeafRegisters[i], kArgumentRegisters[i]);
+            }
+        }
+    } else {
+        for (size_t i = 0; i < st.count; i++) {
+            if (i < paramCount && i >= kMaxRegisterArguments) {
+                st.symbols[i].offset = 16 + 8 * (int)(i - kMaxRegisterArguments); // над адресом возврата и rbp
+            } else {
+                st.currentOffset += 8;
+                st.symbols[i].offset = -st.currentOffset;
+            }
+        }
+
+        Emit(output, "    push rbp\n");
+        Emit(output, "    mov rbp, rsp\n");
+        int frameSize = (st.currentOffset + 15) / 16 * 16;
+        if (frameSize) {
+            Emit(output, "    sub rsp, %d\n", frameSize);
+        }
+        for (size_t i = 0; i < paramCount && i < kMaxRegisterArguments; i++) {
+            Emit(output, "    mov qword [rbp - %d], %s\n", -st.symbols[i].offset, kArgumentRegisters[i]);
+        }
+    }
+    EmitZeroLocals(output, &st, paramCount, isLeaf);
+
+    GenerateCode(&st, body, output);
+
+    if (!IsOperation(GetLastStatement(body), Return)) {
+        Emit(output, "    xor eax, eax\n");
+    }
+    Emit(output, ".return:\n");
+    if (!isLeaf) {
+        Emit(output, "    leave\n");
+    }
+    Emit(output, "    ret\n");
+    if (st.slowPaths) {
+        EmitText(output, GetEmitterText(&slowPaths), slowPaths.size);
+        EmitterDtor(&slowPaths);
+    }
+    EmitParallelWorkers(output, &st);
+
+    vectorFree(&st.parallelLoops);
+    free(st.symbols);
+}
+
+// Локальные переменные, как в --vm и при вычислении во время компиляции, начинаются с нуля.
+// Непараметрические слоты кадра идут подряд ниже параметров-регистров
+static void EmitZeroLocals(TEmitter* output, TSymbolTable* st, size_t paramCount, bool isLeaf) {
+    size_t count = st->count - paramCount;
+    if (isLeaf) {
+        for (size_t i = paramCount; i < st->count; i++) {
+            Emit(output, "    xor %s, %s\n", st->symbols[i].reg, st->symbols[i].reg);
+        }
+        return;
+    }
+    if (!count) {
+        return;
+    }
+
+    int top = st->currentOffset - 8 * (int)count; // смещение последнего параметра-регистра
+    if (count <= kMaxUnrolledZeroing) {
+        for (size_t i = 0; i < count; i++) {
+            Emit(output, "    mov qword [rbp - %d], 0\n", top + 8 * (int)(i + 1));
+        }
+        return;
+    }
+    Emit(output, "    xor eax, eax\n");
+    Emit(output, "    mov r11, -%zu\n", count);
+    Emit(output, ".zero_locals:\n");
+    Emit(output, "    mov qword [rbp + r11 * 8 - %d], rax\n", top);
+    Emit(output, "    inc r11\n");
+    Emit(output, "    jnz .zero_locals\n");
+}
+
+// Запись таблицы: [занята, аргументы..., результат]. kMemoProbes - 1 лишних записей в конце,
+// чтобы поиск от последней записи не выходил за таблицу
+static void EmitMemoTables(TEmitter* output, tNode* root) {
+    Vector functions = {};
+    vectorInit(&functions, kInitialSizeOfFunctionVector);
+    CollectFunctions(root, &functions);
+
+    for (size_t i = 0; i < functions.size; i++) {
+        tNode* function = (tNode*)functions.data[i];
+        if (IsOperation(function->right, Memoize)) {
+            size_t entries = (size_t)GetNumberValue(function->right->right) + kMemoProbes - 1;
+            Emit(output, "    %s%s resq %zu\n", kMemoTablePrefix, function->value,
+                 entries * (CountChain(function->left) + 2));
+        }
+    }
+    vectorFree(&functions);
+}
+
+// Аргументы еще в регистрах: хеш Фибоначчи по всем аргументам дает номер первой записи, дальше
+// kMemoProbes записей подряд. При промахе тело вызывается как обычная функция, результат сохраняется
+static void EmitMemoWrapper(TEmitter* output, tNode* node, size_t paramCount) {
+    int bits = GetPowerOfTwo((unsigned long long)GetNumberValue(node->right->right));
+    assert(bits >= 0 && paramCount >= 1 && paramCount <= kMaxRegisterArguments);
+    size_t stride = 8 * (paramCount + 2);
+
+    Emit(output, "\n%s%s:\n", kFunctionPrefix, node->value);
+    Emit(output, "    mov r10, %llu\n", kMemoHashMultiplier);
+    Emit(output, "    mov rax, rdi\n");
+    Emit(output, "    imul rax, r10\n");
+    for (size_t i = 1; i < paramCount; i++) {
+        Emit(output, "    xor rax, %s\n", kArgumentRegisters[i]);
+        Emit(output, "    imul rax, r10\n");
+    }
+    if (bits) {
+        Emit(output, "    shr rax, %d\n", 64 - bits);
+    } else {
+        Emit(output, "    xor eax, eax\n");
+    }
+    Emit(output, "    imul rax, rax, %zu\n", stride);
+    Emit(output, "    mov r11, %s%s\n", kMemoTablePrefix, node->value);
+    Emit(output, "    add r11, rax\n");
+    Emit(output, "    mov r10, %zu\n", kMemoProbes);
+
+    Emit(output, ".memo_probe:\n");
+    Emit(output, "    cmp qword [r11], 0\n");
+    Emit(output, "    je .memo_miss\n");
+    for (size_t i = 0; i < paramCount; i++) {
+        Emit(output, "    cmp %s, qword [r11 + %zu]\n", kArgumentRegisters[i], 8 * (i + 1));
+        Emit(output, "    jne .memo_next\n");
+    }
+    Emit(output, "    mov rax, qword [r11 + %zu]\n", 8 * (paramCount + 1));
+    Emit(output, "    ret\n");
+    Emit(output, ".memo_next:\n");
+    Emit(output, "    add r11, %zu\n", stride);
+    Emit(output, "    dec r10\n");
+    Emit(output, "    jnz .memo_probe\n");
+    Emit(output, "    sub r11, %zu\n", kMemoProbes * stride);
+
+    // r11 и аргументы сохраняются на время вызова, стек перед call выровнен на 16
+    bool needsPadding = (paramCount + 1) % 2 == 0;
+    Emit(output, ".memo_miss:\n");
+    Emit(output, "    push r11\n");
+    for (size_t i = 0; i < paramCount; i++) {
+        Emit(output, "    push %s\n", kArgumentRegisters[i]);
+    }
+    if (needsPadding) {
+        Emit(output, "    sub rsp, 8\n");
+    }
+    Emit(output, "    call %s%s.body\n", kFunctionPrefix, node->value);
+    if (needsPadding) {
+        Emit(output, "    add rsp, 8\n");
+    }
+    for (size_t i = paramCount; i-- > 0;) {
+        Emit(output, "    pop %s\n", kArgumentRegisters[i]);
+    }
+    Emit(output, "    pop r11\n");
+    for (size_t i = 0; i < paramCount; i++) {
+        Emit(output, "    mov qword [r11 + %zu], %s\n", 8 * (i + 1), kArgumentRegisters[i]);
+    }
+    Emit(output, "    mov qword [r11 + %zu], rax\n", 8 * (paramCount + 1));
+    Emit(output, "    mov qword [r11], 1\n");
+    Emit(output, "    ret\n");
+}
+
+// emitters ----------------------------------------------------------------------------------------
+
+static void EmitNumber(TEmitter* output, tNode* node) {
+    if (IsFloatLiteral(node)) {
+        Emit(output, "\n    mov rax, %llu; Number\n", GetDoubleBits(GetFloatValue(node)));
+    } else if (GetNumberValue(node)) {
+        Emit(output, "\n    mov rax, %s; Number\n", node->value);
+    } else {
+        Emit(output, "\n    xor eax, eax; Number\n");
+    }
+}
+
+static void EmitIdentifier(TEmitter* output, tNode* node, TSymbolTable* st) {
+    char operand[kMaxLengthOfOperand] = "";
+    GetVariable(st, node->value, operand);
+
+    Emit(output, "\n    mov rax, %s; Identifier\n", operand);
+}
+
+static void EmitSemicolon(TEmitter* output, tNode* node, TSymbolTable* st) {
+    GenerateCode(st, node->left, output);
+    GenerateCode(st, node->right, output);
+}
+
+static void EmitEqual(TEmitter* output, tNode* node, TSymbolTable* st) {
+    if (IsFloat(st, node->left) && !IsOperation(node->right, Array)) { // у массива double тип элементов, не адреса
+        EmitFloatEqual(output, node, st);
+        return;
+    }
+    if (EmitStoreTile(output, node, st)) {
+        return;
+    }
+
+    char destination[kMaxLengthOfOperand] = "";
+    GetVariable(st, node->left->value, destination);
+
+    GenerateCode(st, node->right, output);
+    Emit(output, "    mov %s, rax; Equal\n", destination);
+}
+
+static void EmitPrint(TEmitter* output, tNode* node, TSymbolTable* st) {
+    if (IsFloat(st, node->left)) {
+        GenerateFloatCode(st, node->left, output);
+        Emit(output, "    call rt_print_float; Print\n");
+        return;
+    }
+
+    GenerateCode(st, node->left, output);
+    if (st->slowPaths) {
+        Emit(output, "    call rt_bignum_print; Print\n"); // и машинное слово, и номер длинного числа
+        return;
+    }
+    Emit(output, "\n    mov rdi, rax; start Print\n");
+    Emit(output, "    call rt_print; end Print\n");
+}
+
+static void EmitAdd(TEmitter* output, tNode* node, TSymbolTable* st) {
+    if (st->slowPaths) {
+        EmitCheckedArithmetic(output, node, st, Add);
+        return;
+    }
+    if (EmitLea(output, node, st)) {
+        return;
+    }
+
+    TOperand operand = {};
+    long long value = 0;
+    if (GetLeafOperand(node->left, st, &operand) && operand.isImmediate && !IsImmediate(node->right, &value)) {
+        GenerateCode(st, node->right, output); // c + expr == expr + c
+    } else {
+        EmitOperands(output, node, st, &operand);
+    }
+
+    if (operand.isImmediate && operand.value == 1) {
+        Emit(output, "    inc rax; Add\n");
+    } else if (!operand.isImmediate || operand.value) {
+        Emit(output, "    add rax, %s; Add\n", operand.text);
+    }
+}
+
+static void EmitSub(TEmitter* output, tNode* node, TSymbolTable* st) {
+    if (st->slowPaths) {
+        EmitCheckedArithmetic(output, node, st, Sub);
+        return;
+    }
+    long long value = 0;
+    if (IsImmediate(node->left, &value) && !value) {
+        GenerateCode(st, node->right, output);
+        Emit(output, "    neg rax; Sub\n");
+        return;
+    }
+
+    TOperand operand = {};
+    EmitOperands(output, node, st, &operand);
+
+    if (operand.isImmediate && operand.value == 1) {
+        Emit(output, "    dec rax; Sub\n");
+    } else if (!operand.isImmediate || operand.value) {
+        Emit(output, "    sub rax, %s; Sub\n", operand.text);
+    }
+}
+
+static void EmitMul(TEmitter* output, tNode* node, TSymbolTable* st) {
+    if (st->slowPaths) {
+        EmitCheckedArithmetic(output, node, st, Mul);
+        return;
+    }
+    TOperand operand = {};
+    long long value = 0;
+    if (GetLeafOperand(node->left, st, &operand) && operand.isImmediate && !IsImmediate(node->right, &value)) {
+        GenerateCode(st, node->right, output); // c * expr == expr * c
+    } else {
+        EmitOperands(output, node, st, &operand);
+    }
+
+    if (!operand.isImmediate) {
+        Emit(output, "    imul rax, %s; Mul\n", operand.text);
+        return;
+    }
+
+    value = operand.value;
+    int power = (value > 0) ? GetPowerOfTwo((unsigned long long)value) : -1;
+    if (!value) {
+        Emit(output, "    xor eax, eax; Mul\n");
+    } else if (power == 0) {
+        // умножение на 1
+    } else if (power > 0) {
+        Emit(output, "    shl rax, %d; Mul\n", power);
+    } else if (value == 3 || value == 5 || value == 9) {
+        Emit(output, "    lea rax, [rax + rax * %lld]; Mul\n", value - 1);
+    } else if (value == -1) {
+        Emit(output, "    neg rax; Mul\n");
+    } else {
+        Emit(output, "    imul rax, rax, %lld; Mul\n", value);
+    }
+}
+
+static void EmitDiv(TEmitter* output, tNode* node, TSymbolTable* st) {
+    // INT64_MIN / -1 не помещается в слово: с длинными числами такое деление уходит в runtime
+    if (node->right->type != Number || !GetNumberValue(node->right)
+        || (st->slowPaths && GetNumberValue(node->right) == -1)) {
+        TOperand operand = {};
+        EmitOperands(output, node, st, &operand);
+        if (operand.isImmediate) {
+            Emit(output, "    mov rcx, %s\n", operand.text);
+            strncpy(operand.text, "rcx", kMaxLengthOfOperand);
+            operand.isImmediate = false;
+        }
+        size_t number = 0;
+        if (st->slowPaths) {
+            number = EmitBignumChecks(output, st, &operand);
+            Emit(output, "    cmp %s, -1\n", operand.text);
+            Emit(output, "    je .bignum%zu\n", number);
+        }
+
+        Emit(output, "    cqo; start Div\n"); // signed extension rax -> rdx:rax
+        Emit(output, "    idiv %s; end Div\n", operand.text);
+        if (st->slowPaths) {
+            EmitBignumCall(output, st, "div", &operand, number);
+        }
+        return;
+    }
+
+    long long divisor = GetNumberValue(node->right);
+    unsigned long long magnitude = (divisor < 0) ? -(unsigned long long)divisor : (unsigned long long)divisor;
+    int power = GetPowerOfTwo(magnitude);
+
+    GenerateCode(st, node->left, output);
+    TOperand operand = {};
+    size_t number = 0;
+    if (st->slowPaths) { // делитель - машинное слово, проверяется только делимое
+        snprintf(operand.text, kMaxLengthOfOperand, "%lld", divisor);
+        operand.isImmediate = true;
+        operand.value = divisor;
+        number = EmitBignumChecks(output, st, &operand);
+    }
+
+    if (power == 0) {
+        // деление на 1
+    } else if (power > 0) {
+        // округление к нулю: отрицательному делимому добавляется 2^k - 1
+        Emit(output, "    mov rdx, rax; start Div\n");
+        Emit(output, "    sar rdx, 63\n");
+        Emit(output, "    shr rdx, %d\n", 64 - power);
+        Emit(output, "    add rax, rdx\n");
+        Emit(output, "    sar rax, %d; end Div\n", power);
+    } else {
+        long long magic = 0;
+        int shift = 0;
+        GetSignedMagic(divisor, &magic, &shift);
+
+        Emit(output, "    mov rcx, rax; start Div\n");
+        Emit(output, "    mov rax, %lld\n", magic);
+        Emit(output, "    imul rcx\n");
+        if (divisor > 0 && magic < 0) {
+            Emit(output, "    add rdx, rcx\n");
+        } else if (divisor < 0 && magic > 0) {
+            Emit(output, "    sub rdx, rcx\n");
+        }
+        if (shift) {
+            Emit(output, "    sar rdx, %d\n", shift);
+        }
+        Emit(output, "    mov rax, rdx\n");
+        Emit(output, "    shr rax, 63\n");
+        Emit(output, "    add rax, rdx; end Div\n");
+    }
+
+    if (power >= 0 && divisor < 0) {
+        Emit(output, "    neg rax\n");
+    }
+    if (st->slowPaths) {
+        EmitBignumCall(output, st, "div", &operand, number);
+    }
+}
+
+static void EmitWhile(TEmitter* output, tNode* node, TSymbolTable* st) {
+    size_t currentWhile = st->labelCount++;
+
+    Emit(output, "\n.while%zu:; start While\n", currentWhile);
+
+    EmitCondition(output, node->left, st, ".endwhile", currentWhile);
+
+    GenerateCode(st, node->right, output);
+
+    Emit(output, "    jmp .while%zu\n", currentWhile);
+    Emit(output, ".endwhile%zu:; end While\n", currentWhile);
+}
+
+static void EmitIf(TEmitter* output, tNode* node, TSymbolTable* st) {
+    size_t currentIf = st->labelCount++;
+
+    EmitCondition(output, node->left, st, ".endif", currentIf);
+
+    GenerateCode(st, node->right, output);
+
+    Emit(output, ".endif%zu:; end If\n", currentIf);
+}
+
+// Значения присваиваний вычисляются всегда, а условие выбирает, записать ли их: между сравнением и cmov
+// только mov и pop, которые не меняют флаги. x = x + 1 и x = x - 1 прибавляют результат setcc
+static void EmitSelectIf(TEmitter* output, tNode* node, TSymbolTable* st) {
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfSelectVector);
+    CollectSelectStatements(node->right, &statements);
+
+    tNode* first = (tNode*)statements.data[0];
+    long long step = 0;
+    if (statements.size == 1 && (IsOperation(first->right, Add) || IsOperation(first->right, Sub))
+        && first->right->left->type == Identifier && !strcmp(first->right->left->value, first->left->value)
+        && IsImmediate(first->right->right, &step) && step == 1) {
+        char destination[kMaxLengthOfOperand] = "";
+        GetVariable(st, first->left->value, destination);
+        const char* code = EmitSelectCondition(output, node->left, st);
+        Emit(output, "    set%s al; start SelectIf\n", code);
+        Emit(output, "    movzx eax, al\n");
+        Emit(output, "    %s %s, rax; end SelectIf\n", (IsOperation(first->right, Add)) ? "add" : "sub", destination);
+        vectorFree(&statements);
+        return;
+    }
+
+    // max = a [ i ] при a [ i ] > max: левый операнд сравнения уже в rax. Иначе одно значение ждет в rdx,
+    // если условие его не портит, а несколько - в стеке
+    bool isLeftOperand = statements.size == 1 && IsComparison(node->left) && IsSameTree(first->right, node->left->left);
+    bool inRdx = statements.size == 1 && !isLeftOperand && !UsesRdx(node->left);
+    for (size_t i = 0; i < statements.size && !isLeftOperand; i++) {
+        GenerateCode(st, ((tNode*)statements.data[i])->right, output);
+        Emit(output, (inRdx) ? "    mov rdx, rax\n" : "    push rax\n");
+    }
+
+    const char* code = EmitSelectCondition(output, node->left, st);
+    for (size_t i = statements.size; i-- > 0;) {
+        const char* name = ((tNode*)statements.data[i])->left->value;
+        char destination[kMaxLengthOfOperand] = "";
+        GetVariable(st, name, destination);
+        const char* value = (inRdx) ? "rdx" : "rax";
+        if (!inRdx && !isLeftOperand) {
+            Emit(output, "    pop rax\n");
+        }
+
+        if (FindSymbol(st, name)->reg) {
+            Emit(output, "    cmov%s %s, %s; SelectIf\n", code, destination, value);
+        } else {
+            Emit(output, "    mov rcx, %s\n", destination);
+            Emit(output, "    cmov%s rcx, %s; SelectIf\n", code, value);
+            Emit(output, "    mov %s, rcx\n", destination);
+        }
+    }
+    vectorFree(&statements);
+}
+
+// Выставляет флаги и возвращает условие, при котором выполняется тело
+static const char* EmitSelectCondition(TEmitter* output, tNode* node, TSymbolTable* st) {
+    if (IsComparison(node)) {
+        EmitCompare(output, node, st);
+        return GetConditionCode(GetOperationType(node->value));
+    }
+
+    GenerateCode(st, node, output);
+    Emit(output, "    test rax, rax\n");
+    return "ne";
+}
+
+// Переменная сравнивается с вариантами один раз: плотные числа - индекс в таблице смещений тел от ее начала,
+// редкие - двоичный поиск. Варианты взаимно исключают друг друга, поэтому после тела - переход в конец
+static void EmitSwitch(TEmitter* output, tNode* node, TSymbolTable* st) {
+    size_t currentSwitch = st->labelCount++;
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfSelectVector);
+    CollectSelectStatements(node->right, &statements);
+
+    TSwitchCase* cases = (TSwitchCase*)calloc(statements.size, sizeof(TSwitchCase));
+    assert(cases);
+    for (size_t i = 0; i < statements.size; i++) {
+        cases[i].value = GetNumberValue(((tNode*)statements.data[i])->left->right);
+        cases[i].index = i;
+    }
+    qsort(cases, statements.size, sizeof(TSwitchCase), CompareCases);
+
+    char variable[kMaxLengthOfOperand] = "";
+    GetVariable(st, node->left->value, variable);
+    Emit(output, "    mov rax, %s; start Switch\n", variable);
+
+    // в таблице каждое число от меньшего до большего: пропуски ведут в конец, и их не больше 60%
+    unsigned long long range = (unsigned long long)cases[statements.size - 1].value - (unsigned long long)cases[0].value;
+    if (range < kMaxJumpTableSize && 2 * (range + 1) <= 5 * statements.size) {
+        EmitJumpTable(output, cases, statements.size, currentSwitch);
+    } else {
+        EmitSearchTree(output, cases, statements.size, currentSwitch);
+        Emit(output, "    jmp .endswitch%zu\n", currentSwitch);
+    }
+
+    for (size_t i = 0; i < statements.size; i++) {
+        Emit(output, ".switch%zu_case%zu:\n", currentSwitch, i);
+        GenerateCode(st, ((tNode*)statements.data[i])->right, output);
+        if (i + 1 < statements.size) {
+            Emit(output, "    jmp .endswitch%zu\n", currentSwitch);
+        }
+    }
+    Emit(output, ".endswitch%zu:; end Switch\n", currentSwitch);
+
+    free(cases);
+    vectorFree(&statements);
+}
+
+// Индекс сравнивается без знака: числа меньше первого варианта после вычитания становятся огромными
+static void EmitJumpTable(TEmitter* output, const TSwitchCase* cases, size_t count, size_t label) {
+    long long first = cases[0].value;
+    long long last = cases[count - 1].value;
+    if (first >= INT32_MIN && first <= INT32_MAX && first) {
+        Emit(output, "    sub rax, %lld\n", first);
+    } else if (first) {
+        Emit(output, "    mov rcx, %lld\n", first);
+        Emit(output, "    sub rax, rcx\n");
+    }
+    Emit(output, "    cmp rax, %lld\n", last - first);
+    Emit(output, "    ja .endswitch%zu\n", label);
+    Emit(output, "    lea rcx, [rel .switch%zu_table]\n", label);
+    Emit(output, "    movsxd rax, dword [rcx + rax * 4]\n");
+    Emit(output, "    add rax, rcx\n");
+    Emit(output, "    jmp rax\n");
+
+    Emit(output, ".switch%zu_table:\n", label);
+    size_t next = 0;
+    for (long long value = first; value <= last; value++) {
+        if (cases[next].value == value) {
+            Emit(output, "    dd .switch%zu_case%zu - .switch%zu_table\n", label, cases[next++].index, label);
+        } else {
+            Emit(output, "    dd .endswitch%zu - .switch%zu_table\n", label, label);
+        }
+    }
+}
+
+// Варианты отсортированы; в каждом узле сравнение с серединой отделяет равенство, меньшие и большие
+static void EmitSearchTree(TEmitter* output, const TSwitchCase* cases, size_t count, size_t label) {
+    if (count <= kMaxLinearCases) {
+        for (size_t i = 0; i < count; i++) {
+            EmitCaseCompare(output, cases[i].value);
+            Emit(output, "    je .switch%zu_case%zu\n", label, cases[i].index);
+        }
+        return;
+    }
+
+    size_t middle = count / 2;
+    EmitCaseCompare(output, cases[middle].value);
+    Emit(output, "    je .switch%zu_case%zu\n", label, cases[middle].index);
+    Emit(output, "    jg .switch%zu_above%zu\n", label, cases[middle].index);
+    EmitSearchTree(output, cases, middle, label);
+    Emit(output, "    jmp .endswitch%zu\n", label);
+    Emit(output, ".switch%zu_above%zu:\n", label, cases[middle].index);
+    EmitSearchTree(output, cases + middle + 1, count - middle - 1, label);
+}
+
+static void EmitCaseCompare(TEmitter* output, long long value) {
+    if (value >= INT32_MIN && value <= INT32_MAX) {
+        Emit(output, "    cmp rax, %lld\n", value);
+    } else {
+        Emit(output, "    mov rcx, %lld\n", value);
+        Emit(output, "    cmp rax, rcx\n");
+    }
+}
+
+static int CompareCases(const void* first, const void* second) {
+    long long firstValue = ((const TSwitchCase*)first)->value;
+    long long secondValue = ((const TSwitchCase*)second)->value;
+    return (firstValue > secondValue) - (firstValue < secondValue);
+}
+
+static void CollectSelectStatements(tNode* node, Vector* statements) {
+    if (IsOperation(node, Semicolon)) {
+        CollectSelectStatements(node->left, statements);
+        CollectSelectStatements(node->right, statements);
+    } else if (node) {
+        vectorPush(statements, node);
+    }
+}
+
+// rdx - индекс элемента и остаток при делении
+static bool UsesRdx(tNode* node) {
+    if (!node) {
+        return false;
+    }
+    return IsOperation(node, Index) || IsOperation(node, Div) || UsesRdx(node->left) || UsesRdx(node->right);
+}
+
+static void EmitComparison(TEmitter* output, tNode* node, TSymbolTable* st, Operations op) {
+    if (IsFloatComparison(st, node)) {
+        op = EmitFloatCompare(output, node, st);
+        Emit(output, "    set%s al; Comparison\n", GetFloatConditionCode(op));
+        Emit(output, "    movzx eax, al\n");
+        return;
+    }
+
+    EmitCompare(output, node, st);
+
+    Emit(output, "    set%s al; Comparison\n", GetConditionCode(op));
+    Emit(output, "    movzx eax, al\n");
+}
+
+static void EmitCall(TEmitter* output, tNode* node, TSymbolTable* st) {
+    tNode* args[kMaxArguments] = {};
+    size_t argCount = GetArguments(node, args);
+
+    char operand[kMaxLengthOfOperand] = "";
+    size_t stackArgs = (argCount > kMaxRegisterArguments) ? argCount - kMaxRegisterArguments : 0;
+    size_t padding = stackArgs % 2; // rsp должен быть кратен 16 в момент call
+    tNode* callee = LookupFunction(st->functions, node->value);
+
+    // double передается битами в тех же регистрах, целый аргумент double-параметра переводится заранее
+    Emit(output, "\n; start Call %s\n", node->value);
+    if (padding) {
+        Emit(output, "    sub rsp, 8\n");
+    }
+    for (size_t i = argCount; i > kMaxRegisterArguments; i--) {
+        if (args[i - 1]->type == Number) {
+            long long value = GetArgumentValue(st, callee, i - 1, args[i - 1]);
+            if (value < INT32_MIN || value > INT32_MAX) { // push кладет только imm32 со знаковым расширением
+                Emit(output, "    mov rax, %lld\n", value);
+                Emit(output, "    push rax\n");
+            } else {
+                Emit(output, "    push %lld\n", value);
+            }
+            continue;
+        }
+        GetVariable(st, args[i - 1]->value, operand);
+        if (IsFloatParameter(st, callee, i - 1) && !IsFloat(st, args[i - 1])) {
+            EmitIntToFloat(output, st, "xmm0", operand);
+            Emit(output, "    movq rax, xmm0\n");
+            strncpy(operand, "rax", kMaxLengthOfOperand);
+        }
+        Emit(output, "    push %s\n", operand);
+    }
+    for (size_t i = 0; i < argCount && i < kMaxRegisterArguments; i++) {
+        if (args[i]->type == Number) {
+            Emit(output, "    mov %s, %lld\n", kArgumentRegisters[i], GetArgumentValue(st, callee, i, args[i]));
+            continue;
+        }
+        GetVariable(st, args[i]->value, operand);
+        if (IsFloatParameter(st, callee, i) && !IsFloat(st, args[i])) {
+            EmitIntToFloat(output, st, "xmm0", operand);
+            Emit(output, "    movq %s, xmm0\n", kArgumentRegisters[i]);
+        } else {
+            Emit(output, "    mov %s, %s\n", kArgumentRegisters[i], operand);
+        }
+    }
+
+    Emit(output, "    call %s%s\n", kFunctionPrefix, node->value);
+    if (stackArgs + padding) {
+        Emit(output, "    add rsp, %zu\n", 8 * (stackArgs + padding));
+    }
+    Emit(output, "; end Call %s\n", node->value);
+}
+
+// Числовой аргумент передается непосредственным значением: для double-параметра - битами double
+static long long GetArgumentValue(TSymbolTable* st, tNode* callee, size_t index, tNode* arg) {
+    if (!IsFloatParameter(st, callee, index) && !IsFloatLiteral(arg)) {
+        return GetNumberValue(arg);
+    }
+
+    double value = GetFloatValue(arg);
+    long long bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static void EmitReturn(TEmitter* output, tNode* node, TSymbolTable* st) {
+    if (st->function && IsFloatFunction(st->types, st->function->value)) {
+        GenerateFloatCode(st, node->left, output);
+        Emit(output, "    movq rax, xmm0\n");
+    } else {
+        GenerateCode(st, node->left, output);
+    }
+
+    // return последним оператором тела продолжается прямо в эпилог
+    tNode* body = (st->function) ? st->function->right : NULL;
+    if (IsOperation(body, Memoize)) {
+        body = body->left;
+    }
+    if (!body || node != GetLastStatement(body)) {
+        Emit(output, "    jmp .return; Return\n");
+    }
 }
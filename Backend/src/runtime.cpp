@@ -0,0 +1,1905 @@
+#include "runtime.h"
+
+#include <assert.h>
+#include <string.h>
+
+// static ------------------------------------------------------------------------------------------
+
+static const unsigned long long kDivisionBy100Magic = 0x28F5C28F5C28F5C3; // (n / 4) * magic >> 66 = n / 100
+static const unsigned long long kFractionScale = 1000000; // 10 ^ kFractionDigits
+static const unsigned kOsxsaveAndAvxBits = (1u << 27) | (1u << 28);
+
+static const size_t kParallelRecordSize = 64; // [блокировка, lo, hi, поток, задание, номер, стек], по строке кеша
+static const size_t kChunksPerWorker = 8; // порций на поток: мельче - ровнее нагрузка, крупнее - реже блокировки
+static const size_t kThreadStackSize = 1 << 23;
+static const size_t kAllocationHeaderSize = 16; // [следующий массив rt_alloc, размер отображения]
+static const size_t kAffinityMaskSize = 128; // байт маски для sched_getaffinity, 1024 процессора
+// CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM | CLONE_PARENT_SETTID
+// | CLONE_CHILD_CLEARTID: ядро пишет tid в запись и обнуляет его с futex wake, когда поток завершается
+static const unsigned kCloneFlags = 0x350F00;
+static const unsigned kStackMapFlags = 0x4022; // MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+static const int kChunkDigits = 18; // длинное число печатается кусками по 18 цифр
+static const unsigned long long kChunkBase = 1000000000000000000ULL; // 10 ^ kChunkDigits
+// Поля double для rt_print_float: m * 2^(E - 1075), m = мантисса с неявной единицей
+static const int kFloatExponentBias = 1023;
+static const int kFloatMantissaBits = 52;
+static const unsigned long long kFloatMantissaMask = (1ULL << 52) - 1;
+static const unsigned long long kFloatInfinityBits = 0x7FF0000000000000ULL; // больше - nan
+static const double kFloatTwo63 = 9223372036854775808.0;
+static const int kFloatMaxFractionShift = 74; // при e >= 74 дробь меньше 2^-21 и округляется до нуля
+static const int kFloatStickyBits = 11; // m * 10^6 < 2^73: без младших 11 бит помещается в регистр
+static const size_t kFloatLimbs = 17; // 2^1024 и запасной limb для сдвига
+static const size_t kFloatChunks = 18; // 309 цифр DBL_MAX по kChunkDigits
+static const char* const kBignumExhaustedMessage = "Error: big integers do not fit in 16 GiB";
+static const char* const kRuntimeSymbols[] = {"rt_print", "rt_print_float", "rt_alloc", "rt_avx2"};
+static const char* const kParallelSymbols[] = {"rt_parallel", "rt_parallel_next", "rt_parallel_lock"};
+
+enum BignumResult {
+    BignumValue     = 1,
+    BignumFlags     = 2,
+    BignumFloatBits = 3,
+};
+
+struct TFloatConstant {
+    const char* name;
+    double value;
+};
+
+// Приведение к [-pi/4, pi/4] по Коди-Уэйту: pi/2 = rt_pio2_hi + rt_pio2_lo, в rt_pio2_hi 33 значащих бита
+static const TFloatConstant kMathConstants[] = {
+    {"rt_two_over_pi",  6.36619772367581382433e-01},
+    {"rt_pio2_hi",      1.57079632673412561417e+00},
+    {"rt_pio2_lo",      6.07710050650619224932e-11},
+    {"rt_sin1",        -1.66666666666666324348e-01},
+    {"rt_sin2",         8.33333333332248946124e-03},
+    {"rt_sin3",        -1.98412698298579493134e-04},
+    {"rt_sin4",         2.75573137070700676789e-06},
+    {"rt_sin5",        -2.50507602534068634195e-08},
+    {"rt_sin6",         1.58969099521155010221e-10},
+    {"rt_cos1",         4.16666666666666019037e-02},
+    {"rt_cos2",        -1.38888888888741095749e-03},
+    {"rt_cos3",         2.48015872894767294178e-05},
+    {"rt_cos4",        -2.75573143513906633035e-07},
+    {"rt_cos5",         2.08757232129817482790e-09},
+    {"rt_cos6",        -1.13596475577881948265e-11},
+    {"rt_half",         0.5},
+    {"rt_one",          1.0},
+};
+
+static void EmitMathConstants(TEmitter* output);
+static void EmitSimdDetection(TEmitter* output);
+static void EmitFreestandingRuntime(TEmitter* output);
+static void EmitLibcRuntime(TEmitter* output, bool preciseMath);
+static void EmitAllocationPush(TEmitter* output);
+static void EmitRelease(TEmitter* output, const Options* options);
+static void EmitParallelRuntime(TEmitter* output, const Options* options);
+static void EmitParallelNext(TEmitter* output);
+static void EmitWorkerDetection(TEmitter* output);
+static void EmitCloneThreads(TEmitter* output);
+static void EmitPthreads(TEmitter* output);
+static void EmitSpinLock(TEmitter* output, const char* lock, const char* scratch, const char* label);
+static void EmitBignumRuntime(TEmitter* output, const Options* options);
+static void EmitBignumEntry(TEmitter* output, const char* name, BignumResult result);
+static void EmitBignumMemory(TEmitter* output, const Options* options);
+static void EmitBignumPrologue(TEmitter* output);
+static void EmitBignumEpilogue(TEmitter* output);
+static void EmitBignumArithmetic(TEmitter* output);
+static void EmitBignumMultiplication(TEmitter* output);
+static void EmitBignumDivision(TEmitter* output);
+static void EmitBignumOutput(TEmitter* output, const Options* options);
+
+// global ------------------------------------------------------------------------------------------
+
+// Точка входа, rt_print (число в rdi) и rt_print_float (double в xmm0): значение печатается с переводом строки,
+// портятся только caller-saved регистры. rt_alloc возвращает в rax обнуленный массив из rdi qword'ов,
+// rt_avx2 до main1 получает 1, если процессор и ОС поддерживают AVX2. Для parallel while добавляются
+// rt_parallel (задание в rdi), rt_parallel_next и rt_parallel_lock, для --overflow=bignum - rt_bignum_*.
+// rt_release освобождает массивы rt_alloc и арену длинных чисел: его вызывает --jit между запусками
+void EmitRuntime(TEmitter* output, const Options* options, bool hasParallelLoops) {
+    assert(output);
+    assert(options);
+
+    if (options->runtime == LibcRuntime) {
+        EmitLibcRuntime(output, options->preciseMath);
+    } else {
+        EmitFreestandingRuntime(output);
+    }
+    if (hasParallelLoops) {
+        EmitParallelRuntime(output, options);
+    }
+    if (options->overflow == BignumOverflow) {
+        EmitBignumRuntime(output, options);
+    }
+    EmitRelease(output, options);
+}
+
+// Символы runtime, которые использует код функций: программа объявляет их global, модули --separate - extern.
+// По одному на строку, чтобы список не упирался в длину строки ассемблера
+void EmitRuntimeSymbols(TEmitter* output, const Options* options, bool hasParallelLoops, const char* directive) {
+    for (size_t i = 0; i < sizeof(kRuntimeSymbols) / sizeof(kRuntimeSymbols[0]); i++) {
+        Emit(output, "%s %s\n", directive, kRuntimeSymbols[i]);
+    }
+    for (size_t i = 0; i < sizeof(kMathConstants) / sizeof(kMathConstants[0]); i++) {
+        Emit(output, "%s %s\n", directive, kMathConstants[i].name);
+    }
+    for (size_t i = 0; hasParallelLoops && i < sizeof(kParallelSymbols) / sizeof(kParallelSymbols[0]); i++) {
+        Emit(output, "%s %s\n", directive, kParallelSymbols[i]);
+    }
+    if (options->preciseMath) {
+        Emit(output, "%s rt_sin\n", directive);
+        Emit(output, "%s rt_cos\n", directive);
+    }
+}
+
+unsigned long long GetDoubleBits(double value) {
+    unsigned long long bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+// Без libc: вывод копится в буфере и уходит через write(2) при переполнении и перед exit
+static void EmitFreestandingRuntime(TEmitter* output) {
+    Emit(output, "global _start\n");
+
+    Emit(output, "\nsection .data\n");
+    Emit(output, "    rt_digits db \"");
+    for (char high = '0'; high <= '9'; high++) {
+        for (char low = '0'; low <= '9'; low++) {
+            EmitText(output, &high, 1);
+            EmitText(output, &low, 1);
+        }
+    }
+    Emit(output, "\"\n");
+    EmitMathConstants(output);
+    Emit(output, "    rt_avx2 dq 0\n");
+
+    Emit(output, "section .bss\n");
+    Emit(output, "    rt_buffer resb %zu\n", kOutputBufferSize);
+    Emit(output, "    rt_length resq 1\n");
+    Emit(output, "    rt_allocations resq 1\n");
+
+    Emit(output, "section .text\n");
+    Emit(output, "_start:\n");
+    Emit(output, "    call rt_main\n");
+    Emit(output, "    mov eax, 60\n");
+    Emit(output, "    xor edi, edi\n");
+    Emit(output, "    syscall\n");
+
+    // обычная функция без аргументов: ее же вызывает --jit
+    Emit(output, "\nrt_main:\n");
+    Emit(output, "    call rt_detect_simd\n");
+    Emit(output, "    call main1\n");
+    Emit(output, "    jmp rt_flush\n");
+    EmitSimdDetection(output);
+
+    // память целыми страницами от mmap(2), лишний qword - чтобы array ( 0 ) тоже получил адрес.
+    // Перед массивом лежит заголовок [следующее отображение, размер]: rt_release снимает их все
+    Emit(output, "\nrt_alloc:\n");
+    Emit(output, "    lea rsi, [rdi + %zu]\n", 1 + kAllocationHeaderSize / 8);
+    Emit(output, "    shl rsi, 3\n");
+    Emit(output, "    xor edi, edi\n");
+    Emit(output, "    mov edx, 3\n"); // PROT_READ | PROT_WRITE
+    Emit(output, "    mov r10, 34\n"); // MAP_PRIVATE | MAP_ANONYMOUS
+    Emit(output, "    mov r8, -1\n");
+    Emit(output, "    xor r9, r9\n");
+    Emit(output, "    mov eax, 9\n");
+    Emit(output, "    syscall\n");
+    Emit(output, "    cmp rax, -4096\n");
+    Emit(output, "    ja .failed\n");
+    Emit(output, "    mov qword [rax + 8], rsi\n");
+    EmitAllocationPush(output);
+    Emit(output, ".failed:\n");
+    Emit(output, "    mov eax, 60\n");
+    Emit(output, "    mov edi, 1\n");
+    Emit(output, "    syscall\n");
+
+    Emit(output, "\nrt_print:\n");
+    Emit(output, "    cmp qword [rt_length], %zu\n", kOutputBufferSize - kMaxLengthOfDecimal);
+    Emit(output, "    jbe .format\n");
+    Emit(output, "    push rdi\n");
+    Emit(output, "    call rt_flush\n");
+    Emit(output, "    pop rdi\n");
+    Emit(output, ".format:\n");
+    Emit(output, "    call rt_append_digits\n");
+    Emit(output, "    jmp rt_append_newline\n");
+
+    // как printf("%.6f"): целая часть усекается, дробная округляется до kFractionDigits знаков по точному
+    // значению (половина - к четному) и при переносе добавляет единицу к целой. Дробь f = m * 2^-e дает
+    // m * 10^6 (до 2^73) в rdx:rax, частное и остаток сдвига на e сравниваются без округлений double
+    Emit(output, "\nrt_print_float:\n");
+    Emit(output, "    cmp qword [rt_length], %zu\n", kOutputBufferSize - kMaxLengthOfFloat);
+    Emit(output, "    jbe .format\n");
+    Emit(output, "    sub rsp, 8\n");
+    Emit(output, "    movsd qword [rsp], xmm0\n");
+    Emit(output, "    call rt_flush\n");
+    Emit(output, "    movsd xmm0, qword [rsp]\n");
+    Emit(output, "    add rsp, 8\n");
+    Emit(output, ".format:\n");
+    Emit(output, "    movq rax, xmm0\n");
+    Emit(output, "    test rax, rax\n");
+    Emit(output, "    jns .positive\n");
+    Emit(output, "    shl rax, 1\n"); // |x|
+    Emit(output, "    shr rax, 1\n");
+    Emit(output, "    movq xmm0, rax\n");
+    Emit(output, "    mov rsi, rt_buffer\n");
+    Emit(output, "    mov rdi, qword [rt_length]\n");
+    Emit(output, "    mov byte [rsi + rdi], 45\n"); // '-'
+    Emit(output, "    inc qword [rt_length]\n");
+    Emit(output, ".positive:\n");
+    Emit(output, "    mov rcx, %llu\n", kFloatInfinityBits); // неотрицательные double сравниваются как целые
+    Emit(output, "    cmp rax, rcx\n");
+    Emit(output, "    jae .special\n");
+    Emit(output, "    mov rcx, %llu\n", GetDoubleBits(kFloatTwo63));
+    Emit(output, "    cmp rax, rcx\n");
+    Emit(output, "    jae .large\n");
+    Emit(output, "    cvttsd2si rdi, xmm0\n");
+    Emit(output, "    cvtsi2sd xmm1, rdi\n");
+    Emit(output, "    subsd xmm0, xmm1\n"); // дробная часть, точно
+    Emit(output, "    movq rax, xmm0\n");
+    Emit(output, "    xor ecx, ecx\n");
+    Emit(output, "    mov rdx, rax\n");
+    Emit(output, "    shr rdx, 52\n");
+    Emit(output, "    cmp rdx, %d\n", kFloatExponentBias + kFloatMantissaBits + 1 - kFloatMaxFractionShift);
+    Emit(output, "    jb .integer\n"); // f < 2^-21: f * 10^6 < 1/2
+    Emit(output, "    mov r8, %llu\n", kFloatMantissaMask);
+    Emit(output, "    and rax, r8\n");
+    Emit(output, "    inc r8\n");
+    Emit(output, "    or rax, r8\n"); // m
+    Emit(output, "    mov r9, rdx\n");
+    Emit(output, "    mov r10, %llu\n", kFractionScale);
+    Emit(output, "    mul r10\n");
+    // младшие 11 бит произведения остаются только признаком ненулевого остатка, остальное помещается в rax
+    Emit(output, "    mov r11, rax\n");
+    Emit(output, "    and r11, %d\n", (1 << kFloatStickyBits) - 1);
+    Emit(output, "    shr rax, %d\n", kFloatStickyBits);
+    Emit(output, "    shl rdx, %d\n", 64 - kFloatStickyBits);
+    Emit(output, "    or rax, rdx\n");
+    Emit(output, "    mov ecx, %d\n", kFloatExponentBias + kFloatMantissaBits - kFloatStickyBits);
+    Emit(output, "    sub rcx, r9\n"); // e - 11, от 42 до 63
+    Emit(output, "    mov rdx, rax\n");
+    Emit(output, "    shr rdx, cl\n"); // частное
+    Emit(output, "    mov r8, 1\n");
+    Emit(output, "    shl r8, cl\n");
+    Emit(output, "    lea r10, [r8 - 1]\n");
+    Emit(output, "    and rax, r10\n");
+    Emit(output, "    add rax, rax\n");
+    Emit(output, "    neg r11\n");
+    Emit(output, "    adc rax, 0\n"); // удвоенный остаток против делителя: половина - ровно r8
+    Emit(output, "    mov rcx, rdx\n");
+    Emit(output, "    cmp rax, r8\n");
+    Emit(output, "    jb .integer\n");
+    Emit(output, "    ja .up\n");
+    Emit(output, "    test rcx, 1\n");
+    Emit(output, "    jz .integer\n");
+    Emit(output, ".up:\n");
+    Emit(output, "    inc rcx\n");
+    Emit(output, "    cmp rcx, %llu\n", kFractionScale);
+    Emit(output, "    jb .integer\n");
+    Emit(output, "    inc rdi\n");
+    Emit(output, "    xor ecx, ecx\n");
+    Emit(output, "    jmp .integer\n");
+
+    Emit(output, ".special:\n");
+    Emit(output, "    mov rsi, rt_buffer\n"); // mov и lea не меняют флаги cmp
+    Emit(output, "    mov rdi, qword [rt_length]\n");
+    Emit(output, "    lea rsi, [rsi + rdi]\n");
+    Emit(output, "    lea rdi, [rdi + 3]\n");
+    Emit(output, "    mov qword [rt_length], rdi\n");
+    Emit(output, "    je .infinity\n");
+    Emit(output, "    mov byte [rsi], 110\n"); // "nan"
+    Emit(output, "    mov byte [rsi + 1], 97\n");
+    Emit(output, "    mov byte [rsi + 2], 110\n");
+    Emit(output, "    jmp rt_append_newline\n");
+    Emit(output, ".infinity:\n");
+    Emit(output, "    mov byte [rsi], 105\n"); // "inf"
+    Emit(output, "    mov byte [rsi + 1], 110\n");
+    Emit(output, "    mov byte [rsi + 2], 102\n");
+    Emit(output, "    jmp rt_append_newline\n");
+
+    // |x| >= 2^63 - целое m * 2^k: limb'ы на стеке делятся на 10^18, куски печатаются от старшего
+    Emit(output, ".large:\n");
+    Emit(output, "    mov rdx, rax\n");
+    Emit(output, "    shr rdx, 52\n");
+    Emit(output, "    sub rdx, %d\n", kFloatExponentBias + kFloatMantissaBits); // k
+    Emit(output, "    mov r8, %llu\n", kFloatMantissaMask);
+    Emit(output, "    and rax, r8\n");
+    Emit(output, "    inc r8\n");
+    Emit(output, "    or rax, r8\n"); // m
+    Emit(output, "    sub rsp, %zu\n", (kFloatLimbs + kFloatChunks) * 8);
+    Emit(output, "    xor ecx, ecx\n");
+    Emit(output, "    xor r9d, r9d\n");
+    Emit(output, ".clear:\n");
+    Emit(output, "    mov qword [rsp + rcx * 8], r9\n");
+    Emit(output, "    inc rcx\n");
+    Emit(output, "    cmp rcx, %zu\n", kFloatLimbs);
+    Emit(output, "    jb .clear\n");
+    Emit(output, "    mov rcx, rdx\n");
+    Emit(output, "    shr rdx, 6\n");
+    Emit(output, "    and ecx, 63\n");
+    Emit(output, "    mov r9, rax\n");
+    Emit(output, "    shl r9, cl\n");
+    Emit(output, "    mov qword [rsp + rdx * 8], r9\n");
+    Emit(output, "    shr rax, 1\n"); // m >> (64 - сдвиг) и при нулевом сдвиге
+    Emit(output, "    xor ecx, 63\n");
+    Emit(output, "    shr rax, cl\n");
+    Emit(output, "    mov qword [rsp + rdx * 8 + 8], rax\n");
+    Emit(output, "    lea r8, [rdx + 2]\n");
+    Emit(output, "    xor r11d, r11d\n"); // rt_append_digits не трогает r11
+    Emit(output, "    mov rcx, %llu\n", kChunkBase);
+    Emit(output, ".divide:\n");
+    Emit(output, "    mov r9, r8\n");
+    Emit(output, "    xor edx, edx\n");
+    Emit(output, ".limb:\n");
+    Emit(output, "    dec r9\n");
+    Emit(output, "    mov rax, qword [rsp + r9 * 8]\n");
+    Emit(output, "    div rcx\n");
+    Emit(output, "    mov qword [rsp + r9 * 8], rax\n");
+    Emit(output, "    test r9, r9\n");
+    Emit(output, "    jnz .limb\n");
+    Emit(output, "    mov qword [rsp + r11 * 8 + %zu], rdx\n", kFloatLimbs * 8);
+    Emit(output, "    inc r11\n");
+    Emit(output, ".trim:\n");
+    Emit(output, "    cmp qword [rsp + r8 * 8 - 8], 0\n");
+    Emit(output, "    jne .divide\n");
+    Emit(output, "    dec r8\n");
+    Emit(output, "    jnz .trim\n");
+    Emit(output, "    dec r11\n");
+    Emit(output, "    mov rdi, qword [rsp + r11 * 8 + %zu]\n", kFloatLimbs * 8);
+    Emit(output, "    call rt_append_digits\n");
+    Emit(output, ".chunk:\n");
+    Emit(output, "    test r11, r11\n");
+    Emit(output, "    jz .whole\n");
+    Emit(output, "    dec r11\n");
+    Emit(output, "    mov rax, qword [rsp + r11 * 8 + %zu]\n", kFloatLimbs * 8);
+    Emit(output, "    mov rsi, rt_buffer\n");
+    Emit(output, "    add rsi, qword [rt_length]\n");
+    Emit(output, "    mov ecx, 10\n");
+    Emit(output, "    mov r8d, %d\n", kChunkDigits);
+    Emit(output, ".digit:\n");
+    Emit(output, "    xor edx, edx\n");
+    Emit(output, "    div rcx\n");
+    Emit(output, "    add dl, 48\n");
+    Emit(output, "    mov byte [rsi + r8 - 1], dl\n");
+    Emit(output, "    dec r8\n");
+    Emit(output, "    jnz .digit\n");
+    Emit(output, "    add qword [rt_length], %d\n", kChunkDigits);
+    Emit(output, "    jmp .chunk\n");
+    Emit(output, ".whole:\n");
+    Emit(output, "    add rsp, %zu\n", (kFloatLimbs + kFloatChunks) * 8);
+    Emit(output, "    xor edi, edi\n");
+    Emit(output, "    jmp .fraction\n");
+
+    Emit(output, ".integer:\n");
+    Emit(output, "    push rcx\n");
+    Emit(output, "    call rt_append_digits\n");
+    Emit(output, "    pop rdi\n");
+    // 10^6 + дробная часть дает ведущие нули, а лишняя единица заменяется точкой
+    Emit(output, ".fraction:\n");
+    Emit(output, "    add rdi, %llu\n", kFractionScale);
+    Emit(output, "    call rt_append_digits\n");
+    Emit(output, "    mov rsi, rt_buffer\n");
+    Emit(output, "    mov rdi, qword [rt_length]\n");
+    Emit(output, "    mov byte [rsi + rdi - %d], 46\n", kFractionDigits + 1); // '.'
+    // дальше перевод строки из rt_append_newline
+
+    Emit(output, "\nrt_append_newline:\n");
+    Emit(output, "    mov rsi, rt_buffer\n");
+    Emit(output, "    mov rdi, qword [rt_length]\n");
+    Emit(output, "    mov byte [rsi + rdi], 10\n");
+    Emit(output, "    inc rdi\n");
+    Emit(output, "    mov qword [rt_length], rdi\n");
+    Emit(output, "    ret\n");
+
+    // цифры rdi без перевода строки пишутся парами справа налево в red zone под rsp, затем копируются в буфер
+    Emit(output, "\nrt_append_digits:\n");
+    Emit(output, "    mov rax, rdi\n");
+    Emit(output, "    mov r8, rsp\n");
+    Emit(output, "    mov r10, rt_digits\n");
+    Emit(output, "    mov r9, %llu\n", kDivisionBy100Magic);
+    Emit(output, ".pair:\n");
+    Emit(output, "    cmp rax, 100\n");
+    Emit(output, "    jb .tail\n");
+    Emit(output, "    mov rcx, rax\n");
+    Emit(output, "    shr rax, 2\n");
+    Emit(output, "    mul r9\n");
+    Emit(output, "    shr rdx, 2\n");
+    Emit(output, "    imul rax, rdx, 100\n");
+    Emit(output, "    sub rcx, rax\n");
+    Emit(output, "    mov al, byte [r10 + rcx * 2 + 1]\n");
+    Emit(output, "    mov byte [r8 - 1], al\n");
+    Emit(output, "    mov al, byte [r10 + rcx * 2]\n");
+    Emit(output, "    mov byte [r8 - 2], al\n");
+    Emit(output, "    sub r8, 2\n");
+    Emit(output, "    mov rax, rdx\n");
+    Emit(output, "    jmp .pair\n");
+    Emit(output, ".tail:\n");
+    Emit(output, "    cmp rax, 10\n");
+    Emit(output, "    jb .digit\n");
+    Emit(output, "    mov cl, byte [r10 + rax * 2 + 1]\n");
+    Emit(output, "    mov byte [r8 - 1], cl\n");
+    Emit(output, "    mov cl, byte [r10 + rax * 2]\n");
+    Emit(output, "    mov byte [r8 - 2], cl\n");
+    Emit(output, "    sub r8, 2\n");
+    Emit(output, "    jmp .copy\n");
+    Emit(output, ".digit:\n");
+    Emit(output, "    add al, 48\n");
+    Emit(output, "    mov byte [r8 - 1], al\n");
+    Emit(output, "    dec r8\n");
+    Emit(output, ".copy:\n");
+    Emit(output, "    mov rsi, rt_buffer\n");
+    Emit(output, "    mov rdi, qword [rt_length]\n");
+    Emit(output, ".byte:\n");
+    Emit(output, "    mov al, byte [r8]\n");
+    Emit(output, "    mov byte [rsi + rdi], al\n");
+    Emit(output, "    inc rdi\n");
+    Emit(output, "    inc r8\n");
+    Emit(output, "    cmp r8, rsp\n");
+    Emit(output, "    jb .byte\n");
+    Emit(output, "    mov qword [rt_length], rdi\n");
+    Emit(output, "    ret\n");
+
+    // write может записать часть буфера или прерваться сигналом; при ошибке остаток выбрасывается
+    Emit(output, "\nrt_flush:\n");
+    Emit(output, "    mov rsi, rt_buffer\n");
+    Emit(output, "    mov rdx, qword [rt_length]\n");
+    Emit(output, ".write:\n");
+    Emit(output, "    test rdx, rdx\n");
+    Emit(output, "    jz .done\n");
+    Emit(output, "    mov eax, 1\n");
+    Emit(output, "    mov edi, 1\n");
+    Emit(output, "    syscall\n");
+    Emit(output, "    cmp rax, -4\n"); // EINTR
+    Emit(output, "    je .write\n");
+    Emit(output, "    test rax, rax\n");
+    Emit(output, "    jle .done\n");
+    Emit(output, "    add rsi, rax\n");
+    Emit(output, "    sub rdx, rax\n");
+    Emit(output, "    jmp .write\n");
+    Emit(output, ".done:\n");
+    Emit(output, "    mov qword [rt_length], 0\n");
+    Emit(output, "    ret\n");
+}
+
+// main возвращается в libc, и exit сбрасывает буфер stdout
+static void EmitLibcRuntime(TEmitter* output, bool preciseMath) {
+    Emit(output, "global main\n");
+    Emit(output, "extern printf, calloc, free\n");
+    if (preciseMath) {
+        Emit(output, "extern sin, cos\n");
+    }
+
+    Emit(output, "\nsection .data\n");
+    Emit(output, "    fmt db \"%%zu\", 10, 0\n");
+    Emit(output, "    fmt_float db \"%%.%df\", 10, 0\n", kFractionDigits);
+    EmitMathConstants(output);
+    Emit(output, "    rt_avx2 dq 0\n");
+
+    Emit(output, "section .bss\n");
+    Emit(output, "    rt_allocations resq 1\n");
+
+    Emit(output, "section .text\n");
+    Emit(output, "main:\n");
+    Emit(output, "    call rt_detect_simd\n");
+    Emit(output, "    call main1\n");
+    Emit(output, "    xor eax, eax\n");
+    Emit(output, "    ret\n");
+    EmitSimdDetection(output);
+
+    Emit(output, "\nrt_alloc:\n");
+    Emit(output, "    lea rdi, [rdi + %zu]\n", 1 + kAllocationHeaderSize / 8);
+    Emit(output, "    mov esi, 8\n");
+    Emit(output, "    sub rsp, 8\n");
+    Emit(output, "    call calloc\n");
+    Emit(output, "    add rsp, 8\n");
+    EmitAllocationPush(output);
+
+    Emit(output, "\nrt_print:\n");
+    Emit(output, "    mov rsi, rdi\n");
+    Emit(output, "    mov rdi, fmt\n");
+    Emit(output, "    xor eax, eax\n");
+    Emit(output, "    jmp printf\n");
+
+    Emit(output, "\nrt_print_float:\n");
+    Emit(output, "    mov rdi, fmt_float\n");
+    Emit(output, "    mov eax, 1\n");
+    Emit(output, "    jmp printf\n");
+
+    if (!preciseMath) {
+        return;
+    }
+
+    // sin и cos встречаются посреди выражений и в листовых функциях: сохраняются все caller-saved
+    // регистры общего назначения, кроме rax, и стек выравнивается для libm
+    const char* const kSavedRegisters[] = {"rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11"};
+    const size_t kSavedCount = sizeof(kSavedRegisters) / sizeof(kSavedRegisters[0]);
+    const char* const kFunctions[] = {"sin", "cos"};
+    for (size_t i = 0; i < sizeof(kFunctions) / sizeof(kFunctions[0]); i++) {
+        Emit(output, "\nrt_%s:\n", kFunctions[i]);
+        Emit(output, "    push rbp\n");
+        Emit(output, "    mov rbp, rsp\n");
+        for (size_t j = 0; j < kSavedCount; j++) {
+            Emit(output, "    push %s\n", kSavedRegisters[j]);
+        }
+        Emit(output, "    and rsp, -16\n");
+        Emit(output, "    call %s\n", kFunctions[i]);
+        Emit(output, "    lea rsp, [rbp - %zu]\n", 8 * kSavedCount);
+        for (size_t j = kSavedCount; j > 0; j--) {
+            Emit(output, "    pop %s\n", kSavedRegisters[j - 1]);
+        }
+        Emit(output, "    pop rbp\n");
+        Emit(output, "    ret\n");
+    }
+}
+
+// rax - память нового массива: заголовок встает в начало списка rt_allocations. Массивы выделяют и потоки
+// parallel while, поэтому голова меняется xchg, а ссылка на прежнюю голову дописывается после. Возвращает адрес
+// за заголовком
+static void EmitAllocationPush(TEmitter* output) {
+    Emit(output, "    mov rcx, rax\n");
+    Emit(output, "    xchg rcx, qword [rt_allocations]\n");
+    Emit(output, "    mov qword [rax], rcx\n");
+    Emit(output, "    add rax, %zu\n", kAllocationHeaderSize);
+    Emit(output, "    ret\n");
+}
+
+// Вызывается, когда программа завершилась и потоков нет: munmap(2) или free для каждого массива из списка
+// и munmap(2) всей арены длинных чисел
+static void EmitRelease(TEmitter* output, const Options* options) {
+    Emit(output, "\nrt_release:\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    mov rbx, qword [rt_allocations]\n");
+    Emit(output, ".next:\n");
+    Emit(output, "    test rbx, rbx\n");
+    Emit(output, "    jz .released\n");
+    Emit(output, "    mov rdi, rbx\n");
+    if (options->runtime == LibcRuntime) {
+        Emit(output, "    mov rbx, qword [rbx]\n");
+        Emit(output, "    call free\n");
+    } else {
+        Emit(output, "    mov rsi, qword [rbx + 8]\n");
+        Emit(output, "    mov rbx, qword [rbx]\n");
+        Emit(output, "    mov eax, 11\n");
+        Emit(output, "    syscall\n");
+    }
+    Emit(output, "    jmp .next\n");
+    Emit(output, ".released:\n");
+    Emit(output, "    mov qword [rt_allocations], 0\n");
+    if (options->overflow == BignumOverflow) {
+        Emit(output, "    mov rdi, qword [rt_bignum_base]\n");
+        Emit(output, "    test rdi, rdi\n");
+        Emit(output, "    jz .done\n");
+        Emit(output, "    mov rsi, %zu\n", kBignumArenaSize);
+        Emit(output, "    mov eax, 11\n");
+        Emit(output, "    syscall\n");
+        Emit(output, "    mov qword [rt_bignum_base], 0\n");
+        Emit(output, "    mov qword [rt_bignum_next], 0\n");
+        Emit(output, ".done:\n");
+    }
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    ret\n");
+}
+
+// Диапазон итераций поровну делится между потоками, каждый берет порции с начала своего диапазона. Поток,
+// у которого диапазон кончился, забирает вторую половину остатка у другого. Записи потоков и задание лежат
+// на стеке rt_parallel, который ждет все потоки. Вложенный parallel while (из функции, вызванной в потоке)
+// выполняется одним потоком
+static void EmitParallelRuntime(TEmitter* output, const Options* options) {
+    size_t workers = (options->parallelThreads < kMaxParallelWorkers) ? options->parallelThreads : kMaxParallelWorkers;
+
+    if (options->runtime == LibcRuntime) {
+        Emit(output, "extern pthread_create, pthread_join\n");
+    }
+    Emit(output, "\nsection .data\n");
+    Emit(output, "    rt_workers dq %zu\n", workers); // 0 - узнать при первом parallel while
+    Emit(output, "section .bss\n");
+    Emit(output, "    rt_parallel_busy resq 1\n");
+    Emit(output, "section .text\n");
+
+    Emit(output, "\nrt_parallel:\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    push r12\n");
+    Emit(output, "    push r13\n");
+    Emit(output, "    push r14\n");
+    Emit(output, "    push r15\n");
+    Emit(output, "    push rbp\n");
+    Emit(output, "    mov rbp, rsp\n");
+    Emit(output, "    mov rbx, rdi\n");
+    Emit(output, "    mov r14, qword [rbx + %zu]\n", kParallelEndOffset);
+    Emit(output, "    sub r14, qword [rbx + %zu]\n", kParallelBeginOffset);
+    Emit(output, "    jle .return\n");
+    Emit(output, "    cmp qword [rt_workers], 0\n");
+    Emit(output, "    jne .detected\n");
+    Emit(output, "    call rt_detect_workers\n");
+    Emit(output, ".detected:\n");
+    Emit(output, "    mov r12, qword [rt_workers]\n");
+    Emit(output, "    cmp r12, r14\n");
+    Emit(output, "    jbe .limited\n");
+    Emit(output, "    mov r12, r14\n");
+    Emit(output, ".limited:\n");
+    Emit(output, "    mov eax, 1\n");
+    Emit(output, "    xchg rax, qword [rt_parallel_busy]\n");
+    Emit(output, "    mov r15, rax\n");
+    Emit(output, "    test rax, rax\n");
+    Emit(output, "    jz .owner\n");
+    Emit(output, "    mov r12, 1\n");
+    Emit(output, ".owner:\n");
+
+    // порция: n / (потоки * kChunksPerWorker), но не меньше одной итерации
+    Emit(output, "    mov rcx, r12\n");
+    Emit(output, "    imul rcx, rcx, %zu\n", kChunksPerWorker);
+    Emit(output, "    mov rax, r14\n");
+    Emit(output, "    xor edx, edx\n");
+    Emit(output, "    div rcx\n");
+    Emit(output, "    cmp rax, 1\n");
+    Emit(output, "    jae .chunk\n");
+    Emit(output, "    mov eax, 1\n");
+    Emit(output, ".chunk:\n");
+    Emit(output, "    mov qword [rbx + 56], rax\n");
+    Emit(output, "    mov qword [rbx + 48], r12\n");
+    Emit(output, "    mov rax, r12\n");
+    Emit(output, "    imul rax, rax, %zu\n", kParallelRecordSize);
+    Emit(output, "    sub rsp, rax\n");
+    Emit(output, "    and rsp, -%zu\n", kParallelRecordSize);
+    Emit(output, "    mov qword [rbx + 40], rsp\n");
+
+    // поток k получает n / T итераций и еще одну, если k < n % T
+    Emit(output, "    mov rax, r14\n");
+    Emit(output, "    xor edx, edx\n");
+    Emit(output, "    div r12\n");
+    Emit(output, "    mov rcx, qword [rbx + %zu]\n", kParallelBeginOffset);
+    Emit(output, "    mov rsi, rsp\n");
+    Emit(output, "    xor edi, edi\n");
+    Emit(output, ".fill:\n");
+    Emit(output, "    mov qword [rsi], 0\n");
+    Emit(output, "    mov qword [rsi + 8], rcx\n");
+    Emit(output, "    add rcx, rax\n");
+    Emit(output, "    cmp rdi, rdx\n");
+    Emit(output, "    jae .even\n");
+    Emit(output, "    inc rcx\n");
+    Emit(output, ".even:\n");
+    Emit(output, "    mov qword [rsi + 16], rcx\n");
+    Emit(output, "    mov qword [rsi + 24], 0\n");
+    Emit(output, "    mov qword [rsi + 32], rbx\n");
+    Emit(output, "    mov qword [rsi + 40], rdi\n");
+    Emit(output, "    mov qword [rsi + 48], 0\n");
+    Emit(output, "    add rsi, %zu\n", kParallelRecordSize);
+    Emit(output, "    inc rdi\n");
+    Emit(output, "    cmp rdi, r12\n");
+    Emit(output, "    jb .fill\n");
+
+    // поток, который не удалось создать, ничего не делает: его диапазон заберут остальные
+    Emit(output, "    mov r13, 1\n");
+    Emit(output, ".spawn:\n");
+    Emit(output, "    cmp r13, r12\n");
+    Emit(output, "    jae .run\n");
+    Emit(output, "    mov rdi, r13\n");
+    Emit(output, "    imul rdi, rdi, %zu\n", kParallelRecordSize);
+    Emit(output, "    add rdi, qword [rbx + 40]\n");
+    Emit(output, "    call rt_parallel_spawn\n");
+    Emit(output, "    inc r13\n");
+    Emit(output, "    jmp .spawn\n");
+    Emit(output, ".run:\n");
+    Emit(output, "    mov rdi, rbx\n");
+    Emit(output, "    xor esi, esi\n");
+    Emit(output, "    call qword [rbx]\n");
+    Emit(output, "    mov r13, 1\n");
+    Emit(output, ".join:\n");
+    Emit(output, "    cmp r13, r12\n");
+    Emit(output, "    jae .joined\n");
+    Emit(output, "    mov rdi, r13\n");
+    Emit(output, "    imul rdi, rdi, %zu\n", kParallelRecordSize);
+    Emit(output, "    add rdi, qword [rbx + 40]\n");
+    Emit(output, "    call rt_parallel_join\n");
+    Emit(output, "    inc r13\n");
+    Emit(output, "    jmp .join\n");
+    Emit(output, ".joined:\n");
+    Emit(output, "    test r15, r15\n");
+    Emit(output, "    jnz .return\n");
+    Emit(output, "    mov qword [rt_parallel_busy], 0\n");
+    Emit(output, ".return:\n");
+    Emit(output, "    mov rsp, rbp\n");
+    Emit(output, "    pop rbp\n");
+    Emit(output, "    pop r15\n");
+    Emit(output, "    pop r14\n");
+    Emit(output, "    pop r13\n");
+    Emit(output, "    pop r12\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    ret\n");
+
+    EmitParallelNext(output);
+
+    // блокировка для сложения частичных сумм: адрес в rdi
+    Emit(output, "\nrt_parallel_lock:\n");
+    EmitSpinLock(output, "rdi", "rax", "lock");
+    Emit(output, "    ret\n");
+
+    EmitWorkerDetection(output);
+    if (options->runtime == LibcRuntime) {
+        EmitPthreads(output);
+    } else {
+        EmitCloneThreads(output);
+    }
+}
+
+// rt_parallel_next (задание в rdi, номер потока в rsi) возвращает в rax и rdx следующую порцию [lo, hi);
+// rax >= rdx, когда итераций не осталось ни у кого
+static void EmitParallelNext(TEmitter* output) {
+    Emit(output, "\nrt_parallel_next:\n");
+    Emit(output, "    mov r8, rsi\n");
+    Emit(output, "    imul r8, r8, %zu\n", kParallelRecordSize);
+    Emit(output, "    add r8, qword [rdi + 40]\n");
+    Emit(output, "    mov r10, qword [rdi + 48]\n");
+    Emit(output, ".own:\n");
+    EmitSpinLock(output, "r8", "rax", "own_lock");
+    Emit(output, "    mov rax, qword [r8 + 8]\n");
+    Emit(output, "    mov rdx, qword [r8 + 16]\n");
+    Emit(output, "    cmp rax, rdx\n");
+    Emit(output, "    jge .empty\n");
+    Emit(output, "    mov rcx, rax\n");
+    Emit(output, "    add rcx, qword [rdi + 56]\n");
+    Emit(output, "    cmp rcx, rdx\n");
+    Emit(output, "    jge .take\n");
+    Emit(output, "    mov rdx, rcx\n");
+    Emit(output, ".take:\n");
+    Emit(output, "    mov qword [r8 + 8], rdx\n");
+    Emit(output, "    mov qword [r8], 0\n");
+    Emit(output, "    ret\n");
+
+    // остальные потоки по кругу, начиная со следующего
+    Emit(output, ".empty:\n");
+    Emit(output, "    mov qword [r8], 0\n");
+    Emit(output, "    mov r11, rsi\n");
+    Emit(output, "    lea r9, [r10 - 1]\n");
+    Emit(output, ".victim:\n");
+    Emit(output, "    test r9, r9\n");
+    Emit(output, "    jz .done\n");
+    Emit(output, "    dec r9\n");
+    Emit(output, "    inc r11\n");
+    Emit(output, "    cmp r11, r10\n");
+    Emit(output, "    jb .index\n");
+    Emit(output, "    xor r11, r11\n");
+    Emit(output, ".index:\n");
+    Emit(output, "    mov rcx, r11\n");
+    Emit(output, "    imul rcx, rcx, %zu\n", kParallelRecordSize);
+    Emit(output, "    add rcx, qword [rdi + 40]\n");
+    EmitSpinLock(output, "rcx", "rax", "victim_lock");
+    Emit(output, "    mov rax, qword [rcx + 8]\n");
+    Emit(output, "    mov rdx, qword [rcx + 16]\n");
+    Emit(output, "    sub rdx, rax\n");
+    Emit(output, "    jg .steal\n");
+    Emit(output, "    mov qword [rcx], 0\n");
+    Emit(output, "    jmp .victim\n");
+    Emit(output, ".steal:\n");
+    Emit(output, "    shr rdx, 1\n");
+    Emit(output, "    add rdx, rax\n");
+    Emit(output, "    mov rax, qword [rcx + 16]\n");
+    Emit(output, "    mov qword [rcx + 16], rdx\n");
+    Emit(output, "    mov qword [rcx], 0\n");
+    Emit(output, "    mov rcx, rax\n");
+    EmitSpinLock(output, "r8", "rax", "thief_lock");
+    Emit(output, "    mov qword [r8 + 8], rdx\n");
+    Emit(output, "    mov qword [r8 + 16], rcx\n");
+    Emit(output, "    mov qword [r8], 0\n");
+    Emit(output, "    jmp .own\n");
+    Emit(output, ".done:\n");
+    Emit(output, "    xor eax, eax\n");
+    Emit(output, "    xor edx, edx\n");
+    Emit(output, "    ret\n");
+}
+
+// Число процессоров, на которых разрешено работать процессу, из sched_getaffinity(2)
+static void EmitWorkerDetection(TEmitter* output) {
+    Emit(output, "\nrt_detect_workers:\n");
+    Emit(output, "    sub rsp, %zu\n", kAffinityMaskSize);
+    Emit(output, "    xor edi, edi\n");
+    Emit(output, "    mov esi, %zu\n", kAffinityMaskSize);
+    Emit(output, "    mov rdx, rsp\n");
+    Emit(output, "    mov eax, 204\n");
+    Emit(output, "    syscall\n");
+    Emit(output, "    xor ecx, ecx\n");
+    Emit(output, "    test rax, rax\n");
+    Emit(output, "    jle .counted\n");
+    Emit(output, "    mov rsi, rsp\n");
+    Emit(output, "    lea rdi, [rsp + rax]\n");
+    Emit(output, ".word:\n");
+    Emit(output, "    mov rdx, qword [rsi]\n");
+    Emit(output, ".bit:\n");
+    Emit(output, "    test rdx, rdx\n");
+    Emit(output, "    jz .next\n");
+    Emit(output, "    lea r8, [rdx - 1]\n");
+    Emit(output, "    and rdx, r8\n");
+    Emit(output, "    inc rcx\n");
+    Emit(output, "    jmp .bit\n");
+    Emit(output, ".next:\n");
+    Emit(output, "    add rsi, 8\n");
+    Emit(output, "    cmp rsi, rdi\n");
+    Emit(output, "    jb .word\n");
+    Emit(output, ".counted:\n");
+    Emit(output, "    cmp rcx, 1\n");
+    Emit(output, "    jae .some\n");
+    Emit(output, "    mov ecx, 1\n");
+    Emit(output, ".some:\n");
+    Emit(output, "    cmp rcx, %zu\n", kMaxParallelWorkers);
+    Emit(output, "    jbe .store\n");
+    Emit(output, "    mov ecx, %zu\n", kMaxParallelWorkers);
+    Emit(output, ".store:\n");
+    Emit(output, "    mov qword [rt_workers], rcx\n");
+    Emit(output, "    add rsp, %zu\n", kAffinityMaskSize);
+    Emit(output, "    ret\n");
+}
+
+// Без libc поток создает clone(2) на стеке от mmap; на вершине стека лежит адрес записи потока.
+// Поток завершается exit(2), ядро обнуляет tid в записи, а rt_parallel_join ждет этого на futex
+static void EmitCloneThreads(TEmitter* output) {
+    Emit(output, "\nrt_parallel_spawn:\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    mov rbx, rdi\n");
+    Emit(output, "    xor edi, edi\n");
+    Emit(output, "    mov esi, %zu\n", kThreadStackSize);
+    Emit(output, "    mov edx, 3\n"); // PROT_READ | PROT_WRITE
+    Emit(output, "    mov r10, %u\n", kStackMapFlags);
+    Emit(output, "    mov r8, -1\n");
+    Emit(output, "    xor r9, r9\n");
+    Emit(output, "    mov eax, 9\n");
+    Emit(output, "    syscall\n");
+    Emit(output, "    cmp rax, -4096\n");
+    Emit(output, "    ja .return\n");
+    Emit(output, "    mov qword [rbx + 48], rax\n");
+    Emit(output, "    lea rsi, [rax + %zu]\n", kThreadStackSize - 16);
+    Emit(output, "    mov qword [rsi], rbx\n");
+    Emit(output, "    mov edi, %u\n", kCloneFlags);
+    Emit(output, "    lea rdx, [rbx + 24]\n");
+    Emit(output, "    lea r10, [rbx + 24]\n");
+    Emit(output, "    xor r8, r8\n");
+    Emit(output, "    mov eax, 56\n");
+    Emit(output, "    syscall\n");
+    Emit(output, "    test rax, rax\n");
+    Emit(output, "    jz .child\n");
+    Emit(output, "    jns .return\n");
+    Emit(output, "    mov rdi, qword [rbx + 48]\n");
+    Emit(output, "    mov esi, %zu\n", kThreadStackSize);
+    Emit(output, "    mov eax, 11\n");
+    Emit(output, "    syscall\n");
+    Emit(output, "    mov qword [rbx + 48], 0\n");
+    Emit(output, ".return:\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    ret\n");
+    Emit(output, ".child:\n");
+    Emit(output, "    mov rax, qword [rsp]\n");
+    Emit(output, "    mov rdi, qword [rax + 32]\n");
+    Emit(output, "    mov rsi, qword [rax + 40]\n");
+    Emit(output, "    call qword [rdi]\n");
+    Emit(output, "    mov eax, 60\n");
+    Emit(output, "    xor edi, edi\n");
+    Emit(output, "    syscall\n");
+
+    Emit(output, "\nrt_parallel_join:\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    mov rbx, rdi\n");
+    Emit(output, ".wait:\n");
+    Emit(output, "    mov edx, dword [rbx + 24]\n");
+    Emit(output, "    test edx, edx\n");
+    Emit(output, "    jz .exited\n");
+    Emit(output, "    lea rdi, [rbx + 24]\n");
+    Emit(output, "    xor esi, esi\n"); // FUTEX_WAIT
+    Emit(output, "    xor r10, r10\n");
+    Emit(output, "    mov eax, 202\n");
+    Emit(output, "    syscall\n");
+    Emit(output, "    jmp .wait\n");
+    Emit(output, ".exited:\n");
+    Emit(output, "    mov rdi, qword [rbx + 48]\n");
+    Emit(output, "    test rdi, rdi\n");
+    Emit(output, "    jz .done\n");
+    Emit(output, "    mov esi, %zu\n", kThreadStackSize);
+    Emit(output, "    mov eax, 11\n");
+    Emit(output, "    syscall\n");
+    Emit(output, ".done:\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    ret\n");
+}
+
+// С libc потоки - pthreads; pthread_t лежит в записи на месте tid, 0 - поток не создан
+static void EmitPthreads(TEmitter* output) {
+    Emit(output, "\nrt_parallel_spawn:\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    mov rbx, rdi\n");
+    Emit(output, "    mov rcx, rdi\n");
+    Emit(output, "    lea rdi, [rbx + 24]\n");
+    Emit(output, "    xor esi, esi\n");
+    Emit(output, "    mov rdx, rt_parallel_thread\n");
+    Emit(output, "    call pthread_create\n");
+    Emit(output, "    test eax, eax\n");
+    Emit(output, "    jz .done\n");
+    Emit(output, "    mov qword [rbx + 24], 0\n");
+    Emit(output, ".done:\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    ret\n");
+
+    Emit(output, "\nrt_parallel_thread:\n");
+    Emit(output, "    sub rsp, 8\n");
+    Emit(output, "    mov rax, rdi\n");
+    Emit(output, "    mov rdi, qword [rax + 32]\n");
+    Emit(output, "    mov rsi, qword [rax + 40]\n");
+    Emit(output, "    call qword [rdi]\n");
+    Emit(output, "    add rsp, 8\n");
+    Emit(output, "    xor eax, eax\n");
+    Emit(output, "    ret\n");
+
+    Emit(output, "\nrt_parallel_join:\n");
+    Emit(output, "    mov rax, qword [rdi + 24]\n");
+    Emit(output, "    test rax, rax\n");
+    Emit(output, "    jz .done\n");
+    Emit(output, "    sub rsp, 8\n");
+    Emit(output, "    mov rdi, rax\n");
+    Emit(output, "    xor esi, esi\n");
+    Emit(output, "    call pthread_join\n");
+    Emit(output, "    add rsp, 8\n");
+    Emit(output, ".done:\n");
+    Emit(output, "    ret\n");
+}
+
+// xchg с памятью атомарен; пока блокировка занята, pause разгружает конвейер
+static void EmitSpinLock(TEmitter* output, const char* lock, const char* scratch, const char* label) {
+    Emit(output, ".%s:\n", label);
+    Emit(output, "    mov %s, 1\n", scratch);
+    Emit(output, "    xchg %s, qword [%s]\n", scratch, lock);
+    Emit(output, "    test %s, %s\n", scratch, scratch);
+    Emit(output, "    jz .%s_done\n", label);
+    Emit(output, "    pause\n");
+    Emit(output, "    jmp .%s\n", label);
+    Emit(output, ".%s_done:\n", label);
+}
+
+// Длинное число в арене: [число limb'ов, знак, limb'ы модуля от младшего]. Результат операции пишется в арену
+// первым, за ним - временные буферы; если он поместился в машинное слово, арена откатывается целиком.
+// Точки входа получают левый операнд в rax и правый в rcx и сохраняют все регистры, кроме результата
+static void EmitBignumRuntime(TEmitter* output, const Options* options) {
+    if (options->runtime == LibcRuntime) {
+        Emit(output, "extern exit\n");
+    }
+    Emit(output, "\nsection .data\n");
+    Emit(output, "    rt_two32 dq %llu\n", GetDoubleBits(4294967296.0));
+    Emit(output, "    rt_bignum_exhausted db \"%s\", 10, 0\n", kBignumExhaustedMessage);
+    if (options->runtime == LibcRuntime) {
+        Emit(output, "    rt_fmt_minus db \"-\", 0\n");
+        Emit(output, "    rt_fmt_head db \"%%llu\", 0\n");
+        Emit(output, "    rt_fmt_chunk db \"%%0%dllu\", 0\n", kChunkDigits);
+        Emit(output, "    rt_fmt_newline db 10, 0\n");
+    }
+    Emit(output, "section .bss\n");
+    Emit(output, "    rt_bignum_base resq 1\n");
+    Emit(output, "    rt_bignum_next resq 1\n");
+    Emit(output, "section .text\n");
+
+    EmitBignumEntry(output, "add", BignumValue);
+    EmitBignumEntry(output, "sub", BignumValue);
+    EmitBignumEntry(output, "mul", BignumValue);
+    EmitBignumEntry(output, "div", BignumValue);
+    EmitBignumEntry(output, "compare", BignumFlags);
+    EmitBignumEntry(output, "print", BignumValue);
+    EmitBignumEntry(output, "float", BignumFloatBits);
+
+    Emit(output, "\nrt_bignum_add.body:\n");
+    Emit(output, "    xor edx, edx\n");
+    Emit(output, "    jmp rt_bignum_sum\n");
+    Emit(output, "\nrt_bignum_sub.body:\n");
+    Emit(output, "    mov edx, 1\n");
+    Emit(output, "    jmp rt_bignum_sum\n");
+
+    EmitBignumMemory(output, options);
+    EmitBignumArithmetic(output);
+    EmitBignumMultiplication(output);
+    EmitBignumDivision(output);
+    EmitBignumOutput(output, options);
+}
+
+// Обертка сохраняет caller-saved регистры и выравнивает стек: медленный путь вызывается посреди выражения
+// и из листовых функций, где переменные живут в rdi, rsi, r8-r11. compare возвращает флаги cmp a, b
+// и не меняет rax, float возвращает биты double в rax и не меняет xmm0 и xmm1
+static void EmitBignumEntry(TEmitter* output, const char* name, BignumResult result) {
+    const char* const kSavedRegisters[] = {"rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11", "rax"};
+    const size_t kSavedCount = (result == BignumFlags) ? 9 : 8;
+
+    Emit(output, "\nrt_bignum_%s:\n", name);
+    Emit(output, "    push rbp\n");
+    Emit(output, "    mov rbp, rsp\n");
+    for (size_t i = 0; i < kSavedCount; i++) {
+        Emit(output, "    push %s\n", kSavedRegisters[i]);
+    }
+    Emit(output, "    and rsp, -16\n");
+    if (result == BignumFloatBits) {
+        Emit(output, "    sub rsp, 16\n");
+        Emit(output, "    movsd qword [rsp], xmm0\n");
+        Emit(output, "    movsd qword [rsp + 8], xmm1\n");
+    }
+    Emit(output, "    mov rdi, rax\n");
+    Emit(output, "    mov rsi, rcx\n");
+    Emit(output, "    call rt_bignum_%s.body\n", name);
+    if (result == BignumFloatBits) {
+        Emit(output, "    movq rax, xmm0\n");
+        Emit(output, "    movsd xmm0, qword [rsp]\n");
+        Emit(output, "    movsd xmm1, qword [rsp + 8]\n");
+    } else if (result == BignumFlags) {
+        Emit(output, "    cmp rax, 0\n");
+    }
+    Emit(output, "    lea rsp, [rbp - %zu]\n", 8 * kSavedCount);
+    for (size_t i = kSavedCount; i > 0; i--) {
+        Emit(output, "    pop %s\n", kSavedRegisters[i - 1]);
+    }
+    Emit(output, "    pop rbp\n");
+    Emit(output, "    ret\n");
+}
+
+// Арена резервируется mmap(2) с MAP_NORESERVE при первом длинном числе, страницы появляются по мере записи
+static void EmitBignumMemory(TEmitter* output, const Options* options) {
+    // rt_bignum_alloc: rdi qword'ов -> rax, портит caller-saved регистры
+    Emit(output, "\nrt_bignum_alloc:\n");
+    Emit(output, "    mov rax, qword [rt_bignum_next]\n");
+    Emit(output, "    test rax, rax\n");
+    Emit(output, "    jnz .mapped\n");
+    Emit(output, "    push rdi\n");
+    Emit(output, "    xor edi, edi\n");
+    Emit(output, "    mov rsi, %zu\n", kBignumArenaSize);
+    Emit(output, "    mov edx, 3\n"); // PROT_READ | PROT_WRITE
+    Emit(output, "    mov r10, %u\n", kStackMapFlags);
+    Emit(output, "    mov r8, -1\n");
+    Emit(output, "    xor r9, r9\n");
+    Emit(output, "    mov eax, 9\n");
+    Emit(output, "    syscall\n");
+    Emit(output, "    pop rdi\n");
+    Emit(output, "    cmp rax, -4096\n");
+    Emit(output, "    ja rt_bignum_fail\n");
+    Emit(output, "    mov qword [rt_bignum_base], rax\n");
+    Emit(output, ".mapped:\n");
+    Emit(output, "    lea rdx, [rax + rdi * 8]\n");
+    Emit(output, "    mov rcx, %zu\n", kBignumArenaSize);
+    Emit(output, "    add rcx, qword [rt_bignum_base]\n");
+    Emit(output, "    cmp rdx, rcx\n");
+    Emit(output, "    ja rt_bignum_fail\n");
+    Emit(output, "    mov qword [rt_bignum_next], rdx\n");
+    Emit(output, "    ret\n");
+
+    // арена кончилась: сообщение в stderr после уже напечатанного и код возврата 1
+    Emit(output, "\nrt_bignum_fail:\n");
+    if (options->runtime == LibcRuntime) {
+        Emit(output, "    mov edi, 2\n");
+        Emit(output, "    mov rsi, rt_bignum_exhausted\n");
+        Emit(output, "    mov edx, %zu\n", strlen(kBignumExhaustedMessage) + 1);
+        Emit(output, "    mov eax, 1\n");
+        Emit(output, "    syscall\n");
+        Emit(output, "    and rsp, -16\n");
+        Emit(output, "    mov edi, 1\n");
+        Emit(output, "    call exit\n");
+    } else {
+        Emit(output, "    call rt_flush\n");
+        Emit(output, "    mov edi, 2\n");
+        Emit(output, "    mov rsi, rt_bignum_exhausted\n");
+        Emit(output, "    mov edx, %zu\n", strlen(kBignumExhaustedMessage) + 1);
+        Emit(output, "    mov eax, 1\n");
+        Emit(output, "    syscall\n");
+        Emit(output, "    mov eax, 60\n");
+        Emit(output, "    mov edi, 1\n");
+        Emit(output, "    syscall\n");
+    }
+
+    // rt_bignum_unpack: значение в rdi -> rax, адрес числа; машинное слово раскладывается в 3 qword'а по rsi
+    Emit(output, "\nrt_bignum_unpack:\n");
+    Emit(output, "    cmp rdi, %lld\n", kBignumCheck);
+    Emit(output, "    jo .bignum\n");
+    Emit(output, "    mov qword [rsi], 1\n");
+    Emit(output, "    xor eax, eax\n");
+    Emit(output, "    mov rdx, rdi\n");
+    Emit(output, "    test rdi, rdi\n");
+    Emit(output, "    jns .positive\n");
+    Emit(output, "    neg rdx\n"); // -2^63 остается 2^63 без знака
+    Emit(output, "    mov eax, 1\n");
+    Emit(output, ".positive:\n");
+    Emit(output, "    mov qword [rsi + 8], rax\n");
+    Emit(output, "    mov qword [rsi + 16], rdx\n");
+    Emit(output, "    mov rax, rsi\n");
+    Emit(output, "    ret\n");
+    Emit(output, ".bignum:\n");
+    Emit(output, "    mov rax, %lld\n", kMaxSmallInteger + (1LL << 31));
+    Emit(output, "    sub rax, rdi\n");
+    Emit(output, "    shl rax, 3\n");
+    Emit(output, "    add rax, qword [rt_bignum_base]\n");
+    Emit(output, "    ret\n");
+
+    // rt_bignum_pack: число в rdi (на вершине арены), rsi limb'ов, знак в rdx -> rax, значение. Старшие нулевые
+    // limb'ы отбрасываются; то, что помещается в машинное слово, возвращается как есть, и арена откатывается
+    Emit(output, "\nrt_bignum_pack:\n");
+    Emit(output, "    test rsi, rsi\n");
+    Emit(output, "    jz .empty\n");
+    Emit(output, "    cmp qword [rdi + rsi * 8 + 8], 0\n");
+    Emit(output, "    jne .trimmed\n");
+    Emit(output, "    dec rsi\n");
+    Emit(output, "    jmp rt_bignum_pack\n");
+    Emit(output, ".empty:\n");
+    Emit(output, "    mov qword [rt_bignum_next], rdi\n");
+    Emit(output, "    xor eax, eax\n");
+    Emit(output, "    ret\n");
+    Emit(output, ".trimmed:\n");
+    Emit(output, "    cmp rsi, 1\n");
+    Emit(output, "    jne .bignum\n");
+    Emit(output, "    mov rax, qword [rdi + 16]\n");
+    Emit(output, "    test rdx, rdx\n");
+    Emit(output, "    jnz .negative\n");
+    Emit(output, "    mov rcx, %lld\n", kMaxSmallInteger);
+    Emit(output, "    cmp rax, rcx\n");
+    Emit(output, "    ja .bignum\n");
+    Emit(output, "    mov qword [rt_bignum_next], rdi\n");
+    Emit(output, "    ret\n");
+    Emit(output, ".negative:\n");
+    Emit(output, "    mov rcx, %llu\n", 1ULL << 63);
+    Emit(output, "    cmp rax, rcx\n");
+    Emit(output, "    ja .bignum\n");
+    Emit(output, "    neg rax\n");
+    Emit(output, "    mov qword [rt_bignum_next], rdi\n");
+    Emit(output, "    ret\n");
+    Emit(output, ".bignum:\n");
+    Emit(output, "    mov qword [rdi], rsi\n");
+    Emit(output, "    mov qword [rdi + 8], rdx\n");
+    Emit(output, "    lea rax, [rdi + rsi * 8 + 16]\n");
+    Emit(output, "    mov qword [rt_bignum_next], rax\n");
+    Emit(output, "    mov rax, rdi\n");
+    Emit(output, "    sub rax, qword [rt_bignum_base]\n");
+    Emit(output, "    shr rax, 3\n");
+    Emit(output, "    mov rcx, %lld\n", kMaxSmallInteger + (1LL << 31));
+    Emit(output, "    sub rcx, rax\n");
+    Emit(output, "    mov rax, rcx\n");
+    Emit(output, "    ret\n");
+
+    // rt_bignum_copy: rdx limb'ов из rsi в rdi; rt_bignum_zero: rsi нулевых limb'ов в rdi
+    Emit(output, "\nrt_bignum_copy:\n");
+    Emit(output, "    test rdx, rdx\n");
+    Emit(output, "    jz .done\n");
+    Emit(output, "    mov rax, qword [rsi]\n");
+    Emit(output, "    mov qword [rdi], rax\n");
+    Emit(output, "    add rsi, 8\n");
+    Emit(output, "    add rdi, 8\n");
+    Emit(output, "    dec rdx\n");
+    Emit(output, "    jmp rt_bignum_copy\n");
+    Emit(output, ".done:\n");
+    Emit(output, "    ret\n");
+
+    Emit(output, "\nrt_bignum_zero:\n");
+    Emit(output, "    test rsi, rsi\n");
+    Emit(output, "    jz .done\n");
+    Emit(output, "    mov qword [rdi], 0\n");
+    Emit(output, "    add rdi, 8\n");
+    Emit(output, "    dec rsi\n");
+    Emit(output, "    jmp rt_bignum_zero\n");
+    Emit(output, ".done:\n");
+    Emit(output, "    ret\n");
+}
+
+// Кадр операции над двумя значениями: rbx и r12 - адреса операндов, r13 - результат, копии машинных слов
+// лежат в [rbp - 64] и [rbp - 88], rdx при входе - в [rbp - 96]
+static void EmitBignumPrologue(TEmitter* output) {
+    Emit(output, "    push rbp\n");
+    Emit(output, "    mov rbp, rsp\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    push r12\n");
+    Emit(output, "    push r13\n");
+    Emit(output, "    push r14\n");
+    Emit(output, "    push r15\n");
+    Emit(output, "    sub rsp, 56\n");
+    Emit(output, "    mov qword [rbp - 96], rdx\n");
+    Emit(output, "    mov r12, rsi\n");
+    Emit(output, "    lea rsi, [rbp - 64]\n");
+    Emit(output, "    call rt_bignum_unpack\n");
+    Emit(output, "    mov rbx, rax\n");
+    Emit(output, "    mov rdi, r12\n");
+    Emit(output, "    lea rsi, [rbp - 88]\n");
+    Emit(output, "    call rt_bignum_unpack\n");
+    Emit(output, "    mov r12, rax\n");
+}
+
+static void EmitBignumEpilogue(TEmitter* output) {
+    Emit(output, ".return:\n");
+    Emit(output, "    lea rsp, [rbp - 40]\n");
+    Emit(output, "    pop r15\n");
+    Emit(output, "    pop r14\n");
+    Emit(output, "    pop r13\n");
+    Emit(output, "    pop r12\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    pop rbp\n");
+    Emit(output, "    ret\n");
+}
+
+static void EmitBignumArithmetic(TEmitter* output) {
+    // rt_bignum_sum: rdi + rsi или rdi - rsi при rdx = 1. Одинаковые знаки складывают модули, разные вычитают
+    // меньший модуль из большего, и результат получает знак большего
+    Emit(output, "\nrt_bignum_sum:\n");
+    EmitBignumPrologue(output);
+    Emit(output, "    mov r15, qword [rbp - 96]\n");
+    Emit(output, "    xor r15, qword [r12 + 8]\n");
+    Emit(output, "    cmp r15, qword [rbx + 8]\n");
+    Emit(output, "    jne .different\n");
+    Emit(output, "    mov rax, qword [rbx]\n");
+    Emit(output, "    cmp rax, qword [r12]\n");
+    Emit(output, "    jae .longer\n");
+    Emit(output, "    xchg rbx, r12\n");
+    Emit(output, ".longer:\n");
+    Emit(output, "    mov r14, qword [rbx]\n");
+    Emit(output, "    lea rdi, [r14 + 3]\n");
+    Emit(output, "    call rt_bignum_alloc\n");
+    Emit(output, "    mov r13, rax\n");
+    Emit(output, "    lea rdi, [r13 + 16]\n");
+    Emit(output, "    lea rsi, [rbx + 16]\n");
+    Emit(output, "    mov rdx, r14\n");
+    Emit(output, "    call rt_bignum_copy\n");
+    Emit(output, "    mov qword [r13 + r14 * 8 + 16], 0\n");
+    Emit(output, "    inc r14\n");
+    Emit(output, "    lea rdi, [r13 + 16]\n");
+    Emit(output, "    mov rsi, r14\n");
+    Emit(output, "    lea rdx, [r12 + 16]\n");
+    Emit(output, "    mov rcx, qword [r12]\n");
+    Emit(output, "    call rt_bignum_add_into\n");
+    Emit(output, "    jmp .pack\n");
+    Emit(output, ".different:\n");
+    Emit(output, "    lea rdi, [rbx + 16]\n");
+    Emit(output, "    mov rsi, qword [rbx]\n");
+    Emit(output, "    lea rdx, [r12 + 16]\n");
+    Emit(output, "    mov rcx, qword [r12]\n");
+    Emit(output, "    call rt_bignum_compare_magnitudes\n");
+    Emit(output, "    mov r15, qword [rbx + 8]\n");
+    Emit(output, "    test rax, rax\n");
+    Emit(output, "    jns .larger\n");
+    Emit(output, "    xchg rbx, r12\n");
+    Emit(output, "    xor r15, 1\n");
+    Emit(output, ".larger:\n");
+    Emit(output, "    mov r14, qword [rbx]\n");
+    Emit(output, "    lea rdi, [r14 + 2]\n");
+    Emit(output, "    call rt_bignum_alloc\n");
+    Emit(output, "    mov r13, rax\n");
+    Emit(output, "    lea rdi, [r13 + 16]\n");
+    Emit(output, "    lea rsi, [rbx + 16]\n");
+    Emit(output, "    mov rdx, r14\n");
+    Emit(output, "    call rt_bignum_copy\n");
+    Emit(output, "    lea rdi, [r13 + 16]\n");
+    Emit(output, "    mov rsi, r14\n");
+    Emit(output, "    lea rdx, [r12 + 16]\n");
+    Emit(output, "    mov rcx, qword [r12]\n");
+    Emit(output, "    call rt_bignum_sub_into\n");
+    Emit(output, ".pack:\n");
+    Emit(output, "    mov rdi, r13\n");
+    Emit(output, "    mov rsi, r14\n");
+    Emit(output, "    mov rdx, r15\n");
+    Emit(output, "    call rt_bignum_pack\n");
+    EmitBignumEpilogue(output);
+
+    Emit(output, "\nrt_bignum_mul.body:\n");
+    EmitBignumPrologue(output);
+    Emit(output, "    mov r15, qword [rbx + 8]\n");
+    Emit(output, "    xor r15, qword [r12 + 8]\n");
+    Emit(output, "    mov r14, qword [rbx]\n");
+    Emit(output, "    add r14, qword [r12]\n");
+    Emit(output, "    lea rdi, [r14 + 2]\n");
+    Emit(output, "    call rt_bignum_alloc\n");
+    Emit(output, "    mov r13, rax\n");
+    Emit(output, "    lea rdi, [r13 + 16]\n");
+    Emit(output, "    lea rsi, [rbx + 16]\n");
+    Emit(output, "    mov rdx, qword [rbx]\n");
+    Emit(output, "    lea rcx, [r12 + 16]\n");
+    Emit(output, "    mov r8, qword [r12]\n");
+    Emit(output, "    call rt_bignum_multiply\n");
+    Emit(output, "    mov rdi, r13\n");
+    Emit(output, "    mov rsi, r14\n");
+    Emit(output, "    mov rdx, r15\n");
+    Emit(output, "    call rt_bignum_pack\n");
+    EmitBignumEpilogue(output);
+
+    // частное округляется к нулю, как у idiv; делитель из одного limb'а - div по limb'ам от старшего
+    Emit(output, "\nrt_bignum_div.body:\n");
+    EmitBignumPrologue(output);
+    Emit(output, "    mov r15, qword [rbx + 8]\n");
+    Emit(output, "    xor r15, qword [r12 + 8]\n");
+    Emit(output, "    mov r14, qword [rbx]\n");
+    Emit(output, "    lea rdi, [r14 + 2]\n");
+    Emit(output, "    call rt_bignum_alloc\n");
+    Emit(output, "    mov r13, rax\n");
+    Emit(output, "    cmp qword [r12], 1\n");
+    Emit(output, "    jne .long\n");
+    Emit(output, "    mov rcx, qword [r12 + 16]\n");
+    Emit(output, "    mov r8, r14\n");
+    Emit(output, "    xor edx, edx\n");
+    Emit(output, ".limb:\n");
+    Emit(output, "    dec r8\n");
+    Emit(output, "    mov rax, qword [rbx + r8 * 8 + 16]\n");
+    Emit(output, "    div rcx\n");
+    Emit(output, "    mov qword [r13 + r8 * 8 + 16], rax\n");
+    Emit(output, "    test r8, r8\n");
+    Emit(output, "    jnz .limb\n");
+    Emit(output, "    jmp .pack\n");
+    Emit(output, ".long:\n");
+    Emit(output, "    lea rdi, [r13 + 16]\n");
+    Emit(output, "    lea rsi, [rbx + 16]\n");
+    Emit(output, "    mov rdx, r14\n");
+    Emit(output, "    lea rcx, [r12 + 16]\n");
+    Emit(output, "    mov r8, qword [r12]\n");
+    Emit(output, "    call rt_bignum_divide\n");
+    Emit(output, ".pack:\n");
+    Emit(output, "    mov rdi, r13\n");
+    Emit(output, "    mov rsi, r14\n");
+    Emit(output, "    mov rdx, r15\n");
+    Emit(output, "    call rt_bignum_pack\n");
+    EmitBignumEpilogue(output);
+
+    Emit(output, "\nrt_bignum_compare.body:\n");
+    EmitBignumPrologue(output);
+    Emit(output, "    mov rax, qword [rbx + 8]\n");
+    Emit(output, "    cmp rax, qword [r12 + 8]\n");
+    Emit(output, "    je .same\n");
+    Emit(output, "    neg rax\n"); // отрицательное меньше: -1, иначе 1
+    Emit(output, "    or rax, 1\n");
+    Emit(output, "    jmp .return\n");
+    Emit(output, ".same:\n");
+    Emit(output, "    lea rdi, [rbx + 16]\n");
+    Emit(output, "    mov rsi, qword [rbx]\n");
+    Emit(output, "    lea rdx, [r12 + 16]\n");
+    Emit(output, "    mov rcx, qword [r12]\n");
+    Emit(output, "    call rt_bignum_compare_magnitudes\n");
+    Emit(output, "    cmp qword [rbx + 8], 0\n");
+    Emit(output, "    je .return\n");
+    Emit(output, "    neg rax\n");
+    EmitBignumEpilogue(output);
+
+    // rt_bignum_compare_magnitudes: модули rdi (rsi limb'ов) и rdx (rcx limb'ов) без старших нулей -> rax: -1, 0, 1
+    Emit(output, "\nrt_bignum_compare_magnitudes:\n");
+    Emit(output, "    cmp rsi, rcx\n");
+    Emit(output, "    jne .different\n");
+    Emit(output, ".limb:\n");
+    Emit(output, "    test rsi, rsi\n");
+    Emit(output, "    jz .equal\n");
+    Emit(output, "    dec rsi\n");
+    Emit(output, "    mov rax, qword [rdi + rsi * 8]\n");
+    Emit(output, "    cmp rax, qword [rdx + rsi * 8]\n");
+    Emit(output, "    je .limb\n");
+    Emit(output, ".different:\n");
+    Emit(output, "    sbb rax, rax\n");
+    Emit(output, "    or rax, 1\n");
+    Emit(output, "    ret\n");
+    Emit(output, ".equal:\n");
+    Emit(output, "    xor eax, eax\n");
+    Emit(output, "    ret\n");
+
+    // rt_bignum_add_into и rt_bignum_sub_into: rdi (rsi limb'ов) +=, -= rdx (rcx limb'ов, не больше rsi).
+    // Перенос между итерациями хранится в r9 как 0 или -1: neg r9 возвращает его во флаг CF
+    const char* const kNames[] = {"add", "sub"};
+    const char* const kWithCarry[] = {"adc", "sbb"};
+    for (size_t i = 0; i < 2; i++) {
+        Emit(output, "\nrt_bignum_%s_into:\n", kNames[i]);
+        Emit(output, "    xor r8d, r8d\n");
+        Emit(output, "    xor r9d, r9d\n");
+        Emit(output, ".limb:\n");
+        Emit(output, "    cmp r8, rcx\n");
+        Emit(output, "    jae .carry\n");
+        Emit(output, "    mov rax, qword [rdx + r8 * 8]\n");
+        Emit(output, "    neg r9\n");
+        Emit(output, "    %s qword [rdi + r8 * 8], rax\n", kWithCarry[i]);
+        Emit(output, "    sbb r9, r9\n");
+        Emit(output, "    inc r8\n");
+        Emit(output, "    jmp .limb\n");
+        Emit(output, ".carry:\n");
+        Emit(output, "    test r9, r9\n");
+        Emit(output, "    jz .done\n");
+        Emit(output, "    cmp r8, rsi\n");
+        Emit(output, "    jae .done\n");
+        Emit(output, "    %s qword [rdi + r8 * 8], 1\n", kNames[i]);
+        Emit(output, "    sbb r9, r9\n");
+        Emit(output, "    inc r8\n");
+        Emit(output, "    jmp .carry\n");
+        Emit(output, ".done:\n");
+        Emit(output, "    ret\n");
+    }
+}
+
+// rt_bignum_multiply: rdi = rsi (rdx limb'ов) * rcx (r8 limb'ов), пишет rdx + r8 limb'ов. Если меньший множитель
+// короче kKaratsubaThreshold - столбиком, иначе по Карацубе: a = a1 * B^m + a0, b = b1 * B^m + b0,
+// ab = z2 * B^2m + ((a0 + a1)(b0 + b1) - z0 - z2) * B^m + z0 - три умножения половинной длины вместо четырех.
+// Множитель не длиннее половины другого умножается на каждую половину отдельно
+static void EmitBignumMultiplication(TEmitter* output) {
+    Emit(output, "\nrt_bignum_multiply:\n");
+    Emit(output, "    cmp rdx, r8\n");
+    Emit(output, "    jae .ordered\n");
+    Emit(output, "    xchg rsi, rcx\n");
+    Emit(output, "    xchg rdx, r8\n");
+    Emit(output, ".ordered:\n");
+    Emit(output, "    cmp r8, %zu\n", kKaratsubaThreshold);
+    Emit(output, "    jb rt_bignum_multiply_basic\n");
+    Emit(output, "    push rbp\n");
+    Emit(output, "    mov rbp, rsp\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    push r12\n");
+    Emit(output, "    push r13\n");
+    Emit(output, "    push r14\n");
+    Emit(output, "    push r15\n");
+    Emit(output, "    sub rsp, 40\n");
+    Emit(output, "    mov rbx, rdi\n");
+    Emit(output, "    mov r12, rsi\n");
+    Emit(output, "    mov r13, rdx\n");
+    Emit(output, "    mov r14, rcx\n");
+    Emit(output, "    mov r15, r8\n");
+    Emit(output, "    mov rax, qword [rt_bignum_next]\n");
+    Emit(output, "    mov qword [rbp - 48], rax\n");
+    Emit(output, "    lea rax, [r13 + 1]\n");
+    Emit(output, "    shr rax, 1\n");
+    Emit(output, "    mov qword [rbp - 56], rax\n"); // m
+    Emit(output, "    cmp r15, rax\n");
+    Emit(output, "    ja .balanced\n");
+
+    Emit(output, "    mov rdi, rbx\n");
+    Emit(output, "    mov rsi, r12\n");
+    Emit(output, "    mov rdx, rax\n");
+    Emit(output, "    mov rcx, r14\n");
+    Emit(output, "    mov r8, r15\n");
+    Emit(output, "    call rt_bignum_multiply\n"); // a0 * b -> r [0, m + bn)
+    Emit(output, "    mov rdi, r13\n");
+    Emit(output, "    sub rdi, qword [rbp - 56]\n");
+    Emit(output, "    add rdi, r15\n");
+    Emit(output, "    call rt_bignum_alloc\n");
+    Emit(output, "    mov qword [rbp - 64], rax\n");
+    Emit(output, "    mov rdi, rax\n");
+    Emit(output, "    mov rax, qword [rbp - 56]\n");
+    Emit(output, "    lea rsi, [r12 + rax * 8]\n");
+    Emit(output, "    mov rdx, r13\n");
+    Emit(output, "    sub rdx, rax\n");
+    Emit(output, "    mov rcx, r14\n");
+    Emit(output, "    mov r8, r15\n");
+    Emit(output, "    call rt_bignum_multiply\n"); // a1 * b
+    Emit(output, "    mov rax, qword [rbp - 56]\n");
+    Emit(output, "    lea rdi, [rax + r15]\n");
+    Emit(output, "    lea rdi, [rbx + rdi * 8]\n");
+    Emit(output, "    mov rsi, r13\n");
+    Emit(output, "    sub rsi, rax\n");
+    Emit(output, "    call rt_bignum_zero\n"); // r [m + bn, an + bn)
+    Emit(output, "    mov rax, qword [rbp - 56]\n");
+    Emit(output, "    lea rdi, [rbx + rax * 8]\n");
+    Emit(output, "    lea rsi, [r13 + r15]\n");
+    Emit(output, "    sub rsi, rax\n");
+    Emit(output, "    mov rdx, qword [rbp - 64]\n");
+    Emit(output, "    mov rcx, r13\n");
+    Emit(output, "    sub rcx, rax\n");
+    Emit(output, "    add rcx, r15\n");
+    Emit(output, "    call rt_bignum_add_into\n");
+    Emit(output, "    jmp .return\n");
+
+    Emit(output, ".balanced:\n");
+    Emit(output, "    mov rdi, rbx\n");
+    Emit(output, "    mov rsi, r12\n");
+    Emit(output, "    mov rdx, rax\n");
+    Emit(output, "    mov rcx, r14\n");
+    Emit(output, "    mov r8, rax\n");
+    Emit(output, "    call rt_bignum_multiply\n"); // z0 -> r [0, 2m)
+    Emit(output, "    mov rax, qword [rbp - 56]\n");
+    Emit(output, "    mov rdi, rax\n");
+    Emit(output, "    shl rdi, 4\n");
+    Emit(output, "    add rdi, rbx\n");
+    Emit(output, "    lea rsi, [r12 + rax * 8]\n");
+    Emit(output, "    mov rdx, r13\n");
+    Emit(output, "    sub rdx, rax\n");
+    Emit(output, "    lea rcx, [r14 + rax * 8]\n");
+    Emit(output, "    mov r8, r15\n");
+    Emit(output, "    sub r8, rax\n");
+    Emit(output, "    call rt_bignum_multiply\n"); // z2 -> r [2m, an + bn)
+
+    // a0 + a1 и b0 + b1 по m + 1 limb'ов, их произведение - 2m + 2
+    Emit(output, "    mov rdi, qword [rbp - 56]\n");
+    Emit(output, "    lea rdi, [rdi * 4 + 4]\n");
+    Emit(output, "    call rt_bignum_alloc\n");
+    Emit(output, "    mov qword [rbp - 64], rax\n");
+    Emit(output, "    mov rcx, qword [rbp - 56]\n");
+    Emit(output, "    lea rdx, [rax + rcx * 8 + 8]\n");
+    Emit(output, "    mov qword [rbp - 72], rdx\n");
+    Emit(output, "    lea rdx, [rdx + rcx * 8 + 8]\n");
+    Emit(output, "    mov qword [rbp - 80], rdx\n");
+    const char* const kHalves[][3] = {{"r12", "r13", "64"}, {"r14", "r15", "72"}};
+    for (size_t i = 0; i < 2; i++) {
+        Emit(output, "    mov rdi, qword [rbp - %s]\n", kHalves[i][2]);
+        Emit(output, "    mov rsi, %s\n", kHalves[i][0]);
+        Emit(output, "    mov rdx, qword [rbp - 56]\n");
+        Emit(output, "    call rt_bignum_copy\n");
+        Emit(output, "    mov rax, qword [rbp - 56]\n");
+        Emit(output, "    mov rdi, qword [rbp - %s]\n", kHalves[i][2]);
+        Emit(output, "    mov qword [rdi + rax * 8], 0\n");
+        Emit(output, "    lea rsi, [rax + 1]\n");
+        Emit(output, "    lea rdx, [%s + rax * 8]\n", kHalves[i][0]);
+        Emit(output, "    mov rcx, %s\n", kHalves[i][1]);
+        Emit(output, "    sub rcx, rax\n");
+        Emit(output, "    call rt_bignum_add_into\n");
+    }
+    Emit(output, "    mov rax, qword [rbp - 56]\n");
+    Emit(output, "    mov rdi, qword [rbp - 80]\n");
+    Emit(output, "    mov rsi, qword [rbp - 64]\n");
+    Emit(output, "    lea rdx, [rax + 1]\n");
+    Emit(output, "    mov rcx, qword [rbp - 72]\n");
+    Emit(output, "    lea r8, [rax + 1]\n");
+    Emit(output, "    call rt_bignum_multiply\n");
+    Emit(output, "    mov rax, qword [rbp - 56]\n");
+    Emit(output, "    mov rdi, qword [rbp - 80]\n");
+    Emit(output, "    lea rsi, [rax * 2 + 2]\n");
+    Emit(output, "    mov rdx, rbx\n");
+    Emit(output, "    lea rcx, [rax * 2]\n");
+    Emit(output, "    call rt_bignum_sub_into\n"); // - z0
+    Emit(output, "    mov rax, qword [rbp - 56]\n");
+    Emit(output, "    mov rdi, qword [rbp - 80]\n");
+    Emit(output, "    lea rsi, [rax * 2 + 2]\n");
+    Emit(output, "    mov rdx, rax\n");
+    Emit(output, "    shl rdx, 4\n");
+    Emit(output, "    add rdx, rbx\n");
+    Emit(output, "    lea rcx, [r13 + r15]\n");
+    Emit(output, "    sub rcx, rax\n");
+    Emit(output, "    sub rcx, rax\n");
+    Emit(output, "    call rt_bignum_sub_into\n"); // - z2
+    // средняя часть без старших нулей прибавляется к r с limb'а m
+    Emit(output, "    mov rax, qword [rbp - 56]\n");
+    Emit(output, "    mov rdx, qword [rbp - 80]\n");
+    Emit(output, "    lea rcx, [rax * 2 + 2]\n");
+    Emit(output, ".trim:\n");
+    Emit(output, "    cmp qword [rdx + rcx * 8 - 8], 0\n");
+    Emit(output, "    jne .middle\n");
+    Emit(output, "    dec rcx\n");
+    Emit(output, "    jnz .trim\n");
+    Emit(output, ".middle:\n");
+    Emit(output, "    lea rdi, [rbx + rax * 8]\n");
+    Emit(output, "    lea rsi, [r13 + r15]\n");
+    Emit(output, "    sub rsi, rax\n");
+    Emit(output, "    call rt_bignum_add_into\n");
+    Emit(output, ".return:\n");
+    Emit(output, "    mov rax, qword [rbp - 48]\n");
+    Emit(output, "    mov qword [rt_bignum_next], rax\n");
+    Emit(output, "    lea rsp, [rbp - 40]\n");
+    Emit(output, "    pop r15\n");
+    Emit(output, "    pop r14\n");
+    Emit(output, "    pop r13\n");
+    Emit(output, "    pop r12\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    pop rbp\n");
+    Emit(output, "    ret\n");
+
+    // столбиком: строка на каждый limb короткого множителя rcx (r8 limb'ов), rdx >= r8
+    Emit(output, "\nrt_bignum_multiply_basic:\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    push r12\n");
+    Emit(output, "    push r13\n");
+    Emit(output, "    push r14\n");
+    Emit(output, "    mov r11, rdx\n");
+    Emit(output, "    mov r12, rcx\n");
+    Emit(output, "    lea rax, [rdx + r8]\n");
+    Emit(output, "    xor ecx, ecx\n");
+    Emit(output, ".clear:\n");
+    Emit(output, "    mov qword [rdi + rcx * 8], 0\n");
+    Emit(output, "    inc rcx\n");
+    Emit(output, "    cmp rcx, rax\n");
+    Emit(output, "    jb .clear\n");
+    Emit(output, "    xor r9d, r9d\n");
+    Emit(output, ".row:\n");
+    Emit(output, "    mov rbx, qword [r12 + r9 * 8]\n");
+    Emit(output, "    lea r13, [rdi + r9 * 8]\n");
+    Emit(output, "    xor r14d, r14d\n");
+    Emit(output, "    xor r10d, r10d\n");
+    Emit(output, ".column:\n");
+    Emit(output, "    mov rax, qword [rsi + r10 * 8]\n");
+    Emit(output, "    mul rbx\n");
+    Emit(output, "    add rax, r14\n");
+    Emit(output, "    adc rdx, 0\n");
+    Emit(output, "    add rax, qword [r13 + r10 * 8]\n");
+    Emit(output, "    adc rdx, 0\n");
+    Emit(output, "    mov qword [r13 + r10 * 8], rax\n");
+    Emit(output, "    mov r14, rdx\n");
+    Emit(output, "    inc r10\n");
+    Emit(output, "    cmp r10, r11\n");
+    Emit(output, "    jb .column\n");
+    Emit(output, "    mov qword [r13 + r11 * 8], r14\n");
+    Emit(output, "    inc r9\n");
+    Emit(output, "    cmp r9, r8\n");
+    Emit(output, "    jb .row\n");
+    Emit(output, "    pop r14\n");
+    Emit(output, "    pop r13\n");
+    Emit(output, "    pop r12\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    ret\n");
+}
+
+// rt_bignum_divide: rdi = rsi (rdx limb'ов) / rcx (r8 limb'ов, старший не ноль) делением в столбик по битам:
+// остаток из r8 + 1 limb'ов сдвигается на бит делимого и, если не меньше делителя, уменьшается на него
+static void EmitBignumDivision(TEmitter* output) {
+    Emit(output, "\nrt_bignum_divide:\n");
+    Emit(output, "    push rbp\n");
+    Emit(output, "    mov rbp, rsp\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    push r12\n");
+    Emit(output, "    push r13\n");
+    Emit(output, "    push r14\n");
+    Emit(output, "    push r15\n");
+    Emit(output, "    sub rsp, 24\n");
+    Emit(output, "    mov rbx, rdi\n");
+    Emit(output, "    mov r12, rsi\n");
+    Emit(output, "    mov r13, rdx\n");
+    Emit(output, "    mov r14, rcx\n");
+    Emit(output, "    mov r15, r8\n");
+    Emit(output, "    mov rax, qword [rt_bignum_next]\n");
+    Emit(output, "    mov qword [rbp - 48], rax\n");
+    Emit(output, "    lea rdi, [r15 + 1]\n");
+    Emit(output, "    call rt_bignum_alloc\n");
+    Emit(output, "    mov qword [rbp - 56], rax\n");
+    Emit(output, "    mov rdi, rax\n");
+    Emit(output, "    lea rsi, [r15 + 1]\n");
+    Emit(output, "    call rt_bignum_zero\n");
+    Emit(output, "    mov rdi, rbx\n");
+    Emit(output, "    mov rsi, r13\n");
+    Emit(output, "    call rt_bignum_zero\n");
+    Emit(output, "    mov rax, r13\n");
+    Emit(output, "    shl rax, 6\n");
+    Emit(output, "    mov qword [rbp - 64], rax\n");
+    Emit(output, ".bit:\n");
+    Emit(output, "    mov rax, qword [rbp - 64]\n");
+    Emit(output, "    test rax, rax\n");
+    Emit(output, "    jz .return\n");
+    Emit(output, "    dec rax\n");
+    Emit(output, "    mov qword [rbp - 64], rax\n");
+    Emit(output, "    mov rcx, rax\n");
+    Emit(output, "    shr rax, 6\n");
+    Emit(output, "    mov rdx, qword [r12 + rax * 8]\n");
+    Emit(output, "    and ecx, 63\n");
+    Emit(output, "    shr rdx, cl\n");
+    Emit(output, "    and edx, 1\n");
+    Emit(output, "    mov rdi, qword [rbp - 56]\n");
+    Emit(output, "    xor ecx, ecx\n");
+    Emit(output, ".shift:\n");
+    Emit(output, "    mov rax, qword [rdi + rcx * 8]\n");
+    Emit(output, "    mov rsi, rax\n");
+    Emit(output, "    shr rsi, 63\n");
+    Emit(output, "    add rax, rax\n");
+    Emit(output, "    or rax, rdx\n");
+    Emit(output, "    mov qword [rdi + rcx * 8], rax\n");
+    Emit(output, "    mov rdx, rsi\n");
+    Emit(output, "    inc rcx\n");
+    Emit(output, "    cmp rcx, r15\n");
+    Emit(output, "    jbe .shift\n");
+    Emit(output, "    cmp qword [rdi + r15 * 8], 0\n");
+    Emit(output, "    jne .subtract\n");
+    Emit(output, "    mov rcx, r15\n");
+    Emit(output, ".compare:\n");
+    Emit(output, "    dec rcx\n");
+    Emit(output, "    mov rax, qword [rdi + rcx * 8]\n");
+    Emit(output, "    cmp rax, qword [r14 + rcx * 8]\n");
+    Emit(output, "    ja .subtract\n");
+    Emit(output, "    jb .bit\n");
+    Emit(output, "    test rcx, rcx\n");
+    Emit(output, "    jnz .compare\n");
+    Emit(output, ".subtract:\n");
+    Emit(output, "    lea rsi, [r15 + 1]\n");
+    Emit(output, "    mov rdx, r14\n");
+    Emit(output, "    mov rcx, r15\n");
+    Emit(output, "    call rt_bignum_sub_into\n");
+    Emit(output, "    mov rax, qword [rbp - 64]\n");
+    Emit(output, "    mov rcx, rax\n");
+    Emit(output, "    shr rax, 6\n");
+    Emit(output, "    and ecx, 63\n");
+    Emit(output, "    mov edx, 1\n");
+    Emit(output, "    shl rdx, cl\n");
+    Emit(output, "    or qword [rbx + rax * 8], rdx\n");
+    Emit(output, "    jmp .bit\n");
+    Emit(output, ".return:\n");
+    Emit(output, "    mov rax, qword [rbp - 48]\n");
+    Emit(output, "    mov qword [rt_bignum_next], rax\n");
+    Emit(output, "    lea rsp, [rbp - 40]\n");
+    Emit(output, "    pop r15\n");
+    Emit(output, "    pop r14\n");
+    Emit(output, "    pop r13\n");
+    Emit(output, "    pop r12\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    pop rbp\n");
+    Emit(output, "    ret\n");
+}
+
+// Модуль делится на 10^18, пока не станет нулем; куски печатаются от старшего, все кроме первого - с ведущими
+// нулями. Вывод идет через rt_bignum_put_*: свой буфер без libc, printf с libc
+static void EmitBignumOutput(TEmitter* output, const Options* options) {
+    Emit(output, "\nrt_bignum_print.body:\n");
+    Emit(output, "    push rbp\n");
+    Emit(output, "    mov rbp, rsp\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    push r12\n");
+    Emit(output, "    push r13\n");
+    Emit(output, "    push r14\n");
+    Emit(output, "    push r15\n");
+    Emit(output, "    sub rsp, 40\n"); // стек выровнен для printf
+    Emit(output, "    mov rbx, rdi\n");
+    Emit(output, "    cmp rbx, %lld\n", kBignumCheck);
+    Emit(output, "    jo .bignum\n");
+    Emit(output, "    test rbx, rbx\n");
+    Emit(output, "    jns .small\n");
+    Emit(output, "    call rt_bignum_put_minus\n");
+    Emit(output, "    neg rbx\n");
+    Emit(output, ".small:\n");
+    Emit(output, "    mov rdi, rbx\n");
+    Emit(output, "    call rt_bignum_put_head\n");
+    Emit(output, "    jmp .newline\n");
+    Emit(output, ".bignum:\n");
+    Emit(output, "    lea rsi, [rbp - 72]\n");
+    Emit(output, "    call rt_bignum_unpack\n");
+    Emit(output, "    mov r12, rax\n");
+    Emit(output, "    mov rax, qword [rt_bignum_next]\n");
+    Emit(output, "    mov qword [rbp - 48], rax\n");
+    Emit(output, "    cmp qword [r12 + 8], 0\n");
+    Emit(output, "    je .positive\n");
+    Emit(output, "    call rt_bignum_put_minus\n");
+    Emit(output, ".positive:\n");
+    // копия модуля и куски по 18 цифр: кусков не больше, чем 2 на limb
+    Emit(output, "    mov r13, qword [r12]\n");
+    Emit(output, "    lea rdi, [r13 + r13 * 2 + 1]\n");
+    Emit(output, "    call rt_bignum_alloc\n");
+    Emit(output, "    mov r14, rax\n");
+    Emit(output, "    mov rdi, rax\n");
+    Emit(output, "    lea rsi, [r12 + 16]\n");
+    Emit(output, "    mov rdx, r13\n");
+    Emit(output, "    call rt_bignum_copy\n");
+    Emit(output, "    lea r15, [r14 + r13 * 8]\n");
+    Emit(output, "    xor ebx, ebx\n");
+    Emit(output, ".divide:\n");
+    Emit(output, "    mov rcx, %llu\n", kChunkBase);
+    Emit(output, "    mov r8, r13\n");
+    Emit(output, "    xor edx, edx\n");
+    Emit(output, ".limb:\n");
+    Emit(output, "    dec r8\n");
+    Emit(output, "    mov rax, qword [r14 + r8 * 8]\n");
+    Emit(output, "    div rcx\n");
+    Emit(output, "    mov qword [r14 + r8 * 8], rax\n");
+    Emit(output, "    test r8, r8\n");
+    Emit(output, "    jnz .limb\n");
+    Emit(output, "    mov qword [r15 + rbx * 8], rdx\n");
+    Emit(output, "    inc rbx\n");
+    Emit(output, ".trim:\n");
+    Emit(output, "    cmp qword [r14 + r13 * 8 - 8], 0\n");
+    Emit(output, "    jne .divide\n");
+    Emit(output, "    dec r13\n");
+    Emit(output, "    jnz .trim\n");
+    Emit(output, "    dec rbx\n");
+    Emit(output, "    mov rdi, qword [r15 + rbx * 8]\n");
+    Emit(output, "    call rt_bignum_put_head\n");
+    Emit(output, ".chunk:\n");
+    Emit(output, "    test rbx, rbx\n");
+    Emit(output, "    jz .restore\n");
+    Emit(output, "    dec rbx\n");
+    Emit(output, "    mov rdi, qword [r15 + rbx * 8]\n");
+    Emit(output, "    call rt_bignum_put_chunk\n");
+    Emit(output, "    jmp .chunk\n");
+    Emit(output, ".restore:\n");
+    Emit(output, "    mov rax, qword [rbp - 48]\n");
+    Emit(output, "    mov qword [rt_bignum_next], rax\n");
+    Emit(output, ".newline:\n");
+    Emit(output, "    call rt_bignum_put_newline\n");
+    Emit(output, "    lea rsp, [rbp - 40]\n");
+    Emit(output, "    pop r15\n");
+    Emit(output, "    pop r14\n");
+    Emit(output, "    pop r13\n");
+    Emit(output, "    pop r12\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    pop rbp\n");
+    Emit(output, "    ret\n");
+
+    if (options->runtime == LibcRuntime) {
+        const char* const kPuts[][2] = {{"minus", "rt_fmt_minus"}, {"head", "rt_fmt_head"},
+                                        {"chunk", "rt_fmt_chunk"}, {"newline", "rt_fmt_newline"}};
+        for (size_t i = 0; i < sizeof(kPuts) / sizeof(kPuts[0]); i++) {
+            Emit(output, "\nrt_bignum_put_%s:\n", kPuts[i][0]);
+            Emit(output, "    mov rsi, rdi\n");
+            Emit(output, "    mov rdi, %s\n", kPuts[i][1]);
+            Emit(output, "    xor eax, eax\n");
+            Emit(output, "    jmp printf\n");
+        }
+    } else {
+        // в буфере должно остаться место на kMaxLengthOfDecimal байт
+        Emit(output, "\nrt_bignum_reserve:\n");
+        Emit(output, "    cmp qword [rt_length], %zu\n", kOutputBufferSize - kMaxLengthOfDecimal);
+        Emit(output, "    jbe .done\n");
+        Emit(output, "    push rdi\n");
+        Emit(output, "    call rt_flush\n");
+        Emit(output, "    pop rdi\n");
+        Emit(output, ".done:\n");
+        Emit(output, "    ret\n");
+
+        Emit(output, "\nrt_bignum_put_minus:\n");
+        Emit(output, "    call rt_bignum_reserve\n");
+        Emit(output, "    mov rsi, rt_buffer\n");
+        Emit(output, "    mov rdi, qword [rt_length]\n");
+        Emit(output, "    mov byte [rsi + rdi], 45\n"); // '-'
+        Emit(output, "    inc qword [rt_length]\n");
+        Emit(output, "    ret\n");
+
+        Emit(output, "\nrt_bignum_put_head:\n");
+        Emit(output, "    call rt_bignum_reserve\n");
+        Emit(output, "    jmp rt_append_digits\n");
+
+        Emit(output, "\nrt_bignum_put_chunk:\n");
+        Emit(output, "    call rt_bignum_reserve\n");
+        Emit(output, "    mov rax, rdi\n");
+        Emit(output, "    mov rsi, rt_buffer\n");
+        Emit(output, "    add rsi, qword [rt_length]\n");
+        Emit(output, "    mov ecx, 10\n");
+        Emit(output, "    mov r8d, %d\n", kChunkDigits);
+        Emit(output, ".digit:\n");
+        Emit(output, "    xor edx, edx\n");
+        Emit(output, "    div rcx\n");
+        Emit(output, "    add dl, 48\n");
+        Emit(output, "    mov byte [rsi + r8 - 1], dl\n");
+        Emit(output, "    dec r8\n");
+        Emit(output, "    jnz .digit\n");
+        Emit(output, "    add qword [rt_length], %d\n", kChunkDigits);
+        Emit(output, "    ret\n");
+
+        Emit(output, "\nrt_bignum_put_newline:\n");
+        Emit(output, "    call rt_bignum_reserve\n");
+        Emit(output, "    jmp rt_append_newline\n");
+    }
+
+    // double из длинного числа: limb'ы от старшего, каждый по половинам в 32 бита (cvtsi2sd знаковый)
+    Emit(output, "\nrt_bignum_float.body:\n");
+    Emit(output, "    cmp rdi, %lld\n", kBignumCheck);
+    Emit(output, "    jo .bignum\n");
+    Emit(output, "    cvtsi2sd xmm0, rdi\n");
+    Emit(output, "    ret\n");
+    Emit(output, ".bignum:\n");
+    Emit(output, "    call rt_bignum_unpack\n");
+    Emit(output, "    mov rcx, qword [rax]\n");
+    Emit(output, "    xorpd xmm0, xmm0\n");
+    Emit(output, ".limb:\n");
+    Emit(output, "    dec rcx\n");
+    Emit(output, "    mulsd xmm0, qword [rt_two32]\n");
+    Emit(output, "    mulsd xmm0, qword [rt_two32]\n");
+    Emit(output, "    mov rdx, qword [rax + rcx * 8 + 16]\n");
+    Emit(output, "    mov r8, rdx\n");
+    Emit(output, "    shr r8, 32\n");
+    Emit(output, "    cvtsi2sd xmm1, r8\n");
+    Emit(output, "    mulsd xmm1, qword [rt_two32]\n");
+    Emit(output, "    addsd xmm0, xmm1\n");
+    Emit(output, "    mov r8d, edx\n");
+    Emit(output, "    cvtsi2sd xmm1, r8\n");
+    Emit(output, "    addsd xmm0, xmm1\n");
+    Emit(output, "    test rcx, rcx\n");
+    Emit(output, "    jnz .limb\n");
+    Emit(output, "    cmp qword [rax + 8], 0\n");
+    Emit(output, "    je .done\n");
+    Emit(output, "    xorpd xmm1, xmm1\n");
+    Emit(output, "    subsd xmm1, xmm0\n");
+    Emit(output, "    movapd xmm0, xmm1\n");
+    Emit(output, ".done:\n");
+    Emit(output, "    ret\n");
+}
+
+// AVX2 должны поддерживать и процессор, и ОС: OSXSAVE и AVX в cpuid 1, сохранение xmm и ymm в XCR0,
+// AVX2 в cpuid 7
+static void EmitSimdDetection(TEmitter* output) {
+    Emit(output, "\nrt_detect_simd:\n");
+    Emit(output, "    push rbx\n");
+    Emit(output, "    mov eax, 1\n");
+    Emit(output, "    cpuid\n");
+    Emit(output, "    and ecx, %u\n", kOsxsaveAndAvxBits);
+    Emit(output, "    cmp ecx, %u\n", kOsxsaveAndAvxBits);
+    Emit(output, "    jne .done\n");
+    Emit(output, "    xor ecx, ecx\n");
+    Emit(output, "    xgetbv\n");
+    Emit(output, "    and eax, 6\n");
+    Emit(output, "    cmp eax, 6\n");
+    Emit(output, "    jne .done\n");
+    Emit(output, "    mov eax, 7\n");
+    Emit(output, "    xor ecx, ecx\n");
+    Emit(output, "    cpuid\n");
+    Emit(output, "    shr ebx, 5\n");
+    Emit(output, "    and ebx, 1\n");
+    Emit(output, "    mov qword [rt_avx2], rbx\n");
+    Emit(output, ".done:\n");
+    Emit(output, "    pop rbx\n");
+    Emit(output, "    ret\n");
+}
+
+static void EmitMathConstants(TEmitter* output) {
+    for (size_t i = 0; i < sizeof(kMathConstants) / sizeof(kMathConstants[0]); i++) {
+        Emit(output, "    %s dq %llu\n", kMathConstants[i].name, GetDoubleBits(kMathConstants[i].value));
+    }
+}
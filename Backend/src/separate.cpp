@@ -0,0 +1,341 @@
+#include "separate.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "tree.h"
+#include "tokenizer.h"
+#include "astUtils.h"
+#include "optimizer.h"
+#include "typeInference.h"
+#include "nasmGen.h"
+#include "emitter.h"
+#include "assembler.h"
+#include "elfWriter.h"
+#include "linker.h"
+#include "jit.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kMaxLengthOfHeader = 256;
+const size_t kInitialSizeOfNameVector = 16;
+const char* const kCompilerFileName = "/proc/self/exe"; // новый компилятор может генерировать другой код
+
+// Модуль или программа: AST единицы, ее типы и опции, текст ассемблера, если единица перекомпилирована
+struct TCompilationJob {
+    TProgram* program;
+    size_t index;
+    tNode* root;
+    TTypeInfo types;
+    Options options;
+    TUnit unit;
+    char asmFileName[kMaxLengthOfFileName];
+    char header[kMaxLengthOfHeader]; // первая строка name.s: модуль и опции, с которыми он собран
+    bool isStale;
+    TEmitter output;
+};
+
+struct TCompilationPool {
+    TCompilationJob** jobs;
+    size_t count;
+    size_t next; // следующая единица для свободного потока
+};
+
+static void BuildHeader(const char* module, const Options* options, char* header);
+static bool IsStale(TProgram* program, TCompilationJob* job);
+static bool IsNewer(const struct stat* first, const struct stat* second);
+static bool ReadFirstLine(const char* fileName, char* line, size_t size);
+static void CheckImportTypes(TCompilationJob* jobs, size_t count);
+static bool HasSameTypes(TCompilationJob* importer, TCompilationJob* owner, tNode* function);
+static void CompileJobs(TCompilationJob** jobs, size_t count);
+static void* CompileUnits(void* argument);
+static void AssembleJob(TCompilationJob* job, TObject* object);
+static char* ReadFile(const char* fileName);
+static void WriteModuleObject(TCompilationJob* job);
+
+// global ------------------------------------------------------------------------------------------
+
+// Каждый модуль собирается в свой name.s отдельно от программы: от функций других модулей ему нужны только
+// объявления. name.s служит кешем: модуль перекомпилируется, если он или модули, которые он подключает,
+// изменились после name.s или опции другие. Устаревшие модули и программа компилируются параллельно
+void RunSeparateCompilation(TProgram* program, const Options* options) {
+    size_t count = program->count;
+    TCompilationJob* jobs = (TCompilationJob*)calloc(count + 1, sizeof(TCompilationJob));
+    TCompilationJob** staleJobs = (TCompilationJob**)calloc(count + 1, sizeof(TCompilationJob*));
+    assert(jobs && staleJobs);
+
+    bool hasParallelLoops = false;
+    for (size_t i = 0; i < count; i++) {
+        hasParallelLoops |= ContainsParallelLoop(program->modules[i].root);
+    }
+
+    // типы выводятся по полным телам: объявление функции другого модуля должно совпасть с ее определением
+    size_t staleCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        TCompilationJob* job = &jobs[i];
+        const char* name = program->modules[i].name;
+        job->program = program;
+        job->index = i;
+        job->options = *options;
+        job->options.module = name;
+        vectorInit(&job->unit.exports, kInitialSizeOfNameVector);
+        CollectExports(program, i, &job->unit.exports);
+        if (name) {
+            job->options.enableEvaluation = false; // в модуле нет кода вне функций
+            snprintf(job->asmFileName, kMaxLengthOfFileName, "%s%s", name, kModuleAsmExtension);
+            BuildHeader(name, options, job->header);
+        } else {
+            job->unit.hasParallelLoops = hasParallelLoops;
+            strncpy(job->asmFileName, kNasmFileName, kMaxLengthOfFileName - 1);
+        }
+        job->isStale = !name || IsStale(program, job);
+        if (job->isStale) {
+            staleJobs[staleCount++] = job;
+        }
+
+        job->root = BuildUnit(program, i);
+        InferTypes(job->root, &job->types);
+    }
+    CheckImportTypes(jobs, count);
+    for (size_t i = 0; i < count; i++) {
+        DeclareImports(program, i, jobs[i].root);
+    }
+
+    CompileJobs(staleJobs, staleCount);
+
+    if (options->outputFormat == AsmOutput) {
+        WriteEmitter(&jobs[0].output, kNasmFileName);
+    } else if (options->outputFormat == ObjectOutput) {
+        TObject object = {};
+        AssembleJob(&jobs[0], &object);
+        WriteObjectFile(kObjectFileName, &object);
+        ObjectDtor(&object);
+        for (size_t i = 1; i < count; i++) {
+            WriteModuleObject(&jobs[i]);
+        }
+    } else {
+        TObject* objects = (TObject*)calloc(count, sizeof(TObject));
+        assert(objects);
+        for (size_t i = 0; i < count; i++) {
+            AssembleJob(&jobs[i], &objects[i]);
+        }
+        TObject linked = {};
+        LinkObjects(objects, count, &linked);
+        if (options->outputFormat == JitOutput) {
+            RunJit(&linked, options->jitRuns);
+        } else {
+            WriteExecutable(kExecutableFileName, &linked);
+        }
+
+        ObjectDtor(&linked);
+        for (size_t i = 0; i < count; i++) {
+            ObjectDtor(&objects[i]);
+        }
+        free(objects);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (jobs[i].isStale) {
+            EmitterDtor(&jobs[i].output);
+        }
+        vectorFree(&jobs[i].unit.exports);
+        TypeInfoDtor(&jobs[i].types);
+        treeDtor(jobs[i].root);
+    }
+    free(staleJobs);
+    free(jobs);
+}
+
+// static ------------------------------------------------------------------------------------------
+
+// Опции, от которых зависит код модуля. Программа и ее runtime собираются всегда
+static void BuildHeader(const char* module, const Options* options, char* header) {
+    snprintf(header, kMaxLengthOfHeader,
+             "; module %s: inline %d %zu, tail %d, loop %d, vector %d, dce %d, select %d, specialize %d, switch %d, "
+             "closed %d, unroll %zu %zu, runtime %d, comments %d, math %d %d, memoize %d %zu, threads %zu, "
+             "superopt %s",
+             module, options->enableInlining, options->inlineThreshold, options->enableTailCalls,
+             options->enableLoopOptimizations, options->enableVectorization, options->enableDeadCodeElimination,
+             options->enableIfConversion, options->enableSpecialization, options->enableJumpTables,
+             options->enableClosedForms, options->unrollFactor, options->unrollBudget, options->runtime,
+             options->emitComments, options->preciseMath, options->fastMath, options->memoization, options->memoSize,
+             options->parallelThreads, (options->superoptRules) ? options->superoptRules : "-");
+}
+
+static bool IsStale(TProgram* program, TCompilationJob* job) {
+    struct stat asmFile = {};
+    if (stat(job->asmFileName, &asmFile)) {
+        return true;
+    }
+
+    Vector closure = {};
+    vectorInit(&closure, kInitialSizeOfNameVector);
+    CollectImportClosure(program, job->index, &closure);
+    vectorPush(&closure, &program->modules[job->index]);
+
+    struct stat compiler = {};
+    bool isStale = !stat(kCompilerFileName, &compiler) && !IsNewer(&asmFile, &compiler);
+    for (size_t i = 0; i < closure.size && !isStale; i++) {
+        struct stat source = {};
+        isStale = stat(((TModule*)closure.data[i])->fileName, &source) || !IsNewer(&asmFile, &source);
+    }
+    vectorFree(&closure);
+    struct stat rules = {}; // правила супероптимизатора меняют код так же, как исходник
+    isStale = isStale || (job->options.superoptRules && !stat(job->options.superoptRules, &rules)
+                          && !IsNewer(&asmFile, &rules));
+
+    char header[kMaxLengthOfHeader] = "";
+    return isStale || !ReadFirstLine(job->asmFileName, header, kMaxLengthOfHeader) || strcmp(header, job->header);
+}
+
+static bool IsNewer(const struct stat* first, const struct stat* second) {
+    return first->st_mtim.tv_sec > second->st_mtim.tv_sec
+        || (first->st_mtim.tv_sec == second->st_mtim.tv_sec && first->st_mtim.tv_nsec > second->st_mtim.tv_nsec);
+}
+
+static bool ReadFirstLine(const char* fileName, char* line, size_t size) {
+    FILE* file = fopen(fileName, "r");
+    if (!file) {
+        return false;
+    }
+
+    bool isRead = fgets(line, (int)size, file) != NULL;
+    fclose(file);
+    line[strcspn(line, "\n")] = '\0';
+    return isRead;
+}
+
+// Вызов другого модуля идет по соглашению, которое вывели типы владельца. Если вызовы программы делают
+// параметр или результат double, а в модуле он целый, один код на всех не получится
+static void CheckImportTypes(TCompilationJob* jobs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        for (tNode* node = jobs[i].root; node; node = (IsOperation(node, Semicolon)) ? node->left : NULL) {
+            tNode* function = (IsOperation(node, Semicolon)) ? node->right : node;
+            size_t owner = (function->type == Function) ? FindOwner(jobs[i].program, function->value) : i;
+            if (owner == i || HasSameTypes(&jobs[i], &jobs[owner], function)) {
+                continue;
+            }
+            fprintf(stderr, "Error: function '%s' from %s gets other types in %s, compile without --separate\n",
+                    function->value, jobs[owner].program->modules[owner].fileName,
+                    jobs[i].program->modules[i].fileName);
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static bool HasSameTypes(TCompilationJob* importer, TCompilationJob* owner, tNode* function) {
+    tNode* definition = FindFunction(owner->root, function->value);
+    assert(definition);
+
+    if (IsFloatFunction(&importer->types, function->value) != IsFloatFunction(&owner->types, function->value)) {
+        return false;
+    }
+    for (tNode* param = function->left; param; param = param->left) {
+        if (IsFloatVariable(&importer->types, function, param->value)
+            != IsFloatVariable(&owner->types, definition, param->value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void CompileJobs(TCompilationJob** jobs, size_t count) {
+    TCompilationPool pool = {
+        .jobs = jobs,
+        .count = count,
+        .next = 0,
+    };
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threadCount = (cores > 0) ? (size_t)cores : 1;
+    if (threadCount > count) {
+        threadCount = count;
+    }
+
+    pthread_t* threads = (pthread_t*)calloc(threadCount + 1, sizeof(pthread_t));
+    assert(threads);
+    for (size_t i = 1; i < threadCount; i++) {
+        if (pthread_create(&threads[i], NULL, CompileUnits, &pool)) {
+            fprintf(stderr, "Error: cannot start compilation thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    CompileUnits(&pool);
+    for (size_t i = 1; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+static void* CompileUnits(void* argument) {
+    TCompilationPool* pool = (TCompilationPool*)argument;
+
+    size_t i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+    for (; i < pool->count; i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) {
+        TCompilationJob* job = pool->jobs[i];
+        job->root = RunOptimizer(job->root, &job->options, &job->types);
+
+        EmitterCtor(&job->output, job->options.emitComments);
+        if (job->options.module) {
+            EmitText(&job->output, job->header, strlen(job->header)); // Emit без --asm-comments убрал бы его
+            EmitText(&job->output, "\n", 1);
+        }
+        GenerateUnit(job->root, &job->options, &job->types, &job->unit, &job->output);
+        if (job->options.module) {
+            WriteEmitter(&job->output, job->asmFileName);
+        }
+    }
+    return NULL;
+}
+
+// Актуальный модуль берется из name.s, остальные - из только что сгенерированного текста
+static void AssembleJob(TCompilationJob* job, TObject* object) {
+    if (job->isStale) {
+        Assemble(GetEmitterText(&job->output), object);
+        return;
+    }
+
+    char* source = ReadFile(job->asmFileName);
+    Assemble(source, object);
+    free(source);
+}
+
+static char* ReadFile(const char* fileName) {
+    FILE* file = fopen(fileName, "r");
+    if (!file) {
+        fprintf(stderr, "Error: cannot open %s\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t size = getFileSize(file);
+    char* text = (char*)calloc(size + 1, sizeof(char));
+    assert(text);
+    if (fread(text, sizeof(char), size, file) != size) {
+        fprintf(stderr, "Error: cannot read %s\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+    fclose(file);
+    return text;
+}
+
+// name.o пересобирается, только если name.s новее
+static void WriteModuleObject(TCompilationJob* job) {
+    char objectFileName[kMaxLengthOfFileName] = "";
+    snprintf(objectFileName, kMaxLengthOfFileName, "%s%s", job->options.module, kModuleObjectExtension);
+
+    struct stat asmFile = {};
+    struct stat objectFile = {};
+    if (!job->isStale && !stat(objectFileName, &objectFile) && !stat(job->asmFileName, &asmFile)
+        && IsNewer(&objectFile, &asmFile)) {
+        return;
+    }
+
+    TObject object = {};
+    AssembleJob(job, &object);
+    WriteObjectFile(objectFileName, &object);
+    ObjectDtor(&object);
+}
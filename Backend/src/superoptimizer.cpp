@@ -0,0 +1,1905 @@
+#include "superoptimizer.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vector.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kMaxWindow = 5; // команд подряд внутри базового блока
+const size_t kMaxReplacement = 2; // длина замен, которые ищет перебор
+const size_t kMaxImmediates = 4; // $0 ... $3 в окне
+const size_t kMaxMemoryOperands = 4; // @0 ... @3 в окне
+const size_t kMaxOperands = 3;
+const size_t kMaxAddressTokens = 16;
+const size_t kRegisterCount = 16;
+const size_t kLocationCount = kRegisterCount + kMaxMemoryOperands; // регистры, затем @k
+const size_t kMaxVariables = kLocationCount + kMaxImmediates; // начальные значения мест и $k
+const size_t kMaxTerms = 32;
+const size_t kMaxPower = 64;
+const size_t kRandomTests = 16;
+const size_t kMaxExhaustiveInputs = 6; // 4^6 наборов граничных значений
+const size_t kMaxImmediatePool = 48;
+const size_t kMaxShift = 3;
+const size_t kMaxLengthOfRule = 512;
+const size_t kMaxLengthOfInstruction = 128;
+const size_t kMaxLengthOfOperand = 64;
+const size_t kInitialSizeOfRuleVector = 256;
+const size_t kInitialSizeOfMemoryVector = 16;
+const size_t kInitialSizeOfBlock = 64;
+const size_t kInitialSizeOfCandidates = 256;
+const int kNoRegister = -1;
+const int kStackPointer = 4;
+const int kFramePointer = 5;
+const unsigned long long kTestSeed = 0x9E3779B97F4A7C15ull;
+const unsigned long long kEdgeValues[] = {0, 1, 1ull << 63, ~0ull};
+
+// Оценка в тактах: загрузка из памяти дороже команды, imul - трех
+const size_t kInstructionCost = 1;
+const size_t kMultiplyCost = 2;
+const size_t kComplexLeaCost = 1; // lea с базой, индексом и смещением
+const size_t kLoadCost = 3;
+const size_t kStoreCost = 1;
+
+const char* const kKeepWindow = "keep";
+const char* const kDeleteWindow = "delete";
+const char* const kRuleSeparator = " => ";
+const char* const kSequenceSeparator = "; ";
+const char* const kRulesHeader = "# superoptimizer rules: window => replacement | keep | delete\n";
+
+const char* const kRegisterNames[kRegisterCount] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8",  "r9",  "r10", "r11", "r12", "r13", "r14", "r15",
+};
+
+// Команды после блока, которые перезаписывают флаги, не читая их
+const char* const kFlagWriters[] = {
+    "cmp", "test", "add", "sub", "and", "or", "xor", "imul", "neg", "mul", "div", "idiv", "call", "ret",
+};
+
+enum SuperOpcode {
+    SuperMov            = 0,
+    SuperAdd            = 1,
+    SuperSub            = 2,
+    SuperImul           = 3,
+    SuperNeg            = 4,
+    SuperShl            = 5,
+    SuperLea            = 6,
+    SuperXor            = 7, // только xor r, r
+    SuperPush           = 8,
+    SuperPop            = 9,
+    SuperOpcodeCount    = 10,
+};
+
+const char* const kMnemonics[SuperOpcodeCount] = {
+    "mov", "add", "sub", "imul", "neg", "shl", "lea", "xor", "push", "pop",
+};
+
+enum SuperOperandKind {
+    SuperRegister   = 1,
+    SuperMemory     = 2, // qword [ name ] или qword [ rbp +- 8k ]: разные тексты - разные ячейки
+    SuperImmediate  = 3,
+    SuperAddress    = 4, // [ base + index * scale + disp ] для lea
+};
+
+enum ImmediateKind {
+    LiteralImmediate    = 1,
+    SymbolImmediate     = 2, // $first
+    NegatedImmediate    = 3, // -$first
+    SumImmediate        = 4, // $first+$second
+    DifferenceImmediate = 5, // $first-$second
+    ProductImmediate    = 6, // $first*$second
+};
+
+struct TSuperImmediate {
+    ImmediateKind kind;
+    long long value;
+    size_t first;
+    size_t second;
+};
+
+struct TSuperOperand {
+    SuperOperandKind kind;
+    int reg; // регистр или база адреса
+    int index;
+    int scale;
+    size_t memory; // @k окна или номер текста в таблице блока
+    TSuperImmediate immediate; // значение или смещение адреса
+};
+
+struct TSuperInstruction {
+    SuperOpcode opcode;
+    size_t count;
+    TSuperOperand operands[kMaxOperands];
+};
+
+// Команды блока, где числа заменены на $k, а ячейки памяти - на @k. Ключ правила - текст окна
+struct TWindow {
+    TSuperInstruction instructions[kMaxWindow];
+    size_t count;
+    long long immediates[kMaxImmediates];
+    size_t immediateCount;
+    size_t memories[kMaxMemoryOperands]; // номера в таблице блока
+    size_t memoryCount;
+};
+
+struct TMachine {
+    unsigned long long locations[kLocationCount];
+    unsigned long long immediates[kMaxImmediates];
+    unsigned long long stack[kMaxWindow];
+    size_t depth;
+};
+
+struct TMonomial {
+    unsigned long long coefficient;
+    unsigned char powers[kMaxVariables];
+};
+
+// Многочлен от начальных значений мест и $k с коэффициентами по модулю 2^64
+struct TPolynomial {
+    TMonomial terms[kMaxTerms];
+    size_t count;
+    bool isOverflow; // не поместился - считается несравнимым
+};
+
+struct TSymbolicMachine {
+    TPolynomial locations[kLocationCount];
+    TPolynomial stack[kMaxWindow];
+    size_t depth;
+};
+
+struct TCandidate {
+    TSuperInstruction instruction;
+    size_t cost;
+    unsigned reads;
+    unsigned writes;
+};
+
+struct TSearch {
+    const TWindow* window;
+    unsigned writes; // места, которые пишет окно
+    unsigned required; // места, значение которых окно меняет: замена пишет только их
+    TMachine* inputs;
+    TMachine* outputs; // inputs после окна
+    size_t testCount;
+    TSymbolicMachine* expected;
+    TSymbolicMachine* actual;
+    TCandidate* candidates;
+    size_t candidateCount;
+    size_t candidateCapacity;
+    TSuperInstruction best[kMaxReplacement];
+    size_t bestCount;
+    size_t bestCost;
+    bool isFound;
+};
+
+struct TSuperRule {
+    char* key;
+    char* replacement; // команды через "; ", keep или delete
+};
+
+// Команды из словаря подряд; между ними бывают только пустые строки
+struct TBlock {
+    TSuperInstruction* instructions;
+    size_t count;
+    size_t capacity;
+    Vector memories; // тексты qword [ ... ]
+    bool isChanged;
+};
+
+static Vector rules = {}; // TSuperRule*, по возрастанию ключа
+static Vector learnedRules = {}; // найдены перебором и еще не дописаны в файл
+static const char* rulesFileName = NULL;
+static pthread_mutex_t rulesLock = PTHREAD_MUTEX_INITIALIZER; // модули --separate генерируются в потоках
+
+static void OptimizeText(TEmitter* output, char* text, size_t length, bool isLearning);
+static void FlushBlock(TEmitter* output, TBlock* block, const char* begin, const char* end, bool isFlagLive,
+                       bool isLearning);
+static void OptimizeBlock(TBlock* block, bool isFlagLive, bool isLearning);
+static bool ApplyRule(TBlock* block, size_t position, size_t length, bool isFlagLive, bool isLearning);
+static bool BuildWindow(const TSuperInstruction* instructions, size_t count, TWindow* window);
+static bool AbstractImmediate(TSuperImmediate* immediate, TWindow* window);
+static bool BindInstruction(TSuperInstruction* instruction, const TWindow* window);
+static bool IsEncodable(const TSuperInstruction* instruction);
+static bool AreFlagsDead(const TBlock* block, size_t position, bool isFlagLive);
+static void AddBlockInstruction(TBlock* block, const TSuperInstruction* instruction);
+static void ReserveBlock(TBlock* block, size_t count);
+static void ClearBlock(TBlock* block);
+
+static void LoadRules(const char* fileName, bool isLearning);
+static bool CheckRule(const char* key, const char* replacement);
+static const TSuperRule* FindRule(const char* key);
+static const TSuperRule* AddRule(const char* key, const char* replacement);
+static void SaveLearnedRules();
+static int CompareRules(const void* first, const void* second);
+static int CompareRuleKey(const void* key, const void* rule);
+
+static void SearchReplacement(const TWindow* window, char* replacement, size_t size);
+static void PrepareTests(TSearch* search);
+static void GenerateCandidates(TSearch* search);
+static void AddCandidate(TSearch* search, SuperOpcode opcode, const TSuperOperand* first,
+                         const TSuperOperand* second, const TSuperOperand* third);
+static void SearchSingles(TSearch* search);
+static void SearchPairs(TSearch* search);
+static bool IsEquivalent(TSearch* search, const TSuperInstruction* instructions, size_t count);
+static bool HaveSameLocations(const TMachine* first, const TMachine* second, unsigned mask);
+static size_t BuildImmediatePool(const TWindow* window, bool withLiterals, bool withSums, TSuperImmediate* pool);
+static int CompareCandidates(const void* first, const void* second);
+static unsigned long long NextRandom(unsigned long long* state);
+
+static bool ParseLine(const char* line, const char* end, Vector* memories, TSuperInstruction* instruction);
+static bool ParseSequence(const char* text, TSuperInstruction* instructions, size_t maxCount, size_t* count);
+static bool ParseWindow(const char* text, TWindow* window);
+static bool ParseInstruction(char* text, Vector* memories, TSuperInstruction* instruction);
+static bool ParseOperand(char* text, Vector* memories, TSuperOperand* operand);
+static bool ParseAddress(char* text, bool isAbstract, TSuperOperand* operand);
+static bool ParseMemory(const char* text, Vector* memories, TSuperOperand* operand);
+static bool ParseRegister(const char* text, int* reg);
+static bool ParseImmediate(const char* text, bool isAbstract, TSuperImmediate* immediate);
+static bool ParseSymbol(const char** text, size_t* symbol);
+static bool IsSupported(const TSuperInstruction* instruction);
+static bool IsBlankLine(const char* line, const char* end);
+static bool IsFlagWriterLine(const char* line, const char* end);
+static void PrintSequence(const TSuperInstruction* instructions, size_t count, const Vector* memories, char* text,
+                          size_t size);
+static void PrintInstruction(const TSuperInstruction* instruction, const Vector* memories, char* text, size_t size);
+static void PrintOperand(const TSuperOperand* operand, const Vector* memories, char* text, size_t size);
+static void PrintImmediate(const TSuperImmediate* immediate, char* text, size_t size);
+
+static size_t GetCost(const TSuperInstruction* instruction);
+static size_t GetSequenceCost(const TSuperInstruction* instructions, size_t count);
+static size_t GetLocation(const TSuperOperand* operand);
+static unsigned GetReads(const TSuperInstruction* instruction);
+static unsigned GetWrites(const TSuperInstruction* instruction);
+static unsigned GetOperandReads(const TSuperOperand* operand);
+static bool ReadsDestination(const TSuperInstruction* instruction);
+static bool WritesFlags(const TSuperInstruction* instruction);
+static bool IsBalanced(const TSuperInstruction* instructions, size_t count);
+static size_t CountBits(unsigned mask);
+static bool FitsInt32(long long value);
+
+static void Execute(TMachine* machine, const TSuperInstruction* instructions, size_t count);
+static unsigned long long ReadOperand(const TMachine* machine, const TSuperOperand* operand);
+static unsigned long long EvaluateImmediate(const TSuperImmediate* immediate, const unsigned long long* values);
+static void InitSymbolic(TSymbolicMachine* machine);
+static void ExecuteSymbolic(TSymbolicMachine* machine, const TSuperInstruction* instructions, size_t count);
+static void ReadSymbolicOperand(const TSymbolicMachine* machine, const TSuperOperand* operand, TPolynomial* result);
+static void ImmediateToPolynomial(const TSuperImmediate* immediate, TPolynomial* result);
+static void PolynomialConstant(TPolynomial* polynomial, unsigned long long value);
+static void PolynomialVariable(TPolynomial* polynomial, size_t variable);
+static void PolynomialAdd(TPolynomial* result, const TPolynomial* first, const TPolynomial* second,
+                          unsigned long long factor);
+static void PolynomialMultiply(TPolynomial* result, const TPolynomial* first, const TPolynomial* second);
+static void AddTerm(TPolynomial* polynomial, const TMonomial* term);
+static bool ArePolynomialsEqual(const TPolynomial* first, const TPolynomial* second);
+
+// global ------------------------------------------------------------------------------------------
+
+// Супероптимизатор коротких участков: окна до kMaxWindow целочисленных команд внутри базового блока
+// ищутся в файле правил, найденная более дешевая последовательность подставляется вместо окна.
+// С --superopt-learn окна, которых нет в файле, перебираются: замены до kMaxReplacement команд
+// проверяются прогоном на случайных и всех граничных значениях, затем сравнением многочленов по модулю
+// 2^64. Результат, в том числе "keep", дописывается в файл, и следующие компиляции не перебирают
+// Текст до start (runtime, данные) не трогается
+void Superoptimize(TEmitter* output, size_t start, const Options* options) {
+    if (!options->superoptRules) {
+        return;
+    }
+
+    pthread_mutex_lock(&rulesLock);
+    LoadRules(options->superoptRules, options->superoptLearn);
+    if (!options->superoptLearn) { // без перебора таблица дальше только читается
+        pthread_mutex_unlock(&rulesLock);
+    }
+
+    size_t length = output->size - start;
+    char* text = (char*)calloc(length + 1, sizeof(char));
+    assert(text);
+    memcpy(text, output->data + start, length);
+    output->size = start;
+
+    OptimizeText(output, text, length, options->superoptLearn);
+    free(text);
+
+    if (options->superoptLearn) {
+        SaveLearnedRules();
+        pthread_mutex_unlock(&rulesLock);
+    }
+}
+
+// static ------------------------------------------------------------------------------------------
+
+// Строки вне блоков и блоки без замен переписываются как есть
+static void OptimizeText(TEmitter* output, char* text, size_t length, bool isLearning) {
+    TBlock block = {};
+    block.instructions = (TSuperInstruction*)calloc(kInitialSizeOfBlock, sizeof(TSuperInstruction));
+    assert(block.instructions);
+    block.capacity = kInitialSizeOfBlock;
+    vectorInit(&block.memories, kInitialSizeOfMemoryVector);
+
+    const char* end = text + length;
+    const char* blockBegin = NULL;
+    const char* blockEnd = NULL;
+    for (const char* line = text; line < end; ) {
+        const char* newline = (const char*)memchr(line, '\n', (size_t)(end - line));
+        const char* next = (newline) ? newline + 1 : end;
+
+        TSuperInstruction instruction = {};
+        if (IsBlankLine(line, next)) {
+            if (!blockBegin) {
+                EmitText(output, line, (size_t)(next - line));
+            }
+        } else if (ParseLine(line, next, &block.memories, &instruction)) {
+            blockBegin = (blockBegin) ? blockBegin : line;
+            blockEnd = next;
+            AddBlockInstruction(&block, &instruction);
+        } else if (blockBegin) {
+            FlushBlock(output, &block, blockBegin, blockEnd, !IsFlagWriterLine(line, next), isLearning);
+            EmitText(output, blockEnd, (size_t)(next - blockEnd));
+            blockBegin = NULL;
+        } else {
+            EmitText(output, line, (size_t)(next - line));
+        }
+        line = next;
+    }
+    if (blockBegin) {
+        FlushBlock(output, &block, blockBegin, blockEnd, true, isLearning);
+        EmitText(output, blockEnd, (size_t)(end - blockEnd));
+    }
+
+    ClearBlock(&block);
+    vectorFree(&block.memories);
+    free(block.instructions);
+}
+
+static void FlushBlock(TEmitter* output, TBlock* block, const char* begin, const char* end, bool isFlagLive,
+                       bool isLearning) {
+    OptimizeBlock(block, isFlagLive, isLearning);
+
+    if (!block->isChanged) {
+        EmitText(output, begin, (size_t)(end - begin));
+    } else {
+        for (size_t i = 0; i < block->count; i++) {
+            char line[kMaxLengthOfInstruction] = "";
+            PrintInstruction(&block->instructions[i], &block->memories, line, kMaxLengthOfInstruction);
+            Emit(output, "    %s\n", line);
+        }
+    }
+    ClearBlock(block);
+}
+
+// Каждая замена строго уменьшает оценку блока, поэтому цикл конечен. После замены окна, которые ее
+// задевают, проверяются снова
+static void OptimizeBlock(TBlock* block, bool isFlagLive, bool isLearning) {
+    size_t position = 0;
+    while (position < block->count) {
+        bool isReplaced = false;
+        size_t longest = (block->count - position < kMaxWindow) ? block->count - position : kMaxWindow;
+        for (size_t length = longest; length > 0 && !isReplaced; length--) {
+            isReplaced = ApplyRule(block, position, length, isFlagLive, isLearning);
+        }
+
+        if (isReplaced) {
+            position = (position >= kMaxWindow) ? position - kMaxWindow + 1 : 0;
+        } else {
+            position++;
+        }
+    }
+}
+
+static bool ApplyRule(TBlock* block, size_t position, size_t length, bool isFlagLive, bool isLearning) {
+    TWindow window = {};
+    if (!BuildWindow(&block->instructions[position], length, &window) || !IsBalanced(window.instructions, length)) {
+        return false;
+    }
+
+    char key[kMaxLengthOfRule] = "";
+    PrintSequence(window.instructions, length, NULL, key, kMaxLengthOfRule);
+    const TSuperRule* rule = FindRule(key);
+    if (!rule && isLearning) {
+        char replacement[kMaxLengthOfRule] = "";
+        SearchReplacement(&window, replacement, kMaxLengthOfRule);
+        rule = AddRule(key, replacement);
+    }
+    if (!rule || !strcmp(rule->replacement, kKeepWindow)) {
+        return false;
+    }
+
+    TSuperInstruction replacement[kMaxWindow] = {};
+    size_t count = 0;
+    if (strcmp(rule->replacement, kDeleteWindow)) {
+        bool isParsed = ParseSequence(rule->replacement, replacement, kMaxWindow, &count);
+        assert(isParsed && "rules are checked when they are loaded or found");
+    }
+    bool writesFlags = false;
+    for (size_t i = 0; i < count; i++) {
+        if (!BindInstruction(&replacement[i], &window)) {
+            return false;
+        }
+        writesFlags |= WritesFlags(&replacement[i]);
+    }
+    for (size_t i = 0; i < length; i++) {
+        writesFlags |= WritesFlags(&window.instructions[i]);
+    }
+    if (writesFlags && !AreFlagsDead(block, position + length, isFlagLive)) {
+        return false;
+    }
+
+    ReserveBlock(block, block->count - length + count);
+    memmove(&block->instructions[position + count], &block->instructions[position + length],
+            (block->count - position - length) * sizeof(TSuperInstruction));
+    memcpy(&block->instructions[position], replacement, count * sizeof(TSuperInstruction));
+    block->count = block->count - length + count;
+    block->isChanged = true;
+    return true;
+}
+
+// Числа, кроме 0, 1, -1 и сдвигов, становятся $k по порядку появления, равные - одним $k; ячейки - @k
+static bool BuildWindow(const TSuperInstruction* instructions, size_t count, TWindow* window) {
+    window->count = count;
+    for (size_t i = 0; i < count; i++) {
+        TSuperInstruction* instruction = &window->instructions[i];
+        *instruction = instructions[i];
+
+        for (size_t j = 0; j < instruction->count; j++) {
+            TSuperOperand* operand = &instruction->operands[j];
+            if (operand->kind == SuperMemory) {
+                size_t k = 0;
+                while (k < window->memoryCount && window->memories[k] != operand->memory) {
+                    k++;
+                }
+                if (k == kMaxMemoryOperands) {
+                    return false;
+                }
+                window->memories[k] = operand->memory;
+                window->memoryCount += (k == window->memoryCount);
+                operand->memory = k;
+            } else if ((operand->kind == SuperImmediate && instruction->opcode != SuperShl)
+                       || operand->kind == SuperAddress) {
+                if (!AbstractImmediate(&operand->immediate, window)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static bool AbstractImmediate(TSuperImmediate* immediate, TWindow* window) {
+    long long value = immediate->value;
+    if (value == 0 || value == 1 || value == -1) {
+        return true;
+    }
+
+    size_t k = 0;
+    while (k < window->immediateCount && window->immediates[k] != value) {
+        k++;
+    }
+    if (k == kMaxImmediates) {
+        return false;
+    }
+    window->immediates[k] = value;
+    window->immediateCount += (k == window->immediateCount);
+    immediate->kind = SymbolImmediate;
+    immediate->first = k;
+    return true;
+}
+
+// $k и @k замены - конкретные числа и ячейки окна
+static bool BindInstruction(TSuperInstruction* instruction, const TWindow* window) {
+    unsigned long long values[kMaxImmediates] = {};
+    for (size_t i = 0; i < window->immediateCount; i++) {
+        values[i] = (unsigned long long)window->immediates[i];
+    }
+
+    for (size_t i = 0; i < instruction->count; i++) {
+        TSuperOperand* operand = &instruction->operands[i];
+        if (operand->kind == SuperMemory) {
+            if (operand->memory >= window->memoryCount) {
+                return false;
+            }
+            operand->memory = window->memories[operand->memory];
+        } else if (operand->kind == SuperImmediate || operand->kind == SuperAddress) {
+            TSuperImmediate* immediate = &operand->immediate;
+            if (immediate->kind != LiteralImmediate
+                && (immediate->first >= window->immediateCount
+                    || (immediate->kind != SymbolImmediate && immediate->kind != NegatedImmediate
+                        && immediate->second >= window->immediateCount))) {
+                return false;
+            }
+            immediate->value = (long long)EvaluateImmediate(immediate, values);
+            immediate->kind = LiteralImmediate;
+        }
+    }
+    return IsEncodable(instruction);
+}
+
+static bool IsEncodable(const TSuperInstruction* instruction) {
+    if (instruction->opcode == SuperMov && instruction->operands[0].kind == SuperRegister) {
+        return true; // mov r64, imm64
+    }
+    for (size_t i = 0; i < instruction->count; i++) {
+        const TSuperOperand* operand = &instruction->operands[i];
+        if ((operand->kind == SuperImmediate || operand->kind == SuperAddress) && !FitsInt32(operand->immediate.value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Флаги, которые меняют окно и замена, никто не читает: до чтения их перезапишет команда блока или
+// строка сразу после него
+static bool AreFlagsDead(const TBlock* block, size_t position, bool isFlagLive) {
+    for (size_t i = position; i < block->count; i++) {
+        if (WritesFlags(&block->instructions[i])) {
+            return true;
+        }
+    }
+    return !isFlagLive;
+}
+
+static void AddBlockInstruction(TBlock* block, const TSuperInstruction* instruction) {
+    ReserveBlock(block, block->count + 1);
+    block->instructions[block->count++] = *instruction;
+}
+
+static void ReserveBlock(TBlock* block, size_t count) {
+    if (count <= block->capacity) {
+        return;
+    }
+    while (block->capacity < count) {
+        block->capacity *= 2;
+    }
+    block->instructions = (TSuperInstruction*)realloc(block->instructions, block->capacity * sizeof(TSuperInstruction));
+    assert(block->instructions);
+}
+
+static void ClearBlock(TBlock* block) {
+    for (size_t i = 0; i < block->memories.size; i++) {
+        free(block->memories.data[i]);
+    }
+    block->memories.size = 0;
+    block->count = 0;
+    block->isChanged = false;
+}
+
+// Файл правил: строки "окно => замена", "окно => keep" (дешевле не найдено) и "окно => delete".
+// Правило из файла проверяется многочленами, как найденное перебором
+static void LoadRules(const char* fileName, bool isLearning) {
+    if (rulesFileName) {
+        return;
+    }
+    rulesFileName = fileName;
+    vectorInit(&rules, kInitialSizeOfRuleVector);
+    vectorInit(&learnedRules, kInitialSizeOfRuleVector);
+
+    FILE* file = fopen(fileName, "r");
+    if (!file) {
+        if (isLearning) {
+            return;
+        }
+        fprintf(stderr, "Error: cannot read superoptimizer rules %s\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+
+    char line[kMaxLengthOfRule] = "";
+    size_t lineNumber = 0;
+    while (fgets(line, (int)kMaxLengthOfRule, file)) {
+        lineNumber++;
+        line[strcspn(line, "\n")] = '\0';
+        if (!*line || *line == '#') {
+            continue;
+        }
+
+        char* separator = strstr(line, kRuleSeparator);
+        if (separator) {
+            *separator = '\0';
+        }
+        if (!separator || !CheckRule(line, separator + strlen(kRuleSeparator))) {
+            fprintf(stderr, "Error: %s:%zu: malformed or unsound superoptimizer rule\n", fileName, lineNumber);
+            exit(EXIT_FAILURE);
+        }
+
+        TSuperRule* rule = (TSuperRule*)calloc(1, sizeof(TSuperRule));
+        assert(rule);
+        rule->key = strdup(line);
+        rule->replacement = strdup(separator + strlen(kRuleSeparator));
+        assert(rule->key && rule->replacement);
+        vectorPush(&rules, rule);
+    }
+    fclose(file);
+
+    qsort(rules.data, rules.size, sizeof(void*), CompareRules);
+}
+
+static bool CheckRule(const char* key, const char* replacement) {
+    TWindow window = {};
+    if (!ParseWindow(key, &window) || !IsBalanced(window.instructions, window.count)) {
+        return false;
+    }
+    if (!strcmp(replacement, kKeepWindow)) {
+        return true;
+    }
+
+    TSuperInstruction instructions[kMaxWindow] = {};
+    size_t count = 0;
+    if (strcmp(replacement, kDeleteWindow) && !ParseSequence(replacement, instructions, kMaxWindow, &count)) {
+        return false;
+    }
+    unsigned writes = 0;
+    for (size_t i = 0; i < window.count; i++) {
+        writes |= GetWrites(&window.instructions[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (instructions[i].opcode == SuperPush || instructions[i].opcode == SuperPop) {
+            return false;
+        }
+        for (size_t j = 0; j < instructions[i].count; j++) {
+            const TSuperOperand* operand = &instructions[i].operands[j];
+            const TSuperImmediate* immediate = &operand->immediate;
+            if (operand->kind == SuperMemory && operand->memory >= window.memoryCount) {
+                return false;
+            }
+            if ((operand->kind == SuperImmediate || operand->kind == SuperAddress)
+                && immediate->kind != LiteralImmediate
+                && (immediate->first >= window.immediateCount || immediate->second >= window.immediateCount)) {
+                return false;
+            }
+        }
+        writes |= GetWrites(&instructions[i]);
+    }
+    if (GetSequenceCost(instructions, count) >= GetSequenceCost(window.instructions, window.count)) {
+        return false; // иначе замены могли бы ходить по кругу
+    }
+
+    TSymbolicMachine* expected = (TSymbolicMachine*)calloc(1, sizeof(TSymbolicMachine));
+    TSymbolicMachine* actual = (TSymbolicMachine*)calloc(1, sizeof(TSymbolicMachine));
+    assert(expected && actual);
+    InitSymbolic(expected);
+    InitSymbolic(actual);
+    ExecuteSymbolic(expected, window.instructions, window.count);
+    ExecuteSymbolic(actual, instructions, count);
+
+    bool isSound = true;
+    for (size_t i = 0; i < kLocationCount && isSound; i++) {
+        isSound = !(writes & (1u << i)) || ArePolynomialsEqual(&expected->locations[i], &actual->locations[i]);
+    }
+    free(expected);
+    free(actual);
+    return isSound;
+}
+
+static const TSuperRule* FindRule(const char* key) {
+    void** found = (void**)bsearch(key, rules.data, rules.size, sizeof(void*), CompareRuleKey);
+    return (found) ? (const TSuperRule*)*found : NULL;
+}
+
+static const TSuperRule* AddRule(const char* key, const char* replacement) {
+    TSuperRule* rule = (TSuperRule*)calloc(1, sizeof(TSuperRule));
+    assert(rule);
+    rule->key = strdup(key);
+    rule->replacement = strdup(replacement);
+    assert(rule->key && rule->replacement);
+
+    size_t position = 0;
+    while (position < rules.size && CompareRuleKey(key, &rules.data[position]) > 0) {
+        position++;
+    }
+    vectorPush(&rules, rule);
+    memmove(&rules.data[position + 1], &rules.data[position], (rules.size - position - 1) * sizeof(void*));
+    rules.data[position] = rule;
+
+    vectorPush(&learnedRules, rule);
+    return rule;
+}
+
+static void SaveLearnedRules() {
+    if (!learnedRules.size) {
+        return;
+    }
+
+    FILE* file = fopen(rulesFileName, "a");
+    if (!file) {
+        fprintf(stderr, "Error: cannot write superoptimizer rules %s\n", rulesFileName);
+        exit(EXIT_FAILURE);
+    }
+    if (!ftell(file)) {
+        fputs(kRulesHeader, file);
+    }
+    for (size_t i = 0; i < learnedRules.size; i++) {
+        const TSuperRule* rule = (const TSuperRule*)learnedRules.data[i];
+        fprintf(file, "%s%s%s\n", rule->key, kRuleSeparator, rule->replacement);
+    }
+    fclose(file);
+    learnedRules.size = 0;
+}
+
+static int CompareRules(const void* first, const void* second) {
+    return strcmp((*(const TSuperRule* const*)first)->key, (*(const TSuperRule* const*)second)->key);
+}
+
+static int CompareRuleKey(const void* key, const void* rule) {
+    return strcmp((const char*)key, (*(const TSuperRule* const*)rule)->key);
+}
+
+// Перебор замен из одной и двух команд, которые пишут только места, измененные окном, в порядке
+// стоимости. Кандидат сначала прогоняется на тестах, многочлены сравниваются только у прошедших
+static void SearchReplacement(const TWindow* window, char* replacement, size_t size) {
+    TSearch search = {};
+    search.window = window;
+    search.expected = (TSymbolicMachine*)calloc(1, sizeof(TSymbolicMachine));
+    search.actual = (TSymbolicMachine*)calloc(1, sizeof(TSymbolicMachine));
+    assert(search.expected && search.actual);
+    InitSymbolic(search.expected);
+    ExecuteSymbolic(search.expected, window->instructions, window->count);
+
+    bool isComparable = true;
+    for (size_t i = 0; i < window->count; i++) {
+        search.writes |= GetWrites(&window->instructions[i]);
+    }
+    for (size_t i = 0; i < kLocationCount; i++) {
+        if (!(search.writes & (1u << i))) {
+            continue;
+        }
+        TPolynomial initial = {};
+        PolynomialVariable(&initial, i);
+        isComparable &= !search.expected->locations[i].isOverflow;
+        if (!ArePolynomialsEqual(&search.expected->locations[i], &initial)) {
+            search.required |= 1u << i;
+        }
+    }
+    search.bestCost = GetSequenceCost(window->instructions, window->count);
+
+    if (isComparable && !search.required) {
+        search.isFound = true;
+        search.bestCount = 0;
+    } else if (isComparable && CountBits(search.required) <= kMaxReplacement) {
+        PrepareTests(&search);
+        GenerateCandidates(&search);
+        SearchSingles(&search);
+        SearchPairs(&search);
+    }
+
+    if (!search.isFound) {
+        snprintf(replacement, size, "%s", kKeepWindow);
+    } else if (!search.bestCount) {
+        snprintf(replacement, size, "%s", kDeleteWindow);
+    } else {
+        PrintSequence(search.best, search.bestCount, NULL, replacement, size);
+    }
+
+    free(search.candidates);
+    free(search.inputs);
+    free(search.outputs);
+    free(search.expected);
+    free(search.actual);
+}
+
+// kRandomTests случайных состояний, затем все сочетания граничных значений для того, что окно читает,
+// если входов не больше kMaxExhaustiveInputs
+static void PrepareTests(TSearch* search) {
+    const TWindow* window = search->window;
+    unsigned reads = 0;
+    unsigned written = 0;
+    for (size_t i = 0; i < window->count; i++) {
+        reads |= GetReads(&window->instructions[i]) & ~written;
+        written |= GetWrites(&window->instructions[i]);
+    }
+
+    size_t inputs[kMaxVariables] = {};
+    size_t inputCount = 0;
+    for (size_t i = 0; i < kLocationCount; i++) {
+        if (reads & (1u << i)) {
+            inputs[inputCount++] = i;
+        }
+    }
+    for (size_t i = 0; i < window->immediateCount; i++) {
+        inputs[inputCount++] = kLocationCount + i;
+    }
+    size_t exhaustiveCount = (inputCount <= kMaxExhaustiveInputs) ? (size_t)1 << (2 * inputCount) : 0;
+
+    search->testCount = kRandomTests + exhaustiveCount;
+    search->inputs = (TMachine*)calloc(search->testCount, sizeof(TMachine));
+    search->outputs = (TMachine*)calloc(search->testCount, sizeof(TMachine));
+    assert(search->inputs && search->outputs);
+
+    unsigned long long seed = kTestSeed;
+    for (size_t t = 0; t < search->testCount; t++) {
+        TMachine* machine = &search->inputs[t];
+        for (size_t i = 0; i < kLocationCount; i++) {
+            machine->locations[i] = NextRandom(&seed);
+        }
+        for (size_t i = 0; i < kMaxImmediates; i++) {
+            machine->immediates[i] = NextRandom(&seed);
+        }
+        if (t >= kRandomTests) {
+            size_t combination = t - kRandomTests;
+            for (size_t i = 0; i < inputCount; i++) {
+                unsigned long long value = kEdgeValues[(combination >> (2 * i)) & 3];
+                if (inputs[i] < kLocationCount) {
+                    machine->locations[inputs[i]] = value;
+                } else {
+                    machine->immediates[inputs[i] - kLocationCount] = value;
+                }
+            }
+        }
+
+        search->outputs[t] = *machine;
+        Execute(&search->outputs[t], window->instructions, window->count);
+    }
+}
+
+// Операнды кандидатов - регистры и ячейки окна, $k, их суммы, разности и произведения
+static void GenerateCandidates(TSearch* search) {
+    const TWindow* window = search->window;
+    search->candidateCapacity = kInitialSizeOfCandidates;
+    search->candidates = (TCandidate*)calloc(search->candidateCapacity, sizeof(TCandidate));
+    assert(search->candidates);
+
+    unsigned registers = 0;
+    for (size_t i = 0; i < window->count; i++) {
+        const TSuperInstruction* instruction = &window->instructions[i];
+        for (size_t j = 0; j < instruction->count; j++) {
+            const TSuperOperand* operand = &instruction->operands[j];
+            if (operand->kind == SuperRegister || operand->kind == SuperAddress) {
+                registers |= (operand->reg != kNoRegister) ? 1u << operand->reg : 0;
+            }
+            if (operand->kind == SuperAddress && operand->index != kNoRegister) {
+                registers |= 1u << operand->index;
+            }
+        }
+    }
+
+    TSuperOperand sources[kLocationCount] = {};
+    size_t sourceCount = 0;
+    for (size_t i = 0; i < kLocationCount; i++) {
+        if (i < kRegisterCount && (registers & (1u << i))) {
+            sources[sourceCount++] = {.kind = SuperRegister, .reg = (int)i, .index = kNoRegister, .scale = 1,
+                                      .memory = 0, .immediate = {}};
+        } else if (i >= kRegisterCount && i - kRegisterCount < window->memoryCount) {
+            sources[sourceCount++] = {.kind = SuperMemory, .reg = kNoRegister, .index = kNoRegister, .scale = 1,
+                                      .memory = i - kRegisterCount, .immediate = {}};
+        }
+    }
+
+    TSuperImmediate general[kMaxImmediatePool] = {};
+    size_t generalCount = BuildImmediatePool(window, true, true, general);
+    TSuperImmediate factors[kMaxImmediatePool] = {};
+    size_t factorCount = BuildImmediatePool(window, false, false, factors);
+    TSuperImmediate displacements[kMaxImmediatePool] = {};
+    displacements[0] = {.kind = LiteralImmediate, .value = 0, .first = 0, .second = 0};
+    size_t displacementCount = 1;
+    for (size_t i = 0; i < window->immediateCount; i++) {
+        displacements[displacementCount++] = {.kind = SymbolImmediate, .value = 0, .first = i, .second = 0};
+        displacements[displacementCount++] = {.kind = NegatedImmediate, .value = 0, .first = i, .second = 0};
+    }
+
+    for (size_t location = 0; location < kLocationCount; location++) {
+        if (!(search->required & (1u << location))) {
+            continue;
+        }
+        bool isRegister = location < kRegisterCount;
+        TSuperOperand destination = {.kind = (isRegister) ? SuperRegister : SuperMemory,
+                                     .reg = (isRegister) ? (int)location : kNoRegister, .index = kNoRegister,
+                                     .scale = 1, .memory = (isRegister) ? 0 : location - kRegisterCount,
+                                     .immediate = {}};
+
+        for (size_t i = 0; i < sourceCount; i++) {
+            if (sources[i].kind == SuperRegister && sources[i].reg == destination.reg) {
+                continue;
+            }
+            AddCandidate(search, SuperMov, &destination, &sources[i], NULL);
+            AddCandidate(search, SuperAdd, &destination, &sources[i], NULL);
+            AddCandidate(search, SuperSub, &destination, &sources[i], NULL);
+        }
+        for (size_t i = 0; i < generalCount; i++) {
+            TSuperOperand immediate = {.kind = SuperImmediate, .reg = kNoRegister, .index = kNoRegister, .scale = 1,
+                                       .memory = 0, .immediate = general[i]};
+            AddCandidate(search, SuperMov, &destination, &immediate, NULL);
+            AddCandidate(search, SuperAdd, &destination, &immediate, NULL);
+            AddCandidate(search, SuperSub, &destination, &immediate, NULL);
+        }
+        if (!isRegister) {
+            continue;
+        }
+
+        AddCandidate(search, SuperNeg, &destination, NULL, NULL);
+        AddCandidate(search, SuperXor, &destination, &destination, NULL);
+        for (size_t shift = 1; shift <= kMaxShift; shift++) {
+            TSuperOperand count = {.kind = SuperImmediate, .reg = kNoRegister, .index = kNoRegister, .scale = 1,
+                                   .memory = 0, .immediate = {.kind = LiteralImmediate, .value = (long long)shift,
+                                                              .first = 0, .second = 0}};
+            AddCandidate(search, SuperShl, &destination, &count, NULL);
+        }
+        for (size_t i = 0; i < sourceCount; i++) {
+            AddCandidate(search, SuperImul, &destination, &sources[i], NULL);
+            for (size_t j = 0; j < factorCount; j++) {
+                TSuperOperand factor = {.kind = SuperImmediate, .reg = kNoRegister, .index = kNoRegister,
+                                        .scale = 1, .memory = 0, .immediate = factors[j]};
+                AddCandidate(search, SuperImul, &destination, &sources[i], &factor);
+            }
+        }
+
+        for (int base = kNoRegister; base < (int)kRegisterCount; base++) {
+            for (int index = kNoRegister; index < (int)kRegisterCount; index++) {
+                if ((base != kNoRegister && !(registers & (1u << base)))
+                    || (index != kNoRegister && !(registers & (1u << index)))
+                    || (base == kNoRegister && index == kNoRegister)) {
+                    continue;
+                }
+                for (int scale = 1; scale <= 8; scale *= 2) {
+                    if ((index == kNoRegister && scale != 1) || (base == kNoRegister && scale == 1)) {
+                        continue;
+                    }
+                    for (size_t i = 0; i < displacementCount; i++) {
+                        if (index == kNoRegister && displacements[i].kind == LiteralImmediate) {
+                            continue; // lea r, [ base ] - это mov
+                        }
+                        TSuperOperand address = {.kind = SuperAddress, .reg = base, .index = index, .scale = scale,
+                                                 .memory = 0, .immediate = displacements[i]};
+                        AddCandidate(search, SuperLea, &destination, &address, NULL);
+                    }
+                }
+            }
+        }
+    }
+
+    qsort(search->candidates, search->candidateCount, sizeof(TCandidate), CompareCandidates);
+}
+
+static void AddCandidate(TSearch* search, SuperOpcode opcode, const TSuperOperand* first,
+                         const TSuperOperand* second, const TSuperOperand* third) {
+    TCandidate candidate = {};
+    candidate.instruction.opcode = opcode;
+    const TSuperOperand* operands[kMaxOperands] = {first, second, third};
+    for (size_t i = 0; i < kMaxOperands && operands[i]; i++) {
+        candidate.instruction.operands[candidate.instruction.count++] = *operands[i];
+    }
+    if (!IsSupported(&candidate.instruction)) {
+        return;
+    }
+
+    candidate.cost = GetCost(&candidate.instruction);
+    candidate.reads = GetReads(&candidate.instruction);
+    candidate.writes = GetWrites(&candidate.instruction);
+    if (candidate.cost >= search->bestCost) {
+        return;
+    }
+
+    if (search->candidateCount == search->candidateCapacity) {
+        search->candidateCapacity *= 2;
+        search->candidates = (TCandidate*)realloc(search->candidates, search->candidateCapacity * sizeof(TCandidate));
+        assert(search->candidates);
+    }
+    search->candidates[search->candidateCount++] = candidate;
+}
+
+static void SearchSingles(TSearch* search) {
+    for (size_t i = 0; i < search->candidateCount; i++) {
+        const TCandidate* candidate = &search->candidates[i];
+        if (candidate->cost >= search->bestCost) {
+            break;
+        }
+        if (candidate->writes == search->required && IsEquivalent(search, &candidate->instruction, 1)) {
+            search->best[0] = candidate->instruction;
+            search->bestCount = 1;
+            search->bestCost = candidate->cost;
+            search->isFound = true;
+            return;
+        }
+    }
+}
+
+// Для первой команды состояние после нее считается один раз, вторая проверяется на нем
+static void SearchPairs(TSearch* search) {
+    if (!search->candidateCount) {
+        return;
+    }
+
+    size_t cheapest = search->candidates[0].cost;
+    TMachine afterFirst[kRandomTests] = {};
+    for (size_t i = 0; i < search->candidateCount; i++) {
+        const TCandidate* first = &search->candidates[i];
+        if (first->cost + cheapest >= search->bestCost) {
+            break;
+        }
+        for (size_t t = 0; t < kRandomTests; t++) {
+            afterFirst[t] = search->inputs[t];
+            Execute(&afterFirst[t], &first->instruction, 1);
+        }
+
+        for (size_t j = 0; j < search->candidateCount; j++) {
+            const TCandidate* second = &search->candidates[j];
+            if (first->cost + second->cost >= search->bestCost) {
+                break;
+            }
+            if ((first->writes | second->writes) != search->required
+                || (first->writes == second->writes && !(second->reads & first->writes))) {
+                continue; // какое-то место не записано или первая команда мертва
+            }
+
+            bool isMatched = true;
+            for (size_t t = 0; t < kRandomTests && isMatched; t++) {
+                TMachine machine = afterFirst[t];
+                Execute(&machine, &second->instruction, 1);
+                isMatched = HaveSameLocations(&machine, &search->outputs[t], search->writes);
+            }
+            TSuperInstruction pair[kMaxReplacement] = {first->instruction, second->instruction};
+            if (isMatched && IsEquivalent(search, pair, kMaxReplacement)) {
+                memcpy(search->best, pair, sizeof(pair));
+                search->bestCount = kMaxReplacement;
+                search->bestCost = first->cost + second->cost;
+                search->isFound = true;
+                break;
+            }
+        }
+    }
+}
+
+// Все места, которые пишет окно, после кандидата такие же: на тестах и как многочлены
+static bool IsEquivalent(TSearch* search, const TSuperInstruction* instructions, size_t count) {
+    for (size_t t = 0; t < search->testCount; t++) {
+        TMachine machine = search->inputs[t];
+        Execute(&machine, instructions, count);
+        if (!HaveSameLocations(&machine, &search->outputs[t], search->writes)) {
+            return false;
+        }
+    }
+
+    InitSymbolic(search->actual);
+    ExecuteSymbolic(search->actual, instructions, count);
+    for (size_t i = 0; i < kLocationCount; i++) {
+        if ((search->writes & (1u << i))
+            && !ArePolynomialsEqual(&search->actual->locations[i], &search->expected->locations[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool HaveSameLocations(const TMachine* first, const TMachine* second, unsigned mask) {
+    for (size_t i = 0; i < kLocationCount; i++) {
+        if ((mask & (1u << i)) && first->locations[i] != second->locations[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 0, 1, -1 (withLiterals), $k, -$k, $i+$j и $i-$j (withSums), $i*$j
+static size_t BuildImmediatePool(const TWindow* window, bool withLiterals, bool withSums, TSuperImmediate* pool) {
+    size_t count = 0;
+    if (withLiterals) {
+        pool[count++] = {.kind = LiteralImmediate, .value = 0, .first = 0, .second = 0};
+        pool[count++] = {.kind = LiteralImmediate, .value = 1, .first = 0, .second = 0};
+        pool[count++] = {.kind = LiteralImmediate, .value = -1, .first = 0, .second = 0};
+    }
+    for (size_t i = 0; i < window->immediateCount; i++) {
+        pool[count++] = {.kind = SymbolImmediate, .value = 0, .first = i, .second = 0};
+        pool[count++] = {.kind = NegatedImmediate, .value = 0, .first = i, .second = 0};
+        for (size_t j = i; j < window->immediateCount; j++) {
+            pool[count++] = {.kind = ProductImmediate, .value = 0, .first = i, .second = j};
+            if (withSums && j != i) {
+                pool[count++] = {.kind = SumImmediate, .value = 0, .first = i, .second = j};
+                pool[count++] = {.kind = DifferenceImmediate, .value = 0, .first = i, .second = j};
+                pool[count++] = {.kind = DifferenceImmediate, .value = 0, .first = j, .second = i};
+            }
+        }
+    }
+    assert(count <= kMaxImmediatePool);
+    return count;
+}
+
+static int CompareCandidates(const void* first, const void* second) {
+    const TCandidate* a = (const TCandidate*)first;
+    const TCandidate* b = (const TCandidate*)second;
+    return (a->cost > b->cost) - (a->cost < b->cost);
+}
+
+// xorshift64*: тесты одинаковы от запуска к запуску, и файл правил тоже
+static unsigned long long NextRandom(unsigned long long* state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1Dull;
+}
+
+static bool ParseLine(const char* line, const char* end, Vector* memories, TSuperInstruction* instruction) {
+    size_t length = (size_t)(end - line);
+    if (length >= kMaxLengthOfInstruction) {
+        return false;
+    }
+    char text[kMaxLengthOfInstruction] = "";
+    memcpy(text, line, length);
+    text[strcspn(text, ";\n")] = '\0';
+    return ParseInstruction(text, memories, instruction);
+}
+
+// Команды правила через "; "
+static bool ParseSequence(const char* text, TSuperInstruction* instructions, size_t maxCount, size_t* count) {
+    if (strlen(text) >= kMaxLengthOfRule) {
+        return false;
+    }
+    char buffer[kMaxLengthOfRule] = "";
+    strcpy(buffer, text);
+
+    *count = 0;
+    for (char* instruction = buffer; instruction; ) {
+        char* next = strstr(instruction, kSequenceSeparator);
+        if (next) {
+            *next = '\0';
+            next += strlen(kSequenceSeparator);
+        }
+        if (*count == maxCount || !ParseInstruction(instruction, NULL, &instructions[(*count)++])) {
+            return false;
+        }
+        instruction = next;
+    }
+    return true;
+}
+
+static bool ParseWindow(const char* text, TWindow* window) {
+    if (!ParseSequence(text, window->instructions, kMaxWindow, &window->count)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < window->count; i++) {
+        const TSuperInstruction* instruction = &window->instructions[i];
+        for (size_t j = 0; j < instruction->count; j++) {
+            const TSuperOperand* operand = &instruction->operands[j];
+            const TSuperImmediate* immediate = &operand->immediate;
+            if (operand->kind == SuperMemory && operand->memory + 1 > window->memoryCount) {
+                window->memoryCount = operand->memory + 1;
+            }
+            if ((operand->kind == SuperImmediate || operand->kind == SuperAddress)
+                && immediate->kind == SymbolImmediate && immediate->first + 1 > window->immediateCount) {
+                window->immediateCount = immediate->first + 1;
+            } else if ((operand->kind == SuperImmediate || operand->kind == SuperAddress)
+                       && immediate->kind != SymbolImmediate && immediate->kind != LiteralImmediate) {
+                return false; // в окне только $k
+            }
+        }
+    }
+    return true;
+}
+
+// memories == NULL - текст правила с @k и $k, иначе строка nasm.s
+static bool ParseInstruction(char* text, Vector* memories, TSuperInstruction* instruction) {
+    *instruction = {};
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    char* operands = text + strcspn(text, " \t");
+    if (*operands) {
+        *operands++ = '\0';
+    }
+
+    size_t opcode = 0;
+    while (opcode < SuperOpcodeCount && strcmp(text, kMnemonics[opcode])) {
+        opcode++;
+    }
+    if (opcode == SuperOpcodeCount) {
+        return false;
+    }
+    instruction->opcode = (SuperOpcode)opcode;
+
+    for (char* operand = operands; operand && *operand; ) {
+        char* next = strchr(operand, ',');
+        if (next) {
+            *next++ = '\0';
+        }
+        while (isspace((unsigned char)*operand)) {
+            operand++;
+        }
+        size_t length = strlen(operand);
+        while (length && isspace((unsigned char)operand[length - 1])) {
+            operand[--length] = '\0';
+        }
+
+        if (instruction->count == kMaxOperands
+            || !ParseOperand(operand, memories, &instruction->operands[instruction->count++])) {
+            return false;
+        }
+        operand = next;
+    }
+    return IsSupported(instruction);
+}
+
+static bool ParseOperand(char* text, Vector* memories, TSuperOperand* operand) {
+    *operand = {.kind = SuperRegister, .reg = kNoRegister, .index = kNoRegister, .scale = 1, .memory = 0,
+                .immediate = {.kind = LiteralImmediate, .value = 0, .first = 0, .second = 0}};
+
+    if (*text == '@') {
+        char* end = NULL;
+        unsigned long memory = strtoul(text + 1, &end, 10);
+        operand->kind = SuperMemory;
+        operand->memory = memory;
+        return !memories && isdigit((unsigned char)text[1]) && !*end && memory < kMaxMemoryOperands;
+    }
+    if (!strncmp(text, "qword [", strlen("qword ["))) {
+        return memories && ParseMemory(text, memories, operand);
+    }
+    if (*text == '[') {
+        size_t length = strlen(text);
+        if (text[length - 1] != ']') {
+            return false;
+        }
+        text[length - 1] = '\0';
+        return ParseAddress(text + 1, !memories, operand);
+    }
+    if (ParseRegister(text, &operand->reg)) {
+        return true;
+    }
+    operand->kind = SuperImmediate;
+    return ParseImmediate(text, !memories, &operand->immediate);
+}
+
+// base, index * scale и смещение через " + " и " - ", без rsp и rbp
+static bool ParseAddress(char* text, bool isAbstract, TSuperOperand* operand) {
+    char* tokens[kMaxAddressTokens] = {};
+    size_t count = 0;
+    char* state = NULL;
+    for (char* token = strtok_r(text, " ", &state); token; token = strtok_r(NULL, " ", &state)) {
+        if (count == kMaxAddressTokens) {
+            return false;
+        }
+        tokens[count++] = token;
+    }
+
+    operand->kind = SuperAddress;
+    bool hasDisplacement = false;
+    bool isNegative = false;
+    for (size_t i = 0; i < count; i++) {
+        int reg = kNoRegister;
+        if (ParseRegister(tokens[i], &reg)) {
+            if (isNegative) {
+                return false;
+            }
+            if (i + 2 < count && !strcmp(tokens[i + 1], "*")) {
+                int scale = atoi(tokens[i + 2]);
+                if (operand->index != kNoRegister || (scale != 1 && scale != 2 && scale != 4 && scale != 8)) {
+                    return false;
+                }
+                operand->index = reg;
+                operand->scale = scale;
+                i += 2;
+            } else if (operand->reg == kNoRegister) {
+                operand->reg = reg;
+            } else if (operand->index == kNoRegister) {
+                operand->index = reg;
+            } else {
+                return false;
+            }
+        } else {
+            if (hasDisplacement || !ParseImmediate(tokens[i], isAbstract, &operand->immediate)) {
+                return false;
+            }
+            if (isNegative) {
+                if (operand->immediate.kind != LiteralImmediate) {
+                    return false;
+                }
+                operand->immediate.value = (long long)(0 - (unsigned long long)operand->immediate.value);
+            }
+            hasDisplacement = true;
+        }
+
+        if (i + 1 < count) {
+            i++;
+            if (strcmp(tokens[i], "+") && strcmp(tokens[i], "-")) {
+                return false;
+            }
+            isNegative = tokens[i][0] == '-';
+            if (i + 1 == count) {
+                return false;
+            }
+        }
+    }
+    return operand->reg != kNoRegister || operand->index != kNoRegister;
+}
+
+// qword [ name ] или qword [ rbp +- 8k ]: такие ячейки не перекрываются, если их тексты разные
+static bool ParseMemory(const char* text, Vector* memories, TSuperOperand* operand) {
+    const char* inner = text + strlen("qword [");
+    size_t length = strlen(inner);
+    if (!length || inner[length - 1] != ']' || length >= kMaxLengthOfOperand) {
+        return false;
+    }
+    char address[kMaxLengthOfOperand] = "";
+    memcpy(address, inner, length - 1);
+
+    int reg = kNoRegister;
+    if (!strncmp(address, "rbp ", strlen("rbp "))) {
+        char sign = address[strlen("rbp ")];
+        char* end = NULL;
+        long offset = strtol(address + strlen("rbp - "), &end, 10);
+        if ((sign != '+' && sign != '-') || address[strlen("rbp -")] != ' '
+            || !isdigit((unsigned char)address[strlen("rbp - ")]) || *end || offset % 8) {
+            return false;
+        }
+    } else {
+        if (!isalpha((unsigned char)*address) && *address != '_' && *address != '.') {
+            return false;
+        }
+        for (const char* c = address; *c; c++) {
+            if (!isalnum((unsigned char)*c) && *c != '_' && *c != '.') {
+                return false;
+            }
+        }
+        if (ParseRegister(address, &reg) || !strcmp(address, "rsp") || !strcmp(address, "rbp")
+            || (address[0] == 'e' && strlen(address) == 3)) { // переменная с именем регистра - не ячейка
+            return false;
+        }
+    }
+
+    size_t memory = 0;
+    while (memory < memories->size && strcmp((const char*)memories->data[memory], text)) {
+        memory++;
+    }
+    if (memory == memories->size) {
+        char* copy = strdup(text);
+        assert(copy);
+        vectorPush(memories, copy);
+    }
+    operand->kind = SuperMemory;
+    operand->memory = memory;
+    return true;
+}
+
+static bool ParseRegister(const char* text, int* reg) {
+    for (size_t i = 0; i < kRegisterCount; i++) {
+        if (!strcmp(text, kRegisterNames[i]) && (int)i != kStackPointer && (int)i != kFramePointer) {
+            *reg = (int)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Число; в правиле еще $a, -$a, $a+$b, $a-$b, $a*$b. Генератор печатает числа без знака (до 2^64 - 1):
+// значение - 64-битный образ числа, как у самой инструкции
+static bool ParseImmediate(const char* text, bool isAbstract, TSuperImmediate* immediate) {
+    *immediate = {.kind = LiteralImmediate, .value = 0, .first = 0, .second = 0};
+    if (isdigit((unsigned char)*text) || (*text == '-' && isdigit((unsigned char)text[1]))) {
+        char* end = NULL;
+        errno = 0;
+        immediate->value = (*text == '-') ? strtoll(text, &end, 10) : (long long)strtoull(text, &end, 10);
+        return !*end && errno != ERANGE;
+    }
+    if (!isAbstract) {
+        return false;
+    }
+
+    if (*text == '-') {
+        text++;
+        immediate->kind = NegatedImmediate;
+        return ParseSymbol(&text, &immediate->first) && !*text;
+    }
+    if (!ParseSymbol(&text, &immediate->first)) {
+        return false;
+    }
+    if (!*text) {
+        immediate->kind = SymbolImmediate;
+        return true;
+    }
+
+    char operation = *text++;
+    immediate->kind = (operation == '+') ? SumImmediate : (operation == '-') ? DifferenceImmediate : ProductImmediate;
+    return (operation == '+' || operation == '-' || operation == '*') && ParseSymbol(&text, &immediate->second)
+        && !*text;
+}
+
+static bool ParseSymbol(const char** text, size_t* symbol) {
+    if (**text != '$' || !isdigit((unsigned char)(*text)[1])) {
+        return false;
+    }
+    *symbol = (size_t)((*text)[1] - '0');
+    *text += 2;
+    return *symbol < kMaxImmediates;
+}
+
+// Формы, которые есть в словаре перебора и которые собирает встроенный ассемблер
+static bool IsSupported(const TSuperInstruction* instruction) {
+    const TSuperOperand* first = &instruction->operands[0];
+    const TSuperOperand* second = &instruction->operands[1];
+    const TSuperOperand* third = &instruction->operands[2];
+    bool isRegister = first->kind == SuperRegister;
+    bool isMemory = first->kind == SuperMemory;
+
+    switch (instruction->opcode) {
+        case SuperMov:
+        case SuperAdd:
+        case SuperSub:
+            return instruction->count == 2 && (isRegister || isMemory)
+                && (second->kind == SuperRegister || second->kind == SuperImmediate
+                    || (isRegister && second->kind == SuperMemory));
+        case SuperImul:
+            return isRegister && (second->kind == SuperRegister || second->kind == SuperMemory)
+                && (instruction->count == 2 || (instruction->count == 3 && third->kind == SuperImmediate));
+        case SuperNeg:
+        case SuperPush:
+        case SuperPop:
+            return instruction->count == 1 && isRegister;
+        case SuperShl:
+            return instruction->count == 2 && isRegister && second->kind == SuperImmediate
+                && second->immediate.kind == LiteralImmediate && second->immediate.value > 0
+                && second->immediate.value < 64;
+        case SuperLea:
+            return instruction->count == 2 && isRegister && second->kind == SuperAddress;
+        case SuperXor:
+            return instruction->count == 2 && isRegister && second->kind == SuperRegister && second->reg == first->reg;
+        case SuperOpcodeCount:
+        default:
+            return false;
+    }
+}
+
+static bool IsBlankLine(const char* line, const char* end) {
+    while (line < end && isspace((unsigned char)*line)) {
+        line++;
+    }
+    return line == end || *line == ';';
+}
+
+static bool IsFlagWriterLine(const char* line, const char* end) {
+    while (line < end && isspace((unsigned char)*line)) {
+        line++;
+    }
+    size_t length = 0;
+    while (line + length < end && isalpha((unsigned char)line[length])) {
+        length++;
+    }
+
+    for (size_t i = 0; i < sizeof(kFlagWriters) / sizeof(kFlagWriters[0]); i++) {
+        if (strlen(kFlagWriters[i]) == length && !strncmp(line, kFlagWriters[i], length)
+            && (line + length == end || isspace((unsigned char)line[length]))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void PrintSequence(const TSuperInstruction* instructions, size_t count, const Vector* memories, char* text,
+                          size_t size) {
+    size_t offset = 0;
+    text[0] = '\0';
+    for (size_t i = 0; i < count && offset < size; i++) {
+        char instruction[kMaxLengthOfInstruction] = "";
+        PrintInstruction(&instructions[i], memories, instruction, kMaxLengthOfInstruction);
+        int length = snprintf(text + offset, size - offset, "%s%s", (i) ? kSequenceSeparator : "", instruction);
+        offset += (length > 0) ? (size_t)length : 0;
+    }
+}
+
+static void PrintInstruction(const TSuperInstruction* instruction, const Vector* memories, char* text, size_t size) {
+    char operands[kMaxOperands][kMaxLengthOfOperand] = {};
+    for (size_t i = 0; i < instruction->count; i++) {
+        PrintOperand(&instruction->operands[i], memories, operands[i], kMaxLengthOfOperand);
+    }
+
+    switch (instruction->count) {
+        case 1:  snprintf(text, size, "%s %s", kMnemonics[instruction->opcode], operands[0]); break;
+        case 2:  snprintf(text, size, "%s %s, %s", kMnemonics[instruction->opcode], operands[0], operands[1]); break;
+        default: snprintf(text, size, "%s %s, %s, %s", kMnemonics[instruction->opcode], operands[0], operands[1],
+                          operands[2]); break;
+    }
+}
+
+static void PrintOperand(const TSuperOperand* operand, const Vector* memories, char* text, size_t size) {
+    switch (operand->kind) {
+        case SuperRegister:
+            snprintf(text, size, "%s", kRegisterNames[operand->reg]);
+            break;
+        case SuperMemory:
+            if (memories) {
+                snprintf(text, size, "%s", (const char*)memories->data[operand->memory]);
+            } else {
+                snprintf(text, size, "@%zu", operand->memory);
+            }
+            break;
+        case SuperImmediate:
+            PrintImmediate(&operand->immediate, text, size);
+            break;
+        case SuperAddress: {
+            char base[kMaxLengthOfOperand] = "";
+            char index[kMaxLengthOfOperand] = "";
+            char displacement[kMaxLengthOfOperand] = "";
+            if (operand->reg != kNoRegister) {
+                snprintf(base, kMaxLengthOfOperand, "%s", kRegisterNames[operand->reg]);
+            }
+            if (operand->index != kNoRegister && operand->scale == 1) {
+                snprintf(index, kMaxLengthOfOperand, "%s%s", (*base) ? " + " : "", kRegisterNames[operand->index]);
+            } else if (operand->index != kNoRegister) {
+                snprintf(index, kMaxLengthOfOperand, "%s%s * %d", (*base) ? " + " : "", kRegisterNames[operand->index],
+                         operand->scale);
+            }
+            const TSuperImmediate* immediate = &operand->immediate;
+            if (immediate->kind == LiteralImmediate && immediate->value < 0) {
+                snprintf(displacement, kMaxLengthOfOperand, " - %llu", 0 - (unsigned long long)immediate->value);
+            } else if (immediate->kind != LiteralImmediate || immediate->value) {
+                char value[kMaxLengthOfOperand / 2] = "";
+                PrintImmediate(immediate, value, kMaxLengthOfOperand / 2);
+                snprintf(displacement, kMaxLengthOfOperand, " + %s", value);
+            }
+            snprintf(text, size, "[%s%s%s]", base, index, displacement);
+            break;
+        }
+        default:
+            assert(0 && "unknown operand");
+    }
+}
+
+static void PrintImmediate(const TSuperImmediate* immediate, char* text, size_t size) {
+    switch (immediate->kind) {
+        case LiteralImmediate:      snprintf(text, size, "%lld", immediate->value); break;
+        case SymbolImmediate:       snprintf(text, size, "$%zu", immediate->first); break;
+        case NegatedImmediate:      snprintf(text, size, "-$%zu", immediate->first); break;
+        case SumImmediate:          snprintf(text, size, "$%zu+$%zu", immediate->first, immediate->second); break;
+        case DifferenceImmediate:   snprintf(text, size, "$%zu-$%zu", immediate->first, immediate->second); break;
+        case ProductImmediate:      snprintf(text, size, "$%zu*$%zu", immediate->first, immediate->second); break;
+        default:                    assert(0 && "unknown immediate");
+    }
+}
+
+static size_t GetCost(const TSuperInstruction* instruction) {
+    size_t cost = kInstructionCost;
+    const TSuperOperand* second = &instruction->operands[1];
+    switch (instruction->opcode) {
+        case SuperImul: cost += kMultiplyCost; break;
+        case SuperPush: cost += kStoreCost; break;
+        case SuperPop:  cost += kLoadCost; break;
+        case SuperLea:
+            if (second->reg != kNoRegister && second->index != kNoRegister
+                && (second->immediate.kind != LiteralImmediate || second->immediate.value)) {
+                cost += kComplexLeaCost;
+            }
+            break;
+        default:
+            break;
+    }
+
+    for (size_t i = 0; i < instruction->count; i++) {
+        if (instruction->operands[i].kind != SuperMemory) {
+            continue;
+        }
+        if (i == 0) {
+            cost += kStoreCost + ((ReadsDestination(instruction)) ? kLoadCost : 0);
+        } else {
+            cost += kLoadCost;
+        }
+    }
+    return cost;
+}
+
+static size_t GetSequenceCost(const TSuperInstruction* instructions, size_t count) {
+    size_t cost = 0;
+    for (size_t i = 0; i < count; i++) {
+        cost += GetCost(&instructions[i]);
+    }
+    return cost;
+}
+
+static size_t GetLocation(const TSuperOperand* operand) {
+    return (operand->kind == SuperRegister) ? (size_t)operand->reg : kRegisterCount + operand->memory;
+}
+
+static unsigned GetReads(const TSuperInstruction* instruction) {
+    unsigned reads = 0;
+    for (size_t i = (ReadsDestination(instruction)) ? 0 : 1; i < instruction->count; i++) {
+        reads |= GetOperandReads(&instruction->operands[i]);
+    }
+    return reads;
+}
+
+static unsigned GetWrites(const TSuperInstruction* instruction) {
+    return (instruction->opcode == SuperPush) ? 0 : 1u << GetLocation(&instruction->operands[0]);
+}
+
+static unsigned GetOperandReads(const TSuperOperand* operand) {
+    switch (operand->kind) {
+        case SuperRegister:
+        case SuperMemory:
+            return 1u << GetLocation(operand);
+        case SuperAddress:
+            return ((operand->reg != kNoRegister) ? 1u << operand->reg : 0)
+                 | ((operand->index != kNoRegister) ? 1u << operand->index : 0);
+        case SuperImmediate:
+        default:
+            return 0;
+    }
+}
+
+static bool ReadsDestination(const TSuperInstruction* instruction) {
+    switch (instruction->opcode) {
+        case SuperAdd:
+        case SuperSub:
+        case SuperNeg:
+        case SuperShl:
+        case SuperPush:
+            return true;
+        case SuperImul:
+            return instruction->count == 2;
+        default:
+            return false;
+    }
+}
+
+static bool WritesFlags(const TSuperInstruction* instruction) {
+    return instruction->opcode == SuperAdd || instruction->opcode == SuperSub || instruction->opcode == SuperImul
+        || instruction->opcode == SuperNeg || instruction->opcode == SuperShl || instruction->opcode == SuperXor;
+}
+
+// push и pop окна парные и не снимают со стека больше, чем положили
+static bool IsBalanced(const TSuperInstruction* instructions, size_t count) {
+    size_t depth = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (instructions[i].opcode == SuperPush) {
+            depth++;
+        } else if (instructions[i].opcode == SuperPop) {
+            if (!depth) {
+                return false;
+            }
+            depth--;
+        }
+    }
+    return !depth;
+}
+
+static size_t CountBits(unsigned mask) {
+    size_t count = 0;
+    for (; mask; mask &= mask - 1) {
+        count++;
+    }
+    return count;
+}
+
+static bool FitsInt32(long long value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+static void Execute(TMachine* machine, const TSuperInstruction* instructions, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const TSuperInstruction* instruction = &instructions[i];
+        const TSuperOperand* destination = &instruction->operands[0];
+        unsigned long long source = (instruction->count > 1) ? ReadOperand(machine, &instruction->operands[1]) : 0;
+        unsigned long long value = 0;
+
+        switch (instruction->opcode) {
+            case SuperMov:
+            case SuperLea:  value = source; break;
+            case SuperAdd:  value = ReadOperand(machine, destination) + source; break;
+            case SuperSub:  value = ReadOperand(machine, destination) - source; break;
+            case SuperNeg:  value = 0 - ReadOperand(machine, destination); break;
+            case SuperShl:  value = ReadOperand(machine, destination) << (source & 63); break;
+            case SuperXor:  value = 0; break;
+            case SuperPop:  value = machine->stack[--machine->depth]; break;
+            case SuperImul:
+                value = (instruction->count == 3) ? source * ReadOperand(machine, &instruction->operands[2])
+                                                  : ReadOperand(machine, destination) * source;
+                break;
+            case SuperPush:
+                machine->stack[machine->depth++] = ReadOperand(machine, destination);
+                continue;
+            case SuperOpcodeCount:
+            default:
+                assert(0 && "unknown opcode");
+        }
+        machine->locations[GetLocation(destination)] = value;
+    }
+}
+
+static unsigned long long ReadOperand(const TMachine* machine, const TSuperOperand* operand) {
+    switch (operand->kind) {
+        case SuperRegister:
+        case SuperMemory:
+            return machine->locations[GetLocation(operand)];
+        case SuperImmediate:
+            return EvaluateImmediate(&operand->immediate, machine->immediates);
+        case SuperAddress: {
+            unsigned long long address = EvaluateImmediate(&operand->immediate, machine->immediates);
+            address += (operand->reg != kNoRegister) ? machine->locations[operand->reg] : 0;
+            address += (operand->index != kNoRegister)
+                     ? machine->locations[operand->index] * (unsigned long long)operand->scale : 0;
+            return address;
+        }
+        default:
+            assert(0 && "unknown operand");
+            return 0;
+    }
+}
+
+static unsigned long long EvaluateImmediate(const TSuperImmediate* immediate, const unsigned long long* values) {
+    switch (immediate->kind) {
+        case LiteralImmediate:      return (unsigned long long)immediate->value;
+        case SymbolImmediate:       return values[immediate->first];
+        case NegatedImmediate:      return 0 - values[immediate->first];
+        case SumImmediate:          return values[immediate->first] + values[immediate->second];
+        case DifferenceImmediate:   return values[immediate->first] - values[immediate->second];
+        case ProductImmediate:      return values[immediate->first] * values[immediate->second];
+        default:                    assert(0 && "unknown immediate"); return 0;
+    }
+}
+
+static void InitSymbolic(TSymbolicMachine* machine) {
+    for (size_t i = 0; i < kLocationCount; i++) {
+        PolynomialVariable(&machine->locations[i], i);
+    }
+    machine->depth = 0;
+}
+
+static void ExecuteSymbolic(TSymbolicMachine* machine, const TSuperInstruction* instructions, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const TSuperInstruction* instruction = &instructions[i];
+        const TSuperOperand* destination = &instruction->operands[0];
+        TPolynomial source = {};
+        TPolynomial value = {};
+        TPolynomial old = {};
+        if (instruction->count > 1) {
+            ReadSymbolicOperand(machine, &instruction->operands[1], &source);
+        }
+        ReadSymbolicOperand(machine, destination, &old);
+
+        switch (instruction->opcode) {
+            case SuperMov:
+            case SuperLea:  value = source; break;
+            case SuperAdd:  PolynomialAdd(&value, &old, &source, 1); break;
+            case SuperSub:  PolynomialAdd(&value, &old, &source, ~0ull); break;
+            case SuperNeg:  PolynomialAdd(&value, &value, &old, ~0ull); break;
+            case SuperXor:  break;
+            case SuperPop:  value = machine->stack[--machine->depth]; break;
+            case SuperShl: {
+                TPolynomial factor = {};
+                PolynomialConstant(&factor, 1ull << (instruction->operands[1].immediate.value & 63));
+                PolynomialMultiply(&value, &old, &factor);
+                break;
+            }
+            case SuperImul:
+                if (instruction->count == 3) {
+                    ReadSymbolicOperand(machine, &instruction->operands[2], &old);
+                }
+                PolynomialMultiply(&value, &old, &source);
+                break;
+            case SuperPush:
+                machine->stack[machine->depth++] = old;
+                continue;
+            case SuperOpcodeCount:
+            default:
+                assert(0 && "unknown opcode");
+        }
+        machine->locations[GetLocation(destination)] = value;
+    }
+}
+
+static void ReadSymbolicOperand(const TSymbolicMachine* machine, const TSuperOperand* operand, TPolynomial* result) {
+    switch (operand->kind) {
+        case SuperRegister:
+        case SuperMemory:
+            *result = machine->locations[GetLocation(operand)];
+            break;
+        case SuperImmediate:
+            ImmediateToPolynomial(&operand->immediate, result);
+            break;
+        case SuperAddress: {
+            ImmediateToPolynomial(&operand->immediate, result);
+            if (operand->reg != kNoRegister) {
+                PolynomialAdd(result, result, &machine->locations[operand->reg], 1);
+            }
+            if (operand->index != kNoRegister) {
+                PolynomialAdd(result, result, &machine->locations[operand->index], (unsigned long long)operand->scale);
+            }
+            break;
+        }
+        default:
+            assert(0 && "unknown operand");
+    }
+}
+
+static void ImmediateToPolynomial(const TSuperImmediate* immediate, TPolynomial* result) {
+    TPolynomial first = {};
+    TPolynomial second = {};
+    PolynomialVariable(&first, kLocationCount + immediate->first);
+    PolynomialVariable(&second, kLocationCount + immediate->second);
+    *result = {};
+
+    switch (immediate->kind) {
+        case LiteralImmediate:      PolynomialConstant(result, (unsigned long long)immediate->value); break;
+        case SymbolImmediate:       *result = first; break;
+        case NegatedImmediate:      PolynomialAdd(result, result, &first, ~0ull); break;
+        case SumImmediate:          PolynomialAdd(result, &first, &second, 1); break;
+        case DifferenceImmediate:   PolynomialAdd(result, &first, &second, ~0ull); break;
+        case ProductImmediate:      PolynomialMultiply(result, &first, &second); break;
+        default:                    assert(0 && "unknown immediate");
+    }
+}
+
+static void PolynomialConstant(TPolynomial* polynomial, unsigned long long value) {
+    *polynomial = {};
+    TMonomial term = {};
+    term.coefficient = value;
+    AddTerm(polynomial, &term);
+}
+
+static void PolynomialVariable(TPolynomial* polynomial, size_t variable) {
+    *polynomial = {};
+    TMonomial term = {};
+    term.coefficient = 1;
+    term.powers[variable] = 1;
+    AddTerm(polynomial, &term);
+}
+
+// result = first + factor * second; result может совпадать с first
+static void PolynomialAdd(TPolynomial* result, const TPolynomial* first, const TPolynomial* second,
+                          unsigned long long factor) {
+    TPolynomial sum = *first;
+    sum.isOverflow |= second->isOverflow;
+    for (size_t i = 0; i < second->count; i++) {
+        TMonomial term = second->terms[i];
+        term.coefficient *= factor;
+        AddTerm(&sum, &term);
+    }
+    *result = sum;
+}
+
+static void PolynomialMultiply(TPolynomial* result, const TPolynomial* first, const TPolynomial* second) {
+    TPolynomial product = {};
+    product.isOverflow = first->isOverflow || second->isOverflow;
+    for (size_t i = 0; i < first->count; i++) {
+        for (size_t j = 0; j < second->count; j++) {
+            TMonomial term = {};
+            term.coefficient = first->terms[i].coefficient * second->terms[j].coefficient;
+            for (size_t k = 0; k < kMaxVariables; k++) {
+                size_t power = (size_t)first->terms[i].powers[k] + second->terms[j].powers[k];
+                product.isOverflow |= power > kMaxPower;
+                term.powers[k] = (unsigned char)((power > kMaxPower) ? kMaxPower : power);
+            }
+            AddTerm(&product, &term);
+        }
+    }
+    *result = product;
+}
+
+static void AddTerm(TPolynomial* polynomial, const TMonomial* term) {
+    for (size_t i = 0; i < polynomial->count; i++) {
+        TMonomial* existing = &polynomial->terms[i];
+        if (memcmp(existing->powers, term->powers, kMaxVariables)) {
+            continue;
+        }
+        existing->coefficient += term->coefficient;
+        if (!existing->coefficient) {
+            *existing = polynomial->terms[--polynomial->count];
+        }
+        return;
+    }
+
+    if (!term->coefficient) {
+        return;
+    }
+    if (polynomial->count == kMaxTerms) {
+        polynomial->isOverflow = true;
+        return;
+    }
+    polynomial->terms[polynomial->count++] = *term;
+}
+
+static bool ArePolynomialsEqual(const TPolynomial* first, const TPolynomial* second) {
+    if (first->isOverflow || second->isOverflow || first->count != second->count) {
+        return false;
+    }
+
+    for (size_t i = 0; i < first->count; i++) {
+        bool isFound = false;
+        for (size_t j = 0; j < second->count && !isFound; j++) {
+            isFound = !memcmp(first->terms[i].powers, second->terms[j].powers, kMaxVariables)
+                   && first->terms[i].coefficient == second->terms[j].coefficient;
+        }
+        if (!isFound) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,358 @@
+#include "vm.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "runtime.h"
+#include "ifConverter.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfArrayVector = 16;
+
+static void Interpret(TVmProgram* program, TVmValue* stack, const TVmInstruction** frames, Vector* arrays);
+static long long WrapAdd(long long first, long long second);
+static long long WrapSub(long long first, long long second);
+static long long WrapMul(long long first, long long second);
+static bool IsEqualFloat(double first, double second);
+[[noreturn]] static void VmError(const char* message);
+static double GetTime();
+
+// global ------------------------------------------------------------------------------------------
+
+// Второй бэкенд: без nasm.s, ассемблера и компоновки программа сразу выполняется интерпретатором байткода
+void RunVm(tNode* root, const Options* options, TTypeInfo* types) {
+    TVmProgram program = {};
+    CompileVmProgram(root, types, &program, options->profileOutput != NULL);
+    ExecuteVmProgram(&program, options->jitRuns);
+    if (options->profileOutput) {
+        WriteIfProfile(options->profileOutput, program.counters, program.ifCount);
+    }
+    VmProgramDtor(&program);
+}
+
+// Перед каждым запуском глобальные переменные получают начальные значения, массивы освобождаются после него
+void ExecuteVmProgram(TVmProgram* program, size_t runs) {
+    assert(program);
+
+    if ((size_t)program->frameSize > kVmStackSize) {
+        VmError("too many variables");
+    }
+
+    TVmValue* stack = (TVmValue*)calloc(kVmStackSize, sizeof(TVmValue));
+    const TVmInstruction** frames = (const TVmInstruction**)calloc(kVmMaxCallDepth, sizeof(TVmInstruction*));
+    assert(stack && frames);
+    Vector arrays = {};
+    vectorInit(&arrays, kInitialSizeOfArrayVector);
+
+    double start = GetTime();
+    for (size_t i = 0; i < runs; i++) {
+        memcpy(stack, program->globals, program->globalCount * sizeof(TVmValue));
+        Interpret(program, stack, frames, &arrays);
+
+        for (size_t j = 0; j < arrays.size; j++) {
+            free(arrays.data[j]);
+        }
+        arrays.size = 0;
+    }
+    double elapsed = GetTime() - start;
+    fflush(stdout);
+
+    if (runs > 1) {
+        fprintf(stderr, "vm: %zu runs, %.2f us per run\n", runs, elapsed * 1e6 / (double)runs);
+    }
+
+    vectorFree(&arrays);
+    free(frames);
+    free(stack);
+}
+
+// static ------------------------------------------------------------------------------------------
+
+#define NEXT()              do { pc++; goto *pc->handler; } while (0)
+#define JUMP_IF(condition)  do { pc += (condition) ? pc->c : 1; goto *pc->handler; } while (0)
+
+// Каждый обработчик сам переходит к следующему по handler, поэтому у каждого свой косвенный переход,
+// который предсказатель учит отдельно. Адреса меток известны только внутри этой функции, и при первом
+// запуске она же заполняет ими handler
+static void Interpret(TVmProgram* program, TVmValue* stack, const TVmInstruction** frames, Vector* arrays) {
+    TVmInstruction* code = program->code;
+    if (!code[0].handler) {
+        for (size_t i = 0; i < program->size; i++) {
+            const void* handler = NULL;
+            switch (code[i].opcode) {
+                case VmLoad:                        handler = &&VmLoad; break;
+                case VmMove:                        handler = &&VmMove; break;
+                case VmLoadGlobal:                  handler = &&VmLoadGlobal; break;
+                case VmStoreGlobal:                 handler = &&VmStoreGlobal; break;
+                case VmAddInt:                      handler = &&VmAddInt; break;
+                case VmSubInt:                      handler = &&VmSubInt; break;
+                case VmMulInt:                      handler = &&VmMulInt; break;
+                case VmDivInt:                      handler = &&VmDivInt; break;
+                case VmAddIntImm:                   handler = &&VmAddIntImm; break;
+                case VmAddElementInt:               handler = &&VmAddElementInt; break;
+                case VmAddFloat:                    handler = &&VmAddFloat; break;
+                case VmSubFloat:                    handler = &&VmSubFloat; break;
+                case VmMulFloat:                    handler = &&VmMulFloat; break;
+                case VmDivFloat:                    handler = &&VmDivFloat; break;
+                case VmAddElementFloat:             handler = &&VmAddElementFloat; break;
+                case VmIntToFloat:                  handler = &&VmIntToFloat; break;
+                case VmSqrt:                        handler = &&VmSqrt; break;
+                case VmSin:                         handler = &&VmSin; break;
+                case VmCos:                         handler = &&VmCos; break;
+                case VmLessInt:                     handler = &&VmLessInt; break;
+                case VmLessOrEqualInt:              handler = &&VmLessOrEqualInt; break;
+                case VmIdenticalInt:                handler = &&VmIdenticalInt; break;
+                case VmNotIdenticalInt:             handler = &&VmNotIdenticalInt; break;
+                case VmLessFloat:                   handler = &&VmLessFloat; break;
+                case VmLessOrEqualFloat:            handler = &&VmLessOrEqualFloat; break;
+                case VmIdenticalFloat:              handler = &&VmIdenticalFloat; break;
+                case VmNotIdenticalFloat:           handler = &&VmNotIdenticalFloat; break;
+                case VmJump:                        handler = &&VmJump; break;
+                case VmJumpIfLessInt:               handler = &&VmJumpIfLessInt; break;
+                case VmJumpIfLessOrEqualInt:        handler = &&VmJumpIfLessOrEqualInt; break;
+                case VmJumpIfIdenticalInt:          handler = &&VmJumpIfIdenticalInt; break;
+                case VmJumpIfNotIdenticalInt:       handler = &&VmJumpIfNotIdenticalInt; break;
+                case VmJumpIfLessIntImm:            handler = &&VmJumpIfLessIntImm; break;
+                case VmJumpIfLessOrEqualIntImm:     handler = &&VmJumpIfLessOrEqualIntImm; break;
+                case VmJumpIfGreaterIntImm:         handler = &&VmJumpIfGreaterIntImm; break;
+                case VmJumpIfGreaterOrEqualIntImm:  handler = &&VmJumpIfGreaterOrEqualIntImm; break;
+                case VmJumpIfIdenticalIntImm:       handler = &&VmJumpIfIdenticalIntImm; break;
+                case VmJumpIfNotIdenticalIntImm:    handler = &&VmJumpIfNotIdenticalIntImm; break;
+                case VmJumpIfLessFloat:             handler = &&VmJumpIfLessFloat; break;
+                case VmJumpIfLessOrEqualFloat:      handler = &&VmJumpIfLessOrEqualFloat; break;
+                case VmJumpIfIdenticalFloat:        handler = &&VmJumpIfIdenticalFloat; break;
+                case VmJumpIfNotIdenticalFloat:     handler = &&VmJumpIfNotIdenticalFloat; break;
+                case VmJumpUnlessLessFloat:         handler = &&VmJumpUnlessLessFloat; break;
+                case VmJumpUnlessLessOrEqualFloat:  handler = &&VmJumpUnlessLessOrEqualFloat; break;
+                case VmIndex:                       handler = &&VmIndex; break;
+                case VmStore:                       handler = &&VmStore; break;
+                case VmArray:                       handler = &&VmArray; break;
+                case VmPrintInt:                    handler = &&VmPrintInt; break;
+                case VmPrintFloat:                  handler = &&VmPrintFloat; break;
+                case VmCall:                        handler = &&VmCall; break;
+                case VmReturn:                      handler = &&VmReturn; break;
+                case VmCount:                       handler = &&VmCount; break;
+                case VmHalt:                        handler = &&VmHalt; break;
+                default:                            assert(0);
+            }
+            code[i].handler = handler;
+        }
+    }
+
+    const TVmInstruction* pc = code;
+    TVmValue* base = stack;
+    size_t depth = 0;
+    goto *pc->handler;
+
+VmLoad:
+    base[pc->a] = pc->immediate;
+    NEXT();
+VmMove:
+    base[pc->a] = base[pc->b];
+    NEXT();
+VmLoadGlobal:
+    base[pc->a] = stack[pc->b];
+    NEXT();
+VmStoreGlobal:
+    stack[pc->b] = base[pc->a];
+    NEXT();
+
+VmAddInt:
+    base[pc->a].integer = WrapAdd(base[pc->b].integer, base[pc->c].integer);
+    NEXT();
+VmSubInt:
+    base[pc->a].integer = WrapSub(base[pc->b].integer, base[pc->c].integer);
+    NEXT();
+VmMulInt:
+    base[pc->a].integer = WrapMul(base[pc->b].integer, base[pc->c].integer);
+    NEXT();
+VmDivInt: {
+    long long divisor = base[pc->c].integer;
+    if (!divisor) {
+        VmError("division by zero");
+    }
+    long long dividend = base[pc->b].integer;
+    base[pc->a].integer = (divisor == -1) ? WrapSub(0, dividend) : dividend / divisor;
+    NEXT();
+}
+VmAddIntImm:
+    base[pc->a].integer = WrapAdd(base[pc->b].integer, pc->immediate.integer);
+    NEXT();
+VmAddElementInt:
+    base[pc->a].integer = WrapAdd(base[pc->b].integer,
+                                  base[pc->c].array[base[pc->immediate.integer].integer].integer);
+    NEXT();
+
+VmAddFloat:
+    base[pc->a].real = base[pc->b].real + base[pc->c].real;
+    NEXT();
+VmSubFloat:
+    base[pc->a].real = base[pc->b].real - base[pc->c].real;
+    NEXT();
+VmMulFloat:
+    base[pc->a].real = base[pc->b].real * base[pc->c].real;
+    NEXT();
+VmDivFloat:
+    base[pc->a].real = base[pc->b].real / base[pc->c].real;
+    NEXT();
+VmAddElementFloat:
+    base[pc->a].real = base[pc->b].real + base[pc->c].array[base[pc->immediate.integer].integer].real;
+    NEXT();
+VmIntToFloat:
+    base[pc->a].real = (double)base[pc->b].integer;
+    NEXT();
+VmSqrt:
+    base[pc->a].real = sqrt(base[pc->b].real);
+    NEXT();
+VmSin:
+    base[pc->a].real = sin(base[pc->b].real);
+    NEXT();
+VmCos:
+    base[pc->a].real = cos(base[pc->b].real);
+    NEXT();
+
+VmLessInt:
+    base[pc->a].integer = (base[pc->b].integer < base[pc->c].integer);
+    NEXT();
+VmLessOrEqualInt:
+    base[pc->a].integer = (base[pc->b].integer <= base[pc->c].integer);
+    NEXT();
+VmIdenticalInt:
+    base[pc->a].integer = (base[pc->b].integer == base[pc->c].integer);
+    NEXT();
+VmNotIdenticalInt:
+    base[pc->a].integer = (base[pc->b].integer != base[pc->c].integer);
+    NEXT();
+VmLessFloat:
+    base[pc->a].integer = isless(base[pc->b].real, base[pc->c].real);
+    NEXT();
+VmLessOrEqualFloat:
+    base[pc->a].integer = islessequal(base[pc->b].real, base[pc->c].real);
+    NEXT();
+VmIdenticalFloat:
+    base[pc->a].integer = IsEqualFloat(base[pc->b].real, base[pc->c].real);
+    NEXT();
+VmNotIdenticalFloat:
+    base[pc->a].integer = !IsEqualFloat(base[pc->b].real, base[pc->c].real);
+    NEXT();
+
+VmJump:
+    pc += pc->c;
+    goto *pc->handler;
+VmJumpIfLessInt:
+    JUMP_IF(base[pc->a].integer < base[pc->b].integer);
+VmJumpIfLessOrEqualInt:
+    JUMP_IF(base[pc->a].integer <= base[pc->b].integer);
+VmJumpIfIdenticalInt:
+    JUMP_IF(base[pc->a].integer == base[pc->b].integer);
+VmJumpIfNotIdenticalInt:
+    JUMP_IF(base[pc->a].integer != base[pc->b].integer);
+VmJumpIfLessIntImm:
+    JUMP_IF(base[pc->a].integer < pc->immediate.integer);
+VmJumpIfLessOrEqualIntImm:
+    JUMP_IF(base[pc->a].integer <= pc->immediate.integer);
+VmJumpIfGreaterIntImm:
+    JUMP_IF(base[pc->a].integer > pc->immediate.integer);
+VmJumpIfGreaterOrEqualIntImm:
+    JUMP_IF(base[pc->a].integer >= pc->immediate.integer);
+VmJumpIfIdenticalIntImm:
+    JUMP_IF(base[pc->a].integer == pc->immediate.integer);
+VmJumpIfNotIdenticalIntImm:
+    JUMP_IF(base[pc->a].integer != pc->immediate.integer);
+VmJumpIfLessFloat:
+    JUMP_IF(isless(base[pc->a].real, base[pc->b].real));
+VmJumpIfLessOrEqualFloat:
+    JUMP_IF(islessequal(base[pc->a].real, base[pc->b].real));
+VmJumpIfIdenticalFloat:
+    JUMP_IF(IsEqualFloat(base[pc->a].real, base[pc->b].real));
+VmJumpIfNotIdenticalFloat:
+    JUMP_IF(!IsEqualFloat(base[pc->a].real, base[pc->b].real));
+VmJumpUnlessLessFloat:
+    JUMP_IF(!isless(base[pc->a].real, base[pc->b].real));
+VmJumpUnlessLessOrEqualFloat:
+    JUMP_IF(!islessequal(base[pc->a].real, base[pc->b].real));
+
+VmIndex:
+    base[pc->a] = base[pc->b].array[base[pc->c].integer];
+    NEXT();
+VmStore:
+    base[pc->b].array[base[pc->c].integer] = base[pc->a];
+    NEXT();
+VmArray: {
+    long long size = base[pc->b].integer;
+    TVmValue* array = (size >= 0) ? (TVmValue*)calloc((size_t)size + 1, sizeof(TVmValue)) : NULL;
+    if (!array) {
+        VmError("cannot allocate array");
+    }
+    vectorPush(arrays, array);
+    base[pc->a].array = array;
+    NEXT();
+}
+
+VmPrintInt:
+    printf("%llu\n", (unsigned long long)base[pc->a].integer);
+    NEXT();
+VmPrintFloat:
+    printf("%.*f\n", kFractionDigits, base[pc->a].real);
+    NEXT();
+
+// адрес возврата - инструкция после VmCall, а из самой VmCall берутся регистр результата и сдвиг кадра
+VmCall:
+    if (depth == kVmMaxCallDepth || (size_t)(base - stack) + (size_t)pc->b + (size_t)pc->immediate.integer
+                                    > kVmStackSize) {
+        VmError("stack overflow");
+    }
+    frames[depth++] = pc + 1;
+    base += pc->b;
+    pc += pc->c;
+    goto *pc->handler;
+VmReturn: {
+    TVmValue result = base[pc->a];
+    pc = frames[--depth];
+    base -= pc[-1].b;
+    base[pc[-1].a] = result;
+    goto *pc->handler;
+}
+VmCount:
+    program->counters[pc->a]++;
+    NEXT();
+VmHalt:
+    return;
+}
+
+#undef NEXT
+#undef JUMP_IF
+
+// Целые переполняются так же, как в машинном коде
+static long long WrapAdd(long long first, long long second) {
+    return (long long)((unsigned long long)first + (unsigned long long)second);
+}
+
+static long long WrapSub(long long first, long long second) {
+    return (long long)((unsigned long long)first - (unsigned long long)second);
+}
+
+static long long WrapMul(long long first, long long second) {
+    return (long long)((unsigned long long)first * (unsigned long long)second);
+}
+
+// == без -Wfloat-equal; nan не равен ничему
+static bool IsEqualFloat(double first, double second) {
+    return islessequal(first, second) && isgreaterequal(first, second);
+}
+
+static void VmError(const char* message) {
+    fflush(stdout);
+    fprintf(stderr, "Error: %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static double GetTime() {
+    timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
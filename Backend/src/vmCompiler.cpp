@@ -0,0 +1,721 @@
+#include "vm.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "astUtils.h"
+#include "ifConverter.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfVmNameVector = 16;
+
+// Переменные живут в регистрах кадра: сначала параметры и локальные (на верхнем уровне - глобальные),
+// выше них временные регистры выражений, которые освобождаются после каждого оператора
+struct TVmCompiler {
+    TVmProgram* program;
+    TTypeInfo* types;
+    TFunctionTable functions; // номер записи - номер функции в program->functions
+    tNode* function; // NULL - верхний уровень
+    Vector globals;
+    Vector locals;
+    int firstTemporary;
+    int top;
+    int frameSize;
+    Vector ifs; // номера if в профиле, пустой без --profile-generate
+};
+
+static void SetInitialValues(TVmCompiler* compiler, tNode* node, bool* isSet);
+static void CompileFunction(TVmCompiler* compiler, TVmFunction* function);
+static void LinkCalls(TVmProgram* program);
+
+static size_t EmitInstruction(TVmCompiler* compiler, TVmOpcode opcode, int a, int b, int c);
+static void SetJumpTarget(TVmCompiler* compiler, size_t jump, size_t target);
+static int AllocateRegister(TVmCompiler* compiler);
+static int GetDestination(TVmCompiler* compiler, int dest);
+static int FindName(Vector* names, const char* name);
+static int FindVariable(TVmCompiler* compiler, const char* name, bool* isGlobal);
+static bool IsFloat(TVmCompiler* compiler, tNode* node);
+static bool IsIntegerLiteral(tNode* node, long long* value);
+static bool IsComparison(tNode* node);
+static Operations GetInverseComparison(Operations op);
+static Operations GetMirroredComparison(Operations op);
+
+static void CompileStatement(TVmCompiler* compiler, tNode* node);
+static void CompileEqual(TVmCompiler* compiler, tNode* node);
+static void CompileStore(TVmCompiler* compiler, tNode* node);
+static void CompileWhile(TVmCompiler* compiler, tNode* node);
+static void CompileIf(TVmCompiler* compiler, tNode* node);
+static void CompileReturn(TVmCompiler* compiler, tNode* node);
+static size_t CompileBranch(TVmCompiler* compiler, tNode* node, bool jumpIfTrue);
+static int CompileExpression(TVmCompiler* compiler, tNode* node, int dest, bool asFloat);
+static int CompileArithmetic(TVmCompiler* compiler, tNode* node, Operations op, int dest);
+static int CompileComparison(TVmCompiler* compiler, tNode* node, Operations op, int dest);
+static void CompileElement(TVmCompiler* compiler, tNode* node, int* array, int* index);
+static int CompileCall(TVmCompiler* compiler, tNode* node, int dest);
+
+// global ------------------------------------------------------------------------------------------
+
+void CompileVmProgram(tNode* root, TTypeInfo* types, TVmProgram* program, bool isProfiling) {
+    assert(root);
+    assert(program);
+
+    *program = {};
+    program->code = (TVmInstruction*)calloc(kInitialVmCodeSize, sizeof(TVmInstruction));
+    assert(program->code);
+    program->capacity = kInitialVmCodeSize;
+
+    TVmCompiler compiler = {
+        .program = program,
+        .types = types,
+        .functions = {},
+        .function = NULL,
+        .globals = {},
+        .locals = {},
+        .firstTemporary = 0,
+        .top = 0,
+        .frameSize = 0,
+        .ifs = {},
+    };
+    vectorInit(&compiler.globals, kInitialSizeOfVmNameVector);
+    vectorInit(&compiler.ifs, kInitialSizeOfVmNameVector);
+    if (isProfiling) {
+        CollectIfNodes(root, &compiler.ifs);
+        program->ifCount = compiler.ifs.size;
+        program->counters = (long long*)calloc(2 * program->ifCount + 1, sizeof(long long));
+        assert(program->counters);
+    }
+    CollectGlobals(root, &compiler.globals);
+
+    program->globalCount = compiler.globals.size;
+    program->globals = (TVmValue*)calloc(program->globalCount + 1, sizeof(TVmValue));
+    bool* isSet = (bool*)calloc(program->globalCount + 1, sizeof(bool));
+    assert(program->globals && isSet);
+    SetInitialValues(&compiler, root, isSet);
+    free(isSet);
+
+    FunctionTableCtor(&compiler.functions, root);
+    program->functionCount = compiler.functions.count;
+    program->functions = (TVmFunction*)calloc(program->functionCount + 1, sizeof(TVmFunction));
+    assert(program->functions);
+    for (size_t i = 0; i < program->functionCount; i++) {
+        program->functions[i].node = compiler.functions.entries[i].function;
+    }
+
+    compiler.firstTemporary = compiler.top = compiler.frameSize = (int)program->globalCount;
+    CompileStatement(&compiler, root);
+    EmitInstruction(&compiler, VmHalt, 0, 0, 0);
+    program->frameSize = compiler.frameSize;
+
+    for (size_t i = 0; i < program->functionCount; i++) {
+        CompileFunction(&compiler, &program->functions[i]);
+    }
+    LinkCalls(program);
+
+    vectorFree(&compiler.ifs);
+    vectorFree(&compiler.globals);
+    FunctionTableDtor(&compiler.functions);
+}
+
+void VmProgramDtor(TVmProgram* program) {
+    free(program->code);
+    free(program->globals);
+    free(program->functions);
+    free(program->counters);
+    *program = {};
+}
+
+// static ------------------------------------------------------------------------------------------
+
+// Как в nasmGen: глобальная переменная получает значение литерала из своего первого присваивания
+static void SetInitialValues(TVmCompiler* compiler, tNode* node, bool* isSet) {
+    if (!node || node->type == Function) {
+        return;
+    }
+
+    if (node->type == Identifier || IsOperation(node, Equal)) {
+        const char* name = (node->type == Identifier) ? node->value : node->left->value;
+        int index = FindName(&compiler->globals, name);
+        if (!isSet[index]) {
+            isSet[index] = true;
+            if (IsOperation(node, Equal) && node->right->type == Number) {
+                TVmValue* value = &compiler->program->globals[index];
+                if (IsFloatVariable(compiler->types, NULL, name)) {
+                    value->real = GetFloatValue(node->right);
+                } else {
+                    value->integer = (long long)strtoull(node->right->value, NULL, 10);
+                }
+            }
+        }
+    }
+
+    SetInitialValues(compiler, node->left, isSet);
+    SetInitialValues(compiler, node->right, isSet);
+}
+
+// Параметры занимают первые регистры кадра: вызывающий код кладет аргументы прямо туда
+static void CompileFunction(TVmCompiler* compiler, TVmFunction* function) {
+    tNode* node = function->node;
+    compiler->function = node;
+    vectorInit(&compiler->locals, kInitialSizeOfVmNameVector);
+    CollectLocals(node, &compiler->globals, &compiler->locals);
+    if (compiler->locals.size < CountChain(node->left)) {
+        fprintf(stderr, "Error: duplicate parameter in function '%s'\n", node->value);
+        exit(EXIT_FAILURE);
+    }
+
+    compiler->firstTemporary = compiler->top = compiler->frameSize = (int)compiler->locals.size;
+    function->entry = compiler->program->size;
+    for (size_t i = CountChain(node->left); i < compiler->locals.size; i++) {
+        EmitInstruction(compiler, VmLoad, (int)i, 0, 0); // локальные переменные начинаются с нуля, как в машинном коде
+    }
+    CompileStatement(compiler, node->right);
+
+    int zero = AllocateRegister(compiler);
+    EmitInstruction(compiler, VmLoad, zero, 0, 0); // без return функция возвращает 0
+    EmitInstruction(compiler, VmReturn, zero, 0, 0);
+    function->frameSize = compiler->frameSize;
+
+    vectorFree(&compiler->locals);
+    compiler->function = NULL;
+}
+
+// До связывания immediate у VmCall - номер функции, после - размер ее кадра
+static void LinkCalls(TVmProgram* program) {
+    for (size_t i = 0; i < program->size; i++) {
+        TVmInstruction* instruction = &program->code[i];
+        if (instruction->opcode == VmCall) {
+            TVmFunction* function = &program->functions[instruction->immediate.integer];
+            instruction->c = (int)((long long)function->entry - (long long)i);
+            instruction->immediate.integer = function->frameSize;
+        }
+    }
+}
+
+// instructions ------------------------------------------------------------------------------------
+
+static size_t EmitInstruction(TVmCompiler* compiler, TVmOpcode opcode, int a, int b, int c) {
+    TVmProgram* program = compiler->program;
+    if (program->size == program->capacity) {
+        program->capacity *= 2;
+        program->code = (TVmInstruction*)realloc(program->code, program->capacity * sizeof(TVmInstruction));
+        assert(program->code);
+    }
+
+    program->code[program->size] = {
+        .handler = NULL,
+        .immediate = {},
+        .a = a,
+        .b = b,
+        .c = c,
+        .opcode = opcode,
+    };
+    return program->size++;
+}
+
+static void SetJumpTarget(TVmCompiler* compiler, size_t jump, size_t target) {
+    compiler->program->code[jump].c = (int)((long long)target - (long long)jump);
+}
+
+static int AllocateRegister(TVmCompiler* compiler) {
+    int reg = compiler->top++;
+    if (compiler->top > compiler->frameSize) {
+        compiler->frameSize = compiler->top;
+    }
+    return reg;
+}
+
+static int GetDestination(TVmCompiler* compiler, int dest) {
+    return (dest >= 0) ? dest : AllocateRegister(compiler);
+}
+
+static int FindName(Vector* names, const char* name) {
+    for (size_t i = 0; i < names->size; i++) {
+        if (!strcmp((const char*)names->data[i], name)) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Внутри функции глобальная переменная - номер ячейки в начале стека регистров, а не регистр кадра
+static int FindVariable(TVmCompiler* compiler, const char* name, bool* isGlobal) {
+    *isGlobal = false;
+    int index = (compiler->function) ? FindName(&compiler->locals, name) : -1;
+    if (index >= 0) {
+        return index;
+    }
+
+    index = FindName(&compiler->globals, name);
+    if (index < 0) {
+        fprintf(stderr, "Error: undefined variable '%s'\n", name);
+        exit(EXIT_FAILURE);
+    }
+    *isGlobal = (compiler->function != NULL);
+    return index;
+}
+
+static bool IsFloat(TVmCompiler* compiler, tNode* node) {
+    return IsFloatExpression(compiler->types, compiler->function, node);
+}
+
+static bool IsIntegerLiteral(tNode* node, long long* value) {
+    if (!node || node->type != Number || IsFloatLiteral(node)) {
+        return false;
+    }
+
+    *value = (long long)strtoull(node->value, NULL, 10);
+    return true;
+}
+
+static bool IsComparison(tNode* node) {
+    if (!node || node->type != Operation) {
+        return false;
+    }
+
+    Operations op = GetOperationType(node->value);
+    return op == Identical || op == NotIdentical || op == Less || op == Greater
+        || op == LessOrEqual || op == GreaterOrEqual;
+}
+
+static Operations GetInverseComparison(Operations op) {
+    switch (op) {
+        case Identical:         return NotIdentical;
+        case NotIdentical:      return Identical;
+        case Less:              return GreaterOrEqual;
+        case Greater:           return LessOrEqual;
+        case LessOrEqual:       return Greater;
+        case GreaterOrEqual:    return Less;
+        default:                assert(0);
+    }
+}
+
+// a op b == b op' a
+static Operations GetMirroredComparison(Operations op) {
+    switch (op) {
+        case Identical:         return Identical;
+        case NotIdentical:      return NotIdentical;
+        case Less:              return Greater;
+        case Greater:           return Less;
+        case LessOrEqual:       return GreaterOrEqual;
+        case GreaterOrEqual:    return LessOrEqual;
+        default:                assert(0);
+    }
+}
+
+// statements --------------------------------------------------------------------------------------
+
+static void CompileStatement(TVmCompiler* compiler, tNode* node) {
+    if (!node || node->type == Function) {
+        return; // тела функций компилируются отдельно
+    }
+
+    switch ((node->type == Operation) ? GetOperationType(node->value) : NoOperation) {
+        case Semicolon:
+            CompileStatement(compiler, node->left);
+            CompileStatement(compiler, node->right);
+            return;
+        case Memoize:       CompileStatement(compiler, node->left); return; // таблицы результатов нет
+        case Switch:        CompileStatement(compiler, node->right); return; // варианты проверяются по очереди
+        case Equal:         CompileEqual(compiler, node); break;
+        case Store:         CompileStore(compiler, node); break;
+        case While:
+        case VectorWhile:
+        case ParallelWhile: CompileWhile(compiler, node); break; // виртуальная машина однопоточная
+        case If:
+        case SelectIf:      CompileIf(compiler, node); break;
+        case Return:        CompileReturn(compiler, node); break;
+        case Print: {
+            bool isFloat = IsFloat(compiler, node->left);
+            int value = CompileExpression(compiler, node->left, -1, isFloat);
+            EmitInstruction(compiler, (isFloat) ? VmPrintFloat : VmPrintInt, value, 0, 0);
+            break;
+        }
+        default:            CompileExpression(compiler, node, -1, false); break;
+    }
+    compiler->top = compiler->firstTemporary;
+}
+
+// Значение вычисляется прямо в регистр переменной; у массива double тип элементов, а не адреса
+static void CompileEqual(TVmCompiler* compiler, tNode* node) {
+    bool asFloat = IsFloatVariable(compiler->types, compiler->function, node->left->value)
+                   && !IsOperation(node->right, Array);
+    bool isGlobal = false;
+    int variable = FindVariable(compiler, node->left->value, &isGlobal);
+    if (!isGlobal) {
+        CompileExpression(compiler, node->right, variable, asFloat);
+        return;
+    }
+
+    int value = CompileExpression(compiler, node->right, -1, asFloat);
+    EmitInstruction(compiler, VmStoreGlobal, value, variable, 0);
+}
+
+static void CompileStore(TVmCompiler* compiler, tNode* node) {
+    int value = CompileExpression(compiler, node->right, -1, IsFloat(compiler, node->left));
+    int array = 0;
+    int index = 0;
+    CompileElement(compiler, node->left, &array, &index);
+    EmitInstruction(compiler, VmStore, value, array, index);
+}
+
+// Условие стоит после тела: на каждой итерации выполняется один переход
+static void CompileWhile(TVmCompiler* compiler, tNode* node) {
+    size_t entry = EmitInstruction(compiler, VmJump, 0, 0, 0);
+    size_t body = compiler->program->size;
+    CompileStatement(compiler, node->right);
+
+    SetJumpTarget(compiler, entry, compiler->program->size);
+    size_t jump = CompileBranch(compiler, node->left, true);
+    SetJumpTarget(compiler, jump, body);
+}
+
+static void CompileIf(TVmCompiler* compiler, tNode* node) {
+    int counter = -1; // перед условием считаются выполнения if, в начале тела - входы в него
+    for (size_t i = 0; i < compiler->ifs.size && counter < 0; i++) {
+        if (compiler->ifs.data[i] == node) {
+            counter = 2 * (int)i;
+        }
+    }
+    if (counter >= 0) {
+        EmitInstruction(compiler, VmCount, counter, 0, 0);
+    }
+
+    size_t jump = CompileBranch(compiler, node->left, false);
+    if (counter >= 0) {
+        EmitInstruction(compiler, VmCount, counter + 1, 0, 0);
+    }
+    CompileStatement(compiler, node->right);
+    SetJumpTarget(compiler, jump, compiler->program->size);
+}
+
+static void CompileReturn(TVmCompiler* compiler, tNode* node) {
+    if (!compiler->function) {
+        CompileExpression(compiler, node->left, -1, false);
+        EmitInstruction(compiler, VmHalt, 0, 0, 0); // return вне функций завершает программу
+        return;
+    }
+
+    bool isFloat = IsFloatFunction(compiler->types, compiler->function->value);
+    int value = CompileExpression(compiler, node->left, -1, isFloat);
+    EmitInstruction(compiler, VmReturn, value, 0, 0);
+}
+
+// Сравнение сливается с переходом; возвращает переход, цель которого еще не известна
+static size_t CompileBranch(TVmCompiler* compiler, tNode* node, bool jumpIfTrue) {
+    int saved = compiler->top;
+    if (!IsComparison(node)) {
+        bool isFloat = IsFloat(compiler, node);
+        int value = CompileExpression(compiler, node, -1, false);
+        if (!isFloat) {
+            compiler->top = saved;
+            size_t jump = EmitInstruction(compiler, (jumpIfTrue) ? VmJumpIfNotIdenticalIntImm : VmJumpIfIdenticalIntImm,
+                                          value, 0, 0);
+            return jump;
+        }
+
+        int zero = AllocateRegister(compiler);
+        EmitInstruction(compiler, VmLoad, zero, 0, 0);
+        compiler->top = saved;
+        return EmitInstruction(compiler, (jumpIfTrue) ? VmJumpIfNotIdenticalFloat : VmJumpIfIdenticalFloat,
+                               value, zero, 0);
+    }
+
+    Operations op = GetOperationType(node->value);
+    if (IsFloat(compiler, node->left) || IsFloat(compiler, node->right)) {
+        int left = CompileExpression(compiler, node->left, -1, true);
+        int right = CompileExpression(compiler, node->right, -1, true);
+        compiler->top = saved;
+        if (op == Greater || op == GreaterOrEqual) {
+            op = GetMirroredComparison(op);
+            int swap = left;
+            left = right;
+            right = swap;
+        }
+
+        TVmOpcode opcode = VmJump;
+        switch (op) {
+            case Identical:     opcode = (jumpIfTrue) ? VmJumpIfIdenticalFloat : VmJumpIfNotIdenticalFloat; break;
+            case NotIdentical:  opcode = (jumpIfTrue) ? VmJumpIfNotIdenticalFloat : VmJumpIfIdenticalFloat; break;
+            case Less:          opcode = (jumpIfTrue) ? VmJumpIfLessFloat : VmJumpUnlessLessFloat; break;
+            case LessOrEqual:   opcode = (jumpIfTrue) ? VmJumpIfLessOrEqualFloat : VmJumpUnlessLessOrEqualFloat; break;
+            default:            assert(0);
+        }
+        return EmitInstruction(compiler, opcode, left, right, 0);
+    }
+
+    if (!jumpIfTrue) {
+        op = GetInverseComparison(op);
+    }
+
+    long long value = 0;
+    tNode* variable = NULL;
+    if (IsIntegerLiteral(node->right, &value)) {
+        variable = node->left;
+    } else if (IsIntegerLiteral(node->left, &value)) {
+        variable = node->right;
+        op = GetMirroredComparison(op);
+    }
+    if (variable) {
+        int left = CompileExpression(compiler, variable, -1, false);
+        compiler->top = saved;
+
+        TVmOpcode opcode = VmJump;
+        switch (op) {
+            case Identical:         opcode = VmJumpIfIdenticalIntImm; break;
+            case NotIdentical:      opcode = VmJumpIfNotIdenticalIntImm; break;
+            case Less:              opcode = VmJumpIfLessIntImm; break;
+            case Greater:           opcode = VmJumpIfGreaterIntImm; break;
+            case LessOrEqual:       opcode = VmJumpIfLessOrEqualIntImm; break;
+            case GreaterOrEqual:    opcode = VmJumpIfGreaterOrEqualIntImm; break;
+            default:                assert(0);
+        }
+        size_t jump = EmitInstruction(compiler, opcode, left, 0, 0);
+        compiler->program->code[jump].immediate.integer = value;
+        return jump;
+    }
+
+    int left = CompileExpression(compiler, node->left, -1, false);
+    int right = CompileExpression(compiler, node->right, -1, false);
+    compiler->top = saved;
+    switch (op) {
+        case Identical:         return EmitInstruction(compiler, VmJumpIfIdenticalInt, left, right, 0);
+        case NotIdentical:      return EmitInstruction(compiler, VmJumpIfNotIdenticalInt, left, right, 0);
+        case Less:              return EmitInstruction(compiler, VmJumpIfLessInt, left, right, 0);
+        case Greater:           return EmitInstruction(compiler, VmJumpIfLessInt, right, left, 0);
+        case LessOrEqual:       return EmitInstruction(compiler, VmJumpIfLessOrEqualInt, left, right, 0);
+        case GreaterOrEqual:    return EmitInstruction(compiler, VmJumpIfLessOrEqualInt, right, left, 0);
+        default:                assert(0);
+    }
+}
+
+// expressions -------------------------------------------------------------------------------------
+
+// Результат в dest, а при dest < 0 - в любом регистре: переменная кадра отдается без копирования.
+// asFloat - нужен double; целые значения переводятся, double в целом контексте передается битами
+static int CompileExpression(TVmCompiler* compiler, tNode* node, int dest, bool asFloat) {
+    if (node->type == Number) {
+        int reg = GetDestination(compiler, dest);
+        size_t load = EmitInstruction(compiler, VmLoad, reg, 0, 0);
+        if (asFloat || IsFloatLiteral(node)) {
+            compiler->program->code[load].immediate.real = GetFloatValue(node);
+        } else {
+            compiler->program->code[load].immediate.integer = (long long)strtoull(node->value, NULL, 10);
+        }
+        return reg;
+    }
+    if (asFloat && !IsFloat(compiler, node)) {
+        int saved = compiler->top;
+        int value = CompileExpression(compiler, node, -1, false);
+        compiler->top = saved;
+        int reg = GetDestination(compiler, dest);
+        EmitInstruction(compiler, VmIntToFloat, reg, value, 0);
+        return reg;
+    }
+
+    if (node->type == Identifier) {
+        bool isGlobal = false;
+        int variable = FindVariable(compiler, node->value, &isGlobal);
+        if (isGlobal) {
+            int reg = GetDestination(compiler, dest);
+            EmitInstruction(compiler, VmLoadGlobal, reg, variable, 0);
+            return reg;
+        }
+        if (dest >= 0 && dest != variable) {
+            EmitInstruction(compiler, VmMove, dest, variable, 0);
+            return dest;
+        }
+        return variable;
+    }
+    if (node->type == Calling) {
+        return CompileCall(compiler, node, dest);
+    }
+    if (node->type != Operation) {
+        fprintf(stderr, "Error: '%s' has no value\n", node->value);
+        exit(EXIT_FAILURE);
+    }
+
+    Operations op = GetOperationType(node->value);
+    int saved = compiler->top;
+    switch (op) {
+        case Add:
+        case Sub:
+        case Mul:
+        case Div:               return CompileArithmetic(compiler, node, op, dest);
+        case Identical:
+        case NotIdentical:
+        case Less:
+        case Greater:
+        case LessOrEqual:
+        case GreaterOrEqual:    return CompileComparison(compiler, node, op, dest);
+        case Sqrt:
+        case Sin:
+        case Cos: {
+            int value = CompileExpression(compiler, node->left, -1, true);
+            compiler->top = saved;
+            int reg = GetDestination(compiler, dest);
+            EmitInstruction(compiler, (op == Sqrt) ? VmSqrt : (op == Sin) ? VmSin : VmCos, reg, value, 0);
+            return reg;
+        }
+        case Index: {
+            int array = 0;
+            int index = 0;
+            CompileElement(compiler, node, &array, &index);
+            compiler->top = saved;
+            int reg = GetDestination(compiler, dest);
+            EmitInstruction(compiler, VmIndex, reg, array, index);
+            return reg;
+        }
+        case Array: {
+            if (IsFloat(compiler, node->left)) {
+                fprintf(stderr, "Error: size of array is not an integer\n");
+                exit(EXIT_FAILURE);
+            }
+            int size = CompileExpression(compiler, node->left, -1, false);
+            compiler->top = saved;
+            int reg = GetDestination(compiler, dest);
+            EmitInstruction(compiler, VmArray, reg, size, 0);
+            return reg;
+        }
+        default:
+            fprintf(stderr, "Error: '%s' has no value\n", node->value);
+            exit(EXIT_FAILURE);
+    }
+}
+
+// Константа или элемент массива в сложении становятся частью самой инструкции
+static int CompileArithmetic(TVmCompiler* compiler, tNode* node, Operations op, int dest) {
+    bool isFloat = IsFloat(compiler, node);
+    int saved = compiler->top;
+    long long value = 0;
+
+    tNode* other = NULL;
+    if (!isFloat && (op == Add || op == Sub) && IsIntegerLiteral(node->right, &value)) {
+        other = node->left;
+        value = (op == Add) ? value : (long long)(0 - (unsigned long long)value);
+    } else if (!isFloat && op == Add && IsIntegerLiteral(node->left, &value)) {
+        other = node->right;
+    }
+    if (other) {
+        int left = CompileExpression(compiler, other, -1, false);
+        compiler->top = saved;
+        int reg = GetDestination(compiler, dest);
+        size_t add = EmitInstruction(compiler, VmAddIntImm, reg, left, 0);
+        compiler->program->code[add].immediate.integer = value;
+        return reg;
+    }
+
+    tNode* element = NULL;
+    if (op == Add && IsOperation(node->right, Index) && IsFloat(compiler, node->right) == isFloat) {
+        element = node->right;
+        other = node->left;
+    } else if (op == Add && IsOperation(node->left, Index) && IsFloat(compiler, node->left) == isFloat) {
+        element = node->left;
+        other = node->right;
+    }
+    if (element) {
+        int left = CompileExpression(compiler, other, -1, isFloat);
+        int array = 0;
+        int index = 0;
+        CompileElement(compiler, element, &array, &index);
+        compiler->top = saved;
+        int reg = GetDestination(compiler, dest);
+        size_t add = EmitInstruction(compiler, (isFloat) ? VmAddElementFloat : VmAddElementInt, reg, left, array);
+        compiler->program->code[add].immediate.integer = index;
+        return reg;
+    }
+
+    int left = CompileExpression(compiler, node->left, -1, isFloat);
+    int right = CompileExpression(compiler, node->right, -1, isFloat);
+    compiler->top = saved;
+    int reg = GetDestination(compiler, dest);
+
+    TVmOpcode opcode = VmAddInt;
+    switch (op) {
+        case Add:   opcode = (isFloat) ? VmAddFloat : VmAddInt; break;
+        case Sub:   opcode = (isFloat) ? VmSubFloat : VmSubInt; break;
+        case Mul:   opcode = (isFloat) ? VmMulFloat : VmMulInt; break;
+        case Div:   opcode = (isFloat) ? VmDivFloat : VmDivInt; break;
+        default:    assert(0);
+    }
+    EmitInstruction(compiler, opcode, reg, left, right);
+    return reg;
+}
+
+// > и >= - это < и <= с переставленными операндами
+static int CompileComparison(TVmCompiler* compiler, tNode* node, Operations op, int dest) {
+    bool isFloat = IsFloat(compiler, node->left) || IsFloat(compiler, node->right);
+    int saved = compiler->top;
+    int left = CompileExpression(compiler, node->left, -1, isFloat);
+    int right = CompileExpression(compiler, node->right, -1, isFloat);
+    compiler->top = saved;
+    int reg = GetDestination(compiler, dest);
+
+    if (op == Greater || op == GreaterOrEqual) {
+        op = GetMirroredComparison(op);
+        int swap = left;
+        left = right;
+        right = swap;
+    }
+
+    TVmOpcode opcode = VmLessInt;
+    switch (op) {
+        case Identical:     opcode = (isFloat) ? VmIdenticalFloat : VmIdenticalInt; break;
+        case NotIdentical:  opcode = (isFloat) ? VmNotIdenticalFloat : VmNotIdenticalInt; break;
+        case Less:          opcode = (isFloat) ? VmLessFloat : VmLessInt; break;
+        case LessOrEqual:   opcode = (isFloat) ? VmLessOrEqualFloat : VmLessOrEqualInt; break;
+        default:            assert(0);
+    }
+    EmitInstruction(compiler, opcode, reg, left, right);
+    return reg;
+}
+
+// Регистры адреса массива и индекса a [ i ]; временные регистры остаются занятыми
+static void CompileElement(TVmCompiler* compiler, tNode* node, int* array, int* index) {
+    if (IsFloat(compiler, node->right)) {
+        fprintf(stderr, "Error: index of array '%s' is not an integer\n", node->left->value);
+        exit(EXIT_FAILURE);
+    }
+
+    *array = CompileExpression(compiler, node->left, -1, false);
+    *index = CompileExpression(compiler, node->right, -1, false);
+}
+
+// Аргументы вычисляются в регистры, с которых начнется кадр вызываемой функции
+static int CompileCall(TVmCompiler* compiler, tNode* node, int dest) {
+    size_t index = GetFunctionIndex(&compiler->functions, node->value);
+    if (index == compiler->functions.count) {
+        fprintf(stderr, "Error: call of undefined function '%s'\n", node->value);
+        exit(EXIT_FAILURE);
+    }
+    tNode* callee = compiler->functions.entries[index].function;
+    size_t argCount = CountChain(node->left);
+    if (CountChain(callee->left) != argCount) {
+        fprintf(stderr, "Error: function '%s' expects %zu arguments, %zu given\n",
+                node->value, CountChain(callee->left), argCount);
+        exit(EXIT_FAILURE);
+    }
+
+    int argBase = compiler->top;
+    for (size_t i = 0; i < argCount; i++) {
+        AllocateRegister(compiler);
+    }
+
+    // аргументы лежат в обратном порядке: последний - в корне цепочки
+    size_t i = argCount;
+    for (tNode* arg = node->left; arg; arg = arg->left) {
+        i--;
+        tNode* param = callee->left;
+        for (size_t j = 0; j < i; j++) {
+            param = param->left;
+        }
+        CompileExpression(compiler, arg, argBase + (int)i, IsFloatVariable(compiler->types, callee, param->value));
+    }
+
+    compiler->top = argBase;
+    int reg = GetDestination(compiler, dest);
+    size_t call = EmitInstruction(compiler, VmCall, reg, argBase, 0);
+    compiler->program->code[call].immediate.integer = (long long)index;
+    return reg;
+}
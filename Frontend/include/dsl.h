@@ -41,5 +41,11 @@
     newNode(Operation, "while", leftNode_, rightNode_)
 #define EQUAL(leftNode_, rightNode_) \
     newNode(Operation, "=", leftNode_, rightNode_)
+#define INDEX(leftNode_, rightNode_) \
+    newNode(Operation, "[", leftNode_, rightNode_)
+#define STORE(leftNode_, rightNode_) \
+    newNode(Operation, "[]=", leftNode_, rightNode_)
+#define ARRAY(leftNode_, rightNode_) \
+    newNode(Operation, "array", leftNode_, rightNode_)
 
 #endif // DSL_H
@@ -39,6 +39,15 @@ enum Operations {
     Def,
     Call,
     Return,
+    Index,
+    Store,
+    Array,
+    VectorWhile,
+    Memoize,
+    ParallelWhile,
+    SelectIf,
+    Import,
+    Switch,
 };
 
 const char* const keyIf = "if";
@@ -56,7 +65,10 @@ const char* const keyGreater = ">";
 const char* const keyCall = "call";
 const char* const keySqrt = "sqrt";
 const char* const keyPrint = "print";
+const char* const keyImport = "import";
 const char* const keyWhile = "while";
+const char* const keyArray = "array";
+const char* const keyParallel = "parallel";
 const char* const keySemicolon = ";";
 const char* const keyIdentical = "==";
 const char* const keyReturn = "return";
@@ -67,5 +79,15 @@ const char* const keyLeftParenthesis = "(";
 const char* const keyRightParenthesis = ")";
 const char* const keyLeftCurlyBracket = "{";
 const char* const keyRightCurlyBracket = "}";
+const char* const keyLeftSquareBracket = "[";
+const char* const keyRightSquareBracket = "]";
+
+// Служебные операции, которых нет в исходном тексте
+const char* const keyStore = "[]="; // a [ i ] = x: left - элемент a [ i ], right - значение
+const char* const keyVectorWhile = "simd_while"; // цикл while, который генератор выполняет векторными инструкциями
+const char* const keyMemoize = "memoize"; // тело функции: left - код, right - число записей в таблице результатов
+const char* const keyParallelWhile = "parallel_while"; // parallel while: итерации делятся между потоками
+const char* const keySelectIf = "select_if"; // if без перехода: значения присваиваний тела выбираются cmov
+const char* const keySwitch = "switch"; // if ( x == число ) подряд: left - x, right - эти if, вариант выбирается переходом по таблице
 
 #endif // NODE_H
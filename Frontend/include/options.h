@@ -0,0 +1,76 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+const size_t kDefaultInlineThreshold = 40;
+const size_t kDefaultUnrollFactor = 4;
+const size_t kDefaultUnrollBudget = 128;
+const size_t kDefaultJitRuns = 1;
+const size_t kDefaultEvaluationSteps = 1 << 20;
+const size_t kDefaultEvaluationMemory = 1 << 20;
+const size_t kDefaultMemoSize = 1 << 12;
+
+enum OutputFormat {
+    AsmOutput           = 1, // nasm.s для nasm и gcc
+    ObjectOutput        = 2, // nasm.o, собранный встроенным ассемблером
+    ExecutableOutput    = 3, // статический исполняемый nasm
+    JitOutput           = 4, // выполнение в памяти компилятора
+    VmOutput            = 5, // байткод для интерпретатора, без ассемблера и машинного кода
+};
+
+enum MemoizationMode {
+    NoMemoization           = 1,
+    RecursiveMemoization    = 2, // чистые функции, которые вызывают себя больше одного раза
+    PureMemoization         = 3, // все чистые функции
+};
+
+enum RuntimeType {
+    FreestandingRuntime = 1, // собственные _start и вывод через write(2), без libc
+    LibcRuntime         = 2, // main и printf, компоновка через gcc
+};
+
+enum OverflowMode {
+    WrapOverflow        = 1, // целые по модулю 2^64, как в машинных командах
+    BignumOverflow      = 2, // после add/sub/mul проверяется jo, переполнение уходит в длинную арифметику runtime
+};
+
+struct Options {
+    bool enableInlining;
+    bool enableTailCalls;
+    bool enableLoopOptimizations;
+    bool enableVectorization;
+    bool enableEvaluation;
+    bool enableDeadCodeElimination;
+    bool enableIfConversion;
+    bool enableSpecialization;
+    bool enableJumpTables;
+    bool enableClosedForms;
+    size_t inlineThreshold; // максимальный размер тела встраиваемой функции в узлах AST
+    size_t unrollFactor; // 0 или 1 - не разворачивать циклы
+    size_t unrollBudget; // максимальный размер развернутого тела цикла в узлах AST
+    OutputFormat outputFormat;
+    RuntimeType runtime;
+    bool emitComments; // комментарии к инструкциям в nasm.s
+    bool preciseMath; // sin и cos через libm вместо встроенных многочленов
+    bool fastMath; // суммы double можно переставлять: векторизуются и вещественные редукции
+    size_t jitRuns; // сколько раз выполнить программу в режиме --jit или --vm
+    size_t codegenThreads; // потоки для генерации функций, 0 - по числу ядер
+    size_t evaluationSteps; // бюджет выполнения программы при компиляции в узлах AST
+    size_t evaluationMemory; // бюджет массивов при компиляции в байтах
+    MemoizationMode memoization;
+    size_t memoSize; // записей в таблице результатов одной функции
+    size_t parallelThreads; // потоки для parallel while, 0 - по числу доступных ядер при запуске программы
+    const char* profileOutput; // куда --vm записывает, сколько раз выполнился каждый if и его тело
+    const char* profileInput; // профиль для выбора if, которые выполняются без перехода
+    OverflowMode overflow;
+    bool separateCompilation; // каждый модуль - отдельный nasm-файл и объектный файл, без оптимизаций между модулями
+    const char* module; // модуль, который сейчас компилируется, NULL - программа из code.txt
+    const char* superoptRules; // файл правил супероптимизатора, NULL - без него
+    bool superoptLearn; // окна, которых нет в файле, перебираются, и найденное дописывается в файл
+};
+
+Options parseOptions(int argc, char* argv[]);
+
+#endif // OPTIONS_H
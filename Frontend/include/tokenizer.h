@@ -17,7 +17,7 @@ struct Token {
     Token* right;
 };
 
-Vector tokenizer();
+Vector tokenizer(const char* fileName);
 size_t getFileSize(FILE* file);
 bool isKeyWord(const char* const word);
 void tokenVectorDtor(Vector* vec);
@@ -25,5 +25,7 @@ void treeDtor(tNode* node);
 void dump(tNode* root);
 tNode* copyNode(tNode* node);
 bool subtreeContainsVariable(tNode* node);
+const char* storeString(const char* str);
+void freeStoredStrings();
 
 #endif // TREE_H
@@ -0,0 +1,199 @@
+#include "options.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "debug.h"
+
+// static --------------------------------------------------------------------------------------------------------------
+
+static size_t parseNumber(const char* option, const char* value);
+[[noreturn]] static void usageError(const char* option);
+
+// global --------------------------------------------------------------------------------------------------------------
+
+Options parseOptions(int argc, char* argv[]) {
+    Options options = {
+        .enableInlining = true,
+        .enableTailCalls = true,
+        .enableLoopOptimizations = true,
+        .enableVectorization = true,
+        .enableEvaluation = true,
+        .enableDeadCodeElimination = true,
+        .enableIfConversion = true,
+        .enableSpecialization = true,
+        .enableJumpTables = true,
+        .enableClosedForms = true,
+        .inlineThreshold = kDefaultInlineThreshold,
+        .unrollFactor = kDefaultUnrollFactor,
+        .unrollBudget = kDefaultUnrollBudget,
+        .outputFormat = AsmOutput,
+        .runtime = FreestandingRuntime,
+        .emitComments = false,
+        .preciseMath = false,
+        .fastMath = false,
+        .jitRuns = kDefaultJitRuns,
+        .codegenThreads = 0,
+        .evaluationSteps = kDefaultEvaluationSteps,
+        .evaluationMemory = kDefaultEvaluationMemory,
+        .memoization = RecursiveMemoization,
+        .memoSize = kDefaultMemoSize,
+        .parallelThreads = 0,
+        .profileOutput = NULL,
+        .profileInput = NULL,
+        .overflow = WrapOverflow,
+        .separateCompilation = false,
+        .module = NULL,
+        .superoptRules = NULL,
+        .superoptLearn = false,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+
+        if (!strcmp(option, "--no-inline")) {
+            options.enableInlining = false;
+        } else if (!strcmp(option, "--no-tail-calls")) {
+            options.enableTailCalls = false;
+        } else if (!strcmp(option, "--no-loop-opt")) {
+            options.enableLoopOptimizations = false;
+        } else if (!strcmp(option, "--no-vectorize")) {
+            options.enableVectorization = false;
+        } else if (!strcmp(option, "--no-eval")) {
+            options.enableEvaluation = false;
+        } else if (!strcmp(option, "--no-dce")) {
+            options.enableDeadCodeElimination = false;
+        } else if (!strcmp(option, "--no-if-conversion")) {
+            options.enableIfConversion = false;
+        } else if (!strcmp(option, "--no-specialize")) {
+            options.enableSpecialization = false;
+        } else if (!strcmp(option, "--no-jump-tables")) {
+            options.enableJumpTables = false;
+        } else if (!strcmp(option, "--no-closed-forms")) {
+            options.enableClosedForms = false;
+        } else if (!strcmp(option, "--separate")) {
+            options.separateCompilation = true;
+        } else if (!strncmp(option, "--profile-generate=", strlen("--profile-generate="))) {
+            options.profileOutput = option + strlen("--profile-generate=");
+        } else if (!strncmp(option, "--profile-use=", strlen("--profile-use="))) {
+            options.profileInput = option + strlen("--profile-use=");
+        } else if (!strncmp(option, "--superopt=", strlen("--superopt="))) {
+            options.superoptRules = option + strlen("--superopt=");
+            options.superoptLearn = false;
+        } else if (!strncmp(option, "--superopt-learn=", strlen("--superopt-learn="))) {
+            options.superoptRules = option + strlen("--superopt-learn=");
+            options.superoptLearn = true;
+        } else if (!strcmp(option, "--overflow=wrap")) {
+            options.overflow = WrapOverflow;
+        } else if (!strcmp(option, "--overflow=bignum")) {
+            options.overflow = BignumOverflow;
+        } else if (!strncmp(option, "--eval-steps=", strlen("--eval-steps="))) {
+            options.evaluationSteps = parseNumber(option, option + strlen("--eval-steps="));
+        } else if (!strncmp(option, "--eval-memory=", strlen("--eval-memory="))) {
+            options.evaluationMemory = parseNumber(option, option + strlen("--eval-memory="));
+        } else if (!strncmp(option, "--inline-threshold=", strlen("--inline-threshold="))) {
+            options.inlineThreshold = parseNumber(option, option + strlen("--inline-threshold="));
+        } else if (!strncmp(option, "--unroll=", strlen("--unroll="))) {
+            options.unrollFactor = parseNumber(option, option + strlen("--unroll="));
+        } else if (!strncmp(option, "--unroll-budget=", strlen("--unroll-budget="))) {
+            options.unrollBudget = parseNumber(option, option + strlen("--unroll-budget="));
+        } else if (!strcmp(option, "--memoize=none")) {
+            options.memoization = NoMemoization;
+        } else if (!strcmp(option, "--memoize=recursive")) {
+            options.memoization = RecursiveMemoization;
+        } else if (!strcmp(option, "--memoize=pure")) {
+            options.memoization = PureMemoization;
+        } else if (!strncmp(option, "--memo-size=", strlen("--memo-size="))) {
+            options.memoSize = parseNumber(option, option + strlen("--memo-size="));
+        } else if (!strncmp(option, "--parallel-threads=", strlen("--parallel-threads="))) {
+            options.parallelThreads = parseNumber(option, option + strlen("--parallel-threads="));
+        } else if (!strcmp(option, "--emit=asm")) {
+            options.outputFormat = AsmOutput;
+        } else if (!strcmp(option, "--emit=obj")) {
+            options.outputFormat = ObjectOutput;
+        } else if (!strcmp(option, "--emit=exe")) {
+            options.outputFormat = ExecutableOutput;
+        } else if (!strcmp(option, "--runtime=freestanding")) {
+            options.runtime = FreestandingRuntime;
+        } else if (!strcmp(option, "--runtime=libc")) {
+            options.runtime = LibcRuntime;
+        } else if (!strcmp(option, "--asm-comments")) {
+            options.emitComments = true;
+        } else if (!strcmp(option, "--precise-math")) {
+            options.preciseMath = true;
+        } else if (!strcmp(option, "--fast-math")) {
+            options.fastMath = true;
+        } else if (!strcmp(option, "--jit")) {
+            options.outputFormat = JitOutput;
+        } else if (!strncmp(option, "--jit-runs=", strlen("--jit-runs="))) {
+            options.outputFormat = JitOutput;
+            options.jitRuns = parseNumber(option, option + strlen("--jit-runs="));
+        } else if (!strncmp(option, "--codegen-threads=", strlen("--codegen-threads="))) {
+            options.codegenThreads = parseNumber(option, option + strlen("--codegen-threads="));
+        } else if (!strcmp(option, "--vm")) {
+            options.outputFormat = VmOutput;
+        } else if (!strncmp(option, "--vm-runs=", strlen("--vm-runs="))) {
+            options.outputFormat = VmOutput;
+            options.jitRuns = parseNumber(option, option + strlen("--vm-runs="));
+        } else {
+            usageError(option);
+        }
+    }
+
+    if (options.preciseMath && options.runtime != LibcRuntime) {
+        fprintf(stderr, "Error: --precise-math needs libm, use it with --runtime=libc\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options.profileOutput && (options.outputFormat != VmOutput || !*options.profileOutput)) {
+        fprintf(stderr, "Error: --profile-generate=FILE records the profile in the bytecode VM, use it with --vm\n");
+        exit(EXIT_FAILURE);
+    }
+    if (options.superoptRules && !*options.superoptRules) {
+        usageError("--superopt=");
+    }
+    if (options.overflow == BignumOverflow) {
+        if (options.outputFormat == VmOutput) {
+            fprintf(stderr, "Error: --overflow=bignum is implemented by the native code generator, not by --vm\n");
+            exit(EXIT_FAILURE);
+        }
+        // вычисление при компиляции, векторные циклы и cmov/setcc считают по модулю 2^64 без проверок
+        options.enableEvaluation = false;
+        options.enableVectorization = false;
+        options.enableIfConversion = false;
+    }
+    if (options.separateCompilation
+        && (options.outputFormat == VmOutput || options.overflow == BignumOverflow || options.profileInput)) {
+        fprintf(stderr, "Error: --separate compiles modules to machine code, it does not work with --vm, "
+                        "--overflow=bignum and --profile-use\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return options;
+}
+
+// static --------------------------------------------------------------------------------------------------------------
+
+static size_t parseNumber(const char* option, const char* value) {
+    char* end = NULL;
+    unsigned long long number = strtoull(value, &end, 10);
+    if (!*value || *end) {
+        usageError(option);
+    }
+
+    return (size_t)number;
+}
+
+static void usageError(const char* option) {
+    fprintf(stderr, "Unknown or malformed option: %s\n", option);
+    fprintf(stderr, "Usage: run [--no-inline] [--inline-threshold=N] [--no-tail-calls] [--no-loop-opt]\n"
+                    "           [--no-vectorize] [--unroll=N] [--unroll-budget=N] [--emit=asm|obj|exe]\n"
+                    "           [--runtime=freestanding|libc] [--precise-math] [--fast-math] [--asm-comments]\n"
+                    "           [--jit] [--jit-runs=N] [--vm] [--vm-runs=N] [--codegen-threads=N]\n"
+                    "           [--no-eval] [--eval-steps=N] [--eval-memory=N] [--no-dce]\n"
+                    "           [--memoize=none|recursive|pure] [--memo-size=N] [--parallel-threads=N]\n"
+                    "           [--no-if-conversion] [--profile-generate=FILE] [--profile-use=FILE]\n"
+                    "           [--overflow=wrap|bignum] [--no-specialize] [--no-jump-tables] [--separate]\n"
+                    "           [--no-closed-forms] [--superopt=FILE] [--superopt-learn=FILE]\n");
+
+    exit(EXIT_FAILURE);
+}
@@ -17,8 +17,10 @@ static tNode* getGrammar(Vector tokenVector);
 static tNode* getIf(Vector tokenVector, size_t* pos);
 static tNode* getDef(Vector tokenVector, size_t* pos);
 static tNode* getWhile(Vector tokenVector, size_t* pos);
+static tNode* getIndex(Vector tokenVector, size_t* pos, tNode* array);
 static tNode* getNumber(Vector tokenVector, size_t* pos);
 static tNode* getVariable(Vector tokenVector, size_t* pos);
+static tNode* getArgument(Vector tokenVector, size_t* pos);
 static tNode* getOperation(Vector tokenVector, size_t* pos);
 static tNode* getExpression(Vector tokenVector, size_t* pos);
 static tNode* getComparsion(Vector tokenVector, size_t* pos);
@@ -127,6 +129,9 @@ static tNode* getParentheses(Vector tokenVector, size_t* pos) {
         return node;
     } else if (GET_TOKEN_TYPE(*pos) == Identifier) {
         tNode* node = getVariable(tokenVector, pos);
+        if (!strcmp(GET_TOKEN(*pos), keyLeftSquareBracket)) {
+            node = getIndex(tokenVector, pos, node);
+        }
         return node;
     } else if (GET_TOKEN_TYPE(*pos) == Number) {
         return getNumber(tokenVector, pos);
@@ -174,12 +179,36 @@ static tNode* getMathFunction(Vector tokenVector, size_t* pos) {
         CHECK_RIGHT_PARENTHESIS;
         (*pos)++;
 
+        return node;
+    } else if (!strcmp(GET_TOKEN(*pos), keyArray)) {
+        tNode* node = ARRAY(NULL, NULL);
+
+        (*pos)++;
+        CHECK_LEFT_PARENTHESIS;
+        (*pos)++;
+
+        node->left = getComparsion(tokenVector, pos);
+
+        CHECK_RIGHT_PARENTHESIS;
+        (*pos)++;
+
         return node;
     } else {
         syntaxError(__LINE__);
     }
 }
 
+static tNode* getIndex(Vector tokenVector, size_t* pos, tNode* array) {
+    (*pos)++;
+    tNode* index = getComparsion(tokenVector, pos);
+    if (strcmp(GET_TOKEN(*pos), keyRightSquareBracket)) {
+        syntaxError(__LINE__);
+    }
+    (*pos)++;
+
+    return INDEX(array, index);
+}
+
 static tNode* getNumber(Vector tokenVector, size_t* pos) {
     return NUM(GET_TOKEN((*pos)++));
 }
@@ -188,6 +217,17 @@ static tNode* getVariable(Vector tokenVector, size_t* pos) {
     return VAR(GET_TOKEN((*pos)++));
 }
 
+// Аргумент вызова - переменная или число
+static tNode* getArgument(Vector tokenVector, size_t* pos) {
+    if (GET_TOKEN_TYPE(*pos) == Number) {
+        return getNumber(tokenVector, pos);
+    }
+    if (GET_TOKEN_TYPE(*pos) != Identifier) {
+        syntaxError(__LINE__);
+    }
+    return getVariable(tokenVector, pos);
+}
+
 static tNode* getDef(Vector tokenVector, size_t* pos) {
     if (!strcmp(GET_TOKEN(*pos), keyDef)) {
         (*pos)++;
@@ -208,6 +248,12 @@ static tNode* getDef(Vector tokenVector, size_t* pos) {
         tNode* rightNode = getOperation(tokenVector, pos);
         return newNode(Function, name, node, rightNode);
     }
+    if (!strcmp(GET_TOKEN(*pos), keyImport)) {
+        (*pos)++;
+        tNode* module = newNode(Identifier, GET_TOKEN(*pos), NULL, NULL);
+        (*pos)++;
+        return newNode(Operation, keyImport, module, NULL);
+    }
     tNode* leftNode = getOperation(tokenVector, pos);
     return leftNode;
 }
@@ -221,6 +267,15 @@ static tNode* getOperation(Vector tokenVector, size_t* pos) {
         (*pos)++;
         tNode* node = getWhile(tokenVector, pos);
         return node;
+    } else if (!strcmp(GET_TOKEN(*pos), keyParallel)) {
+        (*pos)++;
+        if (strcmp(GET_TOKEN(*pos), keyWhile)) {
+            syntaxError(__LINE__);
+        }
+        (*pos)++;
+        tNode* node = getWhile(tokenVector, pos);
+        node->value = keyParallelWhile;
+        return node;
     } else if (!strcmp(GET_TOKEN(*pos), keyPrint)) {
         (*pos)++;
         CHECK_LEFT_PARENTHESIS;
@@ -287,6 +342,14 @@ static tNode* getWhile(Vector tokenVector, size_t* pos) {
 static tNode* getAssignment(Vector tokenVector, size_t* pos) {
     tNode* leftNode = getVariable(tokenVector, pos);
     tNode* rightNode = NULL;
+    if (!strcmp(GET_TOKEN(*pos), keyLeftSquareBracket)) {
+        leftNode = getIndex(tokenVector, pos, leftNode);
+        if (strcmp(GET_TOKEN(*pos), keyEqual)) {
+            syntaxError(__LINE__);
+        }
+        (*pos)++;
+        return STORE(leftNode, getComparsion(tokenVector, pos));
+    }
     if (strcmp(GET_TOKEN(*pos), keyEqual)) {
         syntaxError(__LINE__);
     }
@@ -297,11 +360,12 @@ static tNode* getAssignment(Vector tokenVector, size_t* pos) {
         (*pos)++;
         CHECK_LEFT_PARENTHESIS;
         (*pos)++;
-        tNode* leftNode = getVariable(tokenVector, pos);
+        tNode* leftNode = getArgument(tokenVector, pos);
         while (!strcmp(GET_TOKEN(*pos), keySemicolon)) {
             (*pos)++;
-            leftNode = newNode(Identifier, GET_TOKEN(*pos), leftNode, NULL);
-            (*pos)++;
+            tNode* argument = getArgument(tokenVector, pos);
+            argument->left = leftNode;
+            leftNode = argument;
         }
         CHECK_RIGHT_PARENTHESIS;
         (*pos)++;
@@ -9,9 +9,12 @@
 #include "tree.h"
 #include "debug.h"
 
-Vector tokenizer() {
-    FILE* inputFile = fopen(kNameOfFileWithCode, "r");
-    assert(inputFile);
+Vector tokenizer(const char* fileName) {
+    FILE* inputFile = fopen(fileName, "r");
+    if (!inputFile) {
+        fprintf(stderr, "Error: cannot open %s\n", fileName);
+        exit(EXIT_FAILURE);
+    }
 
     size_t fileSize = getFileSize(inputFile);
 
@@ -88,7 +91,10 @@ bool isKeyWord(const char* const word) {
     else if (!strcmp(word, keySqrt             )) return true;
     else if (!strcmp(word, keyLess             )) return true;
     else if (!strcmp(word, keyWhile            )) return true;
+    else if (!strcmp(word, keyArray            )) return true;
+    else if (!strcmp(word, keyParallel         )) return true;
     else if (!strcmp(word, keyPrint            )) return true;
+    else if (!strcmp(word, keyImport           )) return true;
     else if (!strcmp(word, keyReturn           )) return true;
     else if (!strcmp(word, keyGreater          )) return true;
     else if (!strcmp(word, keySemicolon        )) return true;
@@ -100,6 +106,8 @@ bool isKeyWord(const char* const word) {
     else if (!strcmp(word, keyRightParenthesis )) return true;
     else if (!strcmp(word, keyLeftCurlyBracket )) return true;
     else if (!strcmp(word, keyRightCurlyBracket)) return true;
+    else if (!strcmp(word, keyLeftSquareBracket)) return true;
+    else if (!strcmp(word, keyRightSquareBracket)) return true;
 
     else return false;
 }
@@ -3,13 +3,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "debug.h"
+#include "vector.h"
 
 #define GRAPHVIZ
 
+const size_t kInitialSizeOfStringStorage = 16;
+
 // static --------------------------------------------------------------------------------------------------------------
 
+static Vector storedStrings = {};
+static pthread_mutex_t storedStringsLock = PTHREAD_MUTEX_INITIALIZER; // модули оптимизируются в потоках
+
 static tNode* memoryAllocationForNode();
 static void dumpTreeTraversal(tNode* node, FILE* dumpFile);
 static void dumpTreeTraversalWithArrows(tNode* node, FILE* dumpFile);
@@ -23,6 +30,8 @@ tNode* newNode(NodeType type, const char* value, tNode* left, tNode* right) {
         case Number:
         {
             node = memoryAllocationForNode();
+            node->left = left; // число - аргумент вызова: left - предыдущий аргумент
+            node->right = right;
 
             node->type = Number;
         }
@@ -140,6 +149,34 @@ bool subtreeContainsVariable(tNode* node) {
     }
 }
 
+// Имена и числа, созданные при оптимизациях, живут до конца работы компилятора
+const char* storeString(const char* str) {
+    assert(str);
+
+    char* copy = strdup(str);
+    assert(copy);
+
+    pthread_mutex_lock(&storedStringsLock);
+    if (!storedStrings.data) {
+        vectorInit(&storedStrings, kInitialSizeOfStringStorage);
+    }
+    vectorPush(&storedStrings, copy);
+    pthread_mutex_unlock(&storedStringsLock);
+
+    return copy;
+}
+
+void freeStoredStrings() {
+    if (!storedStrings.data) {
+        return;
+    }
+
+    freeAllocatedVectorCells(&storedStrings);
+    vectorFree(&storedStrings);
+    storedStrings.size = 0;
+    storedStrings.capacity = 0;
+}
+
 // static --------------------------------------------------------------------------------------------------------------
 
 static tNode* memoryAllocationForNode(void) {
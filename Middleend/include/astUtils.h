@@ -0,0 +1,69 @@
+#ifndef AST_UTILS_H
+#define AST_UTILS_H
+
+#include "node.h"
+#include "vector.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+
+const long long kMaxSafeNumber = 1LL << 62; // сумма и произведение на малый множитель без переполнения
+const size_t kMaxArguments = 128;
+
+// Функции программы по имени и число вызовов каждой: таблица строится одним обходом на проход оптимизации,
+// чтобы не искать функцию и не считать ее вызовы обходом AST в каждом месте вызова
+struct TFunctionEntry {
+    const char* name;
+    tNode* function;
+    size_t calls; // вызовов во всей программе
+    bool isRemoved; // по имени не находится, узел удалит RemoveFunctions
+};
+
+struct TFunctionTable {
+    TFunctionEntry* entries; // в порядке программы, повторные определения тоже
+    size_t count;
+    size_t capacity;
+    size_t* slots; // открытая адресация по хешу имени: номер записи + 1, 0 - свободно
+    size_t slotCount; // степень двойки, не меньше удвоенного count
+};
+
+Operations GetOperationType(const char* const word);
+bool IsOperation(tNode* node, Operations op);
+size_t CountNodes(tNode* node);
+size_t CountChain(tNode* node);
+tNode* NewNumberNode(long long value);
+bool GetNumber(tNode* node, long long* value);
+bool IsImported(tNode* function);
+tNode* FindFunction(tNode* root, const char* name);
+tNode* RemoveStatement(tNode* root, tNode* statement);
+tNode* GetLastStatement(tNode* node);
+tNode* AppendStatement(tNode* sequence, tNode* statement);
+bool IsSameTree(tNode* first, tNode* second);
+bool ContainsCalling(tNode* node);
+bool ContainsParallelLoop(tNode* node);
+size_t CountCalls(tNode* node, const char* name);
+size_t GetArguments(tNode* call, tNode** args);
+
+void FunctionTableCtor(TFunctionTable* table, tNode* root);
+void FunctionTableDtor(TFunctionTable* table);
+void AddFunction(TFunctionTable* table, tNode* function);
+size_t GetFunctionIndex(const TFunctionTable* table, const char* name);
+tNode* LookupFunction(const TFunctionTable* table, const char* name);
+size_t GetCallCount(const TFunctionTable* table, const char* name);
+void AddCalls(TFunctionTable* table, tNode* node);
+void RemoveCalls(TFunctionTable* table, tNode* node);
+void RemoveFunction(TFunctionTable* table, tNode* function);
+tNode* RemoveFunctions(tNode* root, const TFunctionTable* table);
+size_t CountReferences(tNode* node, const char* name);
+size_t CountAssignments(tNode* node, const char* name);
+
+bool ContainsName(const Vector* names, const char* name);
+void AddName(Vector* names, const char* name);
+void CollectGlobals(tNode* node, Vector* globals);
+void CollectLocals(tNode* function, Vector* globals, Vector* locals);
+void CollectAssignments(tNode* node, Vector* names);
+bool IsAssigned(tNode* node, const char* name);
+bool IsIndexed(tNode* node, const char* name);
+void RenameVariable(tNode* node, const char* name, const char* newName);
+
+#endif // AST_UTILS_H
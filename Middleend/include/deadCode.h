@@ -0,0 +1,9 @@
+#ifndef DEAD_CODE_H
+#define DEAD_CODE_H
+
+#include "node.h"
+#include "options.h"
+
+tNode* EliminateDeadCode(tNode* root, const Options* options);
+
+#endif // DEAD_CODE_H
@@ -0,0 +1,10 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include "node.h"
+#include "options.h"
+#include "typeInference.h"
+
+tNode* EvaluateProgram(tNode* root, const Options* options, TTypeInfo* types);
+
+#endif // EVALUATOR_H
@@ -0,0 +1,13 @@
+#ifndef IF_CONVERTER_H
+#define IF_CONVERTER_H
+
+#include "node.h"
+#include "vector.h"
+#include "options.h"
+#include "typeInference.h"
+
+tNode* ConvertIfs(tNode* root, const Options* options, TTypeInfo* types);
+void CollectIfNodes(tNode* node, Vector* ifs);
+void WriteIfProfile(const char* fileName, const long long* counters, size_t ifCount);
+
+#endif // IF_CONVERTER_H
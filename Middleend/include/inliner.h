@@ -0,0 +1,11 @@
+#ifndef INLINER_H
+#define INLINER_H
+
+#include "node.h"
+#include "options.h"
+#include "typeInference.h"
+
+tNode* RunInliner(tNode* root, const Options* options, TTypeInfo* types);
+tNode* EliminateTailCalls(tNode* root);
+
+#endif // INLINER_H
@@ -0,0 +1,9 @@
+#ifndef LOOP_OPTIMIZER_H
+#define LOOP_OPTIMIZER_H
+
+#include "node.h"
+#include "typeInference.h"
+
+tNode* OptimizeLoops(tNode* root, TTypeInfo* types);
+
+#endif // LOOP_OPTIMIZER_H
@@ -0,0 +1,11 @@
+#ifndef MEMOIZER_H
+#define MEMOIZER_H
+
+#include "node.h"
+#include "vector.h"
+#include "options.h"
+
+void CollectPureFunctions(tNode* root, Vector* pure);
+tNode* MemoizeFunctions(tNode* root, const Options* options);
+
+#endif // MEMOIZER_H
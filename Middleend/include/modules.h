@@ -0,0 +1,33 @@
+#ifndef MODULES_H
+#define MODULES_H
+
+#include "node.h"
+#include "vector.h"
+
+const size_t kMaxLengthOfFileName = 256;
+
+// Файл с кодом: программа (code.txt) или модуль name.txt, подключенный строкой import name ;
+struct TModule {
+    const char* name; // NULL - программа
+    char fileName[kMaxLengthOfFileName];
+    Vector tokens; // значения узлов AST указывают в буфер токенизатора
+    tNode* root; // без import, у модуля - только функции
+    Vector imports; // имена модулей, которые подключает этот файл
+};
+
+// modules [ 0 ] - программа, дальше модули в порядке первого import
+struct TProgram {
+    TModule* modules;
+    size_t count;
+    size_t capacity;
+};
+
+void LoadProgram(TProgram* program, const char* fileName);
+void ProgramDtor(TProgram* program);
+tNode* BuildUnit(TProgram* program, size_t index);
+void DeclareImports(TProgram* program, size_t index, tNode* root);
+void CollectImportClosure(TProgram* program, size_t index, Vector* closure);
+void CollectExports(TProgram* program, size_t index, Vector* exports);
+size_t FindOwner(TProgram* program, const char* function);
+
+#endif // MODULES_H
@@ -0,0 +1,10 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "node.h"
+#include "options.h"
+#include "typeInference.h"
+
+tNode* RunOptimizer(tNode* root, const Options* options, TTypeInfo* types);
+
+#endif // OPTIMIZER_H
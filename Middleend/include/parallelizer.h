@@ -0,0 +1,24 @@
+#ifndef PARALLELIZER_H
+#define PARALLELIZER_H
+
+#include "node.h"
+#include "vector.h"
+#include "options.h"
+#include "typeInference.h"
+
+// Цикл parallel while ( i < n ) { ... ; i = i + 1 ; }: диапазон [i, n) делится между потоками.
+// Суммы s = s + expr копятся в каждом потоке отдельно и прибавляются к s после цикла. Остальные переменные,
+// которым присваивает тело, у каждого потока свои, а после цикла получают значения из последней итерации
+struct TParallelLoop {
+    const char* counter;
+    tNode* limit;
+    Vector reductions; // имена сумм
+    Vector privates; // остальные переменные, которым присваивает тело, вместе со счетчиком
+};
+
+void CheckParallelLoops(tNode* root, const Options* options, TTypeInfo* types);
+bool MatchParallelLoop(tNode* loop, TParallelLoop* parallel);
+void ParallelLoopDtor(TParallelLoop* parallel);
+void CollectParallelCallees(tNode* root, Vector* callees);
+
+#endif // PARALLELIZER_H
@@ -0,0 +1,10 @@
+#ifndef SCALAR_EVOLUTION_H
+#define SCALAR_EVOLUTION_H
+
+#include "node.h"
+#include "options.h"
+#include "typeInference.h"
+
+tNode* ReplaceClosedForms(tNode* root, const Options* options, TTypeInfo* types);
+
+#endif // SCALAR_EVOLUTION_H
@@ -0,0 +1,10 @@
+#ifndef SPECIALIZER_H
+#define SPECIALIZER_H
+
+#include "node.h"
+#include "options.h"
+#include "typeInference.h"
+
+tNode* SpecializeFunctions(tNode* root, const Options* options, TTypeInfo* types);
+
+#endif // SPECIALIZER_H
@@ -0,0 +1,10 @@
+#ifndef SWITCH_CONVERTER_H
+#define SWITCH_CONVERTER_H
+
+#include "node.h"
+#include "options.h"
+#include "typeInference.h"
+
+tNode* ConvertSwitches(tNode* root, const Options* options, TTypeInfo* types);
+
+#endif // SWITCH_CONVERTER_H
@@ -0,0 +1,37 @@
+#ifndef TYPE_INFERENCE_H
+#define TYPE_INFERENCE_H
+
+#include "node.h"
+#include "vector.h"
+
+#include <stdbool.h>
+
+// Типы переменных одной функции; для кода вне функций name == NULL
+struct TScopeTypes {
+    const char* name;
+    Vector locals;
+    Vector floats; // переменные типа double
+    bool returnsFloat;
+};
+
+// Тип переменной один на всю область видимости: double, если ей хоть раз присваивается вещественное значение.
+// Типы выводятся один раз по исходной программе, а оптимизации сообщают о новых переменных через
+// MarkFloatVariable: после встраивания или удаления вызовов повторный вывод дал бы другие типы
+struct TTypeInfo {
+    Vector globals;
+    TScopeTypes* scopes; // scopes[0] - глобальная область
+    size_t scopeCount;
+};
+
+void InferTypes(tNode* root, TTypeInfo* types);
+void TypeInfoDtor(TTypeInfo* types);
+
+bool IsFloatLiteral(tNode* node);
+double GetFloatValue(tNode* node);
+bool IsFloatVariable(TTypeInfo* types, tNode* function, const char* name);
+bool IsFloatFunction(TTypeInfo* types, const char* name);
+bool IsFloatExpression(TTypeInfo* types, tNode* function, tNode* node);
+void MarkFloatVariable(TTypeInfo* types, tNode* function, const char* name);
+void CopyFunctionTypes(TTypeInfo* types, tNode* function, tNode* copy);
+
+#endif // TYPE_INFERENCE_H
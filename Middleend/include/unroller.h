@@ -0,0 +1,9 @@
+#ifndef UNROLLER_H
+#define UNROLLER_H
+
+#include "node.h"
+#include "options.h"
+
+tNode* UnrollLoops(tNode* root, const Options* options);
+
+#endif // UNROLLER_H
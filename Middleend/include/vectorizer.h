@@ -0,0 +1,28 @@
+#ifndef VECTORIZER_H
+#define VECTORIZER_H
+
+#include "node.h"
+#include "vector.h"
+#include "options.h"
+#include "typeInference.h"
+
+const int kVectorRegisters = 16; // xmm0..xmm15, они же младшие половины ymm0..ymm15
+
+// Цикл while ( i < n ) { ... ; i = i + 1 ; }, тело которого - поэлементные a [ i ] = expr и суммы s = s + expr.
+// Временные значения занимают векторные регистры с нулевого, инварианты и суммы - с последнего вниз
+struct TVectorLoop {
+    const char* counter;
+    tNode* limit;
+    bool isFloat; // элементы double, иначе целые
+    Vector invariants; // числа и переменные, которые не меняются в цикле
+    Vector reductions; // имена сумм
+};
+
+tNode* VectorizeLoops(tNode* root, const Options* options, TTypeInfo* types);
+bool MatchVectorLoop(tNode* loop, tNode* function, TTypeInfo* types, bool allowFloatReductions, TVectorLoop* vector);
+void VectorLoopDtor(TVectorLoop* vector);
+tNode* GetReductionOperand(tNode* statement);
+int GetInvariantRegister(TVectorLoop* vector, tNode* node);
+int GetReductionRegister(TVectorLoop* vector, const char* name);
+
+#endif // VECTORIZER_H
@@ -0,0 +1,488 @@
+#include "astUtils.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tree.h"
+
+const size_t kMaxLengthOfNumberString = 32;
+const size_t kInitialSizeOfFunctionTable = 16;
+
+// static ------------------------------------------------------------------------------------------
+
+static void CollectAssigned(tNode* node, Vector* globals, Vector* locals);
+static void AddFunctions(TFunctionTable* table, tNode* node);
+static void CountCallsIn(TFunctionTable* table, tNode* node, bool isAdded);
+static size_t HashName(const char* name);
+static bool IsRemovedFunction(const TFunctionTable* table, tNode* node);
+static void InsertSlot(TFunctionTable* table, size_t index);
+
+// global ------------------------------------------------------------------------------------------
+
+Operations GetOperationType(const char* const word) {
+    assert(word);          
+
+         if (!strcmp(word, "if"    )) return If;                // done
+    else if (!strcmp(word, "+"     )) return Add;               // done
+    else if (!strcmp(word, "-"     )) return Sub;               // done
+    else if (!strcmp(word, "*"     )) return Mul;               // done
+    else if (!strcmp(word, "/"     )) return Div;               // done
+    else if (!strcmp(word, "sin"   )) return Sin; // done
+    else if (!strcmp(word, "cos"   )) return Cos; // done
+    else if (!strcmp(word, "sqrt"  )) return Sqrt; // done
+    else if (!strcmp(word, "<"     )) return Less;              // done
+    else if (!strcmp(word, "while" )) return While;             // done
+    else if (!strcmp(word, "="     )) return Equal;             // done
+    else if (!strcmp(word, "print" )) return Print;             // done
+    else if (!strcmp(word, "return")) return Return; // done
+    else if (!strcmp(word, ">"     )) return Greater;           // done
+    else if (!strcmp(word, ";"     )) return Semicolon;         // done
+    else if (!strcmp(word, "=="    )) return Identical;         // done
+    else if (!strcmp(word, "<="    )) return LessOrEqual;       // done
+    else if (!strcmp(word, "!="    )) return NotIdentical;      // done
+    else if (!strcmp(word, ">="    )) return GreaterOrEqual;    // done
+    else if (!strcmp(word, "["     )) return Index;
+    else if (!strcmp(word, "[]="   )) return Store;
+    else if (!strcmp(word, "array" )) return Array;
+    else if (!strcmp(word, "simd_while")) return VectorWhile;
+    else if (!strcmp(word, "memoize")) return Memoize;
+    else if (!strcmp(word, "parallel_while")) return ParallelWhile;
+    else if (!strcmp(word, "select_if")) return SelectIf;
+    else if (!strcmp(word, "import")) return Import;
+    else if (!strcmp(word, "switch")) return Switch;
+
+    else return NoOperation;
+}
+
+bool IsOperation(tNode* node, Operations op) {
+    return node && (node->type == Operation) && (GetOperationType(node->value) == op);
+}
+
+size_t CountNodes(tNode* node) {
+    return (node) ? 1 + CountNodes(node->left) + CountNodes(node->right) : 0;
+}
+
+// Параметры и аргументы хранятся цепочкой по left
+size_t CountChain(tNode* node) {
+    size_t count = 0;
+    for (; node; node = node->left) {
+        count++;
+    }
+    return count;
+}
+
+tNode* NewNumberNode(long long value) {
+    char buffer[kMaxLengthOfNumberString] = "";
+    snprintf(buffer, kMaxLengthOfNumberString, "%llu", (unsigned long long)value);
+
+    return newNode(Number, storeString(buffer), NULL, NULL);
+}
+
+// Значение целой константы, если она не больше kMaxSafeNumber
+bool GetNumber(tNode* node, long long* value) {
+    if (!node || node->type != Number) {
+        return false;
+    }
+
+    char* end = NULL;
+    unsigned long long number = strtoull(node->value, &end, 10);
+    if (*end || number > (unsigned long long)kMaxSafeNumber) {
+        return false;
+    }
+
+    *value = (long long)number;
+    return true;
+}
+
+// --separate: функция другого модуля, от которой осталось только объявление - параметры и типы
+bool IsImported(tNode* function) {
+    return function && function->type == Function && IsOperation(function->right, Import);
+}
+
+tNode* FindFunction(tNode* root, const char* name) {
+    if (!root) {
+        return NULL;
+    }
+    if (root->type == Function) {
+        return (!strcmp(root->value, name)) ? root : NULL;
+    }
+    if (!IsOperation(root, Semicolon)) {
+        return NULL;
+    }
+
+    tNode* function = FindFunction(root->left, name);
+    return (function) ? function : FindFunction(root->right, name);
+}
+
+// Вырезает оператор из цепочки ';' и освобождает его, возвращает новый корень
+tNode* RemoveStatement(tNode* root, tNode* statement) {
+    if (!root || root == statement) {
+        return root; // пустую программу не строим
+    }
+    if (!IsOperation(root, Semicolon)) {
+        return root;
+    }
+
+    if (root->left == statement || root->right == statement) {
+        tNode* rest = (root->left == statement) ? root->right : root->left;
+        treeDtor(statement);
+        root->left = NULL;
+        root->right = NULL;
+        treeDtor(root);
+        return rest;
+    }
+
+    root->left = RemoveStatement(root->left, statement);
+    root->right = RemoveStatement(root->right, statement);
+    return root;
+}
+
+tNode* GetLastStatement(tNode* node) {
+    while (IsOperation(node, Semicolon)) {
+        node = node->right;
+    }
+    return node;
+}
+
+tNode* AppendStatement(tNode* sequence, tNode* statement) {
+    return (sequence) ? newNode(Operation, keySemicolon, sequence, statement) : statement;
+}
+
+bool IsSameTree(tNode* first, tNode* second) {
+    if (!first || !second) {
+        return first == second;
+    }
+
+    return first->type == second->type && !strcmp(first->value, second->value)
+        && IsSameTree(first->left, second->left) && IsSameTree(first->right, second->right);
+}
+
+bool ContainsParallelLoop(tNode* node) {
+    if (!node) {
+        return false;
+    }
+    return IsOperation(node, ParallelWhile) || ContainsParallelLoop(node->left) || ContainsParallelLoop(node->right);
+}
+
+bool ContainsCalling(tNode* node) {
+    if (!node) {
+        return false;
+    }
+    return node->type == Calling || ContainsCalling(node->left) || ContainsCalling(node->right);
+}
+
+size_t CountCalls(tNode* node, const char* name) {
+    if (!node) {
+        return 0;
+    }
+
+    size_t count = (node->type == Calling && !strcmp(node->value, name)) ? 1 : 0;
+    return count + CountCalls(node->left, name) + CountCalls(node->right, name);
+}
+
+// Функции ищутся там же, где их находит FindFunction: в цепочке ';' верхнего уровня
+void FunctionTableCtor(TFunctionTable* table, tNode* root) {
+    assert(table);
+
+    *table = {};
+    table->slotCount = 2 * kInitialSizeOfFunctionTable;
+    table->slots = (size_t*)calloc(table->slotCount, sizeof(size_t));
+    assert(table->slots);
+
+    AddFunctions(table, root);
+    AddCalls(table, root);
+}
+
+void FunctionTableDtor(TFunctionTable* table) {
+    free(table->entries);
+    free(table->slots);
+    *table = {};
+}
+
+// Повторное определение получает запись, но по имени находится первое, как в FindFunction
+void AddFunction(TFunctionTable* table, tNode* function) {
+    if (table->count == table->capacity) {
+        table->capacity = (table->capacity) ? 2 * table->capacity : kInitialSizeOfFunctionTable;
+        table->entries = (TFunctionEntry*)realloc(table->entries, table->capacity * sizeof(TFunctionEntry));
+        assert(table->entries);
+    }
+    table->entries[table->count++] = {
+        .name = function->value,
+        .function = function,
+        .calls = 0,
+        .isRemoved = false,
+    };
+
+    if (2 * table->count > table->slotCount) {
+        free(table->slots);
+        table->slotCount *= 2;
+        table->slots = (size_t*)calloc(table->slotCount, sizeof(size_t));
+        assert(table->slots);
+        for (size_t i = 0; i < table->count; i++) {
+            InsertSlot(table, i);
+        }
+    } else {
+        InsertSlot(table, table->count - 1);
+    }
+}
+
+// Номер записи функции или count, если ее нет
+size_t GetFunctionIndex(const TFunctionTable* table, const char* name) {
+    size_t mask = table->slotCount - 1;
+    for (size_t i = HashName(name) & mask; table->slots[i]; i = (i + 1) & mask) {
+        if (!strcmp(table->entries[table->slots[i] - 1].name, name)) {
+            return table->slots[i] - 1;
+        }
+    }
+    return table->count;
+}
+
+tNode* LookupFunction(const TFunctionTable* table, const char* name) {
+    size_t index = GetFunctionIndex(table, name);
+    return (index < table->count && !table->entries[index].isRemoved) ? table->entries[index].function : NULL;
+}
+
+size_t GetCallCount(const TFunctionTable* table, const char* name) {
+    size_t index = GetFunctionIndex(table, name);
+    return (index < table->count) ? table->entries[index].calls : 0;
+}
+
+// Вызовы в поддереве, которое появилось в программе (копия тела) или уходит из нее
+void AddCalls(TFunctionTable* table, tNode* node) {
+    CountCallsIn(table, node, true);
+}
+
+void RemoveCalls(TFunctionTable* table, tNode* node) {
+    CountCallsIn(table, node, false);
+}
+
+// Вызовы из тела больше не считаются, а имя больше не находит функцию. Сами узлы удаляет RemoveFunctions
+void RemoveFunction(TFunctionTable* table, tNode* function) {
+    RemoveCalls(table, function->right);
+    size_t index = GetFunctionIndex(table, function->value);
+    if (index < table->count && table->entries[index].function == function) {
+        table->entries[index].isRemoved = true;
+    }
+}
+
+// Удаляет все функции, убранные RemoveFunction, одним обходом программы (RemoveStatement на каждую обходил бы
+// ее заново). Как и RemoveStatement, единственный оператор не удаляет
+tNode* RemoveFunctions(tNode* root, const TFunctionTable* table) {
+    if (!IsOperation(root, Semicolon)) {
+        return root;
+    }
+
+    root->left = RemoveFunctions(root->left, table);
+    root->right = RemoveFunctions(root->right, table);
+    tNode* statement = NULL;
+    tNode* rest = NULL;
+    if (IsRemovedFunction(table, root->left)) {
+        statement = root->left;
+        rest = root->right;
+    } else if (IsRemovedFunction(table, root->right)) {
+        statement = root->right;
+        rest = root->left;
+    } else {
+        return root;
+    }
+
+    treeDtor(statement);
+    root->left = NULL;
+    root->right = NULL;
+    treeDtor(root);
+    return rest;
+}
+
+// Аргументы вызова лежат в обратном порядке: последний - в корне цепочки
+size_t GetArguments(tNode* call, tNode** args) {
+    size_t count = CountChain(call->left);
+    assert(count <= kMaxArguments);
+
+    size_t i = count;
+    for (tNode* arg = call->left; arg; arg = arg->left) {
+        args[--i] = arg;
+    }
+    return count;
+}
+
+size_t CountReferences(tNode* node, const char* name) {
+    if (!node) {
+        return 0;
+    }
+
+    size_t count = (node->type == Identifier && !strcmp(node->value, name)) ? 1 : 0;
+    return count + CountReferences(node->left, name) + CountReferences(node->right, name);
+}
+
+size_t CountAssignments(tNode* node, const char* name) {
+    if (!node) {
+        return 0;
+    }
+
+    size_t count = (IsOperation(node, Equal) && !strcmp(node->left->value, name)) ? 1 : 0;
+    return count + CountAssignments(node->left, name) + CountAssignments(node->right, name);
+}
+
+bool ContainsName(const Vector* names, const char* name) {
+    for (size_t i = 0; i < names->size; i++) {
+        if (!strcmp((const char*)names->data[i], name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AddName(Vector* names, const char* name) {
+    if (!ContainsName(names, name)) {
+        vectorPush(names, const_cast<char*>(name));
+    }
+}
+
+// Глобальные переменные - все, что упоминается вне функций (так же считает nasmGen)
+void CollectGlobals(tNode* node, Vector* globals) {
+    if (!node || node->type == Function) {
+        return;
+    }
+
+    if (node->type == Identifier) {
+        AddName(globals, node->value);
+    }
+
+    CollectGlobals(node->left, globals);
+    CollectGlobals(node->right, globals);
+}
+
+// Локальные переменные функции: параметры и все, чему она присваивает, кроме глобальных
+void CollectLocals(tNode* function, Vector* globals, Vector* locals) {
+    assert(function && function->type == Function);
+
+    for (tNode* param = function->left; param; param = param->left) {
+        AddName(locals, param->value);
+    }
+    CollectAssigned(function->right, globals, locals);
+}
+
+void CollectAssignments(tNode* node, Vector* names) {
+    if (!node) {
+        return;
+    }
+
+    if (IsOperation(node, Equal)) {
+        AddName(names, node->left->value);
+    }
+
+    CollectAssignments(node->left, names);
+    CollectAssignments(node->right, names);
+}
+
+bool IsAssigned(tNode* node, const char* name) {
+    if (!node) {
+        return false;
+    }
+    if (IsOperation(node, Equal) && !strcmp(node->left->value, name)) {
+        return true;
+    }
+    return IsAssigned(node->left, name) || IsAssigned(node->right, name);
+}
+
+// Переменная используется как массив: a [ i ] или a [ i ] = x
+bool IsIndexed(tNode* node, const char* name) {
+    if (!node) {
+        return false;
+    }
+    if (IsOperation(node, Index) && node->left->type == Identifier && !strcmp(node->left->value, name)) {
+        return true;
+    }
+    return IsIndexed(node->left, name) || IsIndexed(node->right, name);
+}
+
+void RenameVariable(tNode* node, const char* name, const char* newName) {
+    if (!node) {
+        return;
+    }
+    if (node->type == Identifier && !strcmp(node->value, name)) {
+        node->value = newName;
+    }
+
+    RenameVariable(node->left, name, newName);
+    RenameVariable(node->right, name, newName);
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void CollectAssigned(tNode* node, Vector* globals, Vector* locals) {
+    if (!node) {
+        return;
+    }
+
+    if (IsOperation(node, Equal) && !ContainsName(globals, node->left->value)) {
+        AddName(locals, node->left->value);
+    }
+
+    CollectAssigned(node->left, globals, locals);
+    CollectAssigned(node->right, globals, locals);
+}
+
+static void AddFunctions(TFunctionTable* table, tNode* node) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        AddFunction(table, node);
+    } else if (IsOperation(node, Semicolon)) {
+        AddFunctions(table, node->left);
+        AddFunctions(table, node->right);
+    }
+}
+
+static void CountCallsIn(TFunctionTable* table, tNode* node, bool isAdded) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Calling) {
+        size_t index = GetFunctionIndex(table, node->value);
+        if (index < table->count && isAdded) {
+            table->entries[index].calls++;
+        } else if (index < table->count) {
+            assert(table->entries[index].calls);
+            table->entries[index].calls--;
+        }
+        return; // left - цепочка аргументов
+    }
+    CountCallsIn(table, node->left, isAdded);
+    CountCallsIn(table, node->right, isAdded);
+}
+
+static size_t HashName(const char* name) {
+    size_t hash = 14695981039346656037ULL; // FNV-1a
+    for (const char* c = name; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool IsRemovedFunction(const TFunctionTable* table, tNode* node) {
+    if (!node || node->type != Function) {
+        return false;
+    }
+    size_t index = GetFunctionIndex(table, node->value);
+    return index < table->count && table->entries[index].isRemoved && table->entries[index].function == node;
+}
+
+// Первое определение имени остается в таблице: повторное не занимает ячейку
+static void InsertSlot(TFunctionTable* table, size_t index) {
+    size_t mask = table->slotCount - 1;
+    const char* name = table->entries[index].name;
+    for (size_t i = HashName(name) & mask; ; i = (i + 1) & mask) {
+        if (!table->slots[i]) {
+            table->slots[i] = index + 1;
+            return;
+        }
+        if (!strcmp(table->entries[table->slots[i] - 1].name, name)) {
+            return;
+        }
+    }
+}
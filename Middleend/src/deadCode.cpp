@@ -0,0 +1,507 @@
+#include "deadCode.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tree.h"
+#include "dsl.h"
+#include "vector.h"
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfNameVector = 16;
+const size_t kInitialSizeOfStatementVector = 32;
+
+struct TDeadCode {
+    Vector globals; // живы после конца функции и при любом вызове
+    Vector shared; // глобальные, которые упоминают функции: присваивания им на верхнем уровне не удаляются
+    tNode* function; // функция, тело которой обрабатывается, на верхнем уровне - NULL
+    bool changed;
+};
+
+struct TBlock {
+    Vector statements;
+    Vector semicolons; // узлы цепочки, которые освобождаются, если блок собирается заново
+};
+
+static tNode* SimplifyBlock(TDeadCode* dce, tNode* block);
+static tNode* KeepReadLocals(TDeadCode* dce, tNode* function, Vector* assigned);
+static bool GetConstantCondition(tNode* condition, bool* value);
+static bool IsLastDefinition(TDeadCode* dce, const char* name);
+static tNode* RemoveUnusedAssignments(TDeadCode* dce, tNode* node, Vector* reads);
+static void CollectReads(tNode* node, Vector* reads);
+static void CollectSharedNames(tNode* node, Vector* globals, Vector* shared);
+static tNode* EliminateDeadStores(TDeadCode* dce, tNode* root);
+static tNode* ProcessBlock(TDeadCode* dce, tNode* block, Vector* live, bool isRemoving, bool isTopLevel);
+static bool ProcessStatement(TDeadCode* dce, tNode* statement, Vector* live, bool isRemoving, bool isTopLevel);
+static void ProcessLoop(TDeadCode* dce, tNode* loop, Vector* live, bool isRemoving, bool isTopLevel);
+static void AddUses(TDeadCode* dce, tNode* node, Vector* live);
+static void RemoveName(Vector* names, const char* name);
+static void CopyNames(Vector* destination, Vector* source);
+static void FlattenBlock(tNode* node, Vector* statements, Vector* semicolons);
+static tNode* BuildBlock(tNode* block, TBlock* old, Vector* statements);
+static void BlockCtor(TBlock* block, tNode* node);
+static void BlockDtor(TBlock* block);
+static void FreeSemicolons(TBlock* block);
+
+// global ------------------------------------------------------------------------------------------
+
+// Удаляются if и while с ложным условием, код после return, присваивания переменным, которые нигде не читаются
+// (глобальные пропадают из .data), и присваивания, значение которых перезаписывается до чтения.
+// Присваивание с вызовом функции остается: у вызова могут быть побочные эффекты
+tNode* EliminateDeadCode(tNode* root, const Options* options) {
+    if (!options->enableDeadCodeElimination || !root) {
+        return root;
+    }
+
+    TDeadCode dce = {};
+    vectorInit(&dce.globals, kInitialSizeOfNameVector);
+    vectorInit(&dce.shared, kInitialSizeOfNameVector);
+    CollectGlobals(root, &dce.globals);
+    CollectSharedNames(root, &dce.globals, &dce.shared);
+
+    dce.changed = true;
+    while (dce.changed && root) {
+        dce.changed = false;
+        root = SimplifyBlock(&dce, root);
+
+        Vector reads = {};
+        vectorInit(&reads, kInitialSizeOfNameVector);
+        CollectReads(root, &reads);
+        root = RemoveUnusedAssignments(&dce, root, &reads);
+        vectorFree(&reads);
+
+        root = EliminateDeadStores(&dce, root);
+    }
+
+    vectorFree(&dce.shared);
+    vectorFree(&dce.globals);
+    return (root) ? root : NewNumberNode(0); // пустую программу не строим
+}
+
+// static ------------------------------------------------------------------------------------------
+
+// Условия из констант вычисляются, операторы после return недостижимы
+static tNode* SimplifyBlock(TDeadCode* dce, tNode* block) {
+    TBlock old = {};
+    BlockCtor(&old, block);
+    Vector* statements = &old.statements;
+
+    Vector kept = {};
+    vectorInit(&kept, kInitialSizeOfStatementVector);
+    bool isReachable = true;
+    for (size_t i = 0; i < statements->size; i++) {
+        tNode* statement = (tNode*)statements->data[i];
+        bool condition = false;
+
+        if (statement->type == Function) {
+            Vector assigned = {};
+            vectorInit(&assigned, kInitialSizeOfNameVector);
+            CollectAssignments(statement->right, &assigned);
+            statement->right = SimplifyBlock(dce, statement->right);
+            statement->right = KeepReadLocals(dce, statement, &assigned);
+            vectorFree(&assigned);
+            vectorPush(&kept, statement); // определения функций не исполняются
+            continue;
+        }
+        if (!isReachable) {
+            treeDtor(statement);
+            dce->changed = true;
+            continue;
+        }
+
+        if ((IsOperation(statement, If) || IsOperation(statement, While))
+            && GetConstantCondition(statement->left, &condition) && !condition) {
+            treeDtor(statement);
+            dce->changed = true;
+            continue;
+        }
+        if (IsOperation(statement, If) && GetConstantCondition(statement->left, &condition)) {
+            tNode* body = SimplifyBlock(dce, statement->right);
+            statement->right = NULL;
+            treeDtor(statement);
+            dce->changed = true;
+
+            TBlock inner = {};
+            BlockCtor(&inner, body);
+            for (size_t j = 0; j < inner.statements.size; j++) {
+                vectorPush(&kept, inner.statements.data[j]);
+                isReachable = isReachable && !IsOperation((tNode*)inner.statements.data[j], Return);
+            }
+            FreeSemicolons(&inner);
+            BlockDtor(&inner);
+            continue;
+        }
+
+        if (IsOperation(statement, If) || IsOperation(statement, While) || IsOperation(statement, ParallelWhile)
+            || IsOperation(statement, VectorWhile)) {
+            statement->right = SimplifyBlock(dce, statement->right);
+        }
+        if (IsOperation(statement, If) && !statement->right) {
+            treeDtor(statement); // условие без вызовов, поэтому пустой if ничего не делает
+            dce->changed = true;
+            continue;
+        }
+        vectorPush(&kept, statement);
+        isReachable = !IsOperation(statement, Return);
+    }
+
+    tNode* result = BuildBlock(block, &old, &kept);
+    vectorFree(&kept);
+    BlockDtor(&old);
+    return result;
+}
+
+// Удаленный код мог содержать все присваивания локальной переменной, которую функция еще читает:
+// без присваивания генератор не найдет переменную, поэтому она получает 0 в начале тела, как в кадре вызова
+static tNode* KeepReadLocals(TDeadCode* dce, tNode* function, Vector* assigned) {
+    tNode* body = function->right;
+    for (size_t i = 0; i < assigned->size; i++) {
+        const char* name = (const char*)assigned->data[i];
+        if (!IsAssigned(body, name) && CountReferences(body, name) && !CountReferences(function->left, name)
+            && !ContainsName(&dce->globals, name)) {
+            body = SEMICOLON(EQUAL(VAR(name), NewNumberNode(0)), body);
+        }
+    }
+    return body;
+}
+
+// Целое число или сравнение двух целых чисел
+static bool GetConstantCondition(tNode* condition, bool* value) {
+    long long left = 0;
+    long long right = 0;
+    if (GetNumber(condition, &left)) {
+        *value = (left != 0);
+        return true;
+    }
+    if (!condition || condition->type != Operation
+        || !GetNumber(condition->left, &left) || !GetNumber(condition->right, &right)) {
+        return false;
+    }
+
+    switch (GetOperationType(condition->value)) {
+        case Less:              *value = (left <  right); return true;
+        case Greater:           *value = (left >  right); return true;
+        case Identical:         *value = (left == right); return true;
+        case LessOrEqual:       *value = (left <= right); return true;
+        case NotIdentical:      *value = (left != right); return true;
+        case GreaterOrEqual:    *value = (left >= right); return true;
+        default:                return false;
+    }
+}
+
+// Присваивание переменной, которую не читает ни одна функция и ни один оператор программы
+static tNode* RemoveUnusedAssignments(TDeadCode* dce, tNode* node, Vector* reads) {
+    if (!node) {
+        return NULL;
+    }
+
+    if (IsOperation(node, Equal) && !ContainsName(reads, node->left->value) && !ContainsCalling(node->right)) {
+        treeDtor(node);
+        dce->changed = true;
+        return NULL;
+    }
+    if (node->type == Function || IsOperation(node, Semicolon) || IsOperation(node, If)
+        || IsOperation(node, While) || IsOperation(node, ParallelWhile) || IsOperation(node, VectorWhile)) {
+        node->right = RemoveUnusedAssignments(dce, node->right, reads);
+    }
+    if (IsOperation(node, Semicolon)) {
+        node->left = RemoveUnusedAssignments(dce, node->left, reads);
+        if (!node->left || !node->right) {
+            tNode* rest = (node->left) ? node->left : node->right;
+            node->left = NULL;
+            node->right = NULL;
+            treeDtor(node);
+            return rest;
+        }
+    }
+    if (IsOperation(node, If) && !node->right) {
+        treeDtor(node);
+        return NULL;
+    }
+    return node;
+}
+
+// Все упоминания имен, кроме левой части присваивания и параметров функции
+static void CollectReads(tNode* node, Vector* reads) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Identifier) {
+        AddName(reads, node->value);
+    }
+    if (node->type != Function && !IsOperation(node, Equal)) {
+        CollectReads(node->left, reads);
+    }
+    CollectReads(node->right, reads);
+}
+
+// Имя становится глобальным, только пока его упоминает верхний уровень
+static void CollectSharedNames(tNode* node, Vector* globals, Vector* shared) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        Vector names = {};
+        vectorInit(&names, kInitialSizeOfNameVector);
+        CollectReads(node->right, &names);
+        CollectAssignments(node->right, &names);
+        for (size_t i = 0; i < names.size; i++) {
+            if (ContainsName(globals, (const char*)names.data[i])) {
+                AddName(shared, (const char*)names.data[i]);
+            }
+        }
+        vectorFree(&names);
+        return;
+    }
+    if (IsOperation(node, Semicolon)) {
+        CollectSharedNames(node->left, globals, shared);
+        CollectSharedNames(node->right, globals, shared);
+    }
+}
+
+// Анализ живых переменных от конца блока к началу: после функции живы все глобальные, после программы - никто
+static tNode* EliminateDeadStores(TDeadCode* dce, tNode* root) {
+    TBlock block = {};
+    BlockCtor(&block, root);
+    for (size_t i = 0; i < block.statements.size; i++) {
+        tNode* function = (tNode*)block.statements.data[i];
+        if (function->type != Function) {
+            continue;
+        }
+
+        Vector live = {};
+        vectorInit(&live, kInitialSizeOfNameVector);
+        CopyNames(&live, &dce->globals);
+        dce->function = function;
+        function->right = ProcessBlock(dce, function->right, &live, true, false);
+        dce->function = NULL;
+        vectorFree(&live);
+    }
+    BlockDtor(&block);
+
+    Vector live = {};
+    vectorInit(&live, kInitialSizeOfNameVector);
+    root = ProcessBlock(dce, root, &live, true, true);
+    vectorFree(&live);
+    return root;
+}
+
+// Единственное присваивание локальной переменной, которую функция еще читает
+static bool IsLastDefinition(TDeadCode* dce, const char* name) {
+    tNode* function = dce->function;
+    if (!function || ContainsName(&dce->globals, name) || CountReferences(function->left, name)) {
+        return false;
+    }
+
+    return CountAssignments(function->right, name) == 1
+        && CountReferences(function->right, name) > 1;
+}
+
+// live на входе - живые после блока, на выходе - перед ним. Без isRemoving блок только анализируется
+static tNode* ProcessBlock(TDeadCode* dce, tNode* block, Vector* live, bool isRemoving, bool isTopLevel) {
+    TBlock old = {};
+    BlockCtor(&old, block);
+    Vector* statements = &old.statements;
+
+    bool* isDead = (bool*)calloc(statements->size + 1, sizeof(bool));
+    assert(isDead);
+    for (size_t i = statements->size; i-- > 0;) {
+        isDead[i] = !ProcessStatement(dce, (tNode*)statements->data[i], live, isRemoving, isTopLevel);
+    }
+
+    tNode* result = block;
+    if (isRemoving) {
+        Vector kept = {};
+        vectorInit(&kept, kInitialSizeOfStatementVector);
+        for (size_t i = 0; i < statements->size; i++) {
+            if (isDead[i]) {
+                treeDtor((tNode*)statements->data[i]);
+                dce->changed = true;
+            } else {
+                vectorPush(&kept, statements->data[i]);
+            }
+        }
+        result = BuildBlock(block, &old, &kept);
+        vectorFree(&kept);
+    }
+
+    free(isDead);
+    BlockDtor(&old);
+    return result;
+}
+
+// Возвращает false, если оператор можно удалить
+static bool ProcessStatement(TDeadCode* dce, tNode* statement, Vector* live, bool isRemoving, bool isTopLevel) {
+    if (statement->type == Function) {
+        return true;
+    }
+
+    switch ((statement->type == Operation) ? GetOperationType(statement->value) : NoOperation) {
+        case Equal: {
+            const char* name = statement->left->value;
+            bool isKept = ContainsName(live, name) || ContainsCalling(statement->right)
+                       || (isTopLevel && ContainsName(&dce->shared, name));
+            if (!isKept && IsLastDefinition(dce, name)) {
+                // значение не читается, но без присваивания генератор не найдет переменную
+                long long value = 0;
+                if (isRemoving && !(GetNumber(statement->right, &value) && value == 0)) {
+                    treeDtor(statement->right);
+                    statement->right = NewNumberNode(0);
+                    dce->changed = true;
+                }
+                return true;
+            }
+            if (!isKept) {
+                return false;
+            }
+            RemoveName(live, name);
+            AddUses(dce, statement->right, live);
+            return true;
+        }
+        case Return:
+            live->size = 0;
+            CopyNames(live, &dce->globals);
+            AddUses(dce, statement->left, live);
+            return true;
+        case If: {
+            Vector body = {};
+            vectorInit(&body, kInitialSizeOfNameVector);
+            CopyNames(&body, live);
+            statement->right = ProcessBlock(dce, statement->right, &body, isRemoving, isTopLevel);
+            CopyNames(live, &body);
+            vectorFree(&body);
+            AddUses(dce, statement->left, live);
+            return statement->right != NULL;
+        }
+        case While:
+        case ParallelWhile:
+        case VectorWhile:
+            ProcessLoop(dce, statement, live, isRemoving, isTopLevel);
+            return true;
+        default:
+            AddUses(dce, statement, live);
+            return true;
+    }
+}
+
+// Живые перед циклом: неподвижная точка L = live после цикла + условие + живые перед телом при L после него
+static void ProcessLoop(TDeadCode* dce, tNode* loop, Vector* live, bool isRemoving, bool isTopLevel) {
+    Vector loopLive = {};
+    vectorInit(&loopLive, kInitialSizeOfNameVector);
+    CopyNames(&loopLive, live);
+    AddUses(dce, loop->left, &loopLive);
+
+    size_t size = 0;
+    while (size != loopLive.size) {
+        size = loopLive.size;
+
+        Vector body = {};
+        vectorInit(&body, kInitialSizeOfNameVector);
+        CopyNames(&body, &loopLive);
+        ProcessBlock(dce, loop->right, &body, false, isTopLevel);
+        CopyNames(&loopLive, &body);
+        vectorFree(&body);
+    }
+
+    if (isRemoving) {
+        Vector body = {};
+        vectorInit(&body, kInitialSizeOfNameVector);
+        CopyNames(&body, &loopLive);
+        loop->right = ProcessBlock(dce, loop->right, &body, true, isTopLevel);
+        vectorFree(&body);
+    }
+
+    CopyNames(live, &loopLive);
+    vectorFree(&loopLive);
+}
+
+// Вызов может прочитать любую глобальную переменную
+static void AddUses(TDeadCode* dce, tNode* node, Vector* live) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Identifier) {
+        AddName(live, node->value);
+    }
+    if (node->type == Calling) {
+        CopyNames(live, &dce->globals);
+    }
+    AddUses(dce, node->left, live);
+    AddUses(dce, node->right, live);
+}
+
+static void RemoveName(Vector* names, const char* name) {
+    for (size_t i = 0; i < names->size; i++) {
+        if (!strcmp((const char*)names->data[i], name)) {
+            names->data[i] = names->data[--names->size];
+            return;
+        }
+    }
+}
+
+static void CopyNames(Vector* destination, Vector* source) {
+    for (size_t i = 0; i < source->size; i++) {
+        AddName(destination, (const char*)source->data[i]);
+    }
+}
+
+static void BlockCtor(TBlock* block, tNode* node) {
+    vectorInit(&block->statements, kInitialSizeOfStatementVector);
+    vectorInit(&block->semicolons, kInitialSizeOfStatementVector);
+    FlattenBlock(node, &block->statements, &block->semicolons);
+}
+
+static void BlockDtor(TBlock* block) {
+    vectorFree(&block->statements);
+    vectorFree(&block->semicolons);
+}
+
+// Операторы цепочки ';' по порядку
+static void FlattenBlock(tNode* node, Vector* statements, Vector* semicolons) {
+    if (!node) {
+        return;
+    }
+    if (!IsOperation(node, Semicolon)) {
+        vectorPush(statements, node);
+        return;
+    }
+
+    vectorPush(semicolons, node);
+    FlattenBlock(node->left, statements, semicolons);
+    FlattenBlock(node->right, statements, semicolons);
+}
+
+// Если список операторов не изменился, старая цепочка остается, иначе собирается заново.
+// Удаленные операторы к этому моменту уже освобождены, поэтому старая цепочка не обходится
+static tNode* BuildBlock(tNode* block, TBlock* old, Vector* statements) {
+    bool isSame = (old->statements.size == statements->size);
+    for (size_t i = 0; i < statements->size && isSame; i++) {
+        isSame = (old->statements.data[i] == statements->data[i]);
+    }
+    if (isSame) {
+        return block;
+    }
+
+    FreeSemicolons(old);
+    tNode* result = NULL;
+    for (size_t i = 0; i < statements->size; i++) {
+        result = AppendStatement(result, (tNode*)statements->data[i]);
+    }
+    return result;
+}
+
+static void FreeSemicolons(TBlock* block) {
+    for (size_t i = 0; i < block->semicolons.size; i++) {
+        tNode* semicolon = (tNode*)block->semicolons.data[i];
+        semicolon->left = NULL;
+        semicolon->right = NULL;
+        treeDtor(semicolon);
+    }
+    block->semicolons.size = 0;
+}
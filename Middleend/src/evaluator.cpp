@@ -0,0 +1,686 @@
+#include "evaluator.h"
+
+#include <math.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tree.h"
+#include "dsl.h"
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfNameVector = 16;
+const size_t kMaxEvaluatedPrints = 1 << 12; // дальше цикл с print короче своего вывода
+const size_t kMaxEvaluationDepth = 1 << 10; // вызовы вычисляются рекурсией на стеке компилятора
+const size_t kMaxLengthOfFloatString = 32;
+
+struct TEvalArray;
+
+// double хранится битами, как в регистрах nasmGen. Адрес массива известен только машине: с ним
+// можно обращаться к элементам и передавать его дальше, но не считать
+struct TEvalValue {
+    union {
+        long long integer;
+        double real;
+    };
+    TEvalArray* array;
+};
+
+struct TEvalArray {
+    TEvalValue* elements;
+    size_t size;
+};
+
+struct TEvalFunction {
+    tNode* node;
+    Vector locals; // сначала параметры
+};
+
+enum TEvalStatus {
+    EvalNext,
+    EvalReturn, // значение в result; return вне функций завершает программу
+    EvalFailed, // бюджет исчерпан или результат знает только машина - код остается в программе
+};
+
+struct TEvaluator {
+    TTypeInfo* types;
+    bool libmTrigonometry; // встроенные многочлены sin и cos дают другие биты, чем libm
+    Vector globals;
+    TEvalValue* globalValues;
+    TEvalFunction* functions;
+    size_t functionCount;
+    TEvalFunction* function; // NULL - верхний уровень
+    TEvalValue* frame;
+    size_t depth;
+    Vector arrays;
+    Vector prints;
+    TEvalValue result;
+    size_t steps; // оставшийся бюджет
+    size_t memory; // оставшийся бюджет в байтах
+};
+
+static void CollectStatements(tNode* node, Vector* statements);
+static void CollectEvalFunctions(TEvaluator* evaluator, Vector* statements);
+static void SetInitialValues(TEvaluator* evaluator, tNode* node, TEvalValue* values, bool* isSet);
+static tNode* BuildProgram(TEvaluator* evaluator, Vector* statements, size_t done, size_t printCount,
+                           TEvalValue* state, bool isFinished);
+static void FreeSequence(tNode* node);
+static tNode* NewFloatNode(double value);
+static bool Step(TEvaluator* evaluator);
+static bool IsFloat(TEvaluator* evaluator, tNode* node);
+static bool IsEqualFloat(double first, double second);
+static int FindName(Vector* names, const char* name);
+static TEvalValue* FindVariable(TEvaluator* evaluator, const char* name);
+static TEvalFunction* FindEvalFunction(TEvaluator* evaluator, const char* name);
+
+static TEvalStatus ExecuteStatement(TEvaluator* evaluator, tNode* node);
+static TEvalStatus ExecutePrint(TEvaluator* evaluator, tNode* node);
+static bool EvaluateCondition(TEvaluator* evaluator, tNode* node, bool* isTrue);
+static bool EvaluateExpression(TEvaluator* evaluator, tNode* node, bool asFloat, TEvalValue* value);
+static bool EvaluateNumber(TEvaluator* evaluator, tNode* node, bool asFloat, TEvalValue* value);
+static bool EvaluateArithmetic(TEvaluator* evaluator, tNode* node, Operations op, TEvalValue* value);
+static bool EvaluateComparison(TEvaluator* evaluator, tNode* node, Operations op, TEvalValue* value);
+static bool EvaluateElement(TEvaluator* evaluator, tNode* node, TEvalValue** element);
+static bool EvaluateArray(TEvaluator* evaluator, tNode* node, TEvalValue* value);
+static bool EvaluateCall(TEvaluator* evaluator, tNode* node, TEvalValue* value);
+
+// global ------------------------------------------------------------------------------------------
+
+// Программа без ввода выполняется при компиляции, пока хватает бюджета шагов и памяти, и от нее остаются
+// операторы print с готовыми значениями. Если бюджета не хватило, начало верхнего уровня, выполненное до
+// первого массива, заменяется своим выводом и присваиваниями глобальных переменных
+tNode* EvaluateProgram(tNode* root, const Options* options, TTypeInfo* types) {
+    TEvaluator evaluator = {
+        .types = types,
+        .libmTrigonometry = options->preciseMath || options->outputFormat == VmOutput,
+        .globals = {},
+        .globalValues = NULL,
+        .functions = NULL,
+        .functionCount = 0,
+        .function = NULL,
+        .frame = NULL,
+        .depth = 0,
+        .arrays = {},
+        .prints = {},
+        .result = {},
+        .steps = options->evaluationSteps,
+        .memory = options->evaluationMemory,
+    };
+    vectorInit(&evaluator.globals, kInitialSizeOfNameVector);
+    vectorInit(&evaluator.arrays, kInitialSizeOfNameVector);
+    vectorInit(&evaluator.prints, kInitialSizeOfNameVector);
+    CollectGlobals(root, &evaluator.globals);
+
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfNameVector);
+    CollectStatements(root, &statements);
+    CollectEvalFunctions(&evaluator, &statements);
+
+    size_t globalCount = evaluator.globals.size;
+    evaluator.globalValues = (TEvalValue*)calloc(globalCount + 1, sizeof(TEvalValue));
+    TEvalValue* state = (TEvalValue*)calloc(globalCount + 1, sizeof(TEvalValue));
+    bool* isSet = (bool*)calloc(globalCount + 1, sizeof(bool));
+    assert(evaluator.globalValues && state && isSet);
+    for (size_t i = 0; i < statements.size; i++) {
+        SetInitialValues(&evaluator, (tNode*)statements.data[i], evaluator.globalValues, isSet);
+    }
+    free(isSet);
+    memcpy(state, evaluator.globalValues, globalCount * sizeof(TEvalValue));
+
+    // state - глобальные переменные после done первых операторов; массив в оставшийся код не перенести
+    size_t done = 0;
+    size_t printCount = 0;
+    TEvalStatus status = EvalNext;
+    for (size_t i = 0; i < statements.size && status == EvalNext; i++) {
+        status = ExecuteStatement(&evaluator, (tNode*)statements.data[i]);
+        if (status != EvalFailed && !evaluator.arrays.size) {
+            done = i + 1;
+            printCount = evaluator.prints.size;
+            memcpy(state, evaluator.globalValues, globalCount * sizeof(TEvalValue));
+        }
+    }
+
+    if (status != EvalFailed || done) {
+        FreeSequence(root);
+        root = BuildProgram(&evaluator, &statements, done, printCount, state, status != EvalFailed);
+    } else {
+        for (size_t i = 0; i < evaluator.prints.size; i++) {
+            treeDtor((tNode*)evaluator.prints.data[i]);
+        }
+    }
+
+    for (size_t i = 0; i < evaluator.arrays.size; i++) {
+        free(((TEvalArray*)evaluator.arrays.data[i])->elements);
+        free(evaluator.arrays.data[i]);
+    }
+    for (size_t i = 0; i < evaluator.functionCount; i++) {
+        vectorFree(&evaluator.functions[i].locals);
+    }
+    free(evaluator.functions);
+    free(evaluator.globalValues);
+    free(state);
+    vectorFree(&statements);
+    vectorFree(&evaluator.prints);
+    vectorFree(&evaluator.arrays);
+    vectorFree(&evaluator.globals);
+    return root;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void CollectStatements(tNode* node, Vector* statements) {
+    if (!node) {
+        return;
+    }
+
+    if (IsOperation(node, Semicolon)) {
+        CollectStatements(node->left, statements);
+        CollectStatements(node->right, statements);
+    } else {
+        vectorPush(statements, node);
+    }
+}
+
+static void CollectEvalFunctions(TEvaluator* evaluator, Vector* statements) {
+    evaluator->functions = (TEvalFunction*)calloc(statements->size + 1, sizeof(TEvalFunction));
+    assert(evaluator->functions);
+
+    for (size_t i = 0; i < statements->size; i++) {
+        tNode* node = (tNode*)statements->data[i];
+        if (node->type == Function) {
+            TEvalFunction* function = &evaluator->functions[evaluator->functionCount++];
+            function->node = node;
+            vectorInit(&function->locals, kInitialSizeOfNameVector);
+            CollectLocals(node, &evaluator->globals, &function->locals);
+        }
+    }
+}
+
+// Как в nasmGen: глобальная переменная получает значение литерала из своего первого присваивания
+static void SetInitialValues(TEvaluator* evaluator, tNode* node, TEvalValue* values, bool* isSet) {
+    if (!node || node->type == Function) {
+        return;
+    }
+
+    if (node->type == Identifier || IsOperation(node, Equal)) {
+        const char* name = (node->type == Identifier) ? node->value : node->left->value;
+        int index = FindName(&evaluator->globals, name);
+        if (index >= 0 && !isSet[index]) {
+            isSet[index] = true;
+            if (IsOperation(node, Equal) && node->right->type == Number) {
+                if (IsFloatVariable(evaluator->types, NULL, name)) {
+                    values[index].real = GetFloatValue(node->right);
+                } else {
+                    values[index].integer = (long long)strtoull(node->right->value, NULL, 10);
+                }
+            }
+        }
+    }
+
+    SetInitialValues(evaluator, node->left, values, isSet);
+    SetInitialValues(evaluator, node->right, values, isSet);
+}
+
+// Вывод выполненных операторов, затем присваивания, после которых у глобальных переменных значения
+// из state, затем невыполненные операторы. Присваивание не нужно, если такое же значение переменная
+// получит литералом из оставшегося кода. Функции остаются, только пока остался код
+static tNode* BuildProgram(TEvaluator* evaluator, Vector* statements, size_t done, size_t printCount,
+                           TEvalValue* state, bool isFinished) {
+    tNode* program = NULL;
+    for (size_t i = 0; i < statements->size && !isFinished; i++) {
+        tNode* statement = (tNode*)statements->data[i];
+        if (statement->type == Function) {
+            program = AppendStatement(program, statement);
+        }
+    }
+
+    for (size_t i = 0; i < evaluator->prints.size; i++) {
+        if (i < printCount || isFinished) {
+            program = AppendStatement(program, (tNode*)evaluator->prints.data[i]);
+        } else {
+            treeDtor((tNode*)evaluator->prints.data[i]);
+        }
+    }
+
+    if (!isFinished) {
+        TEvalValue* initial = (TEvalValue*)calloc(evaluator->globals.size + 1, sizeof(TEvalValue));
+        bool* isSet = (bool*)calloc(evaluator->globals.size + 1, sizeof(bool));
+        assert(initial && isSet);
+        for (size_t i = done; i < statements->size; i++) {
+            SetInitialValues(evaluator, (tNode*)statements->data[i], initial, isSet);
+        }
+
+        for (size_t i = 0; i < evaluator->globals.size; i++) {
+            if (state[i].integer == initial[i].integer) {
+                continue;
+            }
+            const char* name = (const char*)evaluator->globals.data[i];
+            tNode* value = (IsFloatVariable(evaluator->types, NULL, name)) ? NewFloatNode(state[i].real)
+                                                                            : NewNumberNode(state[i].integer);
+            program = AppendStatement(program, EQUAL(VAR(name), value));
+        }
+        free(initial);
+        free(isSet);
+
+        for (size_t i = done; i < statements->size; i++) {
+            tNode* statement = (tNode*)statements->data[i];
+            if (statement->type != Function) {
+                program = AppendStatement(program, statement);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < statements->size; i++) {
+        tNode* statement = (tNode*)statements->data[i];
+        if ((isFinished) ? true : (i < done && statement->type != Function)) {
+            treeDtor(statement);
+        }
+    }
+
+    return (program) ? program : NewNumberNode(0); // пустую программу не строим
+}
+
+// Удаляет узлы ; верхнего уровня, не трогая сами операторы
+static void FreeSequence(tNode* node) {
+    if (!IsOperation(node, Semicolon)) {
+        return;
+    }
+
+    FreeSequence(node->left);
+    FreeSequence(node->right);
+    node->left = NULL;
+    node->right = NULL;
+    treeDtor(node);
+}
+
+// %.17g восстанавливает то же double; целое значение получает точку, чтобы литерал остался вещественным
+static tNode* NewFloatNode(double value) {
+    char buffer[kMaxLengthOfFloatString] = "";
+    snprintf(buffer, kMaxLengthOfFloatString, "%.17g", value);
+    if (!buffer[strspn(buffer, "0123456789")]) {
+        strncat(buffer, ".0", kMaxLengthOfFloatString - strlen(buffer) - 1);
+    }
+
+    return newNode(Number, storeString(buffer), NULL, NULL);
+}
+
+static bool Step(TEvaluator* evaluator) {
+    if (!evaluator->steps) {
+        return false;
+    }
+
+    evaluator->steps--;
+    return true;
+}
+
+static bool IsFloat(TEvaluator* evaluator, tNode* node) {
+    return IsFloatExpression(evaluator->types, (evaluator->function) ? evaluator->function->node : NULL, node);
+}
+
+// Как ucomisd: nan не равно ничему
+static bool IsEqualFloat(double first, double second) {
+    return islessequal(first, second) && isgreaterequal(first, second);
+}
+
+static int FindName(Vector* names, const char* name) {
+    for (size_t i = 0; i < names->size; i++) {
+        if (!strcmp((const char*)names->data[i], name)) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static TEvalValue* FindVariable(TEvaluator* evaluator, const char* name) {
+    if (evaluator->function) {
+        int index = FindName(&evaluator->function->locals, name);
+        if (index >= 0) {
+            return &evaluator->frame[index];
+        }
+    }
+
+    int index = FindName(&evaluator->globals, name);
+    return (index >= 0) ? &evaluator->globalValues[index] : NULL;
+}
+
+static TEvalFunction* FindEvalFunction(TEvaluator* evaluator, const char* name) {
+    for (size_t i = 0; i < evaluator->functionCount; i++) {
+        if (!strcmp(evaluator->functions[i].node->value, name)) {
+            return &evaluator->functions[i];
+        }
+    }
+    return NULL;
+}
+
+// statements --------------------------------------------------------------------------------------
+
+static TEvalStatus ExecuteStatement(TEvaluator* evaluator, tNode* node) {
+    if (!node || node->type == Function) {
+        return EvalNext;
+    }
+    if (!Step(evaluator)) {
+        return EvalFailed;
+    }
+
+    TEvalValue value = {};
+    bool isTrue = false;
+    switch ((node->type == Operation) ? GetOperationType(node->value) : NoOperation) {
+        case Semicolon: {
+            TEvalStatus status = ExecuteStatement(evaluator, node->left);
+            return (status == EvalNext) ? ExecuteStatement(evaluator, node->right) : status;
+        }
+        case Equal: {
+            bool asFloat = IsFloat(evaluator, node->left) && !IsOperation(node->right, Array);
+            TEvalValue* variable = FindVariable(evaluator, node->left->value);
+            if (!variable || !EvaluateExpression(evaluator, node->right, asFloat, &value)) {
+                return EvalFailed;
+            }
+            *variable = value;
+            return EvalNext;
+        }
+        case Store: {
+            TEvalValue* element = NULL;
+            if (!EvaluateExpression(evaluator, node->right, IsFloat(evaluator, node->left), &value)
+                || !EvaluateElement(evaluator, node->left, &element)) {
+                return EvalFailed;
+            }
+            *element = value;
+            return EvalNext;
+        }
+        case While:
+        case VectorWhile:
+        case ParallelWhile:
+            while (true) {
+                if (!EvaluateCondition(evaluator, node->left, &isTrue)) {
+                    return EvalFailed;
+                }
+                if (!isTrue) {
+                    return EvalNext;
+                }
+                TEvalStatus status = ExecuteStatement(evaluator, node->right);
+                if (status != EvalNext) {
+                    return status;
+                }
+            }
+        case If:
+            if (!EvaluateCondition(evaluator, node->left, &isTrue)) {
+                return EvalFailed;
+            }
+            return (isTrue) ? ExecuteStatement(evaluator, node->right) : EvalNext;
+        case Return: {
+            bool asFloat = evaluator->function && IsFloatFunction(evaluator->types, evaluator->function->node->value);
+            return (EvaluateExpression(evaluator, node->left, asFloat, &evaluator->result)) ? EvalReturn : EvalFailed;
+        }
+        case Print:
+            return ExecutePrint(evaluator, node->left);
+        default:
+            return (EvaluateExpression(evaluator, node, false, &value)) ? EvalNext : EvalFailed;
+    }
+}
+
+static TEvalStatus ExecutePrint(TEvaluator* evaluator, tNode* node) {
+    bool isFloat = IsFloat(evaluator, node);
+    TEvalValue value = {};
+    if (evaluator->prints.size == kMaxEvaluatedPrints || !EvaluateNumber(evaluator, node, isFloat, &value)) {
+        return EvalFailed;
+    }
+
+    tNode* constant = (isFloat) ? NewFloatNode(value.real) : NewNumberNode(value.integer);
+    vectorPush(&evaluator->prints, PRINT(constant, NULL));
+    return EvalNext;
+}
+
+// Условие без сравнения истинно, если значение не равно нулю
+static bool EvaluateCondition(TEvaluator* evaluator, tNode* node, bool* isTrue) {
+    bool isFloat = IsFloat(evaluator, node);
+    TEvalValue value = {};
+    if (!EvaluateNumber(evaluator, node, isFloat, &value)) {
+        return false;
+    }
+
+    *isTrue = (isFloat) ? !IsEqualFloat(value.real, 0) : value.integer != 0;
+    return true;
+}
+
+// expressions -------------------------------------------------------------------------------------
+
+// asFloat - нужен double; целые значения переводятся, double в целом контексте передается битами
+static bool EvaluateExpression(TEvaluator* evaluator, tNode* node, bool asFloat, TEvalValue* value) {
+    if (!node || !Step(evaluator)) {
+        return false;
+    }
+
+    if (node->type == Number) {
+        *value = {};
+        if (asFloat || IsFloatLiteral(node)) {
+            value->real = GetFloatValue(node);
+        } else {
+            value->integer = (long long)strtoull(node->value, NULL, 10);
+        }
+        return true;
+    }
+    if (asFloat && !IsFloat(evaluator, node)) {
+        if (!EvaluateNumber(evaluator, node, false, value)) {
+            return false;
+        }
+        value->real = (double)value->integer;
+        return true;
+    }
+
+    if (node->type == Identifier) {
+        TEvalValue* variable = FindVariable(evaluator, node->value);
+        if (variable) {
+            *value = *variable;
+        }
+        return variable != NULL; // ошибку сообщит генератор
+    }
+    if (node->type == Calling) {
+        return EvaluateCall(evaluator, node, value);
+    }
+    if (node->type != Operation) {
+        return false;
+    }
+
+    Operations op = GetOperationType(node->value);
+    switch (op) {
+        case Add:
+        case Sub:
+        case Mul:
+        case Div:               return EvaluateArithmetic(evaluator, node, op, value);
+        case Identical:
+        case NotIdentical:
+        case Less:
+        case Greater:
+        case LessOrEqual:
+        case GreaterOrEqual:    return EvaluateComparison(evaluator, node, op, value);
+        case Sqrt:
+        case Sin:
+        case Cos: {
+            TEvalValue argument = {};
+            if ((op != Sqrt && !evaluator->libmTrigonometry) || !EvaluateNumber(evaluator, node->left, true, &argument)) {
+                return false;
+            }
+            *value = {};
+            value->real = (op == Sqrt) ? sqrt(argument.real) : (op == Sin) ? sin(argument.real) : cos(argument.real);
+            return true;
+        }
+        case Index: {
+            TEvalValue* element = NULL;
+            if (!EvaluateElement(evaluator, node, &element)) {
+                return false;
+            }
+            *value = *element;
+            return true;
+        }
+        case Array:             return EvaluateArray(evaluator, node, value);
+        default:                return false;
+    }
+}
+
+// Значение, с которым можно считать: не адрес массива
+static bool EvaluateNumber(TEvaluator* evaluator, tNode* node, bool asFloat, TEvalValue* value) {
+    return EvaluateExpression(evaluator, node, asFloat, value) && !value->array;
+}
+
+// Целые переполняются так же, как в машинном коде; деление на ноль оставляется машине
+static bool EvaluateArithmetic(TEvaluator* evaluator, tNode* node, Operations op, TEvalValue* value) {
+    bool isFloat = IsFloat(evaluator, node);
+    TEvalValue left = {};
+    TEvalValue right = {};
+    if (!EvaluateNumber(evaluator, node->left, isFloat, &left) || !EvaluateNumber(evaluator, node->right, isFloat, &right)) {
+        return false;
+    }
+
+    *value = {};
+    if (isFloat) {
+        switch (op) {
+            case Add:   value->real = left.real + right.real; return true;
+            case Sub:   value->real = left.real - right.real; return true;
+            case Mul:   value->real = left.real * right.real; return true;
+            case Div:
+                if (IsEqualFloat(right.real, 0)) {
+                    return false;
+                }
+                value->real = left.real / right.real;
+                return true;
+            default:    assert(0);
+        }
+    }
+
+    unsigned long long first = (unsigned long long)left.integer;
+    unsigned long long second = (unsigned long long)right.integer;
+    switch (op) {
+        case Add:   value->integer = (long long)(first + second); return true;
+        case Sub:   value->integer = (long long)(first - second); return true;
+        case Mul:   value->integer = (long long)(first * second); return true;
+        case Div:
+            if (!right.integer) {
+                return false;
+            }
+            value->integer = (right.integer == -1) ? (long long)(0 - first) : left.integer / right.integer;
+            return true;
+        default:    assert(0);
+    }
+}
+
+static bool EvaluateComparison(TEvaluator* evaluator, tNode* node, Operations op, TEvalValue* value) {
+    bool isFloat = IsFloat(evaluator, node->left) || IsFloat(evaluator, node->right);
+    TEvalValue left = {};
+    TEvalValue right = {};
+    if (!EvaluateNumber(evaluator, node->left, isFloat, &left) || !EvaluateNumber(evaluator, node->right, isFloat, &right)) {
+        return false;
+    }
+
+    bool result = false;
+    if (isFloat) {
+        switch (op) {
+            case Identical:         result = IsEqualFloat(left.real, right.real); break;
+            case NotIdentical:      result = !IsEqualFloat(left.real, right.real); break;
+            case Less:              result = isless(left.real, right.real); break;
+            case Greater:           result = isgreater(left.real, right.real); break;
+            case LessOrEqual:       result = islessequal(left.real, right.real); break;
+            case GreaterOrEqual:    result = isgreaterequal(left.real, right.real); break;
+            default:                assert(0);
+        }
+    } else {
+        switch (op) {
+            case Identical:         result = left.integer == right.integer; break;
+            case NotIdentical:      result = left.integer != right.integer; break;
+            case Less:              result = left.integer < right.integer; break;
+            case Greater:           result = left.integer > right.integer; break;
+            case LessOrEqual:       result = left.integer <= right.integer; break;
+            case GreaterOrEqual:    result = left.integer >= right.integer; break;
+            default:                assert(0);
+        }
+    }
+
+    *value = {};
+    value->integer = result;
+    return true;
+}
+
+// Выход за границы массива оставляется машине
+static bool EvaluateElement(TEvaluator* evaluator, tNode* node, TEvalValue** element) {
+    TEvalValue array = {};
+    TEvalValue index = {};
+    if (IsFloat(evaluator, node->right) || !EvaluateExpression(evaluator, node->left, false, &array)
+        || !EvaluateNumber(evaluator, node->right, false, &index)) {
+        return false;
+    }
+    if (!array.array || index.integer < 0 || (size_t)index.integer >= array.array->size) {
+        return false;
+    }
+
+    *element = &array.array->elements[index.integer];
+    return true;
+}
+
+static bool EvaluateArray(TEvaluator* evaluator, tNode* node, TEvalValue* value) {
+    TEvalValue size = {};
+    if (IsFloat(evaluator, node->left) || !EvaluateNumber(evaluator, node->left, false, &size)) {
+        return false;
+    }
+    if (size.integer < 0 || (size_t)size.integer > evaluator->memory / sizeof(long long)) {
+        return false;
+    }
+    evaluator->memory -= (size_t)size.integer * sizeof(long long);
+
+    TEvalArray* array = (TEvalArray*)calloc(1, sizeof(TEvalArray));
+    assert(array);
+    array->elements = (TEvalValue*)calloc((size_t)size.integer + 1, sizeof(TEvalValue));
+    assert(array->elements);
+    array->size = (size_t)size.integer;
+    vectorPush(&evaluator->arrays, array);
+
+    *value = {};
+    value->array = array;
+    return true;
+}
+
+// Аргументы вычисляются в кадре вызывающего кода и кладутся в первые ячейки нового кадра
+static bool EvaluateCall(TEvaluator* evaluator, tNode* node, TEvalValue* value) {
+    TEvalFunction* callee = FindEvalFunction(evaluator, node->value);
+    size_t argCount = CountChain(node->left);
+    if (!callee || CountChain(callee->node->left) != argCount || callee->locals.size < argCount
+        || evaluator->depth == kMaxEvaluationDepth) {
+        return false; // ошибку сообщит генератор
+    }
+
+    TEvalValue* frame = (TEvalValue*)calloc(callee->locals.size + 1, sizeof(TEvalValue));
+    assert(frame);
+
+    // аргументы лежат в обратном порядке: последний - в корне цепочки
+    bool isEvaluated = true;
+    size_t i = argCount;
+    for (tNode* arg = node->left; arg && isEvaluated; arg = arg->left) {
+        i--;
+        tNode* param = callee->node->left;
+        for (size_t j = 0; j < i; j++) {
+            param = param->left;
+        }
+        bool asFloat = IsFloatVariable(evaluator->types, callee->node, param->value);
+        isEvaluated = EvaluateExpression(evaluator, arg, asFloat, &frame[i]);
+    }
+
+    TEvalStatus status = EvalFailed;
+    if (isEvaluated) {
+        TEvalFunction* caller = evaluator->function;
+        TEvalValue* callerFrame = evaluator->frame;
+        evaluator->function = callee;
+        evaluator->frame = frame;
+        evaluator->depth++;
+        status = ExecuteStatement(evaluator, callee->node->right);
+        evaluator->depth--;
+        evaluator->function = caller;
+        evaluator->frame = callerFrame;
+    }
+    free(frame);
+
+    if (status == EvalFailed) {
+        return false;
+    }
+    *value = (status == EvalReturn) ? evaluator->result : TEvalValue{}; // без return функция возвращает 0
+    return true;
+}
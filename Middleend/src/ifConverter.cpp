@@ -0,0 +1,266 @@
+#include "ifConverter.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfIfVector = 16;
+const size_t kMaxSelectAssignments = 4;
+const double kMispredictPenalty = 16; // такты неверно предсказанного перехода, в узлах AST
+const double kSelectOverhead = 1; // cmov на каждое присваивание
+const char* const kProfileHeader = "if-profile";
+
+struct TIfConverter {
+    TTypeInfo* types;
+    Vector ifs; // все if программы в порядке обхода: номер if в профиле
+    long long* counters; // для if номер i: counters [ 2 * i ] - выполнений, counters [ 2 * i + 1 ] - входов в тело
+};
+
+static void ConvertNode(TIfConverter* converter, tNode* node, tNode* function, size_t loopDepth);
+static void ConvertCases(TIfConverter* converter, tNode* node, tNode* function, size_t loopDepth);
+static bool IsSelectable(TIfConverter* converter, tNode* node, tNode* function);
+static bool IsSelectableValue(TIfConverter* converter, tNode* node, tNode* function, tNode* condition);
+static bool ContainsTree(tNode* node, tNode* tree);
+static void CollectStatements(tNode* node, Vector* statements);
+static bool IsProfitable(TIfConverter* converter, tNode* node, size_t loopDepth);
+static size_t FindIf(TIfConverter* converter, tNode* node);
+static long long* ReadIfProfile(const char* fileName, size_t ifCount);
+
+// global ------------------------------------------------------------------------------------------
+
+// if, тело которого - несколько присваиваний целым переменным без побочных эффектов, выполняется без перехода:
+// генератор вычисляет новые значения всегда, а условие только выбирает, записать ли их (cmov или setcc).
+// Выгодно, если переход часто предсказывается неверно: по профилю --profile-use или внутри циклов без него
+tNode* ConvertIfs(tNode* root, const Options* options, TTypeInfo* types) {
+    if (!options->enableIfConversion || options->profileOutput) {
+        return root; // при записи профиля все if остаются, чтобы их номера совпали
+    }
+
+    TIfConverter converter = {
+        .types = types,
+        .ifs = {},
+        .counters = NULL,
+    };
+    vectorInit(&converter.ifs, kInitialSizeOfIfVector);
+    CollectIfNodes(root, &converter.ifs);
+    if (options->profileInput) {
+        converter.counters = ReadIfProfile(options->profileInput, converter.ifs.size);
+    }
+
+    ConvertNode(&converter, root, NULL, 0);
+
+    free(converter.counters);
+    vectorFree(&converter.ifs);
+    return root;
+}
+
+// Номер if - его место в обходе: сначала узел, потом left и right
+void CollectIfNodes(tNode* node, Vector* ifs) {
+    if (!node) {
+        return;
+    }
+
+    if (IsOperation(node, If)) {
+        vectorPush(ifs, node);
+    }
+    CollectIfNodes(node->left, ifs);
+    CollectIfNodes(node->right, ifs);
+}
+
+void WriteIfProfile(const char* fileName, const long long* counters, size_t ifCount) {
+    FILE* file = fopen(fileName, "w");
+    if (!file) {
+        fprintf(stderr, "Error: cannot write profile %s\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(file, "%s %zu\n", kProfileHeader, ifCount);
+    for (size_t i = 0; i < ifCount; i++) {
+        fprintf(file, "%lld %lld\n", counters[2 * i], counters[2 * i + 1]);
+    }
+    fclose(file);
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void ConvertNode(TIfConverter* converter, tNode* node, tNode* function, size_t loopDepth) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        ConvertNode(converter, node->right, node, 0);
+        return;
+    }
+    if (IsOperation(node, If) && IsSelectable(converter, node, function)
+        && IsProfitable(converter, node, loopDepth)) {
+        node->value = keySelectIf;
+        return;
+    }
+    if (IsOperation(node, Switch)) {
+        ConvertCases(converter, node->right, function, loopDepth);
+        return;
+    }
+
+    bool isLoop = IsOperation(node, While) || IsOperation(node, ParallelWhile) || IsOperation(node, VectorWhile);
+    ConvertNode(converter, node->left, function, loopDepth);
+    ConvertNode(converter, node->right, function, loopDepth + (isLoop ? 1 : 0));
+}
+
+// Варианты switch выбирает таблица переходов, и сами они остаются if: преобразуются только их тела
+static void ConvertCases(TIfConverter* converter, tNode* node, tNode* function, size_t loopDepth) {
+    if (IsOperation(node, Semicolon)) {
+        ConvertCases(converter, node->left, function, loopDepth);
+        ConvertCases(converter, node->right, function, loopDepth);
+    } else {
+        ConvertNode(converter, node->right, function, loopDepth);
+    }
+}
+
+// Тело - до kMaxSelectAssignments присваиваний разным целым переменным, и ни одно не читает результат
+// предыдущего: значения вычисляются до выбора. Элемент массива читается, только если его уже прочитало условие
+static bool IsSelectable(TIfConverter* converter, tNode* node, tNode* function) {
+    tNode* condition = node->left;
+    if (IsFloatExpression(converter->types, function, condition)
+        || (condition->type == Operation && (IsFloatExpression(converter->types, function, condition->left)
+                                             || IsFloatExpression(converter->types, function, condition->right)))) {
+        return false;
+    }
+
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfIfVector);
+    CollectStatements(node->right, &statements);
+    Vector targets = {};
+    vectorInit(&targets, kInitialSizeOfIfVector);
+
+    bool isSelectable = statements.size && statements.size <= kMaxSelectAssignments;
+    for (size_t i = 0; i < statements.size && isSelectable; i++) {
+        tNode* statement = (tNode*)statements.data[i];
+        isSelectable = IsOperation(statement, Equal)
+                    && !IsFloatVariable(converter->types, function, statement->left->value)
+                    && !ContainsName(&targets, statement->left->value)
+                    && IsSelectableValue(converter, statement->right, function, condition);
+        for (size_t j = 0; j < targets.size && isSelectable; j++) {
+            isSelectable = !CountReferences(statement->right, (const char*)targets.data[j]);
+        }
+        if (isSelectable) {
+            AddName(&targets, statement->left->value);
+        }
+    }
+
+    vectorFree(&targets);
+    vectorFree(&statements);
+    return isSelectable;
+}
+
+static bool IsSelectableValue(TIfConverter* converter, tNode* node, tNode* function, tNode* condition) {
+    switch (node->type) {
+        case Number:        return !IsFloatLiteral(node);
+        case Identifier:    return !IsFloatVariable(converter->types, function, node->value);
+        case Operation:
+            switch (GetOperationType(node->value)) {
+                case Add:
+                case Sub:
+                case Mul:   return IsSelectableValue(converter, node->left, function, condition)
+                                && IsSelectableValue(converter, node->right, function, condition);
+                case Index: return !IsFloatExpression(converter->types, function, node)
+                                && ContainsTree(condition, node);
+                default:    return false; // деление может упасть на нуле
+            }
+        case Calling:
+        case Function:
+        default:            return false;
+    }
+}
+
+static bool ContainsTree(tNode* node, tNode* tree) {
+    if (!node) {
+        return false;
+    }
+    return IsSameTree(node, tree) || ContainsTree(node->left, tree) || ContainsTree(node->right, tree);
+}
+
+// Без перехода всегда вычисляется все тело, с переходом - тело в доле p выполнений плюс штраф за ошибку
+// предсказания. Доля ошибок оценивается как min(p, 1 - p): предсказатель угадывает частое направление
+static bool IsProfitable(TIfConverter* converter, tNode* node, size_t loopDepth) {
+    double taken = 0.5;
+    if (converter->counters) {
+        size_t index = FindIf(converter, node);
+        long long executed = converter->counters[2 * index];
+        if (!executed) {
+            return false; // холодный код
+        }
+        taken = (double)converter->counters[2 * index + 1] / (double)executed;
+    } else if (!loopDepth) {
+        return false; // вне цикла if выполняется один раз на вызов, и без профиля выигрыш не виден
+    }
+
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfIfVector);
+    CollectStatements(node->right, &statements);
+    double bodyCost = 0;
+    double assignments = (double)statements.size;
+    for (size_t i = 0; i < statements.size; i++) {
+        bodyCost += (double)CountNodes(((tNode*)statements.data[i])->right);
+    }
+    vectorFree(&statements);
+
+    double mispredictRate = (taken < 1 - taken) ? taken : 1 - taken;
+    double branchCost = taken * bodyCost + mispredictRate * kMispredictPenalty;
+    double selectCost = bodyCost + assignments * kSelectOverhead;
+    return selectCost < branchCost;
+}
+
+static void CollectStatements(tNode* node, Vector* statements) {
+    if (!node) {
+        return;
+    }
+
+    if (IsOperation(node, Semicolon)) {
+        CollectStatements(node->left, statements);
+        CollectStatements(node->right, statements);
+    } else {
+        vectorPush(statements, node);
+    }
+}
+
+static size_t FindIf(TIfConverter* converter, tNode* node) {
+    for (size_t i = 0; i < converter->ifs.size; i++) {
+        if (converter->ifs.data[i] == node) {
+            return i;
+        }
+    }
+    assert(0);
+    return 0;
+}
+
+// Профиль пишет --vm --profile-generate после тех же оптимизаций, поэтому число if должно совпасть
+static long long* ReadIfProfile(const char* fileName, size_t ifCount) {
+    FILE* file = fopen(fileName, "r");
+    if (!file) {
+        fprintf(stderr, "Error: cannot read profile %s\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+
+    char header[sizeof("if-profile")] = "";
+    size_t count = 0;
+    if (fscanf(file, "%10s %zu", header, &count) != 2 || strcmp(header, kProfileHeader) || count != ifCount) {
+        fprintf(stderr, "Error: profile %s was recorded for another program or other options\n", fileName);
+        exit(EXIT_FAILURE);
+    }
+
+    long long* counters = (long long*)calloc(2 * ifCount + 1, sizeof(long long));
+    assert(counters);
+    for (size_t i = 0; i < ifCount; i++) {
+        if (fscanf(file, "%lld %lld", &counters[2 * i], &counters[2 * i + 1]) != 2) {
+            fprintf(stderr, "Error: profile %s is truncated\n", fileName);
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(file);
+    return counters;
+}
@@ -0,0 +1,513 @@
+#include "inliner.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tree.h"
+#include "dsl.h"
+#include "astUtils.h"
+#include "typeInference.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kMaxLengthOfName = 64;
+const size_t kInitialSizeOfNameVector = 16;
+const size_t kMaxInlineIterations = 8;
+const size_t kSingleCallSiteFactor = 4; // единственный вызов: копия заменяет оригинал
+const size_t kCallOverhead = 8; // перенос аргументов, call, пролог и эпилог - в узлах AST
+
+static const char* const kTailCallFlag = "_tc";
+
+struct TInliner {
+    tNode* root;
+    Vector globals;
+    Vector inlined; // функции, встроенные хотя бы в одном месте
+    TFunctionTable functions; // число вызовов меняется с каждым встроенным вызовом
+    TTypeInfo* types;
+    size_t counter; // для уникальных имен копий
+    size_t threshold;
+    size_t budget; // на сколько узлов еще может вырасти программа
+};
+
+static bool InlineCalls(TInliner* inliner, tNode** slot, tNode* caller);
+static bool CanInline(TInliner* inliner, tNode* function);
+static bool IsRecursive(TInliner* inliner, tNode* function);
+static bool Reaches(TInliner* inliner, tNode* node, const char* target, Vector* visited);
+static bool IsAssignedByCallees(TInliner* inliner, tNode* function, const char* name);
+static bool CalleesAssign(TInliner* inliner, tNode* node, const char* name, Vector* visited);
+static void CollectInitialValues(tNode* node, Vector* globals, const char** values, bool* isSet);
+static tNode* KeepInitialValues(tNode* root, Vector* globals, const char** initial);
+static size_t CountReturns(tNode* node);
+static tNode* InlineCall(TInliner* inliner, tNode* statement, tNode* function, tNode* caller);
+static void EliminateTailCallsIn(tNode* root, Vector* globals);
+static bool ReplaceTailCalls(tNode* function, tNode** slot);
+static bool ReplaceLastTailCall(tNode* function, tNode** slot);
+static void SplitStatements(tNode* node, Vector* statements);
+static tNode* JoinStatements(tNode* function, Vector* statements, size_t start, bool* replaced);
+static tNode* BuildTailJump(tNode* function, tNode* call);
+
+// global ------------------------------------------------------------------------------------------
+
+// Встраивает небольшие нерекурсивные функции в места вызова x = call f ( ... )
+tNode* RunInliner(tNode* root, const Options* options, TTypeInfo* types) {
+    TInliner inliner = {
+        .root = root,
+        .globals = {},
+        .inlined = {},
+        .functions = {},
+        .types = types,
+        .counter = 0,
+        .threshold = options->inlineThreshold,
+        .budget = CountNodes(root) + kCallOverhead * options->inlineThreshold,
+    };
+    vectorInit(&inliner.globals, kInitialSizeOfNameVector);
+    vectorInit(&inliner.inlined, kInitialSizeOfNameVector);
+    CollectGlobals(root, &inliner.globals);
+    FunctionTableCtor(&inliner.functions, root);
+
+    // начальное значение глобальной переменной - литерал ее первого упоминания вне функций (как в nasmGen),
+    // а встроенное тело может упомянуть ее раньше
+    const char** initial = (const char**)calloc(inliner.globals.size + 1, sizeof(const char*));
+    bool* isSet = (bool*)calloc(inliner.globals.size + 1, sizeof(bool));
+    assert(initial && isSet);
+    CollectInitialValues(root, &inliner.globals, initial, isSet);
+
+    for (size_t i = 0; i < kMaxInlineIterations && InlineCalls(&inliner, &inliner.root, NULL); i++) {
+        ;
+    }
+    inliner.root = KeepInitialValues(inliner.root, &inliner.globals, initial);
+    free(initial);
+    free(isSet);
+
+    // функции, все вызовы которых встроены, больше не нужны, если их не вызывают другие модули
+    for (size_t i = 0; i < inliner.inlined.size && !options->module; i++) {
+        const char* name = (const char*)inliner.inlined.data[i];
+        if (!GetCallCount(&inliner.functions, name)) {
+            tNode* function = LookupFunction(&inliner.functions, name);
+            RemoveFunction(&inliner.functions, function);
+        }
+    }
+    inliner.root = RemoveFunctions(inliner.root, &inliner.functions);
+
+    vectorFree(&inliner.globals);
+    vectorFree(&inliner.inlined);
+    FunctionTableDtor(&inliner.functions);
+
+    return inliner.root;
+}
+
+// Самовызов в хвостовой позиции (r = call f ( ... ) ; return r ;) превращается в переход на начало:
+// _tc = 1 ; while ( _tc ) { _tc = 0 ; body } ; где хвостовой вызов присваивает параметры и ставит _tc = 1.
+// В начале каждой итерации локальные переменные обнуляются, как в кадре настоящего вызова
+tNode* EliminateTailCalls(tNode* root) {
+    Vector globals = {};
+    vectorInit(&globals, kInitialSizeOfNameVector);
+    CollectGlobals(root, &globals);
+
+    EliminateTailCallsIn(root, &globals);
+
+    vectorFree(&globals);
+    return root;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static bool InlineCalls(TInliner* inliner, tNode** slot, tNode* caller) {
+    tNode* node = *slot;
+    if (!node) {
+        return false;
+    }
+    if (node->type == Function) {
+        caller = node;
+    }
+
+    if (IsOperation(node, Equal) && node->right->type == Calling) {
+        tNode* function = LookupFunction(&inliner->functions, node->right->value);
+        if (!function || !CanInline(inliner, function) || CountChain(function->left) != CountChain(node->right->left)) {
+            return false;
+        }
+
+        size_t size = CountNodes(function->right);
+        inliner->budget = (inliner->budget > size) ? inliner->budget - size : 0;
+        AddName(&inliner->inlined, function->value);
+
+        *slot = InlineCall(inliner, node, function, caller);
+        RemoveCalls(&inliner->functions, node);
+        AddCalls(&inliner->functions, *slot);
+        treeDtor(node);
+        return true;
+    }
+
+    bool changed = InlineCalls(inliner, &node->left, caller);
+    return InlineCalls(inliner, &node->right, caller) || changed;
+}
+
+// Выгода - сэкономленные kCallOverhead узлов на вызов, цена - размер копии тела
+static bool CanInline(TInliner* inliner, tNode* function) {
+    if (IsImported(function)) {
+        return false; // тело в другом объектном файле
+    }
+
+    size_t size = CountNodes(function->right);
+    if (size > inliner->budget) {
+        return false;
+    }
+
+    size_t limit = inliner->threshold;
+    if (GetCallCount(&inliner->functions, function->value) == 1) {
+        limit *= kSingleCallSiteFactor;
+    }
+    if (size > limit) {
+        return false;
+    }
+
+    // без goto выход из середины тела не выразить: return допустим только последним оператором
+    size_t returns = CountReturns(function->right);
+    if (returns > 1 || (returns == 1 && !IsOperation(GetLastStatement(function->right), Return))) {
+        return false;
+    }
+
+    return !IsRecursive(inliner, function);
+}
+
+static bool IsRecursive(TInliner* inliner, tNode* function) {
+    Vector visited = {};
+    vectorInit(&visited, kInitialSizeOfNameVector);
+
+    bool recursive = Reaches(inliner, function->right, function->value, &visited);
+
+    vectorFree(&visited);
+    return recursive;
+}
+
+static bool Reaches(TInliner* inliner, tNode* node, const char* target, Vector* visited) {
+    if (!node) {
+        return false;
+    }
+
+    if (node->type == Calling) {
+        if (!strcmp(node->value, target)) {
+            return true;
+        }
+        if (ContainsName(visited, node->value)) {
+            return false;
+        }
+        AddName(visited, node->value);
+
+        tNode* callee = LookupFunction(&inliner->functions, node->value);
+        return callee && Reaches(inliner, callee->right, target, visited);
+    }
+
+    return Reaches(inliner, node->left, target, visited) || Reaches(inliner, node->right, target, visited);
+}
+
+static bool IsAssignedByCallees(TInliner* inliner, tNode* function, const char* name) {
+    Vector visited = {};
+    vectorInit(&visited, kInitialSizeOfNameVector);
+
+    bool assigned = CalleesAssign(inliner, function->right, name, &visited);
+
+    vectorFree(&visited);
+    return assigned;
+}
+
+// Функции модулей глобальные переменные программы не видят, а их тела без определения здесь нет
+static bool CalleesAssign(TInliner* inliner, tNode* node, const char* name, Vector* visited) {
+    if (!node) {
+        return false;
+    }
+
+    if (node->type == Calling) {
+        if (ContainsName(visited, node->value)) {
+            return CalleesAssign(inliner, node->left, name, visited);
+        }
+        AddName(visited, node->value);
+
+        tNode* callee = LookupFunction(&inliner->functions, node->value);
+        if (callee && !IsImported(callee)
+            && (IsAssigned(callee->right, name) || CalleesAssign(inliner, callee->right, name, visited))) {
+            return true;
+        }
+        return CalleesAssign(inliner, node->left, name, visited); // вызовы в аргументах
+    }
+
+    return CalleesAssign(inliner, node->left, name, visited) || CalleesAssign(inliner, node->right, name, visited);
+}
+
+// Как SetInitialValues в nasmGen: литерал первого присваивания, если до него переменная не упоминалась
+static void CollectInitialValues(tNode* node, Vector* globals, const char** values, bool* isSet) {
+    if (!node || node->type == Function) {
+        return;
+    }
+
+    if (node->type == Identifier || IsOperation(node, Equal)) {
+        const char* name = (node->type == Identifier) ? node->value : node->left->value;
+        size_t index = 0;
+        while (index < globals->size && strcmp((const char*)globals->data[index], name)) {
+            index++;
+        }
+        if (!isSet[index]) {
+            isSet[index] = true;
+            if (IsOperation(node, Equal) && node->right->type == Number) {
+                values[index] = node->right->value;
+            }
+        }
+    }
+
+    CollectInitialValues(node->left, globals, values, isSet);
+    CollectInitialValues(node->right, globals, values, isSet);
+}
+
+// Переменным, у которых после встраивания изменилось бы начальное значение, оно присваивается первым
+// оператором программы (globals.size - ячейка для новых имен копий)
+static tNode* KeepInitialValues(tNode* root, Vector* globals, const char** initial) {
+    const char** values = (const char**)calloc(globals->size + 1, sizeof(const char*));
+    bool* isSet = (bool*)calloc(globals->size + 1, sizeof(bool));
+    assert(values && isSet);
+    CollectInitialValues(root, globals, values, isSet);
+
+    for (size_t i = 0; i < globals->size; i++) {
+        bool isSame = (initial[i] && values[i]) ? !strcmp(initial[i], values[i]) : initial[i] == values[i];
+        if (!isSame) {
+            tNode* value = (initial[i]) ? NUM(initial[i]) : NewNumberNode(0);
+            root = SEMICOLON(EQUAL(VAR((const char*)globals->data[i]), value), root);
+        }
+    }
+
+    free(values);
+    free(isSet);
+    return root;
+}
+
+static size_t CountReturns(tNode* node) {
+    if (!node) {
+        return 0;
+    }
+
+    return (IsOperation(node, Return) ? 1 : 0) + CountReturns(node->left) + CountReturns(node->right);
+}
+
+static tNode* InlineCall(TInliner* inliner, tNode* statement, tNode* function, tNode* caller) {
+    Vector locals = {};
+    vectorInit(&locals, kInitialSizeOfNameVector);
+    CollectLocals(function, &inliner->globals, &locals);
+
+    tNode* body = copyNode(function->right);
+    size_t id = inliner->counter++;
+
+    // локальные переменные копии получают свежие имена _i<id>_<name>
+    Vector freshNames = {};
+    vectorInit(&freshNames, kInitialSizeOfNameVector);
+    for (size_t i = 0; i < locals.size; i++) {
+        char name[kMaxLengthOfName] = "";
+        snprintf(name, kMaxLengthOfName, "_i%zu_%s", id, (const char*)locals.data[i]);
+        const char* fresh = storeString(name);
+        vectorPush(&freshNames, const_cast<char*>(fresh));
+        RenameVariable(body, (const char*)locals.data[i], fresh);
+        if (IsFloatVariable(inliner->types, function, (const char*)locals.data[i])) {
+            MarkFloatVariable(inliner->types, caller, fresh);
+        }
+    }
+
+    // параметр, который никто не перезаписывает (глобальный аргумент - и вызываемые телом функции),
+    // заменяется самим аргументом того же типа;
+    // целый аргумент double-параметра переводится присваиванием
+    tNode* args[kMaxArguments] = {};
+    GetArguments(statement->right, args);
+
+    tNode* result = NULL;
+    size_t i = 0;
+    for (tNode* param = function->left; param; param = param->left, i++) {
+        const char* fresh = (const char*)freshNames.data[i]; // параметры идут первыми
+        const char* arg = args[i]->value;
+        bool sameType = IsFloatVariable(inliner->types, function, param->value)
+                     == IsFloatExpression(inliner->types, caller, args[i]);
+        if (args[i]->type == Number) {
+            result = AppendStatement(result, EQUAL(VAR(fresh), NUM(arg)));
+        } else if (!IsAssigned(function->right, param->value) && !IsAssigned(function->right, arg) && sameType
+                   && !((!caller || ContainsName(&inliner->globals, arg)) && IsAssignedByCallees(inliner, function, arg))) {
+            RenameVariable(body, fresh, arg);
+        } else {
+            result = AppendStatement(result, EQUAL(VAR(fresh), VAR(arg)));
+        }
+    }
+
+    // как в кадре настоящего вызова, локальные переменные копии начинаются с нуля при каждом вызове
+    for (size_t j = i; j < freshNames.size; j++) {
+        result = AppendStatement(result, EQUAL(VAR((const char*)freshNames.data[j]), NewNumberNode(0)));
+    }
+
+    // return e в конце тела становится x = e
+    tNode* last = GetLastStatement(body);
+    if (IsOperation(last, Return)) {
+        last->value = keyEqual;
+        last->right = last->left;
+        last->left = VAR(statement->left->value);
+    } else {
+        body = AppendStatement(body, EQUAL(VAR(statement->left->value), NewNumberNode(0)));
+    }
+    result = AppendStatement(result, body);
+
+    vectorFree(&freshNames);
+    vectorFree(&locals);
+
+    return result;
+}
+
+static void EliminateTailCallsIn(tNode* root, Vector* globals) {
+    if (!root) {
+        return;
+    }
+
+    if (IsOperation(root, Semicolon)) {
+        EliminateTailCallsIn(root->left, globals);
+        EliminateTailCallsIn(root->right, globals);
+        return;
+    }
+    if (root->type != Function) {
+        return;
+    }
+
+    Vector locals = {};
+    vectorInit(&locals, kInitialSizeOfNameVector);
+    CollectLocals(root, globals, &locals);
+
+    if (ReplaceTailCalls(root, &root->right)) {
+        tNode* reset = EQUAL(VAR(kTailCallFlag), NewNumberNode(0));
+        for (size_t i = CountChain(root->left); i < locals.size; i++) { // параметры идут первыми
+            reset = SEMICOLON(reset, EQUAL(VAR((const char*)locals.data[i]), NewNumberNode(0)));
+        }
+
+        tNode* loop = WHILE(VAR(kTailCallFlag), SEMICOLON(reset, root->right));
+        root->right = SEMICOLON(EQUAL(VAR(kTailCallFlag), NewNumberNode(1)), loop);
+    }
+
+    vectorFree(&locals);
+}
+
+// Хвостовые вызовы ищутся в конце списка операторов и в конце тела каждого if этого списка
+static bool ReplaceTailCalls(tNode* function, tNode** slot) {
+    if (IsOperation(*slot, If)) {
+        return ReplaceTailCalls(function, &(*slot)->right);
+    }
+    if (!IsOperation(*slot, Semicolon)) {
+        return false;
+    }
+
+    bool replaced = ReplaceLastTailCall(function, slot);
+
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfNameVector);
+    SplitStatements(*slot, &statements);
+    *slot = JoinStatements(function, &statements, 0, &replaced);
+    vectorFree(&statements);
+
+    return replaced;
+}
+
+static bool ReplaceLastTailCall(tNode* function, tNode** slot) {
+    tNode* node = *slot;
+
+    tNode* last = node->right;
+    if (!IsOperation(last, Return) || !last->left || last->left->type != Identifier) {
+        return false;
+    }
+
+    tNode** previousSlot = (IsOperation(node->left, Semicolon)) ? &node->left->right : &node->left;
+    tNode* previous = *previousSlot;
+    if (!IsOperation(previous, Equal) || previous->right->type != Calling
+        || strcmp(previous->right->value, function->value) || strcmp(previous->left->value, last->left->value)) {
+        return false;
+    }
+
+    *previousSlot = BuildTailJump(function, previous->right);
+    treeDtor(previous);
+
+    // return r больше не нужен: последовательность укорачивается на один оператор
+    *slot = node->left;
+    node->left = NULL;
+    treeDtor(node);
+
+    return true;
+}
+
+static void SplitStatements(tNode* node, Vector* statements) {
+    if (!IsOperation(node, Semicolon)) {
+        vectorPush(statements, node);
+        return;
+    }
+
+    SplitStatements(node->left, statements);
+    SplitStatements(node->right, statements);
+
+    node->left = NULL;
+    node->right = NULL;
+    treeDtor(node);
+}
+
+// После if, в котором сработал хвостовой переход, остаток списка выполняется только при _tc == 0
+static tNode* JoinStatements(tNode* function, Vector* statements, size_t start, bool* replaced) {
+    tNode* result = NULL;
+    for (size_t i = start; i < statements->size; i++) {
+        tNode* statement = (tNode*)vectorGet(statements, i);
+        result = AppendStatement(result, statement);
+
+        if (IsOperation(statement, If) && ReplaceTailCalls(function, &statement->right)) {
+            *replaced = true;
+            if (i + 1 < statements->size) {
+                tNode* rest = JoinStatements(function, statements, i + 1, replaced);
+                tNode* skip = newNode(Operation, keyIdentical, VAR(kTailCallFlag), NewNumberNode(0));
+                return AppendStatement(result, IF(skip, rest));
+            }
+        }
+    }
+
+    return result;
+}
+
+// Параллельное присваивание параметрам: параметр, который читают следующие аргументы, сначала копируется
+static tNode* BuildTailJump(tNode* function, tNode* call) {
+    tNode* args[kMaxArguments] = {};
+    const char* values[kMaxArguments] = {};
+    const char* params[kMaxArguments] = {};
+
+    size_t count = GetArguments(call, args);
+    size_t i = 0;
+    for (tNode* param = function->left; param; param = param->left) {
+        params[i] = param->value;
+        values[i] = args[i]->value;
+        i++;
+    }
+
+    tNode* result = NULL;
+    for (size_t k = 0; k < count; k++) {
+        if (!strcmp(values[k], params[k])) {
+            continue;
+        }
+        for (size_t j = k + 1; j < count; j++) {
+            if (!strcmp(values[j], params[k])) {
+                char name[kMaxLengthOfName] = "";
+                snprintf(name, kMaxLengthOfName, "%s%zu", kTailCallFlag, k);
+                const char* copy = storeString(name);
+                result = AppendStatement(result, EQUAL(VAR(copy), VAR(params[k])));
+                for (size_t m = k + 1; m < count; m++) {
+                    if (!strcmp(values[m], params[k])) {
+                        values[m] = copy;
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    // число не совпадает ни с одним именем и не копируется
+    for (size_t k = 0; k < count; k++) {
+        if (strcmp(values[k], params[k])) {
+            tNode* value = (args[k]->type == Number) ? NUM(values[k]) : VAR(values[k]);
+            result = AppendStatement(result, EQUAL(VAR(params[k]), value));
+        }
+    }
+
+    return AppendStatement(result, EQUAL(VAR(kTailCallFlag), NewNumberNode(1)));
+}
@@ -0,0 +1,398 @@
+#include "loopOptimizer.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "tree.h"
+#include "dsl.h"
+#include "astUtils.h"
+#include "typeInference.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kMaxLengthOfName = 32;
+const size_t kInitialSizeOfNameVector = 16;
+
+struct TLoopOptimizer {
+    tNode** root;
+    Vector globals;
+    TTypeInfo* types;
+    size_t counter; // для уникальных имен временных переменных
+};
+
+// Базовая индукционная переменная: единственное присваивание i = i +- step на верхнем уровне тела
+struct TInduction {
+    const char* name;
+    tNode* step;
+    bool isDecrement;
+    tNode** update; // место оператора i = i +- step в теле
+};
+
+struct TLoop {
+    tNode* loop;
+    tNode* previous; // оператор непосредственно перед циклом
+    tNode* function;
+    TTypeInfo* types;
+    Vector variant; // переменные, меняющиеся в цикле
+    tNode* preheader; // операторы, вынесенные перед циклом
+};
+
+static void OptimizeStatement(TLoopOptimizer* optimizer, tNode** slot, tNode* previous, tNode* function);
+static tNode* OptimizeLoop(TLoopOptimizer* optimizer, tNode** slot, tNode* previous, tNode* function);
+
+static const char* NewTemporary(TLoopOptimizer* optimizer, const char* prefix);
+static bool IsArithmetic(tNode* node);
+static bool IsInvariant(TLoop* loop, tNode* node);
+static bool IsSafeToHoist(tNode* node);
+static void HoistInvariants(TLoopOptimizer* optimizer, TLoop* loop, tNode** slot, Vector* hoisted);
+
+static void FindInductions(TLoop* loop, tNode** slot, TInduction* inductions, size_t* count, size_t capacity);
+static bool IsCheapMultiplier(tNode* node);
+static tNode* FindScaledUse(tNode* node, TInduction* induction, TLoop* loop);
+static tNode* GetMultiplier(tNode* node, const char* name);
+static void ReplaceScaledUses(tNode** slot, const char* name, tNode* multiplier, const char* replacement);
+static void ReduceStrength(TLoopOptimizer* optimizer, TLoop* loop, TInduction* induction);
+static void EliminateInduction(TLoopOptimizer* optimizer, TLoop* loop, TInduction* induction, const char* scaled,
+                               long long multiplier);
+
+// global ------------------------------------------------------------------------------------------
+
+// Анализ циклов while: вынос инвариантов, снижение стоимости умножений на индукционную переменную
+// и удаление индукционных переменных, которые остались нужны только для условия цикла
+tNode* OptimizeLoops(tNode* root, TTypeInfo* types) {
+    TLoopOptimizer optimizer = {
+        .root = &root,
+        .globals = {},
+        .types = types,
+        .counter = 0,
+    };
+    vectorInit(&optimizer.globals, kInitialSizeOfNameVector);
+    CollectGlobals(root, &optimizer.globals);
+
+    OptimizeStatement(&optimizer, &root, NULL, NULL);
+
+    vectorFree(&optimizer.globals);
+    return root;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void OptimizeStatement(TLoopOptimizer* optimizer, tNode** slot, tNode* previous, tNode* function) {
+    tNode* node = *slot;
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        OptimizeStatement(optimizer, &node->right, NULL, node);
+    } else if (IsOperation(node, Semicolon)) {
+        OptimizeStatement(optimizer, &node->left, previous, function);
+        OptimizeStatement(optimizer, &node->right, GetLastStatement(node->left), function);
+    } else if (IsOperation(node, If)) {
+        OptimizeStatement(optimizer, &node->right, NULL, function);
+    } else if (IsOperation(node, While)) {
+        // внешний цикл раньше внутренних: инвариант уходит за все циклы, в которых он не меняется
+        tNode* loop = OptimizeLoop(optimizer, slot, previous, function);
+        OptimizeStatement(optimizer, &loop->right, NULL, function);
+    } else if (IsOperation(node, ParallelWhile)) { // сам цикл делится между потоками и остается как есть
+        OptimizeStatement(optimizer, &node->right, NULL, function);
+    }
+}
+
+static tNode* OptimizeLoop(TLoopOptimizer* optimizer, tNode** slot, tNode* previous, tNode* function) {
+    TLoop loop = {
+        .loop = *slot,
+        .previous = previous,
+        .function = function,
+        .types = optimizer->types,
+        .variant = {},
+        .preheader = NULL,
+    };
+    vectorInit(&loop.variant, kInitialSizeOfNameVector);
+    CollectAssignments(loop.loop, &loop.variant);
+    if (ContainsCalling(loop.loop)) {
+        for (size_t i = 0; i < optimizer->globals.size; i++) { // вызов может изменить любую глобальную
+            AddName(&loop.variant, (const char*)optimizer->globals.data[i]);
+        }
+    }
+
+    Vector hoisted = {};
+    vectorInit(&hoisted, kInitialSizeOfNameVector);
+    HoistInvariants(optimizer, &loop, &loop.loop->left, &hoisted);
+    HoistInvariants(optimizer, &loop, &loop.loop->right, &hoisted);
+    vectorFree(&hoisted);
+
+    const size_t kMaxInductions = 8;
+    TInduction inductions[kMaxInductions] = {};
+    size_t inductionCount = 0;
+    FindInductions(&loop, &loop.loop->right, inductions, &inductionCount, kMaxInductions);
+    for (size_t i = 0; i < inductionCount; i++) {
+        ReduceStrength(optimizer, &loop, &inductions[i]);
+    }
+
+    if (loop.preheader) {
+        *slot = AppendStatement(loop.preheader, loop.loop);
+    }
+
+    vectorFree(&loop.variant);
+    return loop.loop;
+}
+
+static const char* NewTemporary(TLoopOptimizer* optimizer, const char* prefix) {
+    char name[kMaxLengthOfName] = "";
+    snprintf(name, kMaxLengthOfName, "%s%zu", prefix, optimizer->counter++);
+    return storeString(name);
+}
+
+static bool IsArithmetic(tNode* node) {
+    return IsOperation(node, Add) || IsOperation(node, Sub) || IsOperation(node, Mul) || IsOperation(node, Div);
+}
+
+static bool IsInvariant(TLoop* loop, tNode* node) {
+    if (!node) {
+        return true;
+    }
+    if (node->type == Number) {
+        return true;
+    }
+    if (node->type == Identifier) {
+        return !ContainsName(&loop->variant, node->value);
+    }
+    return IsArithmetic(node) && IsInvariant(loop, node->left) && IsInvariant(loop, node->right);
+}
+
+// Вынесенное выражение вычисляется, даже если цикл не выполнится ни разу: деление на переменную может упасть
+static bool IsSafeToHoist(tNode* node) {
+    if (!node || node->type != Operation) {
+        return true;
+    }
+    if (IsOperation(node, Div) && (node->right->type != Number || !strcmp(node->right->value, "0"))) {
+        return false;
+    }
+    return IsSafeToHoist(node->left) && IsSafeToHoist(node->right);
+}
+
+static void HoistInvariants(TLoopOptimizer* optimizer, TLoop* loop, tNode** slot, Vector* hoisted) {
+    tNode* node = *slot;
+    if (!node || node->type == Calling) {
+        return;
+    }
+
+    if (IsArithmetic(node) && IsInvariant(loop, node) && IsSafeToHoist(node)) {
+        // одинаковые выражения делят одну временную переменную
+        for (size_t i = 0; i < hoisted->size; i++) {
+            tNode* assignment = (tNode*)hoisted->data[i];
+            if (IsSameTree(assignment->right, node)) {
+                *slot = VAR(assignment->left->value);
+                treeDtor(node);
+                return;
+            }
+        }
+
+        const char* name = NewTemporary(optimizer, "_l");
+        if (IsFloatExpression(loop->types, loop->function, node)) {
+            MarkFloatVariable(loop->types, loop->function, name);
+        }
+        tNode* assignment = EQUAL(VAR(name), node);
+        vectorPush(hoisted, assignment);
+        loop->preheader = AppendStatement(loop->preheader, assignment);
+        *slot = VAR(name);
+        return;
+    }
+
+    if (IsOperation(node, Equal)) {
+        HoistInvariants(optimizer, loop, &node->right, hoisted); // слева всегда переменная
+        return;
+    }
+
+    HoistInvariants(optimizer, loop, &node->left, hoisted);
+    HoistInvariants(optimizer, loop, &node->right, hoisted);
+}
+
+static void FindInductions(TLoop* loop, tNode** slot, TInduction* inductions, size_t* count, size_t capacity) {
+    tNode* node = *slot;
+
+    if (IsOperation(node, Semicolon)) {
+        FindInductions(loop, &node->left, inductions, count, capacity);
+        FindInductions(loop, &node->right, inductions, count, capacity);
+        return;
+    }
+    if (!IsOperation(node, Equal) || *count >= capacity) {
+        return;
+    }
+
+    const char* name = node->left->value;
+    tNode* expr = node->right;
+    if (!IsOperation(expr, Add) && !IsOperation(expr, Sub)) {
+        return;
+    }
+
+    tNode* step = NULL;
+    if (expr->left->type == Identifier && !strcmp(expr->left->value, name)) {
+        step = expr->right;
+    } else if (IsOperation(expr, Add) && expr->right->type == Identifier && !strcmp(expr->right->value, name)) {
+        step = expr->left;
+    }
+
+    // i * k для double нельзя копить суммой: ошибки округления накапливаются от итерации к итерации
+    if (!step || (step->type != Number && step->type != Identifier) || !IsInvariant(loop, step)
+        || CountAssignments(loop->loop, name) != 1 || IsFloatVariable(loop->types, loop->function, name)) {
+        return;
+    }
+
+    inductions[(*count)++] = {
+        .name = name,
+        .step = step,
+        .isDecrement = IsOperation(expr, Sub),
+        .update = slot,
+    };
+}
+
+// На умножение, которое и так станет shl или lea, отдельную переменную не тратим
+static bool IsCheapMultiplier(tNode* node) {
+    if (node->type != Number) {
+        return false;
+    }
+
+    long long value = (long long)strtoull(node->value, NULL, 10);
+    return value == 0 || value == 1 || value == 2 || value == 3 || value == 4 || value == 5 || value == 8
+        || value == 9 || value == 16;
+}
+
+// Множитель k в выражении name * k или k * name
+static tNode* GetMultiplier(tNode* node, const char* name) {
+    if (!IsOperation(node, Mul)) {
+        return NULL;
+    }
+    if (node->left->type == Identifier && !strcmp(node->left->value, name)) {
+        return node->right;
+    }
+    if (node->right->type == Identifier && !strcmp(node->right->value, name)) {
+        return node->left;
+    }
+    return NULL;
+}
+
+static tNode* FindScaledUse(tNode* node, TInduction* induction, TLoop* loop) {
+    if (!node || node->type == Calling) {
+        return NULL;
+    }
+
+    tNode* multiplier = GetMultiplier(node, induction->name);
+    if (multiplier && (multiplier->type == Number || multiplier->type == Identifier)
+        && IsInvariant(loop, multiplier) && !IsCheapMultiplier(multiplier)
+        && !IsFloatExpression(loop->types, loop->function, multiplier)) {
+        return multiplier;
+    }
+
+    tNode* found = FindScaledUse(node->left, induction, loop);
+    return (found) ? found : FindScaledUse(node->right, induction, loop);
+}
+
+static void ReplaceScaledUses(tNode** slot, const char* name, tNode* multiplier, const char* replacement) {
+    tNode* node = *slot;
+    if (!node || node->type == Calling) {
+        return;
+    }
+
+    tNode* factor = GetMultiplier(node, name);
+    if (factor && IsSameTree(factor, multiplier)) {
+        *slot = VAR(replacement);
+        treeDtor(node);
+        return;
+    }
+
+    ReplaceScaledUses(&node->left, name, multiplier, replacement);
+    ReplaceScaledUses(&node->right, name, multiplier, replacement);
+}
+
+// i * k заменяется переменной s: s = i * k перед циклом и s = s +- step * k сразу после i = i +- step
+static void ReduceStrength(TLoopOptimizer* optimizer, TLoop* loop, TInduction* induction) {
+    const char* firstScaled = NULL;
+    long long firstMultiplier = 0;
+    size_t reduced = 0;
+
+    for (tNode* multiplier = FindScaledUse(loop->loop, induction, loop); multiplier;
+         multiplier = FindScaledUse(loop->loop, induction, loop)) {
+        multiplier = copyNode(multiplier);
+
+        const char* scaled = NewTemporary(optimizer, "_s");
+        AddName(&loop->variant, scaled);
+        loop->preheader = AppendStatement(loop->preheader,
+                                          EQUAL(VAR(scaled), MUL(VAR(induction->name), copyNode(multiplier))));
+        ReplaceScaledUses(&loop->loop->left, induction->name, multiplier, scaled);
+        ReplaceScaledUses(&loop->loop->right, induction->name, multiplier, scaled);
+
+        long long step = 0;
+        long long factor = 0;
+        tNode* delta = NULL;
+        if (GetNumber(induction->step, &step) && GetNumber(multiplier, &factor) && factor > 0
+            && step <= kMaxSafeNumber / factor) {
+            delta = NewNumberNode(step * factor);
+        } else {
+            const char* name = NewTemporary(optimizer, "_d");
+            loop->preheader = AppendStatement(loop->preheader,
+                                              EQUAL(VAR(name), MUL(copyNode(induction->step), copyNode(multiplier))));
+            delta = VAR(name);
+        }
+
+        tNode* update = (induction->isDecrement) ? SUB(VAR(scaled), delta) : ADD(VAR(scaled), delta);
+        *induction->update = SEMICOLON(*induction->update, EQUAL(VAR(scaled), update));
+        induction->update = &(*induction->update)->left;
+
+        if (!reduced++) {
+            firstScaled = scaled;
+            if (!GetNumber(multiplier, &firstMultiplier)) {
+                firstMultiplier = 0;
+            }
+        }
+        treeDtor(multiplier);
+    }
+
+    if (reduced == 1 && firstMultiplier > 0) {
+        EliminateInduction(optimizer, loop, induction, firstScaled, firstMultiplier);
+    }
+}
+
+// После снижения стоимости i может остаться нужна только условию цикла: i < bound превращается в
+// s < bound * k, а инкремент i удаляется. Значения i и s не выходят из [0, 2^62), поэтому сравнения
+// со знаком и без совпадают, а переполнения нет
+static void EliminateInduction(TLoopOptimizer* optimizer, TLoop* loop, TInduction* induction, const char* scaled,
+                               long long multiplier) {
+    const char* name = induction->name;
+    tNode* previous = loop->previous;
+    tNode* condition = loop->loop->left;
+
+    long long initial = 0;
+    long long step = 0;
+    long long bound = 0;
+    if (!IsOperation(previous, Equal) || strcmp(previous->left->value, name) || !GetNumber(previous->right, &initial)
+        || !GetNumber(induction->step, &step) || step == 0 || !condition || !condition->left || !condition->right
+        || condition->left->type != Identifier || strcmp(condition->left->value, name)
+        || !GetNumber(condition->right, &bound)) {
+        return;
+    }
+
+    Operations op = GetOperationType(condition->value);
+    long long limit = kMaxSafeNumber / multiplier;
+    if (induction->isDecrement) {
+        if ((op != Greater && op != GreaterOrEqual) || (initial < bound ? initial : bound) < step || initial > limit) {
+            return;
+        }
+    } else if ((op != Less && op != LessOrEqual) || (initial > bound ? initial : bound) > limit - step) {
+        return;
+    }
+
+    // i больше нигде не читается: ни в теле, ни после цикла (заголовок цикла еще не вставлен в дерево)
+    tNode* scope = (loop->function && !ContainsName(&optimizer->globals, name)) ? loop->function->right
+                                                                                : *optimizer->root;
+    size_t inLoop = CountReferences(loop->loop, name);
+    if (inLoop != 3 || CountReferences(scope, name) != inLoop + 1) {
+        return;
+    }
+
+    condition->left->value = scaled;
+    treeDtor(condition->right);
+    condition->right = NewNumberNode(bound * multiplier);
+    loop->loop->right = RemoveStatement(loop->loop->right, *induction->update);
+}
@@ -0,0 +1,189 @@
+#include "memoizer.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tree.h"
+#include "astUtils.h"
+#include "parallelizer.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfNameVector = 16;
+const size_t kMaxMemoizedParameters = 6; // таблицу проверяет код перед телом, пока аргументы в регистрах
+const size_t kMaxMemoSize = 1 << 24; // таблица лежит в .bss
+
+struct TPurity {
+    TFunctionTable functions;
+    Vector* locals; // по одному на функцию
+    bool* isPure;
+};
+
+static void CollectFunctionNodes(tNode* node, Vector* functions);
+static bool IsPureCode(TPurity* purity, size_t function, tNode* node);
+static bool IsLocalOperand(TPurity* purity, size_t function, tNode* node);
+static size_t CountSelfCalls(tNode* node, const char* name);
+static size_t GetCacheSize(size_t size);
+
+// global ------------------------------------------------------------------------------------------
+
+// Результат чистой функции зависит только от аргументов, а вызов ничего не меняет: она не читает и не
+// пишет глобальные переменные и массивы, не печатает, не создает массивов и вызывает только чистые функции.
+// Сначала чистыми считаются все функции, затем нарушители исключаются, пока список не перестанет меняться
+void CollectPureFunctions(tNode* root, Vector* pure) {
+    TPurity purity = {};
+    FunctionTableCtor(&purity.functions, root);
+
+    Vector globals = {};
+    vectorInit(&globals, kInitialSizeOfNameVector);
+    CollectGlobals(root, &globals);
+
+    size_t count = purity.functions.count;
+    purity.locals = (Vector*)calloc(count + 1, sizeof(Vector));
+    purity.isPure = (bool*)calloc(count + 1, sizeof(bool));
+    assert(purity.locals && purity.isPure);
+    for (size_t i = 0; i < count; i++) {
+        vectorInit(&purity.locals[i], kInitialSizeOfNameVector);
+        CollectLocals(purity.functions.entries[i].function, &globals, &purity.locals[i]);
+        purity.isPure[i] = true;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < count; i++) {
+            if (purity.isPure[i] && !IsPureCode(&purity, i, purity.functions.entries[i].function->right)) {
+                purity.isPure[i] = false;
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (purity.isPure[i]) {
+            AddName(pure, purity.functions.entries[i].function->value);
+        }
+        vectorFree(&purity.locals[i]);
+    }
+    free(purity.locals);
+    free(purity.isPure);
+    vectorFree(&globals);
+    FunctionTableDtor(&purity.functions);
+}
+
+// Тело чистой функции, которая вызывает себя больше одного раза (или любой чистой функции в режиме pure),
+// оборачивается узлом memoize: генератор ставит перед ним поиск аргументов в таблице результатов
+tNode* MemoizeFunctions(tNode* root, const Options* options) {
+    if (options->memoization == NoMemoization || !options->memoSize) {
+        return root;
+    }
+
+    Vector pure = {};
+    vectorInit(&pure, kInitialSizeOfNameVector);
+    CollectPureFunctions(root, &pure);
+
+    Vector functions = {};
+    vectorInit(&functions, kInitialSizeOfNameVector);
+    CollectFunctionNodes(root, &functions);
+
+    Vector parallel = {}; // таблицу результатов пишут без блокировок, поэтому из потоков ее не трогают
+    vectorInit(&parallel, kInitialSizeOfNameVector);
+    CollectParallelCallees(root, &parallel);
+
+    for (size_t i = 0; i < functions.size; i++) {
+        tNode* function = (tNode*)functions.data[i];
+        size_t paramCount = CountChain(function->left);
+        if (!ContainsName(&pure, function->value) || !paramCount || paramCount > kMaxMemoizedParameters
+            || ContainsName(&parallel, function->value) || IsOperation(function->right, Memoize)) {
+            continue;
+        }
+        if (options->memoization == RecursiveMemoization && CountSelfCalls(function->right, function->value) < 2) {
+            continue;
+        }
+
+        tNode* size = NewNumberNode((long long)GetCacheSize(options->memoSize));
+        function->right = newNode(Operation, keyMemoize, function->right, size);
+    }
+
+    vectorFree(&parallel);
+    vectorFree(&functions);
+    vectorFree(&pure);
+    return root;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void CollectFunctionNodes(tNode* node, Vector* functions) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        vectorPush(functions, node);
+    } else if (IsOperation(node, Semicolon)) {
+        CollectFunctionNodes(node->left, functions);
+        CollectFunctionNodes(node->right, functions);
+    }
+}
+
+// Имя, которого нет среди локальных, - глобальная переменная
+static bool IsPureCode(TPurity* purity, size_t function, tNode* node) {
+    if (!node) {
+        return true;
+    }
+
+    switch (node->type) {
+        case Number:        return true;
+        case Identifier:    return IsLocalOperand(purity, function, node);
+        case Calling: {
+            size_t callee = GetFunctionIndex(&purity->functions, node->value);
+            if (callee == purity->functions.count || !purity->isPure[callee]) {
+                return false;
+            }
+            for (tNode* arg = node->left; arg; arg = arg->left) { // аргументы - цепочка по left
+                if (!IsLocalOperand(purity, function, arg)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case Operation:
+            switch (GetOperationType(node->value)) {
+                case Print:
+                case Index:
+                case Store:
+                case Array:
+                case Import:    return false; // тело другого модуля неизвестно
+                default:        return IsPureCode(purity, function, node->left)
+                                    && IsPureCode(purity, function, node->right);
+            }
+        case Function:
+        default:            return false;
+    }
+}
+
+static bool IsLocalOperand(TPurity* purity, size_t function, tNode* node) {
+    return node->type == Number || (node->type == Identifier && ContainsName(&purity->locals[function], node->value));
+}
+
+static size_t CountSelfCalls(tNode* node, const char* name) {
+    if (!node) {
+        return 0;
+    }
+
+    size_t count = (node->type == Calling && !strcmp(node->value, name)) ? 1 : 0;
+    if (node->type == Calling) {
+        return count; // left - цепочка аргументов
+    }
+    return count + CountSelfCalls(node->left, name) + CountSelfCalls(node->right, name);
+}
+
+// Степень двойки: номер записи - старшие биты хеша аргументов
+static size_t GetCacheSize(size_t size) {
+    size_t power = 1;
+    while (power < size && power < kMaxMemoSize) {
+        power *= 2;
+    }
+    return power;
+}
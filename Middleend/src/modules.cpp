@@ -0,0 +1,336 @@
+#include "modules.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tokenizer.h"
+#include "parser.h"
+#include "tree.h"
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfModuleArray = 8;
+const size_t kInitialSizeOfNameVector = 16;
+const size_t kMaxLengthOfName = 64;
+const char* const kModuleExtension = ".txt";
+const char* const kReservedModuleNames[] = {"code", "nasm"}; // code.txt - программа, nasm.s - ее ассемблер
+
+static void LoadModule(TProgram* program, const char* name, const char* fileName);
+static void CheckModuleName(const char* name);
+static size_t FindModule(TProgram* program, const char* name);
+static void CheckDefinitions(TProgram* program);
+static tNode* RemoveUnitStatement(tNode* root, tNode* statement);
+static void CollectStatements(tNode* node, Vector* statements);
+static void CollectCallees(tNode* node, Vector* callees);
+static void RenameCollisions(tNode* function, Vector* globals, const char* module);
+
+// global ------------------------------------------------------------------------------------------
+
+// Загружает программу и все модули, которые она подключает прямо или через другие модули
+void LoadProgram(TProgram* program, const char* fileName) {
+    assert(program);
+    assert(fileName);
+
+    program->modules = (TModule*)calloc(kInitialSizeOfModuleArray, sizeof(TModule));
+    assert(program->modules);
+    program->capacity = kInitialSizeOfModuleArray;
+    program->count = 0;
+
+    LoadModule(program, NULL, fileName);
+    for (size_t i = 0; i < program->count; i++) { // массив растет, пока обходится
+        for (size_t j = 0; j < program->modules[i].imports.size; j++) {
+            const char* name = (const char*)program->modules[i].imports.data[j];
+            if (FindModule(program, name) != program->count) {
+                continue;
+            }
+            CheckModuleName(name);
+            char moduleFileName[kMaxLengthOfFileName] = "";
+            snprintf(moduleFileName, kMaxLengthOfFileName, "%s%s", name, kModuleExtension);
+            LoadModule(program, name, moduleFileName);
+        }
+    }
+
+    CheckDefinitions(program);
+}
+
+void ProgramDtor(TProgram* program) {
+    for (size_t i = 0; i < program->count; i++) {
+        TModule* module = &program->modules[i];
+        treeDtor(module->root);
+        tokenVectorDtor(&module->tokens);
+        free(module->tokens.data);
+        vectorFree(&module->imports);
+    }
+    free(program->modules);
+}
+
+// Единица компиляции - файл вместе с копиями функций всех модулей, которые он подключает, как заголовки.
+// Функции модулей, которые из нее не вызываются, в единицу не попадают. Переменные функций модуля, имена
+// которых совпали с глобальными переменными программы, переименовываются: в модуле они локальные
+tNode* BuildUnit(TProgram* program, size_t index) {
+    assert(index < program->count);
+
+    tNode* root = copyNode(program->modules[index].root);
+    Vector globals = {};
+    vectorInit(&globals, kInitialSizeOfNameVector);
+    if (!program->modules[index].name) {
+        CollectGlobals(root, &globals);
+    }
+
+    Vector closure = {};
+    vectorInit(&closure, kInitialSizeOfModuleArray);
+    CollectImportClosure(program, index, &closure);
+    Vector imported = {};
+    vectorInit(&imported, kInitialSizeOfNameVector);
+    for (size_t i = 0; i < closure.size; i++) {
+        TModule* module = (TModule*)closure.data[i];
+        Vector statements = {};
+        vectorInit(&statements, kInitialSizeOfNameVector);
+        CollectStatements(module->root, &statements);
+        for (size_t j = 0; j < statements.size; j++) {
+            tNode* copy = copyNode((tNode*)statements.data[j]);
+            RenameCollisions(copy, &globals, module->name);
+            root = AppendStatement(root, copy);
+            vectorPush(&imported, copy);
+        }
+        vectorFree(&statements);
+    }
+
+    // живые функции - те, что вызывает сам файл, и те, что вызывают они
+    Vector live = {};
+    vectorInit(&live, kInitialSizeOfNameVector);
+    CollectCallees(program->modules[index].root, &live);
+    TFunctionTable functions = {};
+    FunctionTableCtor(&functions, root);
+    for (size_t i = 0; i < live.size; i++) { // список растет, пока обходится
+        tNode* function = LookupFunction(&functions, (const char*)live.data[i]);
+        if (function) {
+            CollectCallees(function->right, &live);
+        }
+    }
+    FunctionTableDtor(&functions);
+    for (size_t i = 0; i < imported.size; i++) {
+        tNode* function = (tNode*)imported.data[i];
+        if (!ContainsName(&live, function->value)) {
+            root = RemoveUnitStatement(root, function);
+        }
+    }
+
+    vectorFree(&live);
+    vectorFree(&imported);
+    vectorFree(&closure);
+    vectorFree(&globals);
+    return root;
+}
+
+// --separate: от функций других модулей остаются объявления, их код - в объектных файлах этих модулей.
+// Вызывается после вывода типов, пока тела еще есть
+void DeclareImports(TProgram* program, size_t index, tNode* root) {
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfNameVector);
+    CollectStatements(root, &statements);
+
+    for (size_t i = 0; i < statements.size; i++) {
+        tNode* function = (tNode*)statements.data[i];
+        if (function->type == Function && FindOwner(program, function->value) != index) {
+            treeDtor(function->right);
+            function->right = newNode(Operation, keyImport, NULL, NULL);
+        }
+    }
+    vectorFree(&statements);
+}
+
+// Модули, которые файл подключает прямо или через другие модули, без него самого
+void CollectImportClosure(TProgram* program, size_t index, Vector* closure) {
+    vectorPush(closure, &program->modules[index]);
+    for (size_t i = 0; i < closure->size; i++) { // список растет, пока обходится
+        TModule* module = (TModule*)closure->data[i];
+        for (size_t j = 0; j < module->imports.size; j++) {
+            TModule* import = &program->modules[FindModule(program, (const char*)module->imports.data[j])];
+            bool isCollected = false;
+            for (size_t k = 0; k < closure->size && !isCollected; k++) {
+                isCollected = closure->data[k] == import;
+            }
+            if (!isCollected) {
+                vectorPush(closure, import);
+            }
+        }
+    }
+
+    closure->data[0] = closure->data[closure->size - 1];
+    closure->size--;
+}
+
+void CollectExports(TProgram* program, size_t index, Vector* exports) {
+    if (!program->modules[index].name) {
+        return; // функции программы другим модулям не видны
+    }
+
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfNameVector);
+    CollectStatements(program->modules[index].root, &statements);
+    for (size_t i = 0; i < statements.size; i++) {
+        AddName(exports, ((tNode*)statements.data[i])->value);
+    }
+    vectorFree(&statements);
+}
+
+// Номер файла, где определена функция, или program->count
+size_t FindOwner(TProgram* program, const char* function) {
+    for (size_t i = 0; i < program->count; i++) {
+        if (FindFunction(program->modules[i].root, function)) {
+            return i;
+        }
+    }
+    return program->count;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void LoadModule(TProgram* program, const char* name, const char* fileName) {
+    if (program->count == program->capacity) {
+        program->capacity *= 2;
+        program->modules = (TModule*)realloc(program->modules, program->capacity * sizeof(TModule));
+        assert(program->modules);
+    }
+
+    TModule* module = &program->modules[program->count++];
+    *module = {
+        .name = name,
+        .fileName = "",
+        .tokens = {},
+        .root = NULL,
+        .imports = {},
+    };
+    strncpy(module->fileName, fileName, kMaxLengthOfFileName - 1);
+    vectorInit(&module->imports, kInitialSizeOfNameVector);
+
+    module->tokens = tokenizer(module->fileName);
+    module->root = runParser(module->tokens);
+
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfNameVector);
+    CollectStatements(module->root, &statements);
+    for (size_t i = 0; i < statements.size; i++) {
+        tNode* statement = (tNode*)statements.data[i];
+        if (IsOperation(statement, Import)) {
+            AddName(&module->imports, statement->left->value);
+            module->root = RemoveUnitStatement(module->root, statement);
+        } else if (name && statement->type != Function) {
+            fprintf(stderr, "Error: module %s may contain only def and import\n", module->fileName);
+            exit(EXIT_FAILURE);
+        }
+    }
+    vectorFree(&statements);
+}
+
+static void CheckModuleName(const char* name) {
+    bool isValid = *name && strlen(name) < kMaxLengthOfName;
+    for (const char* c = name; *c && isValid; c++) {
+        isValid = isalnum((unsigned char)*c) || *c == '_';
+    }
+    for (size_t i = 0; i < sizeof(kReservedModuleNames) / sizeof(kReservedModuleNames[0]) && isValid; i++) {
+        isValid = strcmp(name, kReservedModuleNames[i]);
+    }
+
+    if (!isValid) {
+        fprintf(stderr, "Error: '%s' cannot be a module name\n", name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static size_t FindModule(TProgram* program, const char* name) {
+    for (size_t i = 0; i < program->count; i++) {
+        if (program->modules[i].name && !strcmp(program->modules[i].name, name)) {
+            return i;
+        }
+    }
+    return program->count;
+}
+
+static void CheckDefinitions(TProgram* program) {
+    // таблицы строятся один раз: FindOwner на каждую функцию обходил бы все модули заново
+    TFunctionTable* tables = (TFunctionTable*)calloc(program->count, sizeof(TFunctionTable));
+    assert(tables);
+    for (size_t i = 0; i < program->count; i++) {
+        FunctionTableCtor(&tables[i], program->modules[i].root);
+    }
+
+    for (size_t i = 0; i < program->count; i++) {
+        Vector statements = {};
+        vectorInit(&statements, kInitialSizeOfNameVector);
+        CollectStatements(program->modules[i].root, &statements);
+        for (size_t j = 0; j < statements.size; j++) {
+            tNode* function = (tNode*)statements.data[j];
+            size_t owner = i;
+            if (function->type == Function) {
+                for (owner = 0; !LookupFunction(&tables[owner], function->value); owner++) {}
+            }
+            if (owner != i) {
+                fprintf(stderr, "Error: function '%s' is defined in both %s and %s\n", function->value,
+                        program->modules[owner].fileName, program->modules[i].fileName);
+                exit(EXIT_FAILURE);
+            }
+        }
+        vectorFree(&statements);
+    }
+
+    for (size_t i = 0; i < program->count; i++) {
+        FunctionTableDtor(&tables[i]);
+    }
+    free(tables);
+}
+
+// RemoveStatement не удаляет единственный оператор: файл может состоять из одного import
+static tNode* RemoveUnitStatement(tNode* root, tNode* statement) {
+    if (root == statement) {
+        treeDtor(root);
+        return NULL;
+    }
+    return RemoveStatement(root, statement);
+}
+
+static void CollectStatements(tNode* node, Vector* statements) {
+    if (!node) {
+        return;
+    }
+
+    if (IsOperation(node, Semicolon)) {
+        CollectStatements(node->left, statements);
+        CollectStatements(node->right, statements);
+    } else {
+        vectorPush(statements, node);
+    }
+}
+
+static void CollectCallees(tNode* node, Vector* callees) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Calling) {
+        AddName(callees, node->value);
+    }
+    CollectCallees(node->left, callees);
+    CollectCallees(node->right, callees);
+}
+
+static void RenameCollisions(tNode* function, Vector* globals, const char* module) {
+    for (size_t i = 0; i < globals->size; i++) {
+        const char* name = (const char*)globals->data[i];
+        bool isParam = false;
+        for (tNode* param = function->left; param && !isParam; param = param->left) {
+            isParam = !strcmp(param->value, name);
+        }
+        if (isParam || !CountReferences(function->right, name)) {
+            continue; // параметр закрывает глобальную переменную
+        }
+
+        char newName[kMaxLengthOfName + kMaxLengthOfName] = "";
+        snprintf(newName, sizeof(newName), "_%s_%s", module, name);
+        RenameVariable(function->right, name, storeString(newName));
+    }
+}
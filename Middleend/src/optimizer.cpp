@@ -0,0 +1,46 @@
+#include "optimizer.h"
+
+#include "deadCode.h"
+#include "evaluator.h"
+#include "ifConverter.h"
+#include "inliner.h"
+#include "loopOptimizer.h"
+#include "memoizer.h"
+#include "parallelizer.h"
+#include "scalarEvolution.h"
+#include "specializer.h"
+#include "switchConverter.h"
+#include "unroller.h"
+#include "vectorizer.h"
+
+// global ------------------------------------------------------------------------------------------
+
+tNode* RunOptimizer(tNode* root, const Options* options, TTypeInfo* types) {
+    CheckParallelLoops(root, options, types);
+    if (options->enableEvaluation) {
+        root = EvaluateProgram(root, options, types);
+    }
+    if (options->enableSpecialization) {
+        root = SpecializeFunctions(root, options, types);
+    }
+    if (options->enableTailCalls) {
+        root = EliminateTailCalls(root);
+    }
+    if (options->enableInlining) {
+        root = RunInliner(root, options, types);
+    }
+    root = ReplaceClosedForms(root, options, types);
+    if (options->enableLoopOptimizations) {
+        root = OptimizeLoops(root, types);
+    }
+    root = EliminateDeadCode(root, options);
+    if (options->enableVectorization) {
+        root = VectorizeLoops(root, options, types);
+    }
+    root = UnrollLoops(root, options);
+    root = MemoizeFunctions(root, options);
+    root = ConvertSwitches(root, options, types);
+    root = ConvertIfs(root, options, types);
+
+    return root;
+}
@@ -0,0 +1,350 @@
+#include "parallelizer.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfNameVector = 16;
+
+struct TParallelChecker {
+    tNode* root;
+    TTypeInfo* types;
+    bool allowFloatReductions;
+    Vector safe; // функции, которые можно вызывать из тела
+};
+
+struct TSafety {
+    Vector functions;
+    Vector* locals; // по одному на функцию
+    bool* isSafe;
+};
+
+static void CheckStatement(TParallelChecker* checker, tNode* node, tNode* function);
+static void CheckLoop(TParallelChecker* checker, tNode* loop, tNode* function);
+static void CheckBody(TParallelChecker* checker, tNode* node, tNode* function);
+[[noreturn]] static void ParallelError(tNode* function, const char* message, const char* name);
+static void CollectSafeFunctions(tNode* root, Vector* safe);
+static void CollectFunctionNodes(tNode* node, Vector* functions);
+static bool IsSafeCode(TSafety* safety, size_t function, tNode* node);
+static bool IsReduction(tNode* body, const char* name);
+static bool HasOnlySums(tNode* node, const char* name);
+static bool IsSumOf(tNode* expression, const char* name);
+static bool IsAssignedBeforeUse(tNode* node, const char* name, bool* isDecided);
+static void CollectCallees(tNode* node, Vector* callees);
+static void CollectLoopCallees(tNode* node, Vector* callees);
+
+// global ------------------------------------------------------------------------------------------
+
+// Итерации parallel while выполняются в разных потоках, поэтому тело не печатает, не возвращает значение
+// и вызывает только функции, которые не печатают и не присваивают глобальным переменным.
+// Независимость итераций по элементам массивов остается на совести программиста
+void CheckParallelLoops(tNode* root, const Options* options, TTypeInfo* types) {
+    TParallelChecker checker = {
+        .root = root,
+        .types = types,
+        .allowFloatReductions = options->fastMath,
+        .safe = {},
+    };
+    vectorInit(&checker.safe, kInitialSizeOfNameVector);
+    CollectSafeFunctions(root, &checker.safe);
+
+    CheckStatement(&checker, root, NULL);
+
+    vectorFree(&checker.safe);
+}
+
+bool MatchParallelLoop(tNode* loop, TParallelLoop* parallel) {
+    assert(parallel);
+
+    *parallel = {};
+    tNode* condition = loop->left;
+    tNode* update = GetLastStatement(loop->right);
+    long long step = 0;
+    if (!IsOperation(condition, Less) || condition->left->type != Identifier
+        || (condition->right->type != Identifier && condition->right->type != Number)
+        || !IsOperation(update, Equal) || strcmp(update->left->value, condition->left->value)
+        || !IsOperation(update->right, Add) || !IsSameTree(update->right->left, condition->left)
+        || !GetNumber(update->right->right, &step) || step != 1
+        || CountAssignments(loop->right, condition->left->value) != 1) {
+        return false;
+    }
+    parallel->counter = condition->left->value;
+    parallel->limit = condition->right;
+    if (parallel->limit->type == Identifier && IsAssigned(loop->right, parallel->limit->value)) {
+        return false;
+    }
+
+    Vector assigned = {};
+    vectorInit(&assigned, kInitialSizeOfNameVector);
+    CollectAssignments(loop->right, &assigned);
+
+    vectorInit(&parallel->reductions, kInitialSizeOfNameVector);
+    vectorInit(&parallel->privates, kInitialSizeOfNameVector);
+    for (size_t i = 0; i < assigned.size; i++) {
+        const char* name = (const char*)assigned.data[i];
+        if (strcmp(name, parallel->counter) && IsReduction(loop->right, name)) {
+            AddName(&parallel->reductions, name);
+        } else {
+            AddName(&parallel->privates, name);
+        }
+    }
+    vectorFree(&assigned);
+    return true;
+}
+
+void ParallelLoopDtor(TParallelLoop* parallel) {
+    vectorFree(&parallel->reductions);
+    vectorFree(&parallel->privates);
+}
+
+// Функции, которые вызываются из тел parallel while напрямую или через другие функции
+void CollectParallelCallees(tNode* root, Vector* callees) {
+    CollectLoopCallees(root, callees);
+
+    for (size_t i = 0; i < callees->size; i++) { // список растет, пока обходится
+        tNode* function = FindFunction(root, (const char*)callees->data[i]);
+        if (function) {
+            CollectCallees(function->right, callees);
+        }
+    }
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void CheckStatement(TParallelChecker* checker, tNode* node, tNode* function) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        CheckStatement(checker, node->right, node);
+        return;
+    }
+    if (IsOperation(node, ParallelWhile)) {
+        CheckLoop(checker, node, function);
+    }
+
+    CheckStatement(checker, node->left, function);
+    CheckStatement(checker, node->right, function);
+}
+
+static void CheckLoop(TParallelChecker* checker, tNode* loop, tNode* function) {
+    TParallelLoop parallel = {};
+    if (!MatchParallelLoop(loop, &parallel)) {
+        ParallelError(function, "the loop must look like parallel while ( i < n ) { ... ; i = i + 1 ; }, "
+                                "where only the last statement changes i and n is not changed", "");
+    }
+
+    if (IsFloatVariable(checker->types, function, parallel.counter)
+        || IsFloatExpression(checker->types, function, parallel.limit)) {
+        ParallelError(function, "the counter and the limit must be integers", "");
+    }
+    for (size_t i = 0; i < parallel.reductions.size && !checker->allowFloatReductions; i++) {
+        const char* name = (const char*)parallel.reductions.data[i];
+        if (IsFloatVariable(checker->types, function, name)) {
+            ParallelError(function, "sum of doubles changes with the order of additions, use --fast-math:", name);
+        }
+    }
+    for (size_t i = 0; i < parallel.privates.size; i++) {
+        const char* name = (const char*)parallel.privates.data[i];
+        bool isDecided = false;
+        if (strcmp(name, parallel.counter) && !IsAssignedBeforeUse(loop->right, name, &isDecided)) {
+            ParallelError(function, "the value is carried between iterations, only sums s = s + expr are allowed:",
+                          name);
+        }
+    }
+    CheckBody(checker, loop->right, function);
+
+    ParallelLoopDtor(&parallel);
+}
+
+static void CheckBody(TParallelChecker* checker, tNode* node, tNode* function) {
+    if (!node) {
+        return;
+    }
+
+    if (IsOperation(node, Print)) {
+        ParallelError(function, "print inside the loop", "");
+    }
+    if (IsOperation(node, Return)) {
+        ParallelError(function, "return inside the loop", "");
+    }
+    if (node->type == Calling) {
+        if (!ContainsName(&checker->safe, node->value)) {
+            ParallelError(function, "the loop calls a function that prints or changes globals:", node->value);
+        }
+        return; // left - цепочка аргументов
+    }
+
+    CheckBody(checker, node->left, function);
+    CheckBody(checker, node->right, function);
+}
+
+static void ParallelError(tNode* function, const char* message, const char* name) {
+    fprintf(stderr, "Error: parallel while in %s%s: %s%s%s\n", (function) ? "function " : "top-level code",
+            (function) ? function->value : "", message, (*name) ? " " : "", name);
+    exit(EXIT_FAILURE);
+}
+
+// Сначала подходят все функции, затем исключаются те, что печатают, присваивают глобальным
+// или вызывают исключенные, пока список не перестанет меняться
+static void CollectSafeFunctions(tNode* root, Vector* safe) {
+    TSafety safety = {};
+    vectorInit(&safety.functions, kInitialSizeOfNameVector);
+    CollectFunctionNodes(root, &safety.functions);
+
+    Vector globals = {};
+    vectorInit(&globals, kInitialSizeOfNameVector);
+    CollectGlobals(root, &globals);
+
+    size_t count = safety.functions.size;
+    safety.locals = (Vector*)calloc(count + 1, sizeof(Vector));
+    safety.isSafe = (bool*)calloc(count + 1, sizeof(bool));
+    assert(safety.locals && safety.isSafe);
+    for (size_t i = 0; i < count; i++) {
+        vectorInit(&safety.locals[i], kInitialSizeOfNameVector);
+        CollectLocals((tNode*)safety.functions.data[i], &globals, &safety.locals[i]);
+        safety.isSafe[i] = true;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < count; i++) {
+            if (safety.isSafe[i] && !IsSafeCode(&safety, i, ((tNode*)safety.functions.data[i])->right)) {
+                safety.isSafe[i] = false;
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (safety.isSafe[i]) {
+            AddName(safe, ((tNode*)safety.functions.data[i])->value);
+        }
+        vectorFree(&safety.locals[i]);
+    }
+    free(safety.locals);
+    free(safety.isSafe);
+    vectorFree(&globals);
+    vectorFree(&safety.functions);
+}
+
+static void CollectFunctionNodes(tNode* node, Vector* functions) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        vectorPush(functions, node);
+    } else if (IsOperation(node, Semicolon)) {
+        CollectFunctionNodes(node->left, functions);
+        CollectFunctionNodes(node->right, functions);
+    }
+}
+
+static bool IsSafeCode(TSafety* safety, size_t function, tNode* node) {
+    if (!node) {
+        return true;
+    }
+
+    if (IsOperation(node, Print) || IsOperation(node, Import)) { // тело другого модуля проверить нельзя
+        return false;
+    }
+    if (IsOperation(node, Equal) && !ContainsName(&safety->locals[function], node->left->value)) {
+        return false;
+    }
+    if (node->type == Calling) {
+        for (size_t i = 0; i < safety->functions.size; i++) {
+            if (!strcmp(((tNode*)safety->functions.data[i])->value, node->value)) {
+                return safety->isSafe[i];
+            }
+        }
+        return false;
+    }
+    return IsSafeCode(safety, function, node->left) && IsSafeCode(safety, function, node->right);
+}
+
+// Сумма упоминается только в своих присваиваниях s = s + a - b ... или s = expr + s, а слагаемые ее не содержат
+static bool IsReduction(tNode* body, const char* name) {
+    size_t assignments = CountAssignments(body, name);
+    return CountReferences(body, name) == 2 * assignments && HasOnlySums(body, name);
+}
+
+static bool HasOnlySums(tNode* node, const char* name) {
+    if (!node) {
+        return true;
+    }
+
+    if (IsOperation(node, Equal) && !strcmp(node->left->value, name)) {
+        return IsSumOf(node->right, name);
+    }
+    return HasOnlySums(node->left, name) && HasOnlySums(node->right, name);
+}
+
+static bool IsSumOf(tNode* expression, const char* name) {
+    if (IsOperation(expression, Add) && expression->right->type == Identifier
+        && !strcmp(expression->right->value, name)) {
+        return !CountReferences(expression->left, name);
+    }
+    if (!IsOperation(expression, Add) && !IsOperation(expression, Sub)) {
+        return false;
+    }
+    for (; IsOperation(expression, Add) || IsOperation(expression, Sub); expression = expression->left) {
+        if (CountReferences(expression->right, name)) {
+            return false;
+        }
+    }
+    return expression->type == Identifier && !strcmp(expression->value, name);
+}
+
+// Каждая итерация сначала присваивает переменной значение, которое от нее не зависит, и только потом читает ее.
+// Присваивание внутри if или вложенного цикла может не выполниться, поэтому там любое упоминание - чтение
+static bool IsAssignedBeforeUse(tNode* node, const char* name, bool* isDecided) {
+    if (!node || *isDecided) {
+        return true;
+    }
+
+    if (IsOperation(node, Semicolon)) {
+        return IsAssignedBeforeUse(node->left, name, isDecided) && IsAssignedBeforeUse(node->right, name, isDecided);
+    }
+    if (IsOperation(node, Equal) && !strcmp(node->left->value, name)) {
+        *isDecided = true;
+        return !CountReferences(node->right, name);
+    }
+    if (CountReferences(node, name)) {
+        *isDecided = true;
+        return false;
+    }
+    return true;
+}
+
+static void CollectCallees(tNode* node, Vector* callees) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Calling) {
+        AddName(callees, node->value);
+        return;
+    }
+    CollectCallees(node->left, callees);
+    CollectCallees(node->right, callees);
+}
+
+static void CollectLoopCallees(tNode* node, Vector* callees) {
+    if (!node) {
+        return;
+    }
+
+    if (IsOperation(node, ParallelWhile)) {
+        CollectCallees(node->right, callees);
+        return;
+    }
+    CollectLoopCallees(node->left, callees);
+    CollectLoopCallees(node->right, callees);
+}
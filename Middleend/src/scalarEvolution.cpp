@@ -0,0 +1,718 @@
+#include "scalarEvolution.h"
+
+#include <string.h>
+
+#include "tree.h"
+#include "dsl.h"
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kMaxEvolutions = 16;
+const size_t kMaxGuards = 2;
+const size_t kMaxLengthOfName = 32;
+const size_t kInitialSizeOfNameVector = 16;
+const size_t kInitialSizeOfStatementVector = 16;
+
+enum EvolutionKind {
+    InductionEvolution  = 1, // i = i + step, шаг не меняется в цикле
+    SumEvolution        = 2, // s = s + f, f аффинна по индукционным переменным: сумма прогрессий
+    ValueEvolution      = 3, // x = f: после цикла остается значение последней итерации
+};
+
+// constant + сумма coefficients [ k ] * i_k, где i_k - индукционная переменная evolutions [ k ], + self * x
+// для присваивания x = ...; NULL - ноль
+struct TAffine {
+    tNode* constant;
+    tNode* coefficients[kMaxEvolutions];
+    tNode* self;
+};
+
+struct TEvolution {
+    const char* name;
+    EvolutionKind kind;
+    size_t position; // номер оператора в теле цикла
+    bool isSubtracted; // i = i - step
+    TAffine term; // шаг, слагаемое или присваиваемое значение
+    tNode* statement;
+};
+
+struct TScalarEvolution {
+    Vector globals;
+    TTypeInfo* types;
+    size_t counter; // для уникальных имен временных переменных
+};
+
+struct TLoopEvolution {
+    tNode* loop;
+    tNode* function;
+    TTypeInfo* types;
+    bool hasCalls;
+    Vector variant; // переменные, меняющиеся в цикле
+    Vector statements; // операторы тела верхнего уровня
+    TEvolution evolutions[kMaxEvolutions];
+    size_t count;
+    size_t counter; // счетчик цикла в evolutions
+    Operations op; // counter op bound
+    tNode* bound;
+    tNode* initial; // число, присвоенное счетчику прямо перед циклом
+};
+
+static void ReplaceInStatement(TScalarEvolution* scev, tNode** slot, tNode* previous, tNode* function);
+static void ReplaceLoop(TScalarEvolution* scev, tNode** slot, tNode* previous, tNode* function);
+static void FindEvolutions(TScalarEvolution* scev, TLoopEvolution* loop);
+static bool MatchCondition(TLoopEvolution* loop, tNode* previous);
+static bool IsFullyClosed(TLoopEvolution* loop);
+static size_t BuildGuards(TLoopEvolution* loop, tNode** guards);
+static tNode* BuildClosedForm(TScalarEvolution* scev, TLoopEvolution* loop, bool isFull);
+
+static tNode* GetUpdateTerm(tNode* statement, bool* isSubtracted);
+static bool IsIntegerInvariant(TLoopEvolution* loop, tNode* node);
+static bool IsEvolving(TScalarEvolution* scev, TLoopEvolution* loop, const char* name);
+static bool ParseAffine(TLoopEvolution* loop, tNode* node, const char* self, TAffine* affine);
+static bool IsConstantAffine(TAffine* affine);
+static void FreeAffine(TAffine* affine);
+static size_t FindInduction(TLoopEvolution* loop, const char* name);
+static tNode* TripCount(TLoopEvolution* loop);
+static tNode* SumOverLoop(TLoopEvolution* loop, TAffine* term, size_t position, const char* trips, const char* pairs);
+static tNode* LastValue(TLoopEvolution* loop, TAffine* term, size_t position, const char* trips);
+static bool ContainsReturn(tNode* node);
+static void CollectStatements(tNode* node, Vector* statements);
+static const char* NewTemporary(TScalarEvolution* scev);
+
+static tNode* Sum(tNode* first, tNode* second);
+static tNode* Difference(tNode* first, tNode* second);
+static tNode* Product(tNode* first, tNode* second);
+static bool IsZero(tNode* node);
+
+// global ------------------------------------------------------------------------------------------
+
+// Циклы while со счетчиком i = i +- c и условием i < n (<=, >, >=) по инвариантной границе n. Число итераций
+// T вычисляется заранее, а переменные, которые цикл только наращивает на аффинные выражения от индукционных
+// переменных, получают значения по формулам сумм арифметических прогрессий. Если весь цикл - такие
+// присваивания, он заменяется формулами целиком, иначе из него выносятся только суммы. Формулы считаются
+// по модулю 2^64, как и сам цикл, а деления в них точные
+tNode* ReplaceClosedForms(tNode* root, const Options* options, TTypeInfo* types) {
+    if (!options->enableClosedForms || options->overflow == BignumOverflow) { // длинные суммы не переполняются
+        return root;
+    }
+
+    TScalarEvolution scev = {
+        .globals = {},
+        .types = types,
+        .counter = 0,
+    };
+    vectorInit(&scev.globals, kInitialSizeOfNameVector);
+    CollectGlobals(root, &scev.globals);
+
+    ReplaceInStatement(&scev, &root, NULL, NULL);
+
+    vectorFree(&scev.globals);
+    return root;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void ReplaceInStatement(TScalarEvolution* scev, tNode** slot, tNode* previous, tNode* function) {
+    tNode* node = *slot;
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        ReplaceInStatement(scev, &node->right, NULL, node);
+    } else if (IsOperation(node, Semicolon)) {
+        ReplaceInStatement(scev, &node->left, previous, function);
+        ReplaceInStatement(scev, &node->right, GetLastStatement(node->left), function);
+    } else if (IsOperation(node, If)) {
+        ReplaceInStatement(scev, &node->right, NULL, function);
+    } else if (IsOperation(node, While)) { // внутренние циклы раньше: после замены внешний может стать проще
+        ReplaceInStatement(scev, &node->right, NULL, function);
+        ReplaceLoop(scev, slot, previous, function);
+    } // parallel while делится между потоками по своему счетчику и остается как есть
+}
+
+static void ReplaceLoop(TScalarEvolution* scev, tNode** slot, tNode* previous, tNode* function) {
+    TLoopEvolution loop = {
+        .loop = *slot,
+        .function = function,
+        .types = scev->types,
+        .hasCalls = ContainsCalling(*slot),
+        .variant = {},
+        .statements = {},
+        .evolutions = {},
+        .count = 0,
+        .counter = 0,
+        .op = NoOperation,
+        .bound = NULL,
+        .initial = NULL,
+    };
+    vectorInit(&loop.variant, kInitialSizeOfNameVector);
+    vectorInit(&loop.statements, kInitialSizeOfStatementVector);
+    CollectAssignments(loop.loop, &loop.variant);
+    if (loop.hasCalls) {
+        for (size_t i = 0; i < scev->globals.size; i++) { // вызов может изменить любую глобальную
+            AddName(&loop.variant, (const char*)scev->globals.data[i]);
+        }
+    }
+    CollectStatements(loop.loop->right, &loop.statements);
+
+    FindEvolutions(scev, &loop);
+    if (MatchCondition(&loop, previous)) {
+        tNode* guards[kMaxGuards] = {};
+        size_t guardCount = BuildGuards(&loop, guards);
+        bool isFull = IsFullyClosed(&loop);
+        tNode* closed = NULL;
+        // без полной замены суммы уходят из цикла, поэтому проверки при выполнении недопустимы
+        if (isFull || (!guardCount && !ContainsReturn(loop.loop))) {
+            closed = BuildClosedForm(scev, &loop, isFull);
+        }
+
+        if (closed) {
+            for (size_t i = guardCount; i > 0; i--) {
+                closed = IF(guards[i - 1], closed);
+                guards[i - 1] = NULL;
+            }
+            closed = IF(copyNode(loop.loop->left), closed);
+            if (isFull && !guardCount) {
+                *slot = closed;
+                treeDtor(loop.loop);
+            } else { // цикл остается: после формул условие уже ложно, иначе он выполняется как раньше
+                *slot = SEMICOLON(closed, loop.loop);
+            }
+        }
+        for (size_t i = 0; i < guardCount; i++) {
+            if (guards[i]) {
+                treeDtor(guards[i]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < loop.count; i++) {
+        FreeAffine(&loop.evolutions[i].term);
+    }
+    vectorFree(&loop.statements);
+    vectorFree(&loop.variant);
+}
+
+// Сначала индукционные переменные: от их значений зависят слагаемые сумм
+static void FindEvolutions(TScalarEvolution* scev, TLoopEvolution* loop) {
+    for (size_t i = 0; i < loop->statements.size && loop->count < kMaxEvolutions; i++) {
+        tNode* statement = (tNode*)loop->statements.data[i];
+        bool isSubtracted = false;
+        tNode* step = GetUpdateTerm(statement, &isSubtracted);
+        if (!step || !IsEvolving(scev, loop, statement->left->value) || !IsIntegerInvariant(loop, step)) {
+            continue;
+        }
+
+        TEvolution* evolution = &loop->evolutions[loop->count++];
+        *evolution = {
+            .name = statement->left->value,
+            .kind = InductionEvolution,
+            .position = i,
+            .isSubtracted = isSubtracted,
+            .term = {},
+            .statement = statement,
+        };
+        ParseAffine(loop, step, NULL, &evolution->term);
+    }
+
+    for (size_t i = 0; i < loop->statements.size && loop->count < kMaxEvolutions; i++) {
+        tNode* statement = (tNode*)loop->statements.data[i];
+        if (!IsOperation(statement, Equal) || FindInduction(loop, statement->left->value) < loop->count
+            || !IsEvolving(scev, loop, statement->left->value)) {
+            continue;
+        }
+
+        const char* name = statement->left->value;
+        TAffine affine = {};
+        if (!ParseAffine(loop, statement->right, name, &affine)) {
+            continue;
+        }
+        long long self = 0;
+        if (affine.self && (!GetNumber(affine.self, &self) || self != 1)) { // x = 2 * x + ... - не прогрессия
+            FreeAffine(&affine);
+            continue;
+        }
+        bool isSum = affine.self != NULL;
+        if (isSum) {
+            treeDtor(affine.self);
+            affine.self = NULL;
+        }
+
+        loop->evolutions[loop->count++] = {
+            .name = name,
+            .kind = (isSum) ? SumEvolution : ValueEvolution,
+            .position = i,
+            .isSubtracted = false,
+            .term = affine,
+            .statement = statement,
+        };
+    }
+}
+
+// i op n или n op i, где i - индукционная переменная с положительным числовым шагом, идущая к границе
+static bool MatchCondition(TLoopEvolution* loop, tNode* previous) {
+    tNode* condition = loop->loop->left;
+    if (!condition || condition->type != Operation || !condition->left || !condition->right) {
+        return false;
+    }
+
+    Operations op = GetOperationType(condition->value);
+    tNode* counter = condition->left;
+    tNode* bound = condition->right;
+    if (counter->type != Identifier || FindInduction(loop, counter->value) >= loop->count) {
+        counter = condition->right;
+        bound = condition->left;
+        op = (op == Less) ? Greater : (op == Greater) ? Less
+           : (op == LessOrEqual) ? GreaterOrEqual : (op == GreaterOrEqual) ? LessOrEqual : op;
+    }
+    if (counter->type != Identifier || !IsIntegerInvariant(loop, bound)) {
+        return false;
+    }
+
+    size_t index = FindInduction(loop, counter->value);
+    long long step = 0;
+    if (index >= loop->count || !GetNumber(loop->evolutions[index].term.constant, &step) || step <= 0) {
+        return false;
+    }
+    bool isUp = !loop->evolutions[index].isSubtracted;
+    if ((isUp && op != Less && op != LessOrEqual) || (!isUp && op != Greater && op != GreaterOrEqual)) {
+        return false;
+    }
+
+    long long value = 0;
+    loop->counter = index;
+    loop->op = op;
+    loop->bound = bound;
+    if (IsOperation(previous, Equal) && !strcmp(previous->left->value, counter->value)
+        && GetNumber(previous->right, &value)) {
+        loop->initial = previous->right;
+    }
+    return !(isUp && GetNumber(bound, &value) && value > kMaxSafeNumber - step); // i + step > LLONG_MAX
+}
+
+// Цикл состоит только из индукционных переменных, сумм и присваиваний, которые нигде больше не читаются
+static bool IsFullyClosed(TLoopEvolution* loop) {
+    if (loop->count != loop->statements.size) {
+        return false;
+    }
+
+    for (size_t i = 0; i < loop->count; i++) {
+        TEvolution* evolution = &loop->evolutions[i];
+        size_t references = CountReferences(loop->loop, evolution->name);
+        if ((evolution->kind == SumEvolution && references != 2)
+            || (evolution->kind == ValueEvolution && references != 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Проверки при выполнении, без которых i +- step или расстояние между i и n могут переполниться.
+// При |n|, |i| < 2^62 ни то, ни другое невозможно; числа в программе неотрицательны и не больше 2^62
+static size_t BuildGuards(TLoopEvolution* loop, tNode** guards) {
+    TEvolution* counter = &loop->evolutions[loop->counter];
+    long long step = 0;
+    GetNumber(counter->term.constant, &step);
+    bool isUp = !counter->isSubtracted;
+    bool isUnit = step == 1 && (loop->op == Less || loop->op == Greater); // последнее значение - сама граница
+    bool isBoundKnown = loop->bound->type == Number;
+    bool isInitialKnown = loop->initial != NULL;
+
+    bool needsBound = !isBoundKnown && !isUnit;
+    bool needsCounter = false;
+    if ((isUp && !isInitialKnown) || (!isUp && !isBoundKnown)) { // n - i или i - n может не поместиться
+        needsBound = !isBoundKnown;
+        needsCounter = !isInitialKnown;
+    }
+
+    size_t count = 0;
+    tNode* limit = NewNumberNode(kMaxSafeNumber);
+    if (needsBound) {
+        guards[count++] = (isUp) ? newNode(Operation, keyLess, copyNode(loop->bound), copyNode(limit))
+                                 : newNode(Operation, keyGreater, copyNode(loop->bound),
+                                           SUB(NewNumberNode(0), copyNode(limit)));
+    }
+    if (needsCounter) {
+        guards[count++] = (isUp) ? newNode(Operation, keyGreater, VAR(counter->name),
+                                           SUB(NewNumberNode(0), copyNode(limit)))
+                                 : newNode(Operation, keyLess, VAR(counter->name), copyNode(limit));
+    }
+    treeDtor(limit);
+    return count;
+}
+
+// T = (n - i - [<]) / step + 1 итераций; P = T * (T - 1) / 2 считается как h * (T - 1) + (T - 2h) * h
+// при h = T / 2, чтобы произведение не переполнялось до деления. Суммы и последние значения читают
+// переменные до цикла, поэтому индукционные переменные обновляются последними
+static tNode* BuildClosedForm(TScalarEvolution* scev, TLoopEvolution* loop, bool isFull) {
+    bool hasSums = false;
+    bool needsPairs = false;
+    for (size_t i = 0; i < loop->count; i++) {
+        TEvolution* evolution = &loop->evolutions[i];
+        if (evolution->kind != SumEvolution || (!isFull && CountReferences(loop->loop, evolution->name) != 2)) {
+            continue; // сумму, которую читает остальное тело, нельзя посчитать заранее
+        }
+        hasSums = true;
+        needsPairs = needsPairs || !IsConstantAffine(&evolution->term);
+    }
+    if (!isFull && !hasSums) {
+        return NULL;
+    }
+
+    const char* trips = NewTemporary(scev);
+    tNode* block = EQUAL(VAR(trips), TripCount(loop));
+    const char* pairs = NULL;
+    if (needsPairs) {
+        const char* half = NewTemporary(scev);
+        pairs = NewTemporary(scev);
+        block = AppendStatement(block, EQUAL(VAR(half), DIV(VAR(trips), NewNumberNode(2))));
+        block = AppendStatement(block, EQUAL(VAR(pairs),
+                                             ADD(MUL(VAR(half), SUB(VAR(trips), NewNumberNode(1))),
+                                                 MUL(SUB(SUB(VAR(trips), VAR(half)), VAR(half)), VAR(half)))));
+    }
+
+    for (size_t i = 0; i < loop->count; i++) {
+        TEvolution* evolution = &loop->evolutions[i];
+        if (evolution->kind == SumEvolution && (isFull || CountReferences(loop->loop, evolution->name) == 2)) {
+            tNode* total = SumOverLoop(loop, &evolution->term, evolution->position, trips, pairs);
+            if (total) {
+                block = AppendStatement(block, EQUAL(VAR(evolution->name), ADD(VAR(evolution->name), total)));
+            }
+            if (!isFull) {
+                loop->loop->right = RemoveStatement(loop->loop->right, evolution->statement);
+            }
+        } else if (evolution->kind == ValueEvolution && isFull) {
+            tNode* value = LastValue(loop, &evolution->term, evolution->position, trips);
+            block = AppendStatement(block, EQUAL(VAR(evolution->name), (value) ? value : NewNumberNode(0)));
+        }
+    }
+
+    for (size_t i = 0; i < loop->count && isFull; i++) {
+        TEvolution* evolution = &loop->evolutions[i];
+        tNode* delta = Product(copyNode(evolution->term.constant), VAR(trips));
+        if (evolution->kind == InductionEvolution && delta) {
+            tNode* update = (evolution->isSubtracted) ? SUB(VAR(evolution->name), delta)
+                                                      : ADD(VAR(evolution->name), delta);
+            block = AppendStatement(block, EQUAL(VAR(evolution->name), update));
+        } else if (delta) {
+            treeDtor(delta);
+        }
+    }
+    return block;
+}
+
+// i = i + step, i = step + i или i = i - step: возвращает step
+static tNode* GetUpdateTerm(tNode* statement, bool* isSubtracted) {
+    if (!IsOperation(statement, Equal)) {
+        return NULL;
+    }
+
+    const char* name = statement->left->value;
+    tNode* expr = statement->right;
+    *isSubtracted = IsOperation(expr, Sub);
+    if ((IsOperation(expr, Add) || IsOperation(expr, Sub)) && expr->left->type == Identifier
+        && !strcmp(expr->left->value, name)) {
+        return expr->right;
+    }
+    if (IsOperation(expr, Add) && expr->right->type == Identifier && !strcmp(expr->right->value, name)) {
+        return expr->left;
+    }
+    return NULL;
+}
+
+static bool IsIntegerInvariant(TLoopEvolution* loop, tNode* node) {
+    if (IsFloatExpression(loop->types, loop->function, node)) {
+        return false;
+    }
+    if (node->type == Number) {
+        return true;
+    }
+    if (node->type == Identifier) {
+        return !ContainsName(&loop->variant, node->value);
+    }
+    return (IsOperation(node, Add) || IsOperation(node, Sub) || IsOperation(node, Mul))
+        && IsIntegerInvariant(loop, node->left) && IsIntegerInvariant(loop, node->right);
+}
+
+// Целая переменная с единственным присваиванием в цикле, которую вызовы из цикла не видят
+static bool IsEvolving(TScalarEvolution* scev, TLoopEvolution* loop, const char* name) {
+    if (IsFloatVariable(loop->types, loop->function, name) || CountAssignments(loop->loop, name) != 1) {
+        return false;
+    }
+    if (!loop->hasCalls) {
+        return true;
+    }
+
+    for (tNode* param = (loop->function) ? loop->function->left : NULL; param; param = param->left) {
+        if (!strcmp(param->value, name)) {
+            return true;
+        }
+    }
+    return loop->function && !ContainsName(&scev->globals, name);
+}
+
+static bool ParseAffine(TLoopEvolution* loop, tNode* node, const char* self, TAffine* affine) {
+    *affine = {};
+    if (IsFloatExpression(loop->types, loop->function, node)) {
+        return false;
+    }
+
+    if (node->type == Number) {
+        affine->constant = copyNode(node);
+        return true;
+    }
+    if (node->type == Identifier) {
+        if (self && !strcmp(node->value, self)) {
+            affine->self = NewNumberNode(1);
+            return true;
+        }
+        size_t index = FindInduction(loop, node->value);
+        if (index < loop->count) {
+            affine->coefficients[index] = NewNumberNode(1);
+            return true;
+        }
+        if (ContainsName(&loop->variant, node->value)) {
+            return false;
+        }
+        affine->constant = copyNode(node);
+        return true;
+    }
+
+    bool isAdd = IsOperation(node, Add);
+    bool isMul = IsOperation(node, Mul);
+    if (!isAdd && !isMul && !IsOperation(node, Sub)) {
+        return false;
+    }
+
+    TAffine left = {};
+    TAffine right = {};
+    if (!ParseAffine(loop, node->left, self, &left) || !ParseAffine(loop, node->right, self, &right)
+        || (isMul && !IsConstantAffine(&left) && !IsConstantAffine(&right))) {
+        FreeAffine(&left);
+        FreeAffine(&right);
+        return false;
+    }
+
+    if (isMul) { // один из множителей инвариантен
+        TAffine* factor = (IsConstantAffine(&left)) ? &left : &right;
+        TAffine* scaled = (factor == &left) ? &right : &left;
+        affine->constant = Product(scaled->constant, copyNode(factor->constant));
+        for (size_t i = 0; i < kMaxEvolutions; i++) {
+            affine->coefficients[i] = Product(scaled->coefficients[i], copyNode(factor->constant));
+        }
+        affine->self = Product(scaled->self, copyNode(factor->constant));
+        if (factor->constant) {
+            treeDtor(factor->constant);
+        }
+        return true;
+    }
+
+    affine->constant = (isAdd) ? Sum(left.constant, right.constant) : Difference(left.constant, right.constant);
+    for (size_t i = 0; i < kMaxEvolutions; i++) {
+        affine->coefficients[i] = (isAdd) ? Sum(left.coefficients[i], right.coefficients[i])
+                                          : Difference(left.coefficients[i], right.coefficients[i]);
+    }
+    affine->self = (isAdd) ? Sum(left.self, right.self) : Difference(left.self, right.self);
+    return true;
+}
+
+static bool IsConstantAffine(TAffine* affine) {
+    if (affine->self) {
+        return false;
+    }
+    for (size_t i = 0; i < kMaxEvolutions; i++) {
+        if (affine->coefficients[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void FreeAffine(TAffine* affine) {
+    if (affine->constant) {
+        treeDtor(affine->constant);
+    }
+    if (affine->self) {
+        treeDtor(affine->self);
+    }
+    for (size_t i = 0; i < kMaxEvolutions; i++) {
+        if (affine->coefficients[i]) {
+            treeDtor(affine->coefficients[i]);
+        }
+    }
+    *affine = {};
+}
+
+static size_t FindInduction(TLoopEvolution* loop, const char* name) {
+    for (size_t i = 0; i < loop->count; i++) {
+        if (loop->evolutions[i].kind == InductionEvolution && !strcmp(loop->evolutions[i].name, name)) {
+            return i;
+        }
+    }
+    return loop->count;
+}
+
+static tNode* TripCount(TLoopEvolution* loop) {
+    TEvolution* counter = &loop->evolutions[loop->counter];
+    long long step = 0;
+    GetNumber(counter->term.constant, &step);
+    bool isStrict = loop->op == Less || loop->op == Greater;
+
+    tNode* start = (loop->initial) ? copyNode(loop->initial) : VAR(counter->name);
+    tNode* distance = (counter->isSubtracted) ? Difference(start, copyNode(loop->bound))
+                                              : Difference(copyNode(loop->bound), start);
+    if (step == 1) {
+        return (isStrict) ? distance : Sum(distance, NewNumberNode(1));
+    }
+    if (isStrict) {
+        distance = Difference(distance, NewNumberNode(1));
+    }
+    return Sum(DIV(distance, NewNumberNode(step)), NewNumberNode(1));
+}
+
+// Сумма term по всем итерациям. Индукционная переменная, обновленная выше оператора, читается уже
+// со следующим значением: сумма ее значений T * i0 + step * (P + T) вместо T * i0 + step * P
+static tNode* SumOverLoop(TLoopEvolution* loop, TAffine* term, size_t position, const char* trips, const char* pairs) {
+    tNode* total = Product(copyNode(term->constant), VAR(trips));
+    for (size_t i = 0; i < loop->count; i++) {
+        if (!term->coefficients[i]) {
+            continue;
+        }
+
+        TEvolution* induction = &loop->evolutions[i];
+        tNode* steps = (induction->position < position) ? Sum(VAR(pairs), VAR(trips)) : VAR(pairs);
+        tNode* shift = Product(copyNode(induction->term.constant), steps);
+        tNode* start = MUL(VAR(trips), VAR(induction->name));
+        tNode* values = (induction->isSubtracted) ? Difference(start, shift) : Sum(start, shift);
+        total = Sum(total, Product(copyNode(term->coefficients[i]), values));
+    }
+    return total;
+}
+
+// Значение term на последней итерации, T - 1
+static tNode* LastValue(TLoopEvolution* loop, TAffine* term, size_t position, const char* trips) {
+    tNode* value = copyNode(term->constant);
+    for (size_t i = 0; i < loop->count; i++) {
+        if (!term->coefficients[i]) {
+            continue;
+        }
+
+        TEvolution* induction = &loop->evolutions[i];
+        tNode* steps = (induction->position < position) ? VAR(trips) : SUB(VAR(trips), NewNumberNode(1));
+        tNode* shift = Product(copyNode(induction->term.constant), steps);
+        tNode* last = (induction->isSubtracted) ? Difference(VAR(induction->name), shift)
+                                                : Sum(VAR(induction->name), shift);
+        value = Sum(value, Product(copyNode(term->coefficients[i]), last));
+    }
+    return value;
+}
+
+static bool ContainsReturn(tNode* node) {
+    if (!node) {
+        return false;
+    }
+    return IsOperation(node, Return) || ContainsReturn(node->left) || ContainsReturn(node->right);
+}
+
+static void CollectStatements(tNode* node, Vector* statements) {
+    if (!node) {
+        return;
+    }
+
+    if (IsOperation(node, Semicolon)) {
+        CollectStatements(node->left, statements);
+        CollectStatements(node->right, statements);
+    } else {
+        vectorPush(statements, node);
+    }
+}
+
+static const char* NewTemporary(TScalarEvolution* scev) {
+    char name[kMaxLengthOfName] = "";
+    snprintf(name, kMaxLengthOfName, "_e%zu", scev->counter++);
+    return storeString(name);
+}
+
+// Построители выражений забирают операнды; NULL - ноль, числа складываются сразу
+
+static tNode* Sum(tNode* first, tNode* second) {
+    if (IsZero(first)) {
+        if (first) {
+            treeDtor(first);
+        }
+        return second;
+    }
+    if (IsZero(second)) {
+        if (second) {
+            treeDtor(second);
+        }
+        return first;
+    }
+
+    long long a = 0;
+    long long b = 0;
+    if (GetNumber(first, &a) && GetNumber(second, &b) && a <= kMaxSafeNumber - b) {
+        treeDtor(first);
+        treeDtor(second);
+        return NewNumberNode(a + b);
+    }
+    return ADD(first, second);
+}
+
+static tNode* Difference(tNode* first, tNode* second) {
+    if (IsZero(second)) {
+        if (second) {
+            treeDtor(second);
+        }
+        return first;
+    }
+    if (IsZero(first)) {
+        if (first) {
+            treeDtor(first);
+        }
+        first = NewNumberNode(0);
+    }
+
+    long long a = 0;
+    long long b = 0;
+    if (GetNumber(first, &a) && GetNumber(second, &b) && a >= b) {
+        treeDtor(first);
+        treeDtor(second);
+        return NewNumberNode(a - b);
+    }
+    return SUB(first, second);
+}
+
+static tNode* Product(tNode* first, tNode* second) {
+    if (IsZero(first) || IsZero(second)) {
+        if (first) {
+            treeDtor(first);
+        }
+        if (second) {
+            treeDtor(second);
+        }
+        return NULL;
+    }
+
+    long long a = 0;
+    long long b = 0;
+    bool isFirstNumber = GetNumber(first, &a);
+    bool isSecondNumber = GetNumber(second, &b);
+    if (isFirstNumber && isSecondNumber && a <= kMaxSafeNumber / b) {
+        treeDtor(first);
+        treeDtor(second);
+        return NewNumberNode(a * b);
+    }
+    if ((isFirstNumber && a == 1) || (isSecondNumber && b == 1)) {
+        treeDtor((isFirstNumber && a == 1) ? first : second);
+        return (isFirstNumber && a == 1) ? second : first;
+    }
+    return MUL(first, second);
+}
+
+static bool IsZero(tNode* node) {
+    long long value = 0;
+    return !node || (GetNumber(node, &value) && !value);
+}
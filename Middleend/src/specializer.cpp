@@ -0,0 +1,336 @@
+#include "specializer.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "tree.h"
+#include "dsl.h"
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kMaxLengthOfName = 64;
+const size_t kMaxLengthOfKey = 512;
+const size_t kInitialSizeOfNameVector = 16;
+const size_t kMaxSpecializedSize = 256; // максимальный размер копируемой функции в узлах AST
+const size_t kMaxSpecializations = 4; // копий одной функции
+const size_t kMaxForwardingDepth = 4; // через сколько вызовов константа может дойти до условия
+
+struct TSpecializer {
+    tNode* root;
+    TTypeInfo* types;
+    Vector keys; // "f(20,_)": функция и значения параметров, для которых сделана копия
+    Vector clones; // имя копии для каждого ключа
+    Vector functions; // функции, у которых есть копии
+    TFunctionTable table; // копии добавляются по мере появления
+    size_t counter;
+    size_t budget; // сколько узлов AST еще можно добавить копиями
+};
+
+static void SpecializeStatements(TSpecializer* specializer, tNode* node, Vector* constants);
+static void SpecializeCalls(TSpecializer* specializer, tNode* node, Vector* constants);
+static void SpecializeCall(TSpecializer* specializer, tNode* call, Vector* constants);
+static bool IsConstantAssignment(TSpecializer* specializer, tNode* node);
+static bool FindConstant(Vector* constants, const char* name, long long* value);
+static bool IsSpecializable(TSpecializer* specializer, tNode* function, const char* param, size_t depth);
+static bool HasFoldableUse(TSpecializer* specializer, tNode* node, const char* name, size_t depth);
+static bool BuildKey(tNode* function, const long long* values, const bool* isBound, char* key);
+static const char* FindSpecialization(TSpecializer* specializer, const char* key);
+static size_t CountSpecializations(TSpecializer* specializer, const char* name);
+static const char* CloneFunction(TSpecializer* specializer, tNode* function, const char* key,
+                                 const long long* values, const bool* isBound);
+static void ReplaceWithNumber(tNode* node, const char* name, long long value);
+static void RemoveArguments(tNode* call, const bool* isBound);
+
+// global ------------------------------------------------------------------------------------------
+
+// Межпроцедурное распространение констант: вызов с аргументом, значение которого известно при компиляции,
+// уходит в копию функции, где параметр заменен числом. Копия делается, только если число попадает в условие
+// if или while (напрямую или через вызовы), - тогда цикл с известной границей разворачивается, а лишние
+// ветви удаляет DCE. Внутри копий константные параметры передаются дальше по графу вызовов
+tNode* SpecializeFunctions(tNode* root, const Options* options, TTypeInfo* types) {
+    TSpecializer specializer = {
+        .root = root,
+        .types = types,
+        .keys = {},
+        .clones = {},
+        .functions = {},
+        .table = {},
+        .counter = 0,
+        .budget = CountNodes(root),
+    };
+    vectorInit(&specializer.keys, kInitialSizeOfNameVector);
+    vectorInit(&specializer.clones, kInitialSizeOfNameVector);
+    vectorInit(&specializer.functions, kInitialSizeOfNameVector);
+    FunctionTableCtor(&specializer.table, root);
+
+    Vector constants = {};
+    vectorInit(&constants, kInitialSizeOfNameVector);
+    SpecializeStatements(&specializer, root, &constants);
+    vectorFree(&constants);
+
+    // оригиналы, которые вызывают только сами себя, больше не нужны, если их не вызывают другие модули.
+    // Вызовы переименованы в копии, поэтому число вызовов считается заново
+    FunctionTableDtor(&specializer.table);
+    FunctionTableCtor(&specializer.table, specializer.root);
+    for (size_t i = 0; i < specializer.functions.size && !options->module; i++) {
+        tNode* function = LookupFunction(&specializer.table, (const char*)specializer.functions.data[i]);
+        if (GetCallCount(&specializer.table, function->value) == CountCalls(function->right, function->value)) {
+            RemoveFunction(&specializer.table, function);
+        }
+    }
+    specializer.root = RemoveFunctions(specializer.root, &specializer.table);
+
+    vectorFree(&specializer.keys);
+    vectorFree(&specializer.clones);
+    vectorFree(&specializer.functions);
+    FunctionTableDtor(&specializer.table);
+
+    return specializer.root;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+// Код вне функций обходится по порядку: глобальная переменная, которой во всей программе присваивается
+// одно целое число, известна после этого присваивания (функцию могут вызвать и до него)
+static void SpecializeStatements(TSpecializer* specializer, tNode* node, Vector* constants) {
+    if (!node || node->type == Function) {
+        return;
+    }
+
+    if (IsOperation(node, Semicolon)) {
+        SpecializeStatements(specializer, node->left, constants);
+        SpecializeStatements(specializer, node->right, constants);
+        return;
+    }
+    SpecializeCalls(specializer, node, constants);
+    if (IsConstantAssignment(specializer, node)) {
+        vectorPush(constants, node);
+    }
+}
+
+static void SpecializeCalls(TSpecializer* specializer, tNode* node, Vector* constants) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Calling) {
+        SpecializeCall(specializer, node, constants);
+        return; // left - цепочка аргументов
+    }
+    SpecializeCalls(specializer, node->left, constants);
+    SpecializeCalls(specializer, node->right, constants);
+}
+
+static void SpecializeCall(TSpecializer* specializer, tNode* call, Vector* constants) {
+    tNode* function = LookupFunction(&specializer->table, call->value);
+    if (!function || IsImported(function)) {
+        return;
+    }
+
+    tNode* args[kMaxArguments] = {};
+    long long values[kMaxArguments] = {};
+    bool isBound[kMaxArguments] = {};
+    size_t count = GetArguments(call, args);
+    if (count != CountChain(function->left)) {
+        return;
+    }
+
+    size_t bound = 0;
+    size_t i = 0;
+    for (tNode* param = function->left; param; param = param->left, i++) {
+        bool isConstant = (args[i]->type == Number) ? GetNumber(args[i], &values[i])
+                        : args[i]->type == Identifier && FindConstant(constants, args[i]->value, &values[i]);
+        isBound[i] = isConstant && IsSpecializable(specializer, function, param->value, 0);
+        bound += (isBound[i]) ? 1 : 0;
+    }
+    if (bound == count) {
+        isBound[count - 1] = false; // у функции остается хотя бы один параметр
+        bound--;
+    }
+
+    char key[kMaxLengthOfKey] = "";
+    if (!bound || !BuildKey(function, values, isBound, key)) {
+        return;
+    }
+    const char* clone = FindSpecialization(specializer, key);
+    if (!clone) {
+        clone = CloneFunction(specializer, function, storeString(key), values, isBound);
+    }
+    if (clone) {
+        call->value = clone;
+        RemoveArguments(call, isBound);
+    }
+}
+
+static bool IsConstantAssignment(TSpecializer* specializer, tNode* node) {
+    long long value = 0;
+    return IsOperation(node, Equal) && node->left->type == Identifier && GetNumber(node->right, &value)
+        && CountAssignments(specializer->root, node->left->value) == 1;
+}
+
+static bool FindConstant(Vector* constants, const char* name, long long* value) {
+    for (size_t i = 0; i < constants->size; i++) {
+        tNode* assignment = (tNode*)constants->data[i];
+        if (!strcmp(assignment->left->value, name)) {
+            return GetNumber(assignment->right, value);
+        }
+    }
+    return false;
+}
+
+// Параметр заменяется числом, только если он целый, функция ему не присваивает и число что-то упрощает
+static bool IsSpecializable(TSpecializer* specializer, tNode* function, const char* param, size_t depth) {
+    return !IsFloatVariable(specializer->types, function, param) && !IsAssigned(function->right, param)
+        && !IsIndexed(function->right, param) && HasFoldableUse(specializer, function->right, param, depth);
+}
+
+static bool HasFoldableUse(TSpecializer* specializer, tNode* node, const char* name, size_t depth) {
+    if (!node) {
+        return false;
+    }
+
+    if ((IsOperation(node, If) || IsOperation(node, While)) && CountReferences(node->left, name)) {
+        return true;
+    }
+    if (node->type == Calling) {
+        tNode* function = LookupFunction(&specializer->table, node->value);
+        if (!function || IsImported(function) || depth >= kMaxForwardingDepth) {
+            return false;
+        }
+        tNode* args[kMaxArguments] = {};
+        size_t count = GetArguments(node, args);
+        size_t i = 0;
+        for (tNode* param = function->left; param && i < count; param = param->left, i++) {
+            if (args[i]->type == Identifier && !strcmp(args[i]->value, name)
+                && IsSpecializable(specializer, function, param->value, depth + 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    return HasFoldableUse(specializer, node->left, name, depth) || HasFoldableUse(specializer, node->right, name, depth);
+}
+
+static bool BuildKey(tNode* function, const long long* values, const bool* isBound, char* key) {
+    size_t length = (size_t)snprintf(key, kMaxLengthOfKey, "%s(", function->value);
+    size_t i = 0;
+    for (tNode* param = function->left; param && length < kMaxLengthOfKey; param = param->left, i++) {
+        if (isBound[i]) {
+            length += (size_t)snprintf(key + length, kMaxLengthOfKey - length, "%lld,", values[i]);
+        } else {
+            length += (size_t)snprintf(key + length, kMaxLengthOfKey - length, "_,");
+        }
+    }
+    return length < kMaxLengthOfKey;
+}
+
+static const char* FindSpecialization(TSpecializer* specializer, const char* key) {
+    for (size_t i = 0; i < specializer->keys.size; i++) {
+        if (!strcmp((const char*)specializer->keys.data[i], key)) {
+            return (const char*)specializer->clones.data[i];
+        }
+    }
+    return NULL;
+}
+
+static size_t CountSpecializations(TSpecializer* specializer, const char* name) {
+    size_t length = strlen(name);
+    size_t count = 0;
+    for (size_t i = 0; i < specializer->keys.size; i++) {
+        const char* key = (const char*)specializer->keys.data[i];
+        count += (!strncmp(key, name, length) && key[length] == '(') ? 1 : 0;
+    }
+    return count;
+}
+
+// Копия без связанных параметров: каждый становится локальной переменной _sN_param, которая
+// присваивается в начале тела и заменяется числом везде, кроме аргументов вызовов. Аргументы
+// остаются переменными и делают константными параметры вызываемых функций
+static const char* CloneFunction(TSpecializer* specializer, tNode* function, const char* key,
+                                 const long long* values, const bool* isBound) {
+    size_t size = CountNodes(function);
+    if (size > kMaxSpecializedSize || size > specializer->budget
+        || CountSpecializations(specializer, function->value) >= kMaxSpecializations) {
+        return NULL;
+    }
+    specializer->budget -= size;
+
+    char name[kMaxLengthOfName] = "";
+    snprintf(name, kMaxLengthOfName, "_s%zu_%s", specializer->counter++, function->value);
+    const char* cloneName = storeString(name);
+    vectorPush(&specializer->keys, const_cast<char*>(key));
+    vectorPush(&specializer->clones, const_cast<char*>(cloneName));
+    AddName(&specializer->functions, function->value);
+
+    tNode* body = copyNode(function->right);
+    tNode* params = NULL;
+    tNode* lastParam = NULL;
+    Vector constants = {};
+    vectorInit(&constants, kInitialSizeOfNameVector);
+    size_t i = 0;
+    for (tNode* param = function->left; param; param = param->left, i++) {
+        if (!isBound[i]) {
+            tNode* copy = VAR(param->value);
+            if (lastParam) {
+                lastParam->left = copy;
+            } else {
+                params = copy;
+            }
+            lastParam = copy;
+            continue;
+        }
+
+        snprintf(name, kMaxLengthOfName, "_s%zu_%s", specializer->counter++, param->value);
+        const char* local = storeString(name);
+        RenameVariable(body, param->value, local);
+        ReplaceWithNumber(body, local, values[i]);
+        tNode* assignment = EQUAL(VAR(local), NewNumberNode(values[i]));
+        body = SEMICOLON(assignment, body);
+        vectorPush(&constants, assignment);
+    }
+
+    tNode* clone = newNode(Function, cloneName, params, body);
+    CopyFunctionTypes(specializer->types, function, clone);
+    specializer->root = AppendStatement(specializer->root, clone);
+    AddFunction(&specializer->table, clone);
+
+    SpecializeCalls(specializer, body, &constants);
+    vectorFree(&constants);
+
+    return cloneName;
+}
+
+static void ReplaceWithNumber(tNode* node, const char* name, long long value) {
+    if (!node || node->type == Calling) {
+        return;
+    }
+
+    if (node->type == Identifier && !strcmp(node->value, name)) {
+        tNode* number = NewNumberNode(value);
+        node->type = Number;
+        node->value = number->value;
+        treeDtor(number);
+        return;
+    }
+    ReplaceWithNumber(node->left, name, value);
+    ReplaceWithNumber(node->right, name, value);
+}
+
+static void RemoveArguments(tNode* call, const bool* isBound) {
+    tNode* args[kMaxArguments] = {};
+    size_t count = GetArguments(call, args);
+
+    tNode* chain = NULL;
+    for (size_t i = 0; i < count; i++) {
+        if (isBound[i]) {
+            args[i]->left = NULL;
+            treeDtor(args[i]);
+        } else {
+            args[i]->left = chain;
+            chain = args[i];
+        }
+    }
+    call->left = chain;
+}
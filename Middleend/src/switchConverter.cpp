@@ -0,0 +1,200 @@
+#include "switchConverter.h"
+
+#include <string.h>
+
+#include "astUtils.h"
+#include "tree.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kMinSwitchCases = 4; // меньше сравнений подряд выполняются не дольше, чем переход по таблице
+const size_t kInitialSizeOfStatementVector = 16;
+
+struct TSwitchConverter {
+    TTypeInfo* types;
+    Vector globals;
+};
+
+static tNode* ConvertBlock(TSwitchConverter* converter, tNode* node, tNode* function);
+static size_t MatchCases(TSwitchConverter* converter, Vector* statements, size_t first, tNode* function);
+static tNode* GetCaseVariable(TSwitchConverter* converter, tNode* node, tNode* function);
+static bool IsGlobal(TSwitchConverter* converter, const char* name, tNode* function);
+static tNode* BuildSwitch(Vector* statements, size_t first, size_t count);
+static void CollectStatements(tNode* node, Vector* statements);
+static void FreeLinks(tNode* node);
+
+// global ------------------------------------------------------------------------------------------
+
+// if ( x == 0 ) { ... } ; if ( x == 1 ) { ... } ; ... подряд по одной целой переменной и разным числам.
+// Если тело не меняет x, следующие условия после него ложны, и выполняется не больше одного тела: генератор
+// выбирает его одним переходом по таблице или двоичным поиском вместо проверки всех условий по очереди
+tNode* ConvertSwitches(tNode* root, const Options* options, TTypeInfo* types) {
+    if (!options->enableJumpTables) {
+        return root;
+    }
+
+    TSwitchConverter converter = {
+        .types = types,
+        .globals = {},
+    };
+    vectorInit(&converter.globals, kInitialSizeOfStatementVector);
+    CollectGlobals(root, &converter.globals);
+
+    root = ConvertBlock(&converter, root, NULL);
+
+    vectorFree(&converter.globals);
+    return root;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static tNode* ConvertBlock(TSwitchConverter* converter, tNode* node, tNode* function) {
+    if (!node) {
+        return NULL;
+    }
+
+    if (node->type == Function) {
+        node->right = ConvertBlock(converter, node->right, node);
+        return node;
+    }
+    if (!IsOperation(node, Semicolon)) {
+        node->left = ConvertBlock(converter, node->left, function);
+        node->right = ConvertBlock(converter, node->right, function);
+        return node;
+    }
+
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfStatementVector);
+    CollectStatements(node, &statements);
+    for (size_t i = 0; i < statements.size; i++) {
+        ConvertBlock(converter, (tNode*)statements.data[i], function);
+    }
+
+    bool isChanged = false;
+    for (size_t i = 0; i < statements.size; i++) {
+        size_t count = MatchCases(converter, &statements, i, function);
+        if (count < kMinSwitchCases) {
+            continue;
+        }
+        statements.data[i] = BuildSwitch(&statements, i, count);
+        memmove(&statements.data[i + 1], &statements.data[i + count], (statements.size - i - count) * sizeof(void*));
+        statements.size -= count - 1;
+        isChanged = true;
+    }
+
+    if (isChanged) { // цепочка собирается заново
+        FreeLinks(node);
+        node = NULL;
+        for (size_t i = 0; i < statements.size; i++) {
+            node = AppendStatement(node, (tNode*)statements.data[i]);
+        }
+    }
+    vectorFree(&statements);
+    return node;
+}
+
+// Сколько операторов подряд, начиная с first, - варианты одной переменной. Тело, которое может изменить
+// переменную (присваиванием или вызовом функции, если она глобальная), бывает только у последнего
+static size_t MatchCases(TSwitchConverter* converter, Vector* statements, size_t first, tNode* function) {
+    tNode* variable = GetCaseVariable(converter, (tNode*)statements->data[first], function);
+    if (!variable) {
+        return 0;
+    }
+
+    bool isGlobal = IsGlobal(converter, variable->value, function);
+    size_t count = 0;
+    for (size_t i = first; i < statements->size; i++) {
+        tNode* statement = (tNode*)statements->data[i];
+        tNode* caseVariable = GetCaseVariable(converter, statement, function);
+        if (!caseVariable || strcmp(caseVariable->value, variable->value)) {
+            break;
+        }
+
+        long long value = 0;
+        GetNumber(statement->left->right, &value);
+        bool isRepeated = false;
+        for (size_t j = first; j < i && !isRepeated; j++) {
+            long long previous = 0;
+            GetNumber(((tNode*)statements->data[j])->left->right, &previous);
+            isRepeated = previous == value;
+        }
+        if (isRepeated) {
+            break;
+        }
+
+        count++;
+        if (IsAssigned(statement->right, variable->value) || (isGlobal && ContainsCalling(statement->right))) {
+            break;
+        }
+    }
+    return count;
+}
+
+// Переменная x из if ( x == число ) или if ( число == x ); число переставляется вправо
+static tNode* GetCaseVariable(TSwitchConverter* converter, tNode* node, tNode* function) {
+    if (!IsOperation(node, If) || !IsOperation(node->left, Identical)) {
+        return NULL;
+    }
+
+    tNode* condition = node->left;
+    if (condition->left->type == Number && condition->right->type == Identifier) {
+        tNode* number = condition->left;
+        condition->left = condition->right;
+        condition->right = number;
+    }
+
+    long long value = 0;
+    if (condition->left->type != Identifier || !GetNumber(condition->right, &value)
+        || IsFloatVariable(converter->types, function, condition->left->value)) {
+        return NULL;
+    }
+    return condition->left;
+}
+
+// Параметр закрывает глобальную переменную с тем же именем, а остальные переменные функции - локальные
+static bool IsGlobal(TSwitchConverter* converter, const char* name, tNode* function) {
+    if (!function) {
+        return true;
+    }
+    for (tNode* param = function->left; param; param = param->left) {
+        if (!strcmp(param->value, name)) {
+            return false;
+        }
+    }
+    return ContainsName(&converter->globals, name);
+}
+
+static tNode* BuildSwitch(Vector* statements, size_t first, size_t count) {
+    tNode* cases = NULL;
+    for (size_t i = first; i < first + count; i++) {
+        cases = AppendStatement(cases, (tNode*)statements->data[i]);
+    }
+    tNode* variable = ((tNode*)statements->data[first])->left->left;
+    return newNode(Operation, keySwitch, newNode(Identifier, variable->value, NULL, NULL), cases);
+}
+
+static void CollectStatements(tNode* node, Vector* statements) {
+    if (!node) {
+        return;
+    }
+
+    if (IsOperation(node, Semicolon)) {
+        CollectStatements(node->left, statements);
+        CollectStatements(node->right, statements);
+    } else {
+        vectorPush(statements, node);
+    }
+}
+
+// Освобождает узлы ; цепочки, но не операторы
+static void FreeLinks(tNode* node) {
+    if (!IsOperation(node, Semicolon)) {
+        return;
+    }
+
+    FreeLinks(node->left);
+    FreeLinks(node->right);
+    node->left = NULL;
+    node->right = NULL;
+    treeDtor(node);
+}
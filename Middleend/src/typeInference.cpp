@@ -0,0 +1,243 @@
+#include "typeInference.h"
+
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfNameVector = 16;
+
+static size_t CountFunctions(tNode* node);
+static void CollectScopes(TTypeInfo* types, tNode* node);
+static TScopeTypes* GetScope(TTypeInfo* types, tNode* function);
+static TScopeTypes* ResolveName(TTypeInfo* types, tNode* function, const char* name);
+static bool PropagateTypes(TTypeInfo* types, const TFunctionTable* functions, tNode* function, tNode* node);
+static bool PropagateArguments(TTypeInfo* types, const TFunctionTable* functions, tNode* function, tNode* calling);
+
+// global ------------------------------------------------------------------------------------------
+
+// Вещественные значения появляются из литералов с точкой и sqrt/sin/cos, а дальше расходятся через
+// присваивания, аргументы вызовов и return, пока типы не перестанут меняться. Тип массива - тип его
+// элементов: массив становится double, если в него записывают double
+void InferTypes(tNode* root, TTypeInfo* types) {
+    assert(types);
+
+    types->scopeCount = 1 + CountFunctions(root);
+    types->scopes = (TScopeTypes*)calloc(types->scopeCount, sizeof(TScopeTypes));
+    assert(types->scopes);
+
+    vectorInit(&types->globals, kInitialSizeOfNameVector);
+    CollectGlobals(root, &types->globals);
+
+    vectorInit(&types->scopes[0].locals, kInitialSizeOfNameVector);
+    vectorInit(&types->scopes[0].floats, kInitialSizeOfNameVector);
+    types->scopeCount = 1;
+    CollectScopes(types, root);
+
+    TFunctionTable functions = {};
+    FunctionTableCtor(&functions, root);
+    bool changed = true;
+    while (changed) {
+        changed = PropagateTypes(types, &functions, NULL, root);
+        for (size_t i = 1; i < types->scopeCount; i++) {
+            tNode* function = LookupFunction(&functions, types->scopes[i].name);
+            changed = PropagateTypes(types, &functions, function, function->right) || changed;
+        }
+    }
+    FunctionTableDtor(&functions);
+}
+
+void TypeInfoDtor(TTypeInfo* types) {
+    for (size_t i = 0; i < types->scopeCount; i++) {
+        vectorFree(&types->scopes[i].locals);
+        vectorFree(&types->scopes[i].floats);
+    }
+    free(types->scopes);
+    vectorFree(&types->globals);
+    *types = {};
+}
+
+// Целые литералы состоят из одних цифр, все остальное (2.5, 1e3) - double
+bool IsFloatLiteral(tNode* node) {
+    return node && node->type == Number && node->value[strspn(node->value, "0123456789")];
+}
+
+double GetFloatValue(tNode* node) {
+    assert(node && node->type == Number);
+
+    return strtod(node->value, NULL);
+}
+
+bool IsFloatVariable(TTypeInfo* types, tNode* function, const char* name) {
+    return ContainsName(&ResolveName(types, function, name)->floats, name);
+}
+
+bool IsFloatFunction(TTypeInfo* types, const char* name) {
+    for (size_t i = 1; i < types->scopeCount; i++) {
+        if (!strcmp(types->scopes[i].name, name)) {
+            return types->scopes[i].returnsFloat;
+        }
+    }
+    return false;
+}
+
+bool IsFloatExpression(TTypeInfo* types, tNode* function, tNode* node) {
+    if (!node) {
+        return false;
+    }
+
+    switch (node->type) {
+        case Number:        return IsFloatLiteral(node);
+        case Identifier:    return IsFloatVariable(types, function, node->value);
+        case Calling:       return IsFloatFunction(types, node->value);
+        case Operation:
+            switch (GetOperationType(node->value)) {
+                case Add:
+                case Sub:
+                case Mul:
+                case Div:   return IsFloatExpression(types, function, node->left)
+                                || IsFloatExpression(types, function, node->right);
+                case Sqrt:
+                case Sin:
+                case Cos:   return true;
+                case Index: return IsFloatVariable(types, function, node->left->value);
+                default:    return false; // сравнения дают 0 или 1, array - адрес
+            }
+        case Function:
+        default:            return false;
+    }
+}
+
+// Новая переменная функции, которой нет среди глобальных, становится ее локальной
+void MarkFloatVariable(TTypeInfo* types, tNode* function, const char* name) {
+    TScopeTypes* scope = GetScope(types, function);
+    if (function && !ContainsName(&scope->locals, name) && !ContainsName(&types->globals, name)) {
+        AddName(&scope->locals, name);
+    }
+
+    AddName(&ResolveName(types, function, name)->floats, name);
+}
+
+// Копия функции (специализация для констант) получает под своим именем те же типы, что и оригинал
+void CopyFunctionTypes(TTypeInfo* types, tNode* function, tNode* copy) {
+    TScopeTypes* scopes = (TScopeTypes*)realloc(types->scopes, (types->scopeCount + 1) * sizeof(TScopeTypes));
+    assert(scopes);
+    types->scopes = scopes;
+
+    TScopeTypes* source = GetScope(types, function);
+    TScopeTypes* scope = &types->scopes[types->scopeCount++];
+    scope->name = copy->value;
+    scope->returnsFloat = source->returnsFloat;
+    vectorInit(&scope->locals, kInitialSizeOfNameVector);
+    vectorInit(&scope->floats, kInitialSizeOfNameVector);
+    for (size_t i = 0; i < source->locals.size; i++) {
+        AddName(&scope->locals, (const char*)source->locals.data[i]);
+    }
+    for (size_t i = 0; i < source->floats.size; i++) {
+        AddName(&scope->floats, (const char*)source->floats.data[i]);
+    }
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static size_t CountFunctions(tNode* node) {
+    if (!node) {
+        return 0;
+    }
+    if (node->type == Function) {
+        return 1;
+    }
+    return (IsOperation(node, Semicolon)) ? CountFunctions(node->left) + CountFunctions(node->right) : 0;
+}
+
+static void CollectScopes(TTypeInfo* types, tNode* node) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        TScopeTypes* scope = &types->scopes[types->scopeCount++];
+        scope->name = node->value;
+        vectorInit(&scope->locals, kInitialSizeOfNameVector);
+        vectorInit(&scope->floats, kInitialSizeOfNameVector);
+        CollectLocals(node, &types->globals, &scope->locals);
+    } else if (IsOperation(node, Semicolon)) {
+        CollectScopes(types, node->left);
+        CollectScopes(types, node->right);
+    }
+}
+
+static TScopeTypes* GetScope(TTypeInfo* types, tNode* function) {
+    for (size_t i = 1; i < types->scopeCount && function; i++) {
+        if (!strcmp(types->scopes[i].name, function->value)) {
+            return &types->scopes[i];
+        }
+    }
+    return &types->scopes[0];
+}
+
+// Имя внутри функции - ее локальная переменная, если она есть среди локальных, иначе глобальная
+static TScopeTypes* ResolveName(TTypeInfo* types, tNode* function, const char* name) {
+    TScopeTypes* scope = GetScope(types, function);
+    return (ContainsName(&scope->locals, name)) ? scope : &types->scopes[0];
+}
+
+static bool PropagateTypes(TTypeInfo* types, const TFunctionTable* functions, tNode* function, tNode* node) {
+    if (!node || node->type == Function) {
+        return false; // тела функций обходятся отдельно
+    }
+
+    bool changed = false;
+    if (IsOperation(node, Equal) && !IsFloatVariable(types, function, node->left->value)
+        && IsFloatExpression(types, function, node->right)) {
+        MarkFloatVariable(types, function, node->left->value);
+        changed = true;
+    } else if (IsOperation(node, Store) && !IsFloatVariable(types, function, node->left->left->value)
+               && IsFloatExpression(types, function, node->right)) {
+        MarkFloatVariable(types, function, node->left->left->value);
+        changed = true;
+    } else if (IsOperation(node, Return) && function && !GetScope(types, function)->returnsFloat
+               && IsFloatExpression(types, function, node->left)) {
+        GetScope(types, function)->returnsFloat = true;
+        changed = true;
+    } else if (node->type == Calling) {
+        return PropagateArguments(types, functions, function, node);
+    }
+
+    changed = PropagateTypes(types, functions, function, node->left) || changed;
+    changed = PropagateTypes(types, functions, function, node->right) || changed;
+    return changed;
+}
+
+// Параметр становится double, если хоть в одном вызове ему передают double. Массив передается адресом,
+// поэтому тип его элементов общий у аргумента и параметра
+static bool PropagateArguments(TTypeInfo* types, const TFunctionTable* functions, tNode* function, tNode* calling) {
+    tNode* callee = LookupFunction(functions, calling->value);
+    size_t argCount = CountChain(calling->left);
+    if (!callee || CountChain(callee->left) != argCount) {
+        return false; // ошибку сообщит генератор
+    }
+
+    bool changed = false;
+    size_t i = argCount;
+    for (tNode* arg = calling->left; arg; arg = arg->left) { // аргументы лежат в обратном порядке
+        tNode* param = callee->left;
+        for (size_t j = 1; j < i; j++) {
+            param = param->left;
+        }
+        i--;
+
+        if (IsFloatExpression(types, function, arg) && !IsFloatVariable(types, callee, param->value)) {
+            MarkFloatVariable(types, callee, param->value);
+            changed = true;
+        } else if (arg->type == Identifier && IsFloatVariable(types, callee, param->value)
+                   && !IsFloatExpression(types, function, arg) && IsIndexed(callee->right, param->value)) {
+            MarkFloatVariable(types, function, arg->value);
+            changed = true;
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,298 @@
+#include "unroller.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "tree.h"
+#include "dsl.h"
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfNameVector = 16;
+
+struct TUnroller {
+    tNode** root;
+    Vector globals;
+    Vector constants; // операторы x = Number верхнего уровня, уже выполненные к текущему месту программы
+    size_t factor;
+    size_t budget; // максимальный размер развернутого тела в узлах AST
+};
+
+// Счетчик цикла: единственное присваивание i = i +- step на верхнем уровне тела
+struct TCounter {
+    const char* name;
+    long long step;
+    bool isDecrement;
+    tNode* update;
+};
+
+static void UnrollStatement(TUnroller* unroller, tNode** slot, tNode* previous, tNode* function, bool isTopLevel);
+static void UnrollLoop(TUnroller* unroller, tNode** slot, tNode* previous, tNode* function);
+static bool ContainsLoop(tNode* node);
+static bool GetConstant(TUnroller* unroller, tNode* node, tNode* function, long long* value);
+static bool FindCounter(TUnroller* unroller, tNode* loop, tNode* function, TCounter* counter);
+static tNode* FindUpdate(tNode* node, const char* name);
+static bool GetTripCount(TUnroller* unroller, tNode* loop, tNode* previous, tNode* function, TCounter* counter,
+                         long long* trips);
+static tNode* RepeatBody(tNode* body, size_t count);
+static tNode* UnrollCountedBody(tNode* body, TCounter* counter, size_t factor);
+static void OffsetCounter(tNode** slot, TCounter* counter, long long offset);
+static tNode* UnrollGuardedBody(tNode* loop, size_t factor);
+
+// global ------------------------------------------------------------------------------------------
+
+// Разворачивает внутренние циклы while в factor копий тела. Если число итераций известно при компиляции,
+// остаток выполняется копиями тела перед циклом, иначе условие проверяется перед каждой копией
+tNode* UnrollLoops(tNode* root, const Options* options) {
+    if (options->unrollFactor < 2) {
+        return root;
+    }
+
+    TUnroller unroller = {
+        .root = &root,
+        .globals = {},
+        .constants = {},
+        .factor = options->unrollFactor,
+        .budget = options->unrollBudget,
+    };
+    vectorInit(&unroller.globals, kInitialSizeOfNameVector);
+    vectorInit(&unroller.constants, kInitialSizeOfNameVector);
+    CollectGlobals(root, &unroller.globals);
+
+    UnrollStatement(&unroller, &root, NULL, NULL, true);
+
+    vectorFree(&unroller.constants);
+    vectorFree(&unroller.globals);
+    return root;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void UnrollStatement(TUnroller* unroller, tNode** slot, tNode* previous, tNode* function, bool isTopLevel) {
+    tNode* node = *slot;
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        UnrollStatement(unroller, &node->right, NULL, node, false);
+    } else if (IsOperation(node, Semicolon)) {
+        UnrollStatement(unroller, &node->left, previous, function, isTopLevel);
+        UnrollStatement(unroller, &node->right, GetLastStatement(node->left), function, isTopLevel);
+    } else if (IsOperation(node, Equal)) {
+        if (isTopLevel && node->right->type == Number) {
+            vectorPush(&unroller->constants, node);
+        }
+    } else if (IsOperation(node, If)) {
+        UnrollStatement(unroller, &node->right, NULL, function, false);
+    } else if (IsOperation(node, While)) {
+        if (ContainsLoop(node->right)) {
+            UnrollStatement(unroller, &node->right, NULL, function, false);
+        } else {
+            UnrollLoop(unroller, slot, previous, function);
+        }
+    } else if (IsOperation(node, ParallelWhile)) {
+        UnrollStatement(unroller, &node->right, NULL, function, false);
+    }
+}
+
+static void UnrollLoop(TUnroller* unroller, tNode** slot, tNode* previous, tNode* function) {
+    tNode* loop = *slot;
+    size_t size = CountNodes(loop->right);
+    size_t factor = (unroller->factor < unroller->budget / size) ? unroller->factor : unroller->budget / size;
+    if (factor < 2) {
+        return;
+    }
+
+    TCounter counter = {};
+    long long trips = 0;
+    if (!GetTripCount(unroller, loop, previous, function, &counter, &trips)) {
+        tNode* body = UnrollGuardedBody(loop, factor);
+        treeDtor(loop->right);
+        loop->right = body;
+        return;
+    }
+    if (trips == 0) {
+        return;
+    }
+
+    if ((size_t)trips <= factor) { // цикл целиком заменяется копиями тела
+        *slot = RepeatBody(loop->right, (size_t)trips);
+        treeDtor(loop);
+        return;
+    }
+
+    // после остатка число итераций кратно factor, и условие достаточно проверять раз в factor копий
+    tNode* prologue = RepeatBody(loop->right, (size_t)trips % factor);
+    tNode* body = UnrollCountedBody(loop->right, &counter, factor);
+    treeDtor(loop->right);
+    loop->right = body;
+    if (prologue) {
+        *slot = SEMICOLON(prologue, loop);
+    }
+}
+
+static bool ContainsLoop(tNode* node) {
+    if (!node) {
+        return false;
+    }
+    return IsOperation(node, While) || IsOperation(node, VectorWhile) || IsOperation(node, ParallelWhile)
+        || ContainsLoop(node->left) || ContainsLoop(node->right);
+}
+
+// Глобальная переменная, которой во всей программе присваивается одно число, известна после этого присваивания
+static bool GetConstant(TUnroller* unroller, tNode* node, tNode* function, long long* value) {
+    if (GetNumber(node, value)) {
+        return true;
+    }
+    if (function || !node || node->type != Identifier || CountAssignments(*unroller->root, node->value) != 1) {
+        return false; // функцию могут вызвать и до присваивания
+    }
+
+    for (size_t i = 0; i < unroller->constants.size; i++) {
+        tNode* assignment = (tNode*)unroller->constants.data[i];
+        if (!strcmp(assignment->left->value, node->value)) {
+            return GetNumber(assignment->right, value);
+        }
+    }
+    return false;
+}
+
+static bool FindCounter(TUnroller* unroller, tNode* loop, tNode* function, TCounter* counter) {
+    tNode* condition = loop->left;
+    if (!condition || !condition->left || condition->left->type != Identifier) {
+        return false;
+    }
+
+    const char* name = condition->left->value;
+    if (CountAssignments(loop->right, name) != 1
+        || (ContainsCalling(loop->right) && (!function || ContainsName(&unroller->globals, name)))) {
+        return false; // вызов может изменить глобальный счетчик
+    }
+
+    tNode* update = FindUpdate(loop->right, name);
+    if (!update) {
+        return false;
+    }
+
+    tNode* expr = update->right;
+    if ((!IsOperation(expr, Add) && !IsOperation(expr, Sub)) || expr->left->type != Identifier
+        || strcmp(expr->left->value, name) || !GetNumber(expr->right, &counter->step) || counter->step == 0) {
+        return false;
+    }
+
+    counter->name = name;
+    counter->isDecrement = IsOperation(expr, Sub);
+    counter->update = update;
+    return true;
+}
+
+// Присваивание счетчику среди операторов верхнего уровня тела: оно выполняется на каждой итерации
+static tNode* FindUpdate(tNode* node, const char* name) {
+    if (IsOperation(node, Semicolon)) {
+        tNode* update = FindUpdate(node->left, name);
+        return (update) ? update : FindUpdate(node->right, name);
+    }
+    return (IsOperation(node, Equal) && !strcmp(node->left->value, name)) ? node : NULL;
+}
+
+static bool GetTripCount(TUnroller* unroller, tNode* loop, tNode* previous, tNode* function, TCounter* counter,
+                         long long* trips) {
+    long long initial = 0;
+    long long bound = 0;
+    if (!FindCounter(unroller, loop, function, counter) || !IsOperation(previous, Equal)
+        || strcmp(previous->left->value, counter->name) || !GetConstant(unroller, previous->right, function, &initial)
+        || !GetConstant(unroller, loop->left->right, function, &bound)) {
+        return false;
+    }
+
+    long long step = counter->step;
+    if (counter->isDecrement) { // i > bound  <=>  -i < -bound
+        initial = -initial;
+        bound = -bound;
+    }
+
+    switch (GetOperationType(loop->left->value)) {
+        case Less:
+        case Greater:
+            if ((GetOperationType(loop->left->value) == Less) == counter->isDecrement) {
+                return false;
+            }
+            *trips = (initial < bound) ? (bound - initial + step - 1) / step : 0;
+            return true;
+        case LessOrEqual:
+        case GreaterOrEqual:
+            if ((GetOperationType(loop->left->value) == LessOrEqual) == counter->isDecrement) {
+                return false;
+            }
+            *trips = (initial <= bound) ? (bound - initial) / step + 1 : 0;
+            return true;
+        case NotIdentical:
+            if (initial > bound || (bound - initial) % step) {
+                return false;
+            }
+            *trips = (bound - initial) / step;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static tNode* RepeatBody(tNode* body, size_t count) {
+    tNode* sequence = NULL;
+    for (size_t i = 0; i < count; i++) {
+        sequence = AppendStatement(sequence, copyNode(body));
+    }
+    return sequence;
+}
+
+// Если счетчик меняется последним оператором тела, копии читают i + k * step, а счетчик
+// увеличивается один раз в конце: копии не ждут друг друга через i
+static tNode* UnrollCountedBody(tNode* body, TCounter* counter, size_t factor) {
+    long long total = 0;
+    if (GetLastStatement(body) != counter->update || !IsOperation(body, Semicolon) || ContainsCalling(body)
+        || counter->step > kMaxSafeNumber / (long long)factor) {
+        return RepeatBody(body, factor); // аргументы вызова - только имена, i + k туда не подставить
+    }
+
+    tNode* statements = copyNode(body);
+    statements = RemoveStatement(statements, GetLastStatement(statements));
+
+    tNode* sequence = NULL;
+    for (size_t k = 0; k < factor; k++) {
+        tNode* copy = copyNode(statements);
+        OffsetCounter(&copy, counter, (long long)k * counter->step);
+        sequence = AppendStatement(sequence, copy);
+        total += counter->step;
+    }
+    treeDtor(statements);
+
+    tNode* step = NewNumberNode(total);
+    tNode* update = (counter->isDecrement) ? SUB(VAR(counter->name), step) : ADD(VAR(counter->name), step);
+    return AppendStatement(sequence, EQUAL(VAR(counter->name), update));
+}
+
+static void OffsetCounter(tNode** slot, TCounter* counter, long long offset) {
+    tNode* node = *slot;
+    if (!node || offset == 0) {
+        return;
+    }
+
+    if (node->type == Identifier && !strcmp(node->value, counter->name)) {
+        *slot = (counter->isDecrement) ? SUB(node, NewNumberNode(offset)) : ADD(node, NewNumberNode(offset));
+        return;
+    }
+
+    OffsetCounter(&node->left, counter, offset);
+    OffsetCounter(&node->right, counter, offset);
+}
+
+// while ( c ) { b ; if ( c ) { b ; if ( c ) { b } } }
+static tNode* UnrollGuardedBody(tNode* loop, size_t factor) {
+    tNode* body = copyNode(loop->right);
+    for (size_t i = 1; i < factor; i++) {
+        body = SEMICOLON(copyNode(loop->right), IF(copyNode(loop->left), body));
+    }
+    return body;
+}
@@ -0,0 +1,282 @@
+#include "vectorizer.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "astUtils.h"
+
+// static ------------------------------------------------------------------------------------------
+
+const size_t kInitialSizeOfLeafVector = 8;
+
+struct TVectorizer {
+    TTypeInfo* types;
+    bool allowFloatReductions;
+};
+
+static void VectorizeStatement(TVectorizer* vectorizer, tNode* node, tNode* function);
+static void CollectStatements(tNode* node, Vector* statements);
+static bool MatchStatements(TVectorLoop* vector, Vector* statements, tNode* function, TTypeInfo* types,
+                            bool allowFloatReductions);
+static bool MatchExpression(TVectorLoop* vector, tNode* node, tNode* function, TTypeInfo* types);
+static bool IsCounter(TVectorLoop* vector, tNode* node);
+static int GetRegisterNeed(tNode* node);
+
+// global ------------------------------------------------------------------------------------------
+
+// Помечает циклы, которые генератор выполняет по 2 (SSE2) или 4 (AVX2) итерации за раз.
+// Вещественные суммы при этом складываются в другом порядке, поэтому векторизуются только с --fast-math
+tNode* VectorizeLoops(tNode* root, const Options* options, TTypeInfo* types) {
+    TVectorizer vectorizer = {
+        .types = types,
+        .allowFloatReductions = options->fastMath,
+    };
+
+    VectorizeStatement(&vectorizer, root, NULL);
+    return root;
+}
+
+// Элементы читаются и пишутся только по индексу i, поэтому итерации независимы и порядок операторов
+// внутри одной итерации сохраняется для каждого элемента
+bool MatchVectorLoop(tNode* loop, tNode* function, TTypeInfo* types, bool allowFloatReductions, TVectorLoop* vector) {
+    assert(vector);
+
+    *vector = {};
+    tNode* condition = loop->left;
+    tNode* update = GetLastStatement(loop->right);
+    long long step = 0;
+    if (!IsOperation(condition, Less) || condition->left->type != Identifier
+        || (condition->right->type != Identifier && condition->right->type != Number)
+        || !IsOperation(update, Equal) || strcmp(update->left->value, condition->left->value)
+        || !IsOperation(update->right, Add) || !IsSameTree(update->right->left, condition->left)
+        || !GetNumber(update->right->right, &step) || step != 1) {
+        return false;
+    }
+
+    vector->counter = condition->left->value;
+    vector->limit = condition->right;
+    if (IsFloatVariable(types, function, vector->counter) || IsFloatExpression(types, function, vector->limit)
+        || IsCounter(vector, vector->limit)) {
+        return false;
+    }
+
+    Vector statements = {};
+    vectorInit(&statements, kInitialSizeOfLeafVector);
+    CollectStatements(loop->right, &statements);
+    statements.size--; // i = i + 1
+
+    vectorInit(&vector->invariants, kInitialSizeOfLeafVector);
+    vectorInit(&vector->reductions, kInitialSizeOfLeafVector);
+    bool isMatched = statements.size && MatchStatements(vector, &statements, function, types, allowFloatReductions);
+    if (isMatched && vector->limit->type == Identifier) {
+        isMatched = !ContainsName(&vector->reductions, vector->limit->value);
+    }
+
+    int need = 0;
+    for (size_t i = 0; i < statements.size && isMatched; i++) {
+        tNode* statement = (tNode*)statements.data[i];
+        tNode* value = (IsOperation(statement, Store)) ? statement->right : GetReductionOperand(statement);
+        int statementNeed = GetRegisterNeed(value);
+        need = (statementNeed > need) ? statementNeed : need;
+    }
+    vectorFree(&statements);
+
+    if (isMatched && need + (int)(vector->invariants.size + vector->reductions.size) <= kVectorRegisters) {
+        return true;
+    }
+    VectorLoopDtor(vector);
+    return false;
+}
+
+void VectorLoopDtor(TVectorLoop* vector) {
+    vectorFree(&vector->invariants);
+    vectorFree(&vector->reductions);
+}
+
+// s = s + expr и s = expr + s; возвращает expr
+tNode* GetReductionOperand(tNode* statement) {
+    if (!IsOperation(statement, Equal) || !IsOperation(statement->right, Add)) {
+        return NULL;
+    }
+
+    tNode* sum = statement->right;
+    if (sum->left->type == Identifier && !strcmp(sum->left->value, statement->left->value)) {
+        return sum->right;
+    }
+    if (sum->right->type == Identifier && !strcmp(sum->right->value, statement->left->value)) {
+        return sum->left;
+    }
+    return NULL;
+}
+
+// Номер регистра с копиями инварианта во всех элементах или -1
+int GetInvariantRegister(TVectorLoop* vector, tNode* node) {
+    for (size_t i = 0; i < vector->invariants.size; i++) {
+        if (IsSameTree((tNode*)vector->invariants.data[i], node)) {
+            return kVectorRegisters - 1 - (int)i;
+        }
+    }
+    return -1;
+}
+
+int GetReductionRegister(TVectorLoop* vector, const char* name) {
+    for (size_t i = 0; i < vector->reductions.size; i++) {
+        if (!strcmp((const char*)vector->reductions.data[i], name)) {
+            return kVectorRegisters - 1 - (int)(vector->invariants.size + i);
+        }
+    }
+    return -1;
+}
+
+// static ------------------------------------------------------------------------------------------
+
+static void VectorizeStatement(TVectorizer* vectorizer, tNode* node, tNode* function) {
+    if (!node) {
+        return;
+    }
+
+    if (node->type == Function) {
+        VectorizeStatement(vectorizer, node->right, node);
+    } else if (IsOperation(node, Semicolon)) {
+        VectorizeStatement(vectorizer, node->left, function);
+        VectorizeStatement(vectorizer, node->right, function);
+    } else if (IsOperation(node, If)) {
+        VectorizeStatement(vectorizer, node->right, function);
+    } else if (IsOperation(node, While)) {
+        TVectorLoop vector = {};
+        if (MatchVectorLoop(node, function, vectorizer->types, vectorizer->allowFloatReductions, &vector)) {
+            node->value = keyVectorWhile;
+            VectorLoopDtor(&vector);
+        } else {
+            VectorizeStatement(vectorizer, node->right, function);
+        }
+    } else if (IsOperation(node, ParallelWhile)) {
+        VectorizeStatement(vectorizer, node->right, function);
+    }
+}
+
+static void CollectStatements(tNode* node, Vector* statements) {
+    if (IsOperation(node, Semicolon)) {
+        CollectStatements(node->left, statements);
+        CollectStatements(node->right, statements);
+    } else {
+        vectorPush(statements, node);
+    }
+}
+
+// Все операторы одного типа: поэлементные операции над double или над целыми
+static bool MatchStatements(TVectorLoop* vector, Vector* statements, tNode* function, TTypeInfo* types,
+                            bool allowFloatReductions) {
+    for (size_t i = 0; i < statements->size; i++) {
+        tNode* statement = (tNode*)statements->data[i];
+        bool isFloat = false;
+        if (IsOperation(statement, Store)) {
+            tNode* element = statement->left;
+            if (element->left->type != Identifier || !IsCounter(vector, element->right)) {
+                return false;
+            }
+            isFloat = IsFloatVariable(types, function, element->left->value);
+        } else if (GetReductionOperand(statement)) {
+            isFloat = IsFloatVariable(types, function, statement->left->value);
+            if (isFloat && !allowFloatReductions) {
+                return false;
+            }
+            AddName(&vector->reductions, statement->left->value);
+        } else {
+            return false;
+        }
+
+        if (i && isFloat != vector->isFloat) {
+            return false;
+        }
+        vector->isFloat = isFloat;
+    }
+
+    for (size_t i = 0; i < statements->size; i++) {
+        tNode* statement = (tNode*)statements->data[i];
+        if (IsOperation(statement, Store)) {
+            tNode* base = statement->left->left;
+            if (IsCounter(vector, base) || ContainsName(&vector->reductions, base->value)
+                || !MatchExpression(vector, statement->right, function, types)) {
+                return false;
+            }
+        } else if (!strcmp(statement->left->value, vector->counter)
+                   || !MatchExpression(vector, GetReductionOperand(statement), function, types)) {
+            return false;
+        }
+    }
+
+    // сумма не должна читаться где-то еще: ее промежуточные значения в цикле не вычисляются
+    for (size_t i = 0; i < vector->reductions.size; i++) {
+        const char* name = (const char*)vector->reductions.data[i];
+        size_t references = 0;
+        for (size_t j = 0; j < statements->size; j++) {
+            references += CountReferences((tNode*)statements->data[j], name);
+        }
+        if (references != 2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool MatchExpression(TVectorLoop* vector, tNode* node, tNode* function, TTypeInfo* types) {
+    switch (node->type) {
+        case Number:
+            if (!vector->isFloat && IsFloatLiteral(node)) {
+                return false;
+            }
+            break;
+        case Identifier:
+            if (IsCounter(vector, node) || ContainsName(&vector->reductions, node->value)
+                || (!vector->isFloat && IsFloatVariable(types, function, node->value))) {
+                return false;
+            }
+            break;
+        case Operation:
+            switch (GetOperationType(node->value)) {
+                case Index: return node->left->type == Identifier && IsCounter(vector, node->right)
+                                && !IsCounter(vector, node->left)
+                                && !ContainsName(&vector->reductions, node->left->value)
+                                && IsFloatVariable(types, function, node->left->value) == vector->isFloat;
+                case Add:
+                case Sub:   return MatchExpression(vector, node->left, function, types)
+                                && MatchExpression(vector, node->right, function, types);
+                case Mul:
+                case Div:   return vector->isFloat && MatchExpression(vector, node->left, function, types)
+                                && MatchExpression(vector, node->right, function, types);
+                case Sqrt:  return vector->isFloat && MatchExpression(vector, node->left, function, types);
+                default:    return false; // умножения 64-битных целых в SSE2 и AVX2 нет
+            }
+        case Function:
+        case Calling:
+        default:
+            return false;
+    }
+
+    if (GetInvariantRegister(vector, node) < 0) {
+        vectorPush(&vector->invariants, node);
+    }
+    return true;
+}
+
+static bool IsCounter(TVectorLoop* vector, tNode* node) {
+    return node->type == Identifier && !strcmp(node->value, vector->counter);
+}
+
+// Сколько временных регистров нужно выражению: левый операнд в r, правый в r + 1
+static int GetRegisterNeed(tNode* node) {
+    if (node->type != Operation) {
+        return 0; // инвариант уже лежит в своем регистре
+    }
+    if (IsOperation(node, Index)) {
+        return 1;
+    }
+
+    int left = GetRegisterNeed(node->left);
+    if (IsOperation(node, Sqrt)) {
+        return (left > 1) ? left : 1;
+    }
+    int right = 1 + GetRegisterNeed(node->right);
+    return (left > right) ? left : right;
+}
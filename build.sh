@@ -2,5 +2,5 @@
 
 make run
 nasm -f elf64 nasm.s -o nasm.o
-gcc -no-pie nasm.o -o nasm
+ld nasm.o -o nasm
 ./nasm
\ No newline at end of file
@@ -1,22 +1,47 @@
 #include "vector.h"
 #include "tokenizer.h"
-#include "parser.h"
 #include "tree.h"
+#include "options.h"
+#include "modules.h"
+#include "optimizer.h"
+#include "typeInference.h"
 #include "nasmGen.h"
+#include "separate.h"
+#include "vm.h"
 
-int main() {
-    Vector tokens = tokenizer();
+int main(int argc, char* argv[]) {
+    Options options = parseOptions(argc, argv);
 
-    tNode* root = runParser(tokens);
+    TProgram program = {};
+    LoadProgram(&program, kNameOfFileWithCode);
 
-    dump(root);
+    if (options.outputFormat != VmOutput) {
+        dump(program.modules[0].root); // graphviz - отдельный процесс, для коротких программ в --vm он дольше всего остального
+    }
 
-    RunGenerator(root);
+    if (options.separateCompilation) {
+        RunSeparateCompilation(&program, &options);
+    } else {
+        // вся программа с модулями - одна единица: функции модулей встраиваются, ненужные не попадают в код
+        tNode* root = BuildUnit(&program, 0);
 
-    tokenVectorDtor(&tokens);
-    free(tokens.data);
+        TTypeInfo types = {};
+        InferTypes(root, &types);
 
-    treeDtor(root);
+        root = RunOptimizer(root, &options, &types);
+
+        if (options.outputFormat == VmOutput) {
+            RunVm(root, &options, &types);
+        } else {
+            RunGenerator(root, &options, &types);
+        }
+
+        TypeInfoDtor(&types);
+        treeDtor(root);
+    }
+
+    ProgramDtor(&program);
+    freeStoredStrings();
 
     return 0;
 }
@@ -0,0 +1,92 @@
+#!/bin/bash
+
+# Прогоняет tests/<name>.txt через --vm, --jit и --emit=exe и сравнивает вывод с tests/<name>.expected.
+# Каждый тест запускается с опциями по умолчанию и с --no-eval (иначе вход-независимая программа вычисляется
+# при компиляции и генератор кода не участвует). Каждая строка tests/<name>.flags - еще один набор опций
+# для всех трех режимов (например, --no-eval --no-tail-calls). Строка tests/<name>.options добавляется ко всем
+# наборам: с ней запускаются тесты, чей вывод верен только при этих опциях (например, --overflow=bignum).
+# Файлы каталога tests/<name>/ (модули, которые программа подключает через import) копируются рядом с ней.
+# --separate и --overflow=bignum реализованы только генератором машинного кода: с ними --vm не запускается.
+# С --runtime=libc исполняемый файл нужно собирать внешним компоновщиком: --emit=exe не запускается.
+# Usage: tests/run.sh [name ...]
+
+TESTS_DIR=$(cd "$(dirname "$0")" && pwd)
+RUN=$TESTS_DIR/../bin/run
+TIMEOUT=60
+
+if [ ! -x "$RUN" ]; then
+    echo "Error: $RUN not found, build it with make" >&2
+    exit 1
+fi
+
+if [ $# -eq 0 ]; then
+    set -- $(cd "$TESTS_DIR" && ls *.txt | sed 's/\.txt$//')
+fi
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+mkdir -p "$WORK_DIR/Frontend/dump"
+
+passed=0
+failed=0
+
+# run_case <mode> <flags...>: печатает вывод программы
+run_case() {
+    local mode=$1
+    shift
+    if [ "$mode" == "--emit=exe" ]; then
+        rm -f nasm
+        timeout $TIMEOUT "$RUN" --emit=exe "$@" > /dev/null 2> errors.txt && timeout $TIMEOUT ./nasm
+    else
+        timeout $TIMEOUT "$RUN" $mode "$@" 2> errors.txt
+    fi
+}
+
+for name in "$@"; do
+    if [ ! -f "$TESTS_DIR/$name.txt" ] || [ ! -f "$TESTS_DIR/$name.expected" ]; then
+        echo "Error: no test $name" >&2
+        failed=$((failed + 1))
+        continue
+    fi
+
+    base=""
+    if [ -f "$TESTS_DIR/$name.options" ]; then
+        base=$(head -1 "$TESTS_DIR/$name.options")
+    fi
+    flagSets=("$base" "$base --no-eval")
+    if [ -f "$TESTS_DIR/$name.flags" ]; then
+        while IFS= read -r line; do
+            flagSets+=("$base $line")
+        done < "$TESTS_DIR/$name.flags"
+    fi
+
+    for flags in "${flagSets[@]}"; do
+        modes="--vm --jit --emit=exe"
+        if [[ "$flags" == *--separate* || "$flags" == *--overflow=bignum* ]]; then
+            modes="--jit --emit=exe"
+        fi
+        if [[ "$flags" == *--runtime=libc* ]]; then
+            modes=${modes/ --emit=exe/}
+        fi
+
+        for mode in $modes; do
+            cp "$TESTS_DIR/$name.txt" "$WORK_DIR/code.txt"
+            if [ -d "$TESTS_DIR/$name" ]; then
+                cp "$TESTS_DIR/$name"/* "$WORK_DIR/"
+            fi
+            output=$(cd "$WORK_DIR" && run_case $mode $flags)
+            status=$?
+            if [ $status -eq 0 ] && [ "$output" == "$(cat "$TESTS_DIR/$name.expected")" ]; then
+                passed=$((passed + 1))
+            else
+                failed=$((failed + 1))
+                echo "FAIL $name $mode $flags (exit $status)"
+                diff <(echo "$output") "$TESTS_DIR/$name.expected" | head -10
+                grep -v "dot: not found" "$WORK_DIR/errors.txt" | head -5
+            fi
+        done
+    done
+done
+
+echo "passed $passed, failed $failed"
+[ $failed -eq 0 ]